@@ -0,0 +1,279 @@
+#include "pch.h"
+#include "D3D12GraphicsDevice.h"
+
+D3D12CommandAllocator::D3D12CommandAllocator(ID3D12Device* pDevice, D3D12_COMMAND_LIST_TYPE type)
+{
+    ThrowIfFailed(pDevice->CreateCommandAllocator(type, IID_PPV_ARGS(&m_allocator)));
+}
+
+D3D12CommandList::D3D12CommandList(
+    ID3D12Device* pDevice,
+    D3D12_COMMAND_LIST_TYPE type,
+    GraphicsCommandAllocator* pAllocator,
+    ID3D12PipelineState* pInitialState)
+{
+    ThrowIfFailed(pDevice->CreateCommandList(0, type, pAllocator->GetNative(), pInitialState, IID_PPV_ARGS(&m_commandList)));
+    NAME_D3D12_OBJECT(m_commandList);
+}
+
+HRESULT D3D12CommandList::Reset(GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState)
+{
+    return m_commandList->Reset(pAllocator->GetNative(), pInitialState);
+}
+
+HRESULT D3D12CommandList::Close()
+{
+    return m_commandList->Close();
+}
+
+void D3D12CommandList::SetPipelineState(ID3D12PipelineState* pPipelineState)
+{
+    m_commandList->SetPipelineState(pPipelineState);
+}
+
+void D3D12CommandList::SetGraphicsRootSignature(ID3D12RootSignature* pRootSignature)
+{
+    m_commandList->SetGraphicsRootSignature(pRootSignature);
+}
+
+void D3D12CommandList::SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+{
+    m_commandList->SetGraphicsRootConstantBufferView(rootParameterIndex, bufferLocation);
+}
+
+void D3D12CommandList::SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+{
+    m_commandList->SetGraphicsRootShaderResourceView(rootParameterIndex, bufferLocation);
+}
+
+void D3D12CommandList::SetGraphicsRoot32BitConstant(UINT rootParameterIndex, UINT srcData, UINT destOffsetIn32BitValues)
+{
+    m_commandList->SetGraphicsRoot32BitConstant(rootParameterIndex, srcData, destOffsetIn32BitValues);
+}
+
+void D3D12CommandList::RSSetViewports(UINT numViewports, const D3D12_VIEWPORT* pViewports)
+{
+    m_commandList->RSSetViewports(numViewports, pViewports);
+}
+
+void D3D12CommandList::RSSetScissorRects(UINT numRects, const D3D12_RECT* pRects)
+{
+    m_commandList->RSSetScissorRects(numRects, pRects);
+}
+
+void D3D12CommandList::OMSetRenderTargets(
+    UINT numRenderTargetDescriptors,
+    const D3D12_CPU_DESCRIPTOR_HANDLE* pRenderTargetDescriptors,
+    BOOL RTsSingleHandleToDescriptorRange,
+    const D3D12_CPU_DESCRIPTOR_HANDLE* pDepthStencilDescriptor)
+{
+    m_commandList->OMSetRenderTargets(numRenderTargetDescriptors, pRenderTargetDescriptors, RTsSingleHandleToDescriptorRange, pDepthStencilDescriptor);
+}
+
+void D3D12CommandList::ResourceBarrier(UINT numBarriers, const D3D12_RESOURCE_BARRIER* pBarriers)
+{
+    m_commandList->ResourceBarrier(numBarriers, pBarriers);
+}
+
+void D3D12CommandList::ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, const FLOAT colorRGBA[4], UINT numRects, const D3D12_RECT* pRects)
+{
+    m_commandList->ClearRenderTargetView(renderTargetView, colorRGBA, numRects, pRects);
+}
+
+void D3D12CommandList::ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView, D3D12_CLEAR_FLAGS clearFlags, FLOAT depth, UINT8 stencil, UINT numRects, const D3D12_RECT* pRects)
+{
+    m_commandList->ClearDepthStencilView(depthStencilView, clearFlags, depth, stencil, numRects, pRects);
+}
+
+void D3D12CommandList::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology)
+{
+    m_commandList->IASetPrimitiveTopology(primitiveTopology);
+}
+
+void D3D12CommandList::IASetVertexBuffers(UINT startSlot, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW* pViews)
+{
+    m_commandList->IASetVertexBuffers(startSlot, numViews, pViews);
+}
+
+void D3D12CommandList::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* pView)
+{
+    m_commandList->IASetIndexBuffer(pView);
+}
+
+void D3D12CommandList::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+{
+    m_commandList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+}
+
+void D3D12CommandList::ExecuteIndirect(
+    ID3D12CommandSignature* pCommandSignature,
+    UINT maxCommandCount,
+    GraphicsResource* pArgumentBuffer,
+    UINT64 argumentBufferOffset,
+    GraphicsResource* pCountBuffer,
+    UINT64 countBufferOffset)
+{
+    m_commandList->ExecuteIndirect(
+        pCommandSignature,
+        maxCommandCount,
+        pArgumentBuffer->Get(),
+        argumentBufferOffset,
+        pCountBuffer != nullptr ? pCountBuffer->Get() : nullptr,
+        countBufferOffset);
+}
+
+void D3D12CommandList::CopyBufferRegion(GraphicsResource* pDstBuffer, UINT64 dstOffset, GraphicsResource* pSrcBuffer, UINT64 srcOffset, UINT64 numBytes)
+{
+    m_commandList->CopyBufferRegion(pDstBuffer->Get(), dstOffset, pSrcBuffer->Get(), srcOffset, numBytes);
+}
+
+void D3D12CommandList::BeginEvent(LPCWSTR name)
+{
+    PIXBeginEvent(m_commandList.Get(), 0, name);
+}
+
+void D3D12CommandList::EndEvent()
+{
+    PIXEndEvent(m_commandList.Get());
+}
+
+D3D12GraphicsDevice::D3D12GraphicsDevice(ComPtr<ID3D12Device> device, ComPtr<ID3D12CommandQueue> commandQueue) :
+    m_device(device),
+    m_commandQueue(commandQueue),
+    m_fenceValue(0),
+    m_copyFenceValue(0)
+{
+    ThrowIfFailed(m_device->CreateFence(m_fenceValue.load(), D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+    NAME_D3D12_OBJECT(m_fence);
+
+    // Create an event handle to use for frame synchronization.
+    m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (m_fenceEvent == nullptr)
+    {
+        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+    }
+
+    // The copy queue maps to the DMA engines on most hardware and runs next to the direct queue
+    D3D12_COMMAND_QUEUE_DESC copyQueueDesc = {};
+    copyQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    copyQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+
+    ThrowIfFailed(m_device->CreateCommandQueue(&copyQueueDesc, IID_PPV_ARGS(&m_copyQueue)));
+    NAME_D3D12_OBJECT(m_copyQueue);
+
+    ThrowIfFailed(m_device->CreateFence(m_copyFenceValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_copyFence)));
+    NAME_D3D12_OBJECT(m_copyFence);
+
+    m_copyFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (m_copyFenceEvent == nullptr)
+    {
+        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+    }
+}
+
+D3D12GraphicsDevice::~D3D12GraphicsDevice()
+{
+    CloseHandle(m_fenceEvent);
+    CloseHandle(m_copyFenceEvent);
+}
+
+std::unique_ptr<GraphicsCommandAllocator> D3D12GraphicsDevice::CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE type)
+{
+    return std::make_unique<D3D12CommandAllocator>(m_device.Get(), type);
+}
+
+std::unique_ptr<GraphicsCommandList> D3D12GraphicsDevice::CreateCommandList(D3D12_COMMAND_LIST_TYPE type, GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState)
+{
+    return std::make_unique<D3D12CommandList>(m_device.Get(), type, pAllocator, pInitialState);
+}
+
+GraphicsResourcePtr D3D12GraphicsDevice::CreateBuffer(D3D12_HEAP_TYPE heapType, uint64_t byteSize, D3D12_RESOURCE_STATES initialState, D3D12_RESOURCE_FLAGS flags)
+{
+    ComPtr<ID3D12Resource> buffer;
+
+    ThrowIfFailed(m_device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(heapType),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize, flags),
+        initialState,
+        nullptr,
+        IID_PPV_ARGS(&buffer)));
+
+    return std::make_shared<GraphicsResource>(buffer, heapType, byteSize);
+}
+
+void D3D12GraphicsDevice::ExecuteCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists)
+{
+    ExecuteOnQueue(m_commandQueue.Get(), m_pendingLists, numCommandLists, ppCommandLists);
+}
+
+void D3D12GraphicsDevice::ExecuteOnQueue(ID3D12CommandQueue* pQueue, std::vector<ID3D12CommandList*>& nativeLists, UINT numCommandLists, GraphicsCommandList* const* ppCommandLists)
+{
+    nativeLists.resize(numCommandLists);
+    for (UINT i = 0; i < numCommandLists; ++i)
+    {
+        nativeLists[i] = ppCommandLists[i]->GetNative();
+    }
+
+    pQueue->ExecuteCommandLists(numCommandLists, nativeLists.data());
+}
+
+UINT64 D3D12GraphicsDevice::Signal()
+{
+    // Signal and increment the fence value.
+    const UINT64 fenceValue = ++m_fenceValue;
+    ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fenceValue));
+
+    return fenceValue;
+}
+
+UINT64 D3D12GraphicsDevice::GetCompletedFenceValue()
+{
+    return m_fence->GetCompletedValue();
+}
+
+void D3D12GraphicsDevice::WaitForFenceValue(UINT64 fenceValue)
+{
+    if (m_fence->GetCompletedValue() < fenceValue)
+    {
+        ThrowIfFailed(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent));
+        WaitForSingleObject(m_fenceEvent, INFINITE);
+    }
+}
+
+void D3D12GraphicsDevice::ExecuteCopyCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists)
+{
+    ExecuteOnQueue(m_copyQueue.Get(), m_pendingCopyLists, numCommandLists, ppCommandLists);
+}
+
+UINT64 D3D12GraphicsDevice::SignalCopy()
+{
+    ++m_copyFenceValue;
+    ThrowIfFailed(m_copyQueue->Signal(m_copyFence.Get(), m_copyFenceValue));
+
+    return m_copyFenceValue;
+}
+
+UINT64 D3D12GraphicsDevice::GetCompletedCopyFenceValue()
+{
+    return m_copyFence->GetCompletedValue();
+}
+
+void D3D12GraphicsDevice::WaitForCopyFenceValue(UINT64 fenceValue)
+{
+    if (m_copyFence->GetCompletedValue() < fenceValue)
+    {
+        ThrowIfFailed(m_copyFence->SetEventOnCompletion(fenceValue, m_copyFenceEvent));
+        WaitForSingleObject(m_copyFenceEvent, INFINITE);
+    }
+}
+
+void D3D12GraphicsDevice::BeginEvent(LPCWSTR name)
+{
+    PIXBeginEvent(m_commandQueue.Get(), 0, name);
+}
+
+void D3D12GraphicsDevice::EndEvent()
+{
+    PIXEndEvent(m_commandQueue.Get());
+}
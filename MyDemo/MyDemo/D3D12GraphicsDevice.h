@@ -0,0 +1,121 @@
+#pragma once
+
+#include "GraphicsDevice.h"
+#include <atomic>
+
+using Microsoft::WRL::ComPtr;
+
+class D3D12CommandAllocator : public GraphicsCommandAllocator
+{
+public:
+    D3D12CommandAllocator(ID3D12Device* pDevice, D3D12_COMMAND_LIST_TYPE type);
+
+    virtual HRESULT Reset() { return m_allocator->Reset(); }
+    virtual ID3D12CommandAllocator* GetNative() const { return m_allocator.Get(); }
+
+private:
+    ComPtr<ID3D12CommandAllocator> m_allocator;
+};
+
+// Forwards straight to ID3D12GraphicsCommandList
+class D3D12CommandList : public GraphicsCommandList
+{
+public:
+    D3D12CommandList(ID3D12Device* pDevice, D3D12_COMMAND_LIST_TYPE type, GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState);
+
+    virtual HRESULT Reset(GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState);
+    virtual HRESULT Close();
+
+    virtual void SetPipelineState(ID3D12PipelineState* pPipelineState);
+    virtual void SetGraphicsRootSignature(ID3D12RootSignature* pRootSignature);
+    virtual void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation);
+    virtual void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation);
+    virtual void SetGraphicsRoot32BitConstant(UINT rootParameterIndex, UINT srcData, UINT destOffsetIn32BitValues);
+
+    virtual void RSSetViewports(UINT numViewports, const D3D12_VIEWPORT* pViewports);
+    virtual void RSSetScissorRects(UINT numRects, const D3D12_RECT* pRects);
+    virtual void OMSetRenderTargets(
+        UINT numRenderTargetDescriptors,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* pRenderTargetDescriptors,
+        BOOL RTsSingleHandleToDescriptorRange,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* pDepthStencilDescriptor);
+
+    virtual void ResourceBarrier(UINT numBarriers, const D3D12_RESOURCE_BARRIER* pBarriers);
+
+    virtual void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, const FLOAT colorRGBA[4], UINT numRects, const D3D12_RECT* pRects);
+    virtual void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView, D3D12_CLEAR_FLAGS clearFlags, FLOAT depth, UINT8 stencil, UINT numRects, const D3D12_RECT* pRects);
+
+    virtual void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology);
+    virtual void IASetVertexBuffers(UINT startSlot, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW* pViews);
+    virtual void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* pView);
+
+    virtual void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation);
+    virtual void ExecuteIndirect(
+        ID3D12CommandSignature* pCommandSignature,
+        UINT maxCommandCount,
+        GraphicsResource* pArgumentBuffer,
+        UINT64 argumentBufferOffset,
+        GraphicsResource* pCountBuffer,
+        UINT64 countBufferOffset);
+
+    virtual void CopyBufferRegion(GraphicsResource* pDstBuffer, UINT64 dstOffset, GraphicsResource* pSrcBuffer, UINT64 srcOffset, UINT64 numBytes);
+
+    virtual void BeginEvent(LPCWSTR name);
+    virtual void EndEvent();
+
+    virtual ID3D12GraphicsCommandList* GetNative() const { return m_commandList.Get(); }
+
+private:
+    ComPtr<ID3D12GraphicsCommandList> m_commandList;
+};
+
+/*
+    Wraps a device and direct queue created by the sample.
+    The copy queue, the fences and their events are owned here.
+*/
+class D3D12GraphicsDevice : public GraphicsDevice
+{
+public:
+    D3D12GraphicsDevice(ComPtr<ID3D12Device> device, ComPtr<ID3D12CommandQueue> commandQueue);
+    virtual ~D3D12GraphicsDevice();
+
+    virtual GraphicsBackend GetBackend() const { return GraphicsBackend::D3D12; }
+    virtual ID3D12Device* GetNative() const { return m_device.Get(); }
+
+    virtual std::unique_ptr<GraphicsCommandAllocator> CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE type);
+    virtual std::unique_ptr<GraphicsCommandList> CreateCommandList(D3D12_COMMAND_LIST_TYPE type, GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState);
+    virtual GraphicsResourcePtr CreateBuffer(D3D12_HEAP_TYPE heapType, uint64_t byteSize, D3D12_RESOURCE_STATES initialState, D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
+
+    virtual void ExecuteCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists);
+
+    virtual UINT64 Signal();
+    virtual UINT64 GetCompletedFenceValue();
+    virtual UINT64 GetNextFenceValue() const { return m_fenceValue + 1; }
+    virtual void WaitForFenceValue(UINT64 fenceValue);
+
+    virtual void ExecuteCopyCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists);
+    virtual UINT64 SignalCopy();
+    virtual UINT64 GetCompletedCopyFenceValue();
+    virtual void WaitForCopyFenceValue(UINT64 fenceValue);
+
+    virtual void BeginEvent(LPCWSTR name);
+    virtual void EndEvent();
+
+private:
+    void ExecuteOnQueue(ID3D12CommandQueue* pQueue, std::vector<ID3D12CommandList*>& nativeLists, UINT numCommandLists, GraphicsCommandList* const* ppCommandLists);
+
+    ComPtr<ID3D12Device> m_device;
+    ComPtr<ID3D12CommandQueue> m_commandQueue;
+    ComPtr<ID3D12Fence> m_fence;
+    HANDLE m_fenceEvent;
+    std::atomic<UINT64> m_fenceValue;     // signaled by the render thread, read by the update thread with -pipelined
+
+    ComPtr<ID3D12CommandQueue> m_copyQueue;
+    ComPtr<ID3D12Fence> m_copyFence;
+    HANDLE m_copyFenceEvent;
+    UINT64 m_copyFenceValue;
+
+    // Scratch for the native lists, one per queue so the queues can be fed from different threads
+    std::vector<ID3D12CommandList*> m_pendingLists;
+    std::vector<ID3D12CommandList*> m_pendingCopyLists;
+};
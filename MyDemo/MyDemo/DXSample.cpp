@@ -7,13 +7,26 @@ DXSample::DXSample(UINT width, UINT height, std::wstring name) :
     m_width(width),
     m_height(height),
     m_title(name),
-    m_useWarpDevice(false)
+    m_useWarpDevice(false),
+    m_useNullDevice(false),
+    m_headlessFrameCount(1000),
+    m_useIndirectDraw(false),
+    m_useDepthPrepass(true),
+    m_usePipelinedFrames(false),
+    m_runTaskBenchmark(false),
+    m_landSize(50),
+    m_optimizeLand(true)
 {
     WCHAR assetsPath[512];
     GetAssetsPath(assetsPath, _countof(assetsPath));
     m_assetsPath = assetsPath;
 
     m_aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+
+#ifdef NULL_BACKEND_ONLY
+    // The only backend built
+    m_useNullDevice = true;
+#endif
 }
 
 DXSample::~DXSample()
@@ -26,6 +39,7 @@ std::wstring DXSample::GetAssetFullPath(LPCWSTR assetName)
     return m_assetsPath + assetName;
 }
 
+#ifndef NULL_BACKEND_ONLY
 // Helper function for acquiring the first available hardware adapter that supports Direct3D 12.
 // If no such adapter can be found, *ppAdapter will be set to nullptr.
 _Use_decl_annotations_
@@ -96,12 +110,18 @@ void DXSample::GetHardwareAdapter(
 
     *ppAdapter = adapter.Detach();
 }
+#endif
 
 // Helper function for setting the window's title text.
 void DXSample::SetCustomWindowText(LPCWSTR text)
 {
+#ifndef NULL_BACKEND_ONLY
     std::wstring windowText = m_title + L": " + text;
     SetWindowText(Win32Application::GetHwnd(), windowText.c_str());
+#else
+    // No window to title
+    (void)text;
+#endif
 }
 
 // Helper function for parsing any supplied command line args.
@@ -116,5 +136,61 @@ void DXSample::ParseCommandLineArgs(WCHAR* argv[], int argc)
             m_useWarpDevice = true;
             m_title = m_title + L" (WARP)";
         }
+        else if (_wcsnicmp(argv[i], L"-null", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/null", wcslen(argv[i])) == 0)
+        {
+            m_useNullDevice = true;
+            m_title = m_title + L" (NULL)";
+        }
+        else if (_wcsnicmp(argv[i], L"-indirect", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/indirect", wcslen(argv[i])) == 0)
+        {
+            m_useIndirectDraw = true;
+            m_title = m_title + L" (Indirect)";
+        }
+        else if (_wcsnicmp(argv[i], L"-noprepass", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/noprepass", wcslen(argv[i])) == 0)
+        {
+            m_useDepthPrepass = false;
+        }
+        else if (_wcsnicmp(argv[i], L"-pipelined", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/pipelined", wcslen(argv[i])) == 0)
+        {
+            m_usePipelinedFrames = true;
+            m_title = m_title + L" (Pipelined)";
+        }
+        else if (_wcsnicmp(argv[i], L"-taskbench", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/taskbench", wcslen(argv[i])) == 0)
+        {
+            m_runTaskBenchmark = true;
+        }
+        else if ((_wcsnicmp(argv[i], L"-frames", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/frames", wcslen(argv[i])) == 0) && i + 1 < argc)
+        {
+            m_headlessFrameCount = static_cast<UINT>(_wtoi(argv[++i]));
+        }
+        else if ((_wcsnicmp(argv[i], L"-model", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/model", wcslen(argv[i])) == 0) && i + 1 < argc)
+        {
+            m_modelPath = argv[++i];
+        }
+        else if ((_wcsnicmp(argv[i], L"-landsize", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/landsize", wcslen(argv[i])) == 0) && i + 1 < argc)
+        {
+            // Only a whole positive number is taken here, CreateLand rejects the sizes it can't build
+            const wchar_t* pLandSize = argv[++i];
+            wchar_t* pEnd = nullptr;
+            const unsigned long long landSize = iswdigit(pLandSize[0]) ? wcstoull(pLandSize, &pEnd, 10) : 0;
+            if (pEnd == nullptr || *pEnd != L'\0' || landSize == 0 || landSize > UINT_MAX)
+            {
+                ThrowIfFailed(E_INVALIDARG);
+            }
+            m_landSize = static_cast<UINT>(landSize);
+        }
+        else if (_wcsnicmp(argv[i], L"-fastland", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/fastland", wcslen(argv[i])) == 0)
+        {
+            m_optimizeLand = false;
+        }
     }
 }
\ No newline at end of file
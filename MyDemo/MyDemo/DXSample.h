@@ -2,7 +2,9 @@
 #pragma once
 
 #include "DXSampleHelper.h"
+#ifndef NULL_BACKEND_ONLY
 #include "Win32Application.h"
+#endif
 
 class DXSample
 {
@@ -23,16 +25,21 @@ public:
     UINT GetWidth() const           { return m_width; }
     UINT GetHeight() const          { return m_height; }
     const WCHAR* GetTitle() const   { return m_title.c_str(); }
+    bool IsHeadless() const         { return m_useNullDevice; }
+    UINT GetHeadlessFrameCount() const { return m_headlessFrameCount; }
+    bool IsTaskBenchmark() const    { return m_runTaskBenchmark; }
 
     void ParseCommandLineArgs(_In_reads_(argc) WCHAR* argv[], int argc);
 
 protected:
     std::wstring GetAssetFullPath(LPCWSTR assetName);
 
+#ifndef NULL_BACKEND_ONLY
     void GetHardwareAdapter(
         _In_ IDXGIFactory1* pFactory,
         _Outptr_result_maybenull_ IDXGIAdapter1** ppAdapter,
         bool requestHighPerformanceAdapter = false);
+#endif
 
     void SetCustomWindowText(LPCWSTR text);
 
@@ -44,6 +51,29 @@ protected:
     // Adapter info.
     bool m_useWarpDevice;
 
+    // Run on the null graphics backend without a window.
+    bool m_useNullDevice;
+    UINT m_headlessFrameCount;
+
+    // Issue the opaque renderers with ExecuteIndirect from a renderer list in GPU memory.
+    bool m_useIndirectDraw;
+
+    // Lay down opaque depth first so the color pass shades each pixel once, Z toggles it at run time.
+    bool m_useDepthPrepass;
+
+    // Update the next frame while a render thread records and submits the current one.
+    bool m_usePipelinedFrames;
+
+    // Run the ThreadPool microbenchmarks instead of the sample.
+    bool m_runTaskBenchmark;
+
+    // Vertices along each side of the land grid, and whether it goes through the optimization passes.
+    UINT m_landSize;
+    bool m_optimizeLand;
+
+    // OBJ file drawn above the land, empty for none.
+    std::wstring m_modelPath;
+
 private:
     // Root assets path.
     std::wstring m_assetsPath;
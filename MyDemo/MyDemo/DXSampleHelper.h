@@ -40,6 +40,7 @@ inline void GetAssetsPath(_Out_writes_(pathSize) WCHAR* path, UINT pathSize)
         throw std::exception();
     }
 
+#ifdef _WIN32
     DWORD size = GetModuleFileName(nullptr, path, pathSize);
     if (size == 0 || size == pathSize)
     {
@@ -48,12 +49,26 @@ inline void GetAssetsPath(_Out_writes_(pathSize) WCHAR* path, UINT pathSize)
     }
 
     WCHAR* lastSlash = wcsrchr(path, L'\\');
+#else
+    // The executable, as GetModuleFileName gives it
+    std::error_code error;
+    const std::wstring executablePath = std::filesystem::read_symlink("/proc/self/exe", error).wstring();
+    if (error || executablePath.size() >= pathSize)
+    {
+        // Method failed or path was truncated.
+        throw std::exception();
+    }
+    wcscpy(path, executablePath.c_str());
+
+    WCHAR* lastSlash = wcsrchr(path, L'/');
+#endif
     if (lastSlash)
     {
         *(lastSlash + 1) = L'\0';
     }
 }
 
+#ifdef _WIN32
 inline HRESULT ReadDataFromFile(LPCWSTR filename, byte** data, UINT* size)
 {
     using namespace Microsoft::WRL;
@@ -155,6 +170,7 @@ inline HRESULT ReadDataFromDDSFile(LPCWSTR filename, byte** data, UINT* offset,
 
     return S_OK;
 }
+#endif
 
 // Assign a name to the object to aid with debugging.
 #if defined(_DEBUG) || defined(DBG)
@@ -165,7 +181,7 @@ inline void SetName(ID3D12Object* pObject, LPCWSTR name)
 inline void SetNameIndexed(ID3D12Object* pObject, LPCWSTR name, UINT index)
 {
     WCHAR fullName[50];
-    if (swprintf_s(fullName, L"%s[%u]", name, index) > 0)
+    if (swprintf_s(fullName, L"%ls[%u]", name, index) > 0)
     {
         pObject->SetName(fullName);
     }
@@ -182,8 +198,8 @@ inline void SetNameIndexed(ID3D12Object*, LPCWSTR, UINT)
 // Naming helper for ComPtr<T>.
 // Assigns the name of the variable as the name of the object.
 // The indexed variant will include the index in the name of the object.
-#define NAME_D3D12_OBJECT(x) SetName((x).Get(), L#x)
-#define NAME_D3D12_OBJECT_INDEXED(x, n) SetNameIndexed((x)[n].Get(), L#x, n)
+#define NAME_D3D12_OBJECT(x) SetName((x).Get(), L"" #x)
+#define NAME_D3D12_OBJECT_INDEXED(x, n) SetNameIndexed((x)[n].Get(), L"" #x, n)
 
 inline UINT CalculateConstantBufferByteSize(UINT byteSize)
 {
@@ -0,0 +1,135 @@
+#include "pch.h"
+#include "DeferredReleaseQueue.h"
+
+DeferredReleaseQueue::DeferredReleaseQueue(GraphicsDevice* device) :
+    m_device(device),
+    m_pendingBytes(0),
+    m_usePendingFrames(false)
+{
+}
+
+void DeferredReleaseQueue::Release(GraphicsResourcePtr resource)
+{
+    if (resource == nullptr)
+    {
+        return;
+    }
+
+    m_pendingBytes += resource->GetSize();
+    QueueAtNextFence({ 0, std::move(resource), nullptr, 0 });
+}
+
+void DeferredReleaseQueue::Release(GraphicsResourcePtr resource, UINT64 fenceValue)
+{
+    if (resource == nullptr)
+    {
+        return;
+    }
+
+    m_pendingBytes += resource->GetSize();
+    m_pending.push_back({ fenceValue, std::move(resource), nullptr, 0 });
+}
+
+void DeferredReleaseQueue::Release(std::function<void()> callback)
+{
+    QueueAtNextFence({ 0, nullptr, std::move(callback), 0 });
+}
+
+void DeferredReleaseQueue::ReleaseAfterCopy(std::function<void()> callback, UINT64 copyFenceValue)
+{
+    QueueAtNextFence({ 0, nullptr, std::move(callback), copyFenceValue });
+}
+
+void DeferredReleaseQueue::QueueAtNextFence(Entry entry)
+{
+    if (m_usePendingFrames)
+    {
+        m_frameEntries.push_back(std::move(entry));
+        return;
+    }
+
+    entry.fenceValue = m_device->GetNextFenceValue();
+    m_pending.push_back(std::move(entry));
+}
+
+// A frame is closed even when empty, every SetPendingFence() call has its own
+void DeferredReleaseQueue::FinishPendingFrame()
+{
+    m_pendingFrames.push_back(std::move(m_frameEntries));
+    m_frameEntries.clear();
+}
+
+void DeferredReleaseQueue::SetPendingFence(UINT64 fenceValue)
+{
+    if (m_pendingFrames.empty())
+    {
+        return;
+    }
+
+    for (Entry& entry : m_pendingFrames.front())
+    {
+        entry.fenceValue = fenceValue;
+        m_pending.push_back(std::move(entry));
+    }
+    m_pendingFrames.pop_front();
+}
+
+void DeferredReleaseQueue::Release(std::function<void()> callback, UINT64 fenceValue)
+{
+    m_pending.push_back({ fenceValue, nullptr, std::move(callback), 0 });
+}
+
+void DeferredReleaseQueue::Collect()
+{
+    if (m_pending.empty())
+    {
+        return;
+    }
+
+    const UINT64 completedValue = m_device->GetCompletedFenceValue();
+    const UINT64 completedCopyValue = m_device->GetCompletedCopyFenceValue();
+
+    while (!m_pending.empty() && m_pending.front().fenceValue <= completedValue && m_pending.front().copyFenceValue <= completedCopyValue)
+    {
+        Retire(m_pending.front());
+        m_pending.pop_front();
+    }
+}
+
+void DeferredReleaseQueue::Flush()
+{
+    while (!m_pending.empty())
+    {
+        Retire(m_pending.front());
+        m_pending.pop_front();
+    }
+
+    for (std::vector<Entry>& frame : m_pendingFrames)
+    {
+        for (Entry& entry : frame)
+        {
+            Retire(entry);
+        }
+    }
+    m_pendingFrames.clear();
+
+    for (Entry& entry : m_frameEntries)
+    {
+        Retire(entry);
+    }
+    m_frameEntries.clear();
+}
+
+void DeferredReleaseQueue::Retire(Entry& entry)
+{
+    if (entry.resource != nullptr)
+    {
+        m_pendingBytes -= entry.resource->GetSize();
+        entry.resource = nullptr;
+    }
+
+    if (entry.callback)
+    {
+        entry.callback();
+    }
+}
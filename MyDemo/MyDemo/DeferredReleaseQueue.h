@@ -0,0 +1,70 @@
+#pragma once
+
+#include "GraphicsDevice.h"
+#include <deque>
+#include <functional>
+
+/*
+    Keeps resources alive until the direct queue has passed a fence value.
+    Release() with no fence value retires at GetNextFenceValue(), which covers
+    everything already submitted and everything recorded but not yet submitted.
+    Collect() once per frame frees whatever the GPU is done with.
+
+    Entries are retired in the order they were queued, so an entry with an explicit
+    fence value lower than the ones before it may be held a little longer than needed.
+
+    With pipelined frames the frame being built is signaled after the one still being submitted,
+    GetNextFenceValue() would free its entries a frame early. After UsePendingFrames() Release()
+    with no fence value holds entries back with the frame being built, FinishPendingFrame() closes it
+    once it is handed over and SetPendingFence() gives the oldest closed frame its fence, like
+    UploadRingBuffer's pending markers. Not thread safe, release from the thread that builds frames.
+*/
+class DeferredReleaseQueue
+{
+public:
+    DeferredReleaseQueue(GraphicsDevice* device);
+
+    void Release(GraphicsResourcePtr resource);
+    void Release(GraphicsResourcePtr resource, UINT64 fenceValue);
+
+    // For things that are not a resource, e.g. giving a range back to a pool
+    void Release(std::function<void()> callback);
+    void Release(std::function<void()> callback, UINT64 fenceValue);
+
+    // Like Release(callback), and not before the copy queue has passed copyFenceValue, e.g. for ranges an upload still writes to
+    void ReleaseAfterCopy(std::function<void()> callback, UINT64 copyFenceValue);
+
+    void UsePendingFrames() { m_usePendingFrames = true; }
+    void FinishPendingFrame();
+    void SetPendingFence(UINT64 fenceValue);
+
+    void Collect();
+
+    // Frees everything right away, only call when both queues are idle
+    void Flush();
+
+    size_t GetPendingCount() const { return m_pending.size(); }
+    uint64_t GetPendingBytes() const { return m_pendingBytes; }
+
+private:
+    struct Entry
+    {
+        UINT64 fenceValue;
+        GraphicsResourcePtr resource;
+        std::function<void()> callback;
+        UINT64 copyFenceValue;
+    };
+
+    // Retires at GetNextFenceValue(), or with the frame being built
+    void QueueAtNextFence(Entry entry);
+    void Retire(Entry& entry);
+
+    GraphicsDevice* m_device;
+    std::deque<Entry> m_pending;
+    uint64_t m_pendingBytes;
+
+    // Entries of the frame being built, then of frames handed over whose fence isn't known yet
+    bool m_usePendingFrames;
+    std::vector<Entry> m_frameEntries;
+    std::deque<std::vector<Entry>> m_pendingFrames;
+};
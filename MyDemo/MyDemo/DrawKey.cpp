@@ -0,0 +1,81 @@
+#include "pch.h"
+#include "DrawKey.h"
+
+uint64_t DrawKeyBuilder::BuildStateKey(const Renderer& renderer)
+{
+    return BuildStateKey(renderer, renderer.startIndex, renderer.indexCount);
+}
+
+uint64_t DrawKeyBuilder::BuildStateKey(const Renderer& renderer, uint32_t startIndex, uint32_t indexCount)
+{
+    const uint32_t pipelineId = GetId(m_pipelineIds, renderer.PSO, PipelineBits);
+    const uint32_t rootSignatureId = GetId(m_rootSignatureIds, renderer.rootSignature, RootSignatureBits);
+    const uint32_t meshId = GetId(m_meshIds, renderer.Geo, MeshBits);
+
+    // Draw ranges are numbered per mesh
+    const DrawRange range(meshId, renderer.PrimitiveType, startIndex, indexCount, renderer.baseVertex);
+
+    auto drawId = m_drawIds.find(range);
+    if (drawId == m_drawIds.end())
+    {
+        if (meshId >= m_drawCounts.size())
+        {
+            m_drawCounts.resize(meshId + 1, 0);
+        }
+
+        if (m_drawCounts[meshId] >= MaxDrawsPerMesh)
+        {
+            ThrowIfFailed(E_OUTOFMEMORY);
+        }
+
+        drawId = m_drawIds.insert(std::make_pair(range, m_drawCounts[meshId]++)).first;
+    }
+
+    uint64_t key = pipelineId;
+    key = (key << RootSignatureBits) | rootSignatureId;
+    key = (key << MeshBits) | meshId;
+    key = (key << DrawBits) | drawId->second;
+
+    return key;
+}
+
+uint64_t DrawKeyBuilder::BuildKey(RenderPass pass, uint64_t stateKey, float depth)
+{
+    const uint64_t depthMask = (1ull << DepthBits) - 1;
+    const uint64_t depthBits = static_cast<uint64_t>(MathHelper::Clamp(depth, 0.f, 1.f) * depthMask);
+    const uint64_t passBits = static_cast<uint64_t>(pass) << (64 - PassBits);
+
+    if (pass == RenderPass::Transparent)
+    {
+        // Farthest first, state only breaks ties
+        return passBits | ((depthMask - depthBits) << StateBits) | stateKey;
+    }
+
+    return passBits | (stateKey << DepthBits) | depthBits;
+}
+
+uint64_t DrawKeyBuilder::BuildDepthKey(uint64_t stateKey, float depth)
+{
+    const uint64_t depthMask = (1ull << DepthBits) - 1;
+    const uint64_t depthBits = static_cast<uint64_t>(MathHelper::Clamp(depth, 0.f, 1.f) * depthMask);
+
+    return (depthBits << StateBits) | stateKey;
+}
+
+uint32_t DrawKeyBuilder::GetId(std::unordered_map<const void*, uint32_t>& ids, const void* object, uint32_t bits)
+{
+    auto id = ids.find(object);
+    if (id != ids.end())
+    {
+        return id->second;
+    }
+
+    const uint32_t newId = static_cast<uint32_t>(ids.size());
+    if (newId >= (1u << bits))
+    {
+        ThrowIfFailed(E_OUTOFMEMORY);
+    }
+
+    ids[object] = newId;
+    return newId;
+}
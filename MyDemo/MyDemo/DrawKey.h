@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Renderer.h"
+#include <map>
+#include <tuple>
+
+/*
+    64 bit keys that put the visible renderers in submission order with one radix sort.
+
+    opaque:      pass 4 | PSO 8 | root signature 4 | mesh 12 | draw 16 | depth 20
+    transparent: pass 4 | inverted depth 20 | PSO 8 | root signature 4 | mesh 12 | draw 16
+    prepass:     zero 4 | depth 20 | PSO 8 | root signature 4 | mesh 12 | draw 16
+
+    Opaque draws are grouped by state and go front to back within a draw, transparent
+    ones go back to front. The pass is on top, so all opaque draws come first.
+    The depth prepass sorts its own list, it only cares about depth.
+    PSOs, root signatures, meshes and draw ranges get small ids the first time they are seen.
+    There are few meshes but a chunked mesh has a draw range per chunk and LOD level, so draws get the wider field.
+    Renderers with the same state key draw exactly the same thing and can be instanced.
+*/
+class DrawKeyBuilder
+{
+public:
+    static const uint32_t PassBits = 4;
+    static const uint32_t PipelineBits = 8;
+    static const uint32_t RootSignatureBits = 4;
+    static const uint32_t MeshBits = 12;
+    static const uint32_t DrawBits = 16;        // per mesh
+    static const uint32_t DepthBits = 20;
+    static const uint32_t StateBits = PipelineBits + RootSignatureBits + MeshBits + DrawBits;
+
+    // Distinct ranges one mesh can be drawn with, meshes that split themselves must stay within it
+    static const uint32_t MaxDrawsPerMesh = 1u << DrawBits;
+
+    // The state part of the key, everything but pass and depth. Compute once per renderer
+    uint64_t BuildStateKey(const Renderer& renderer);
+
+    // Same for another range of the renderer's mesh, e.g. a LOD level
+    uint64_t BuildStateKey(const Renderer& renderer, uint32_t startIndex, uint32_t indexCount);
+
+    // depth is the view space distance mapped to [0, 1]
+    static uint64_t BuildKey(RenderPass pass, uint64_t stateKey, float depth);
+
+    // For the depth prepass, a list of its own: strictly front to back, the state only breaks ties
+    static uint64_t BuildDepthKey(uint64_t stateKey, float depth);
+
+private:
+    typedef std::tuple<uint32_t, D3D12_PRIMITIVE_TOPOLOGY, uint32_t, uint32_t, uint32_t> DrawRange;
+
+    static uint32_t GetId(std::unordered_map<const void*, uint32_t>& ids, const void* object, uint32_t bits);
+
+    std::unordered_map<const void*, uint32_t> m_pipelineIds;
+    std::unordered_map<const void*, uint32_t> m_rootSignatureIds;
+    std::unordered_map<const void*, uint32_t> m_meshIds;
+    std::map<DrawRange, uint32_t> m_drawIds;
+    std::vector<uint32_t> m_drawCounts;         // per mesh id
+};
@@ -11,6 +11,7 @@ public:
     void Update(float elapsedSeconds);
     XMMATRIX GetViewMatrix();
     XMMATRIX GetProjectionMatrix(float fov, float aspectRatio, float nearPlane = 1.0f, float farPlane = 1000.0f);
+    XMFLOAT3 GetPosition() const { return m_position; }
     void SetMoveSpeed(float unitsPerSecond);
     void SetTurnSpeed(float radiansPerSecond);
 
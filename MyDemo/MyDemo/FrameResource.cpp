@@ -1,7 +1,11 @@
 #include "pch.h"
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* pDevice, uint32_t passCount, uint32_t objectCount) :
+FrameResource::FrameResource(GraphicsDevice* pDevice, uint32_t objectCount, uint32_t workerCount, uint32_t waveVertexCount) :
+    objectBufferReallocated(false),
+    passCBAddress(0),
+    depthBatchCount(0),
+    instanceBufferAddress(0),
     fenceValue(0)
 {
 
@@ -10,10 +14,18 @@ FrameResource::FrameResource(ID3D12Device* pDevice, uint32_t passCount, uint32_t
     // resource needs a command allocator because command allocators 
     // cannot be reused until the GPU is done executing the commands 
     // associated with it.
-    ThrowIfFailed(pDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&commandAllocator)));
+    commandAllocator = pDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT);
+
+    // Lists recorded in parallel each need their own allocator,
+    // an allocator can only back one list that is recording at a time
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        workerCommandAllocators.push_back(pDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT));
+    }
     
-    objectUploadCB = std::make_unique<UploadBuffer<ObjectConstantBuffer>> (pDevice, objectCount, true);
-    passUploadCB = std::make_unique<UploadBuffer<PassConstantBuffer>>(pDevice, passCount, true);
+    objectUploadBuffer = std::make_unique<UploadBuffer<ObjectConstantBuffer>>(pDevice, MathHelper::Max(objectCount, 1u));
+
+    waveVertexBuffer = std::make_unique<UploadBuffer<PackedColorVertex>>(pDevice, MathHelper::Max(waveVertexCount, 1u));
 }
 
 FrameResource::~FrameResource()
@@ -21,65 +33,189 @@ FrameResource::~FrameResource()
 
 }
 
-void FrameResource::PopulateCommandList(
-    ID3D12GraphicsCommandList* pCommandList,
-    std::vector<Renderer*>& renderers)
+void FrameResource::ReserveObjects(GraphicsDevice* pDevice, DeferredReleaseQueue* pReleaseQueue, uint32_t objectCount)
 {
-    auto currPassUploadCB = this->passUploadCB->Resource();
-    pCommandList->SetGraphicsRootConstantBufferView(1, currPassUploadCB->GetGPUVirtualAddress());
+    uint32_t capacity = objectUploadBuffer->GetElementCount();
+    if (objectCount <= capacity)
+    {
+        return;
+    }
 
-    auto objectCBSize = CalcConstantBufferByteSize(sizeof(ObjectConstantBuffer));
+    // Grow geometrically so renderers added one at a time don't reallocate every frame
+    while (capacity < objectCount)
+    {
+        capacity *= 2;
+    }
 
-    auto currObjectUploadCB = this->objectUploadCB->Resource();
+    pReleaseQueue->Release(objectUploadBuffer->ResourcePtr());
+    objectUploadBuffer = std::make_unique<UploadBuffer<ObjectConstantBuffer>>(pDevice, capacity);
+
+    // The new buffer starts out empty, every object has to be written again
+    objectBufferReallocated = true;
+}
 
-    for (size_t i = 0; i < renderers.size(); ++i)
+void FrameResource::BuildInstanceBatches(
+    UploadRingBuffer* pUploadRing,
+    const std::vector<Renderer*>& sortedRenderers,
+    MeshletCuller* pMeshletCuller,
+    const std::vector<Renderer*>& depthRenderers,
+    ID3D12PipelineState* pDepthPSO)
+{
+    instanceBatches.clear();
+    depthBatchCount = 0;
+    instanceBufferAddress = 0;
+
+    const size_t instanceCount = depthRenderers.size() + sortedRenderers.size();
+    if (instanceCount == 0)
     {
-        auto currRenderer = renderers[i];
+        return;
+    }
 
-        // if use descriptor table
-        //ID3D12DescriptorHeap* ppHeaps[] = { pCbvSrvDescriptorHeap };
-        //pCommandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+    // One buffer for both, the prepass instances come first
+    const UploadAllocation instanceBuffer = pUploadRing->Allocate(instanceCount * sizeof(uint32_t));
+    uint32_t* pInstances = reinterpret_cast<uint32_t*>(instanceBuffer.cpuAddress);
+    instanceBufferAddress = instanceBuffer.gpuAddress;
 
-        pCommandList->IASetPrimitiveTopology(currRenderer->PrimitiveType);
-        pCommandList->IASetVertexBuffers(0, 1, &currRenderer->Geo->VertexBufferView());
-        pCommandList->IASetIndexBuffer(&currRenderer->Geo->IndexBufferView()); 
+    AddInstanceBatches(depthRenderers, pInstances, 0, pMeshletCuller, true, pDepthPSO);
+    depthBatchCount = instanceBatches.size();
 
-        D3D12_GPU_VIRTUAL_ADDRESS objectUploadAddress = currObjectUploadCB->GetGPUVirtualAddress();
-        objectUploadAddress += currRenderer->objectIndex * objectCBSize;
+    AddInstanceBatches(sortedRenderers, pInstances, static_cast<uint32_t>(depthRenderers.size()), pMeshletCuller, false, nullptr);
+}
 
-        pCommandList->SetGraphicsRootConstantBufferView(0, objectUploadAddress);
+void FrameResource::AddInstanceBatches(
+    const std::vector<Renderer*>& renderers,
+    uint32_t* pInstances,
+    uint32_t firstInstance,
+    MeshletCuller* pMeshletCuller,
+    bool depthOnly,
+    ID3D12PipelineState* pDepthPSO)
+{
+    // A batch of meshlets only draws part of its renderer, nothing may be instanced onto it
+    bool previousCulledPerMeshlet = false;
+
+    for (uint32_t i = 0; i < renderers.size(); ++i)
+    {
+        const Renderer* pRenderer = renderers[i];
+        pInstances[firstInstance + i] = pRenderer->objectIndex;
+
+        InstanceBatch batch;
+        batch.pso = depthOnly ? pDepthPSO : pRenderer->PSO;
+        batch.rootSignature = pRenderer->rootSignature;
+        batch.geo = pRenderer->Geo;
+        batch.vertexBufferView = depthOnly ? pRenderer->Geo->DepthVertexBufferView() : pRenderer->Geo->VertexBufferView();
+        batch.indexBufferView = pRenderer->Geo->IndexBufferView();
+        batch.primitiveType = pRenderer->PrimitiveType;
+        batch.indexCount = pRenderer->indexCount;
+        batch.startIndex = pRenderer->startIndex;
+        batch.baseVertex = pRenderer->baseVertex;
+        batch.firstInstance = firstInstance + i;
+        batch.instanceCount = 1;
+        batch.depthOnly = depthOnly;
+
+        if (pMeshletCuller != nullptr && pMeshletCuller->Cull(*pRenderer, meshletRanges))
+        {
+            for (const MeshletRange& range : meshletRanges)
+            {
+                batch.startIndex = range.startIndex;
+                batch.indexCount = range.indexCount;
+                instanceBatches.push_back(batch);
+            }
+
+            previousCulledPerMeshlet = true;
+            continue;
+        }
+
+        // Equal state keys mean the same PSO, root signature, mesh and draw range.
+        // Only neighbours are merged, that keeps the sorted order (back to front for transparent draws)
+        const bool sameDraw = i > 0 &&
+            !previousCulledPerMeshlet &&
+            renderers[i - 1]->pass == pRenderer->pass &&
+            renderers[i - 1]->stateKey == pRenderer->stateKey;
+
+        if (sameDraw)
+        {
+            instanceBatches.back().instanceCount++;
+        }
+        else
+        {
+            instanceBatches.push_back(batch);
+        }
 
-        pCommandList->DrawIndexedInstanced(currRenderer->indexCount, 1, currRenderer->startIndex, currRenderer->baseVertex, 0);
+        previousCulledPerMeshlet = false;
     }
 }
 
-void XM_CALLCONV FrameResource::UpdateObjectConstantBuffers(std::vector<std::unique_ptr<Renderer>>& allRenderers)
+void FrameResource::PopulateCommandList(
+    GraphicsCommandList* pCommandList,
+    size_t begin,
+    size_t end)
 {
-    auto currObjectCB = this->objectUploadCB.get();
-    for (auto& e : allRenderers)
-    {   
-        // Only update the cbuffer data if the constants have changed.  
-        // This needs to be tracked per frame resource.
-        if (e->numFramesDirty > 0)
+    // Nothing is bound on a fresh list, the first batch sets everything
+    const InstanceBatch* pPrevious = nullptr;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        const InstanceBatch& batch = instanceBatches[i];
+
+        // if use descriptor table
+        //ID3D12DescriptorHeap* ppHeaps[] = { pCbvSrvDescriptorHeap };
+        //pCommandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+
+        if (pPrevious == nullptr || batch.pso != pPrevious->pso)
         {
-            XMMATRIX world = XMLoadFloat4x4(&e->world);
-            
-            ObjectConstantBuffer objConstants;
-            XMStoreFloat4x4(&objConstants.world, XMMatrixTranspose(world));
+            pCommandList->SetPipelineState(batch.pso);
+        }
 
-            currObjectCB->CopyData(e->objectIndex, objConstants);
+        // Root arguments don't survive a root signature change
+        if (pPrevious == nullptr || batch.rootSignature != pPrevious->rootSignature)
+        {
+            pCommandList->SetGraphicsRootSignature(batch.rootSignature);
+            pCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
+            pCommandList->SetGraphicsRootShaderResourceView(2, objectUploadBuffer->Resource()->GetGPUVirtualAddress());
+            pCommandList->SetGraphicsRootShaderResourceView(3, instanceBufferAddress);
+        }
 
-            e->numFramesDirty--;
+        if (pPrevious == nullptr || batch.primitiveType != pPrevious->primitiveType)
+        {
+            pCommandList->IASetPrimitiveTopology(batch.primitiveType);
         }
+
+        if (pPrevious == nullptr || batch.geo != pPrevious->geo || batch.depthOnly != pPrevious->depthOnly)
+        {
+            pCommandList->IASetVertexBuffers(0, 1, &batch.vertexBufferView);
+            pCommandList->IASetIndexBuffer(&batch.indexBufferView);
+        }
+
+        // SV_InstanceID starts at 0 for every draw, StartInstanceLocation doesn't offset it
+        pCommandList->SetGraphicsRoot32BitConstant(0, batch.firstInstance, 0);
+
+        pCommandList->DrawIndexedInstanced(batch.indexCount, batch.instanceCount, batch.startIndex, batch.baseVertex, 0);
+
+        pPrevious = &batch;
     }
 }
 
-void XM_CALLCONV FrameResource::UpdatePassConstantBuffers(XMMATRIX& view, XMMATRIX& projection)
+void FrameResource::UpdateObjectConstantBuffers(TransformStore* pTransforms, uint32_t dirtySet, ThreadPool* pThreadPool)
+{
+    static_assert(sizeof(ObjectConstantBuffer) == sizeof(XMFLOAT4X4), "the transform store writes the object constants as bare matrices");
+
+    // Only update the cbuffer data if the constants have changed.
+    // This needs to be tracked per frame resource. A freshly grown buffer needs everything.
+    if (objectBufferReallocated)
+    {
+        pTransforms->MarkAllDirty(dirtySet);
+        objectBufferReallocated = false;
+    }
+
+    pTransforms->UploadDirty(dirtySet, &objectUploadBuffer->MappedData()->world, pThreadPool);
+}
+
+void XM_CALLCONV FrameResource::UpdatePassConstantBuffers(UploadRingBuffer* pUploadRing, XMMATRIX& view, XMMATRIX& projection)
 {
     XMMATRIX viewProjection = XMMatrixMultiply(view, projection);
-    XMMATRIX inverseView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-    XMMATRIX inverseProjection = XMMatrixInverse(&XMMatrixDeterminant(projection), projection);
-    XMMATRIX inverseViewProjection = XMMatrixInverse(&XMMatrixDeterminant(viewProjection), viewProjection);
+    XMMATRIX inverseView = XMMatrixInverse(nullptr, view);
+    XMMATRIX inverseProjection = XMMatrixInverse(nullptr, projection);
+    XMMATRIX inverseViewProjection = XMMatrixInverse(nullptr, viewProjection);
 
     PassConstantBuffer passConstantBuffer;
     XMStoreFloat4x4(&passConstantBuffer.view, XMMatrixTranspose(view));
@@ -89,6 +225,5 @@ void XM_CALLCONV FrameResource::UpdatePassConstantBuffers(XMMATRIX& view, XMMATR
     XMStoreFloat4x4(&passConstantBuffer.inverseProjection, XMMatrixTranspose(inverseProjection));
     XMStoreFloat4x4(&passConstantBuffer.inverseViewProjection, XMMatrixTranspose(inverseViewProjection));
     
-    auto currentPassCB = this->passUploadCB.get();
-    currentPassCB->CopyData(0, passConstantBuffer);
+    passCBAddress = pUploadRing->AllocateConstants(passConstantBuffer).gpuAddress;
 }
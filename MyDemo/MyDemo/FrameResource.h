@@ -3,6 +3,8 @@
 #include "DXSampleHelper.h"
 #include "GPUBuffer.h"
 #include "Renderer.h"
+#include "MeshletCuller.h"
+#include "TransformStore.h"
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
@@ -22,24 +24,84 @@ struct PassConstantBuffer
     XMFLOAT4X4 inverseViewProjection = MathHelper::Identity4x4();
 };
 
-struct InstanceVertex
+// Renderers drawing the same range of the same mesh, drawn with one instanced call
+struct InstanceBatch
 {
-    XMFLOAT3 pos;
-    XMFLOAT4 color;
+    ID3D12PipelineState* pso = nullptr;
+    ID3D12RootSignature* rootSignature = nullptr;
+    Mesh* geo = nullptr;
+    D3D12_VERTEX_BUFFER_VIEW vertexBufferView = {};     // taken when the batch is built, geo may be pointed elsewhere
+    D3D12_INDEX_BUFFER_VIEW indexBufferView = {};       // before the frame is recorded
+    D3D12_PRIMITIVE_TOPOLOGY primitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    uint32_t indexCount = 0;
+    uint32_t startIndex = 0;
+    uint32_t baseVertex = 0;
+    uint32_t firstInstance = 0;     // into the instance buffer
+    uint32_t instanceCount = 0;
+    bool depthOnly = false;         // depth prepass, draws the position only stream
 };
 
 struct FrameResource
 {
-    ComPtr<ID3D12CommandAllocator> commandAllocator;
-    std::unique_ptr<UploadBuffer<ObjectConstantBuffer>> objectUploadCB;
-    std::unique_ptr<UploadBuffer<PassConstantBuffer>> passUploadCB;
+    std::unique_ptr<GraphicsCommandAllocator> commandAllocator;
+    std::vector<std::unique_ptr<GraphicsCommandAllocator>> workerCommandAllocators;   // one per parallel recorded command list
+
+    /*
+        Object constants stay here between frames so only objects dirty in this frame resource are rewritten.
+        Tightly packed (64 bytes per object), the shaders read it as a StructuredBuffer
+        indexed by a root constant instead of binding a 256 byte aligned CBV per object.
+    */
+    std::unique_ptr<UploadBuffer<ObjectConstantBuffer>> objectUploadBuffer;
+    bool objectBufferReallocated;
+
+    // The water vertices of this frame, rewritten whole every frame once the GPU is done with them
+    std::unique_ptr<UploadBuffer<PackedColorVertex>> waveVertexBuffer;
+
+    // Pass constants are allocated from the upload ring every frame
+    D3D12_GPU_VIRTUAL_ADDRESS passCBAddress;
+
+    /*
+        Rebuilt every frame by BuildInstanceBatches. The instance buffer is one object index
+        per instance, batch by batch, the shaders look the world matrix up in the object buffer.
+    */
+    std::vector<InstanceBatch> instanceBatches;
+    size_t depthBatchCount;         // depth prepass batches at the front of instanceBatches
+    D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress;
+    std::vector<MeshletRange> meshletRanges;     // scratch for BuildInstanceBatches
+
     UINT64 fenceValue;
 
-    FrameResource(ID3D12Device* pDevice, uint32_t passCount, uint32_t objectCount);
+    FrameResource(GraphicsDevice* pDevice, uint32_t objectCount, uint32_t workerCount, uint32_t waveVertexCount);
     ~FrameResource();
 
-    void PopulateCommandList(ID3D12GraphicsCommandList* pCommandList, std::vector<Renderer*>& renderers);
+    // Grows the object buffer, the old one is retired through releaseQueue
+    void ReserveObjects(GraphicsDevice* pDevice, DeferredReleaseQueue* pReleaseQueue, uint32_t objectCount);
+
+    // Groups runs of renderers with the same state key into instanceBatches and writes the instance buffer.
+    // renderers must be in draw key order. With pMeshletCuller, renderers whose mesh has meshlets
+    // get a batch per visible run of meshlets instead and are never instanced.
+    // depthRenderers, nearest first, are batched the same way in front of them and drawn with pDepthPSO
+    void BuildInstanceBatches(
+        UploadRingBuffer* pUploadRing,
+        const std::vector<Renderer*>& sortedRenderers,
+        MeshletCuller* pMeshletCuller = nullptr,
+        const std::vector<Renderer*>& depthRenderers = std::vector<Renderer*>(),
+        ID3D12PipelineState* pDepthPSO = nullptr);
+
+    // Appends the batches of renderers, their instances start at firstInstance. Depth only batches all use pDepthPSO
+    void AddInstanceBatches(
+        const std::vector<Renderer*>& renderers,
+        uint32_t* pInstances,
+        uint32_t firstInstance,
+        MeshletCuller* pMeshletCuller,
+        bool depthOnly,
+        ID3D12PipelineState* pDepthPSO);
+
+    // Records instanceBatches [begin, end), several ranges may be recorded at the same time on different lists.
+    // Only state that differs from the previous batch is set
+    void PopulateCommandList(GraphicsCommandList* pCommandList, size_t begin, size_t end);
 
-    void XM_CALLCONV UpdateObjectConstantBuffers(std::vector<std::unique_ptr<Renderer>>& allRenderers);
-    void XM_CALLCONV UpdatePassConstantBuffers(XMMATRIX& view, XMMATRIX& projection);
+    // Uploads the objects dirty in this frame resource's set of the transform store, everything after a reallocation
+    void UpdateObjectConstantBuffers(TransformStore* pTransforms, uint32_t dirtySet, ThreadPool* pThreadPool);
+    void XM_CALLCONV UpdatePassConstantBuffers(UploadRingBuffer* pUploadRing, XMMATRIX& view, XMMATRIX& projection);
 };
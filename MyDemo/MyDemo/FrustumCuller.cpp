@@ -0,0 +1,160 @@
+#include "pch.h"
+#include "FrustumCuller.h"
+#include <immintrin.h>
+#include <cfloat>
+
+namespace
+{
+    // Never passes a plane test, pads the last group of lanes
+    const float CulledRadius = -FLT_MAX;
+
+#if defined(__AVX__)
+    typedef __m256 Lanes;
+
+    inline Lanes Load(const float* p) { return _mm256_loadu_ps(p); }
+    inline Lanes Splat(float value) { return _mm256_set1_ps(value); }
+    inline Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+    inline Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+    inline Lanes And(Lanes a, Lanes b) { return _mm256_and_ps(a, b); }
+    inline Lanes GreaterEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    inline uint32_t MoveMask(Lanes a) { return static_cast<uint32_t>(_mm256_movemask_ps(a)); }
+#else
+    typedef __m128 Lanes;
+
+    inline Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+    inline Lanes Splat(float value) { return _mm_set1_ps(value); }
+    inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+    inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+    inline Lanes And(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+    inline Lanes GreaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+    inline uint32_t MoveMask(Lanes a) { return static_cast<uint32_t>(_mm_movemask_ps(a)); }
+#endif
+
+    struct Plane
+    {
+        float a, b, c, d;
+    };
+
+    /*
+        With row vectors clip = p * M, so clip.x is p dotted with column 0 and so on.
+        A point is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+    */
+    void ExtractPlanes(const XMFLOAT4X4& m, Plane planes[6])
+    {
+        const Plane x = { m._11, m._21, m._31, m._41 };
+        const Plane y = { m._12, m._22, m._32, m._42 };
+        const Plane z = { m._13, m._23, m._33, m._43 };
+        const Plane w = { m._14, m._24, m._34, m._44 };
+
+        planes[0] = { w.a + x.a, w.b + x.b, w.c + x.c, w.d + x.d };     // left
+        planes[1] = { w.a - x.a, w.b - x.b, w.c - x.c, w.d - x.d };     // right
+        planes[2] = { w.a + y.a, w.b + y.b, w.c + y.c, w.d + y.d };     // bottom
+        planes[3] = { w.a - y.a, w.b - y.b, w.c - y.c, w.d - y.d };     // top
+        planes[4] = z;                                                  // near
+        planes[5] = { w.a - z.a, w.b - z.b, w.c - z.c, w.d - z.d };     // far
+
+        // Unit normals so the plane distance can be compared with the radius
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            const float length = sqrtf(planes[i].a * planes[i].a + planes[i].b * planes[i].b + planes[i].c * planes[i].c);
+            const float invLength = length > 0.f ? 1.f / length : 0.f;
+
+            planes[i].a *= invLength;
+            planes[i].b *= invLength;
+            planes[i].c *= invLength;
+            planes[i].d *= invLength;
+        }
+    }
+}
+
+FrustumCuller::FrustumCuller() :
+    m_count(0)
+{
+}
+
+void FrustumCuller::Resize(uint32_t count)
+{
+    const size_t paddedCount = (static_cast<size_t>(count) + LaneCount - 1) / LaneCount * LaneCount;
+
+    m_centerX.resize(paddedCount, 0.f);
+    m_centerY.resize(paddedCount, 0.f);
+    m_centerZ.resize(paddedCount, 0.f);
+    m_radius.resize(paddedCount, CulledRadius);
+
+    // Shrinking leaves stale spheres in the padding
+    for (size_t i = count; i < paddedCount; ++i)
+    {
+        m_radius[i] = CulledRadius;
+    }
+
+    m_count = count;
+}
+
+void FrustumCuller::SetSphere(uint32_t index, const float localBounds[4], const XMFLOAT4X4& world)
+{
+    const float x = localBounds[0];
+    const float y = localBounds[1];
+    const float z = localBounds[2];
+
+    m_centerX[index] = x * world._11 + y * world._21 + z * world._31 + world._41;
+    m_centerY[index] = x * world._12 + y * world._22 + z * world._32 + world._42;
+    m_centerZ[index] = x * world._13 + y * world._23 + z * world._33 + world._43;
+
+    // Non-uniform scale stretches the sphere by at most the largest axis scale
+    const float scaleX = world._11 * world._11 + world._12 * world._12 + world._13 * world._13;
+    const float scaleY = world._21 * world._21 + world._22 * world._22 + world._23 * world._23;
+    const float scaleZ = world._31 * world._31 + world._32 * world._32 + world._33 * world._33;
+
+    m_radius[index] = localBounds[3] * sqrtf(MathHelper::Max(scaleX, MathHelper::Max(scaleY, scaleZ)));
+}
+
+void FrustumCuller::Cull(const XMFLOAT4X4& viewProjection, std::vector<uint32_t>& visible) const
+{
+    Plane planes[6];
+    ExtractPlanes(viewProjection, planes);
+
+    Lanes planeA[6], planeB[6], planeC[6], planeD[6];
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        planeA[i] = Splat(planes[i].a);
+        planeB[i] = Splat(planes[i].b);
+        planeC[i] = Splat(planes[i].c);
+        planeD[i] = Splat(planes[i].d);
+    }
+
+    const Lanes zero = Splat(0.f);
+
+    // Worst case everything is visible, write through a pointer and trim afterwards
+    visible.resize(m_count);
+    uint32_t* pVisible = visible.data();
+    uint32_t visibleCount = 0;
+
+    const size_t paddedCount = m_radius.size();
+    for (size_t i = 0; i < paddedCount; i += LaneCount)
+    {
+        const Lanes x = Load(&m_centerX[i]);
+        const Lanes y = Load(&m_centerY[i]);
+        const Lanes z = Load(&m_centerZ[i]);
+        const Lanes r = Load(&m_radius[i]);
+
+        // Visible unless the sphere is entirely behind one of the planes
+        Lanes inside = GreaterEqual(Add(Add(Add(Add(Mul(x, planeA[0]), Mul(y, planeB[0])), Mul(z, planeC[0])), planeD[0]), r), zero);
+        for (uint32_t p = 1; p < 6; ++p)
+        {
+            const Lanes distance = Add(Add(Add(Mul(x, planeA[p]), Mul(y, planeB[p])), Mul(z, planeC[p])), planeD[p]);
+            inside = And(inside, GreaterEqual(Add(distance, r), zero));
+        }
+
+        uint32_t mask = MoveMask(inside);
+        while (mask != 0)
+        {
+            unsigned long lane;
+            _BitScanForward(&lane, mask);
+            mask &= mask - 1;
+
+            pVisible[visibleCount++] = static_cast<uint32_t>(i + lane);
+        }
+    }
+
+    visible.resize(visibleCount);
+}
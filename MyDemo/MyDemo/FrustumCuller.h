@@ -0,0 +1,41 @@
+#pragma once
+
+using namespace DirectX;
+
+/*
+    World space bounding spheres kept as a structure of arrays, so Cull() tests
+    4 (SSE) or 8 (AVX) spheres against a frustum plane per instruction.
+    The arrays are padded to a whole number of lanes with spheres that are always culled,
+    the loop has no scalar tail.
+*/
+class FrustumCuller
+{
+public:
+#if defined(__AVX__)
+    static const uint32_t LaneCount = 8;
+#else
+    static const uint32_t LaneCount = 4;
+#endif
+
+    FrustumCuller();
+
+    // Spheres added by growing start out culled until SetSphere is called
+    void Resize(uint32_t count);
+    uint32_t GetCount() const { return m_count; }
+
+    // localBounds is a Mesh::bounds sphere (center xyz, radius), world uses the row vector convention
+    void SetSphere(uint32_t index, const float localBounds[4], const XMFLOAT4X4& world);
+
+    XMFLOAT3 GetCenter(uint32_t index) const { return XMFLOAT3(m_centerX[index], m_centerY[index], m_centerZ[index]); }
+    float GetRadius(uint32_t index) const { return m_radius[index]; }
+
+    // Replaces visible with the indices of the spheres that intersect the frustum, in increasing order
+    void Cull(const XMFLOAT4X4& viewProjection, std::vector<uint32_t>& visible) const;
+
+private:
+    uint32_t m_count;
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    std::vector<float> m_radius;
+};
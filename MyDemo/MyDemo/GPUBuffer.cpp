@@ -2,48 +2,155 @@
 #include "GPUBuffer.h"
 #include "DXSampleHelper.h"
 
-ComPtr<ID3D12Resource> CreateDefaultBuffer(
-    ID3D12Device* device,
-    ID3D12GraphicsCommandList* cmdList,
+GraphicsResourcePtr CreateDefaultBuffer(
+    GraphicsDevice* device,
+    GraphicsCommandList* cmdList,
     const void* initData,
     UINT64 byteSize,
-    ComPtr<ID3D12Resource>& uploadBuffer)
+    DeferredReleaseQueue* releaseQueue)
 {
-    ComPtr<ID3D12Resource> defaultBuffer;
-
-    ThrowIfFailed(device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
-        D3D12_RESOURCE_STATE_COMMON,
-        nullptr,
-        IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
-
-    ThrowIfFailed(device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-        D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
-
-    // Describe the data we want to copy into the default buffer.
-    D3D12_SUBRESOURCE_DATA subResourceData = {};
-    subResourceData.pData = initData;
-    subResourceData.RowPitch = byteSize;
-    subResourceData.SlicePitch = subResourceData.RowPitch;
+    GraphicsResourcePtr defaultBuffer = device->CreateBuffer(D3D12_HEAP_TYPE_DEFAULT, byteSize, D3D12_RESOURCE_STATE_COMMON);
+
+    GraphicsResourcePtr uploadBuffer = device->CreateBuffer(D3D12_HEAP_TYPE_UPLOAD, byteSize, D3D12_RESOURCE_STATE_GENERIC_READ);
 
     /* 
         copy the data to the default buffer.
-        UpdateSubresources() will copy the CPU memory into the intermediate upload heap.  
+        For a buffer UpdateSubresources() is a memcpy into the intermediate upload heap
+        followed by a CopyBufferRegion(), so do that directly.
     */
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
-        D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+    memcpy(uploadBuffer->Map(), initData, static_cast<size_t>(byteSize));
+    uploadBuffer->Unmap();
+
+    const CD3DX12_RESOURCE_BARRIER copyDestBarrier = CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer->Get(),
+        D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+    cmdList->ResourceBarrier(1, &copyDestBarrier);
+
+    cmdList->CopyBufferRegion(defaultBuffer.get(), 0, uploadBuffer.get(), 0, byteSize);
 
-    UpdateSubresources<1>(cmdList, defaultBuffer.Get(), uploadBuffer.Get(), 0, 0, 1, &subResourceData);
+    const CD3DX12_RESOURCE_BARRIER readBarrier = CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer->Get(),
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
+    cmdList->ResourceBarrier(1, &readBarrier);
 
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
-        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+    // cmdList has not been submitted yet, so this retires with the next signal
+    releaseQueue->Release(std::move(uploadBuffer));
 
     return defaultBuffer;
 }
+
+UploadRingBuffer::UploadRingBuffer(GraphicsDevice* device, uint64_t capacity) :
+    m_device(device),
+    m_mappedData(nullptr),
+    m_capacity(capacity),
+    m_head(0),
+    m_tail(0),
+    m_frameStart(0)
+{
+    m_buffer = device->CreateBuffer(D3D12_HEAP_TYPE_UPLOAD, capacity, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+    // Upload heap memory may stay mapped for the lifetime of the resource
+    m_mappedData = m_buffer->Map();
+}
+
+UploadRingBuffer::~UploadRingBuffer()
+{
+    if (m_buffer != nullptr)
+    {
+        m_buffer->Unmap();
+    }
+}
+
+UploadAllocation UploadRingBuffer::Allocate(uint64_t byteSize, uint64_t alignment)
+{
+    // alignment must be a power of two
+    if (byteSize == 0 || byteSize > m_capacity || (alignment & (alignment - 1)) != 0)
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    const uint64_t offset = m_head % m_capacity;
+    uint64_t alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+
+    // A range never wraps around the end of the buffer, skip the rest of it instead
+    if (alignedOffset + byteSize > m_capacity)
+    {
+        alignedOffset = m_capacity;
+    }
+
+    const uint64_t newHead = m_head + (alignedOffset - offset) + byteSize;
+    const uint64_t start = alignedOffset % m_capacity;
+
+    while (newHead - m_tail > m_capacity)
+    {
+        Retire(m_device->GetCompletedFenceValue());
+        if (newHead - m_tail <= m_capacity)
+        {
+            break;
+        }
+
+        // Submitted by another thread, its fence is known once that thread has signaled it
+        if (!m_frames.empty() && m_frames.front().fenceValue == PendingFenceValue && m_waitForPendingFence)
+        {
+            m_waitForPendingFence();
+            if (m_frames.empty() || m_frames.front().fenceValue != PendingFenceValue)
+            {
+                continue;
+            }
+        }
+
+        // The frame being built does not fit on its own, or a pending frame could not be waited for
+        if (m_frames.empty() || m_frames.front().fenceValue == PendingFenceValue)
+        {
+            ThrowIfFailed(E_OUTOFMEMORY);
+        }
+
+        // Out of space, block on the oldest frame in flight
+        m_device->WaitForFenceValue(m_frames.front().fenceValue);
+    }
+
+    m_head = newHead;
+
+    UploadAllocation allocation;
+    allocation.resource = m_buffer.get();
+    allocation.offset = start;
+    allocation.cpuAddress = m_mappedData + start;
+    allocation.gpuAddress = m_buffer->GetGPUVirtualAddress() + start;
+    allocation.size = byteSize;
+
+    return allocation;
+}
+
+void UploadRingBuffer::FinishFrame(UINT64 fenceValue)
+{
+    // A pending frame is kept even when empty, every SetPendingFence() call has its own marker
+    if (m_head != m_frameStart || fenceValue == PendingFenceValue)
+    {
+        m_frames.push_back({ fenceValue, m_head });
+        m_frameStart = m_head;
+    }
+
+    Retire(m_device->GetCompletedFenceValue());
+}
+
+void UploadRingBuffer::SetPendingFence(UINT64 fenceValue)
+{
+    for (FrameMarker& frame : m_frames)
+    {
+        if (frame.fenceValue == PendingFenceValue)
+        {
+            frame.fenceValue = fenceValue;
+            break;
+        }
+    }
+
+    Retire(m_device->GetCompletedFenceValue());
+}
+
+// Stops at the first pending frame, its fence is larger than any completed value
+void UploadRingBuffer::Retire(UINT64 completedFenceValue)
+{
+    while (!m_frames.empty() && m_frames.front().fenceValue <= completedFenceValue)
+    {
+        m_tail = m_frames.front().end;
+        m_frames.pop_front();
+    }
+}
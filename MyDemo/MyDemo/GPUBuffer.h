@@ -1,16 +1,38 @@
 #pragma once
 
+#include "GraphicsDevice.h"
+#include "DeferredReleaseQueue.h"
+#include <deque>
+#include <functional>
+
 using Microsoft::WRL::ComPtr;
 
 // GPUBuffer helper function 
 
+inline uint32_t CalcConstantBufferByteSize(uint32_t byteSize)
+{
+    // Constant buffers must be a multiple of the minimum hardware
+    // allocation size (usually 256 bytes).  So round up to nearest
+    // multiple of 256.  We do this by adding 255 and then masking off
+    // the lower 2 bytes which store all bits < 256.
+    // Example: Suppose byteSize = 300.
+    // (300 + 255) & ~255
+    // 555 & ~255
+    // 0x022B & ~0x00ff
+    // 0x022B & 0xff00
+    // 0x0200
+    // 512
+    return (byteSize + 255) & ~255;
+}
+
 template<typename T>
 class UploadBuffer
 {
 public:
-    UploadBuffer(ID3D12Device* device, uint32_t elementCount, bool isConstantBuffer = false) :
+    UploadBuffer(GraphicsDevice* device, uint32_t elementCount, bool isConstantBuffer = false) :
         m_mappedData(nullptr),
         m_elementByteSize(0),
+        m_elementCount(elementCount),
         m_isConstantBuffer(isConstantBuffer)
     {
         m_elementByteSize = sizeof(T);
@@ -28,31 +50,37 @@ public:
             m_elementByteSize = CalcConstantBufferByteSize(sizeof(T));
         }
 
-        ThrowIfFailed(device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(m_elementByteSize * elementCount),
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&m_uploadBuffer)
-        ));
+        m_uploadBuffer = device->CreateBuffer(
+            D3D12_HEAP_TYPE_UPLOAD,
+            static_cast<uint64_t>(m_elementByteSize) * elementCount,
+            D3D12_RESOURCE_STATE_GENERIC_READ);
 
-        ThrowIfFailed(m_uploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedData)));
+        m_mappedData = m_uploadBuffer->Map();
     }
 
     ~UploadBuffer()
     {
         if (m_uploadBuffer != nullptr)
         {
-            m_uploadBuffer->Unmap(0, nullptr);
+            m_uploadBuffer->Unmap();
         }
 
         m_mappedData = nullptr;
     }
 
-    ID3D12Resource* Resource() const
+    GraphicsResource* Resource() const
+    {
+        return m_uploadBuffer.get();
+    }
+
+    const GraphicsResourcePtr& ResourcePtr() const
+    {
+        return m_uploadBuffer;
+    }
+
+    uint32_t GetElementCount() const
     {
-        return m_uploadBuffer.Get();
+        return m_elementCount;
     }
 
     void CopyData(int elementIndex, const T& data)
@@ -60,38 +88,97 @@ public:
         memcpy(&m_mappedData[elementIndex * m_elementByteSize], &data, sizeof(T));
     }
 
+    // For writing many elements in place. Write combined memory, never read it back
+    T* MappedData() const
+    {
+        return reinterpret_cast<T*>(m_mappedData);
+    }
+
 
 private:
-    ComPtr<ID3D12Resource> m_uploadBuffer;
+    GraphicsResourcePtr m_uploadBuffer;
     BYTE* m_mappedData;
     uint32_t m_elementByteSize;
+    uint32_t m_elementCount;
     bool m_isConstantBuffer;
 };
 
-
-inline uint32_t CalcConstantBufferByteSize(uint32_t byteSize)
-{
-    // Constant buffers must be a multiple of the minimum hardware
-    // allocation size (usually 256 bytes).  So round up to nearest
-    // multiple of 256.  We do this by adding 255 and then masking off
-    // the lower 2 bytes which store all bits < 256.
-    // Example: Suppose byteSize = 300.
-    // (300 + 255) & ~255
-    // 555 & ~255
-    // 0x022B & ~0x00ff
-    // 0x022B & 0xff00
-    // 0x0200
-    // 512
-    return (byteSize + 255) & ~255;
-}
-
-ComPtr<ID3D12Resource> CreateDefaultBuffer(
-    ID3D12Device* device,
-    ID3D12GraphicsCommandList* cmdList,
+// The intermediate upload buffer is handed to releaseQueue, it goes away once cmdList has executed
+GraphicsResourcePtr CreateDefaultBuffer(
+    GraphicsDevice* device,
+    GraphicsCommandList* cmdList,
     const void* initData,
     uint64_t byteSize,
-    ComPtr<ID3D12Resource>& uploadBuffer
+    DeferredReleaseQueue* releaseQueue
 );
 
+// A range handed out by UploadRingBuffer, valid until the frame it was allocated in retires
+struct UploadAllocation
+{
+    GraphicsResource* resource = nullptr;
+    uint64_t offset = 0;                        // from the start of resource, for CopyBufferRegion
+    BYTE* cpuAddress = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS gpuAddress = 0;
+    uint64_t size = 0;
+};
+
+/*
+    One persistently mapped buffer on the upload heap used as a ring.
+    Allocate() bump-allocates aligned ranges for the frame being built,
+    FinishFrame() tags everything allocated since the last call with the fence value of that frame,
+    and the ranges are reused once the fence has completed.
+    A frame submitted by another thread can be finished with PendingFenceValue before its fence is known,
+    SetPendingFence() fills in the oldest pending one later. Nothing after a pending frame is reused.
+    If the ring is full Allocate() waits for the oldest frame in flight, when that one is still pending
+    it first calls the SetPendingFenceWait() callback, which has to block until the frame is submitted
+    and pass its fence to SetPendingFence().
+    Not thread safe, allocate from one thread or hand out sub-ranges of a bigger allocation.
+*/
+class UploadRingBuffer
+{
+public:
+    UploadRingBuffer(GraphicsDevice* device, uint64_t capacity);
+    ~UploadRingBuffer();
+
+    UploadAllocation Allocate(uint64_t byteSize, uint64_t alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+
+    template<typename T>
+    UploadAllocation AllocateConstants(const T& data)
+    {
+        UploadAllocation allocation = Allocate(CalcConstantBufferByteSize(sizeof(T)));
+        memcpy(allocation.cpuAddress, &data, sizeof(T));
+        return allocation;
+    }
+
+    static const UINT64 PendingFenceValue = UINT64_MAX;
 
+    void FinishFrame(UINT64 fenceValue);
+    void SetPendingFence(UINT64 fenceValue);
+    void SetPendingFenceWait(std::function<void()> waitForPendingFence) { m_waitForPendingFence = std::move(waitForPendingFence); }
 
+    GraphicsResource* Resource() const { return m_buffer.get(); }
+    uint64_t GetCapacity() const { return m_capacity; }
+    uint64_t GetUsedSize() const { return m_head - m_tail; }
+
+private:
+    void Retire(UINT64 completedFenceValue);
+
+    struct FrameMarker
+    {
+        UINT64 fenceValue;
+        uint64_t end;
+    };
+
+    GraphicsDevice* m_device;
+    GraphicsResourcePtr m_buffer;
+    BYTE* m_mappedData;
+    uint64_t m_capacity;
+
+    // Running byte positions, the offset into the buffer is position % capacity.
+    // [m_tail, m_frameStart) belongs to frames in flight, [m_frameStart, m_head) to the current one.
+    uint64_t m_head;
+    uint64_t m_tail;
+    uint64_t m_frameStart;
+    std::deque<FrameMarker> m_frames;
+    std::function<void()> m_waitForPendingFence;
+};
@@ -0,0 +1,84 @@
+#include "pch.h"
+#include "GeometryBufferPool.h"
+
+// Bound to references by MathHelper::Max() and make_unique()
+const uint64_t GeometryBufferPool::Alignment;
+
+GeometryBufferPool::GeometryBufferPool(GraphicsDevice* device, uint64_t blockSize) :
+    m_device(device),
+    m_blockSize(blockSize)
+{
+}
+
+GeometryAllocation GeometryBufferPool::Allocate(uint64_t byteSize)
+{
+    GeometryAllocation allocation;
+
+    for (uint32_t i = 0; i < m_blocks.size() && !allocation.IsValid(); ++i)
+    {
+        const TlsfAllocator::Allocation range = m_blocks[i].allocator->Allocate(byteSize);
+        if (range.IsValid())
+        {
+            allocation.block = i;
+            allocation.offset = range.offset;
+            allocation.size = range.size;
+            allocation.node = range.node;
+        }
+    }
+
+    if (!allocation.IsValid())
+    {
+        // Every block is full, add one
+        const uint64_t blockSize = MathHelper::Max(m_blockSize, (byteSize + Alignment - 1) & ~(Alignment - 1));
+
+        Block block;
+        block.buffer = m_device->CreateBuffer(D3D12_HEAP_TYPE_DEFAULT, blockSize, D3D12_RESOURCE_STATE_COMMON);
+        block.allocator = std::make_unique<TlsfAllocator>(blockSize, Alignment);
+
+        const TlsfAllocator::Allocation range = block.allocator->Allocate(byteSize);
+        if (!range.IsValid())
+        {
+            ThrowIfFailed(E_OUTOFMEMORY);
+        }
+
+        allocation.block = static_cast<uint32_t>(m_blocks.size());
+        allocation.offset = range.offset;
+        allocation.size = range.size;
+        allocation.node = range.node;
+
+        m_blocks.push_back(std::move(block));
+    }
+
+    allocation.buffer = m_blocks[allocation.block].buffer;
+
+    return allocation;
+}
+
+void GeometryBufferPool::Free(const GeometryAllocation& allocation)
+{
+    if (!allocation.IsValid() || allocation.block >= m_blocks.size())
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    m_blocks[allocation.block].allocator->Free(allocation.node);
+}
+
+GeometryBufferStats GeometryBufferPool::GetStats() const
+{
+    GeometryBufferStats stats;
+    stats.blockCount = static_cast<uint32_t>(m_blocks.size());
+
+    for (const Block& block : m_blocks)
+    {
+        const TlsfAllocator::Stats blockStats = block.allocator->GetStats();
+
+        stats.reservedBytes += blockStats.totalSize;
+        stats.usedBytes += blockStats.usedSize;
+        stats.allocationCount += blockStats.allocationCount;
+        stats.freeRangeCount += blockStats.freeRangeCount;
+        stats.largestFreeRange = MathHelper::Max(stats.largestFreeRange, blockStats.largestFreeRange);
+    }
+
+    return stats;
+}
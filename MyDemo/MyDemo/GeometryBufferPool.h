@@ -0,0 +1,70 @@
+#pragma once
+
+#include "GraphicsDevice.h"
+#include "TlsfAllocator.h"
+
+// A range of one of the pool's buffers
+struct GeometryAllocation
+{
+    GraphicsResourcePtr buffer;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t block = 0;
+    uint32_t node = TlsfAllocator::InvalidNode;
+
+    bool IsValid() const { return node != TlsfAllocator::InvalidNode; }
+};
+
+struct GeometryBufferStats
+{
+    uint32_t blockCount = 0;
+    uint64_t reservedBytes = 0;         // size of all blocks
+    uint64_t usedBytes = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeRangeCount = 0;
+    uint64_t largestFreeRange = 0;
+
+    // 0 when all free space is one range, towards 1 the more it is split up
+    float Fragmentation() const
+    {
+        const uint64_t freeBytes = reservedBytes - usedBytes;
+        return freeBytes == 0 ? 0.f : 1.f - static_cast<float>(largestFreeRange) / static_cast<float>(freeBytes);
+    }
+};
+
+/*
+    Vertex and index data of many meshes packed into a few large default heap buffers.
+    Each buffer ("block") is sub-allocated with a TLSF allocator, so a mesh costs a few
+    bytes of alignment instead of a committed resource with its 64KB alignment.
+    Ranges are 16 byte aligned, enough for any vertex stride and both index formats.
+
+    Blocks stay in the COMMON state. Buffers allow the copy queue to write one range
+    while the direct queue reads another, so uploads into a block that is in use are fine.
+*/
+class GeometryBufferPool
+{
+public:
+    static const uint64_t DefaultBlockSize = 64 * 1024 * 1024;
+    static const uint64_t Alignment = 16;
+
+    GeometryBufferPool(GraphicsDevice* device, uint64_t blockSize = DefaultBlockSize);
+
+    // Ranges larger than the block size get a block of their own
+    GeometryAllocation Allocate(uint64_t byteSize);
+
+    // The GPU must be done with the range, see the deferred release queue
+    void Free(const GeometryAllocation& allocation);
+
+    GeometryBufferStats GetStats() const;
+
+private:
+    struct Block
+    {
+        GraphicsResourcePtr buffer;
+        std::unique_ptr<TlsfAllocator> allocator;
+    };
+
+    GraphicsDevice* m_device;
+    uint64_t m_blockSize;
+    std::vector<Block> m_blocks;
+};
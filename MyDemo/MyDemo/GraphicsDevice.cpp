@@ -0,0 +1,61 @@
+#include "pch.h"
+#include "GraphicsDevice.h"
+
+GraphicsResource::GraphicsResource(ComPtr<ID3D12Resource> resource, D3D12_HEAP_TYPE heapType, uint64_t byteSize) :
+    m_resource(resource),
+    m_gpuVirtualAddress(resource->GetGPUVirtualAddress()),
+    m_heapType(heapType),
+    m_byteSize(byteSize),
+    m_mappedData(nullptr)
+{
+}
+
+GraphicsResource::GraphicsResource(D3D12_GPU_VIRTUAL_ADDRESS gpuVirtualAddress, D3D12_HEAP_TYPE heapType, uint64_t byteSize) :
+    m_gpuVirtualAddress(gpuVirtualAddress),
+    m_heapType(heapType),
+    m_byteSize(byteSize),
+    m_mappedData(nullptr)
+{
+    // Only CPU visible heaps need backing memory, default heap contents are never observed
+    if (heapType != D3D12_HEAP_TYPE_DEFAULT)
+    {
+        m_hostMemory = std::make_unique<BYTE[]>(static_cast<size_t>(byteSize));
+    }
+}
+
+GraphicsResource::~GraphicsResource()
+{
+    Unmap();
+}
+
+BYTE* GraphicsResource::Map()
+{
+    if (m_mappedData == nullptr)
+    {
+        if (m_resource != nullptr)
+        {
+            ThrowIfFailed(m_resource->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedData)));
+        }
+        else
+        {
+            if (m_hostMemory == nullptr)
+            {
+                // Same as D3D12, resources on the default heap cannot be mapped
+                ThrowIfFailed(E_INVALIDARG);
+            }
+            m_mappedData = m_hostMemory.get();
+        }
+    }
+
+    return m_mappedData;
+}
+
+void GraphicsResource::Unmap()
+{
+    if (m_mappedData != nullptr && m_resource != nullptr)
+    {
+        m_resource->Unmap(0, nullptr);
+    }
+
+    m_mappedData = nullptr;
+}
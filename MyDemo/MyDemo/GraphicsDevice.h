@@ -0,0 +1,188 @@
+#pragma once
+
+#include "DXSampleHelper.h"
+
+using Microsoft::WRL::ComPtr;
+
+/*
+    Thin abstraction over the subset of D3D12 the frame loop uses.
+    D3D12GraphicsDevice forwards every call to the runtime.
+    NullGraphicsDevice accepts every call, records counts and bytes and completes
+    fences on its own, so OnUpdate/OnRender can run headless without a GPU.
+
+    Pipeline state, root signatures and descriptor handles are still passed as
+    native D3D12 types, they are created once at init and are nullptr on the null backend.
+*/
+
+enum class GraphicsBackend
+{
+    D3D12,
+    Null
+};
+
+// Counters recorded by the null backend, the D3D12 backend leaves them at zero
+struct GraphicsStats
+{
+    uint64_t commandListsRecorded = 0;
+    uint64_t commandListsExecuted = 0;
+    uint64_t executeCalls = 0;
+    uint64_t drawCalls = 0;
+    uint64_t indicesDrawn = 0;
+    uint64_t instancesDrawn = 0;
+    uint64_t indirectCalls = 0;
+    uint64_t indirectCommands = 0;      // maximum command counts, the arguments are not read back
+    uint64_t pipelineStateChanges = 0;
+    uint64_t rootSignatureChanges = 0;
+    uint64_t rootArgumentChanges = 0;
+    uint64_t vertexBufferBinds = 0;
+    uint64_t indexBufferBinds = 0;
+    uint64_t topologyChanges = 0;
+    uint64_t resourceBarriers = 0;
+    uint64_t clears = 0;
+    uint64_t copyCommands = 0;
+    uint64_t bytesCopied = 0;
+    uint64_t buffersCreated = 0;
+    uint64_t bytesAllocated = 0;
+    uint64_t fenceSignals = 0;
+    uint64_t fenceWaits = 0;
+};
+
+/*
+    A GPU buffer.
+    On D3D12 it owns the native ID3D12Resource, on the null backend it owns host memory
+    (upload/readback heaps only) and a fake GPU virtual address.
+*/
+class GraphicsResource
+{
+public:
+    GraphicsResource(ComPtr<ID3D12Resource> resource, D3D12_HEAP_TYPE heapType, uint64_t byteSize);
+    GraphicsResource(D3D12_GPU_VIRTUAL_ADDRESS gpuVirtualAddress, D3D12_HEAP_TYPE heapType, uint64_t byteSize);
+    ~GraphicsResource();
+
+    ID3D12Resource* Get() const { return m_resource.Get(); }    // nullptr on the null backend
+    D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() const { return m_gpuVirtualAddress; }
+    D3D12_HEAP_TYPE GetHeapType() const { return m_heapType; }
+    uint64_t GetSize() const { return m_byteSize; }
+
+    // Maps subresource 0 once and keeps it mapped until Unmap()
+    BYTE* Map();
+    void Unmap();
+
+private:
+    ComPtr<ID3D12Resource> m_resource;
+    std::unique_ptr<BYTE[]> m_hostMemory;
+    D3D12_GPU_VIRTUAL_ADDRESS m_gpuVirtualAddress;
+    D3D12_HEAP_TYPE m_heapType;
+    uint64_t m_byteSize;
+    BYTE* m_mappedData;
+};
+
+using GraphicsResourcePtr = std::shared_ptr<GraphicsResource>;
+
+class GraphicsCommandAllocator
+{
+public:
+    virtual ~GraphicsCommandAllocator() = default;
+
+    virtual HRESULT Reset() = 0;
+    virtual ID3D12CommandAllocator* GetNative() const = 0;
+};
+
+// Mirrors the ID3D12GraphicsCommandList methods the renderer records
+class GraphicsCommandList
+{
+public:
+    virtual ~GraphicsCommandList() = default;
+
+    virtual HRESULT Reset(GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState) = 0;
+    virtual HRESULT Close() = 0;
+
+    virtual void SetPipelineState(ID3D12PipelineState* pPipelineState) = 0;
+    virtual void SetGraphicsRootSignature(ID3D12RootSignature* pRootSignature) = 0;
+    virtual void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) = 0;
+    virtual void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) = 0;
+    virtual void SetGraphicsRoot32BitConstant(UINT rootParameterIndex, UINT srcData, UINT destOffsetIn32BitValues) = 0;
+
+    virtual void RSSetViewports(UINT numViewports, const D3D12_VIEWPORT* pViewports) = 0;
+    virtual void RSSetScissorRects(UINT numRects, const D3D12_RECT* pRects) = 0;
+    virtual void OMSetRenderTargets(
+        UINT numRenderTargetDescriptors,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* pRenderTargetDescriptors,
+        BOOL RTsSingleHandleToDescriptorRange,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* pDepthStencilDescriptor) = 0;
+
+    virtual void ResourceBarrier(UINT numBarriers, const D3D12_RESOURCE_BARRIER* pBarriers) = 0;
+
+    virtual void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, const FLOAT colorRGBA[4], UINT numRects, const D3D12_RECT* pRects) = 0;
+    virtual void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView, D3D12_CLEAR_FLAGS clearFlags, FLOAT depth, UINT8 stencil, UINT numRects, const D3D12_RECT* pRects) = 0;
+
+    virtual void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology) = 0;
+    virtual void IASetVertexBuffers(UINT startSlot, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW* pViews) = 0;
+    virtual void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* pView) = 0;
+
+    virtual void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation) = 0;
+    virtual void ExecuteIndirect(
+        ID3D12CommandSignature* pCommandSignature,
+        UINT maxCommandCount,
+        GraphicsResource* pArgumentBuffer,
+        UINT64 argumentBufferOffset,
+        GraphicsResource* pCountBuffer,
+        UINT64 countBufferOffset) = 0;
+
+    virtual void CopyBufferRegion(GraphicsResource* pDstBuffer, UINT64 dstOffset, GraphicsResource* pSrcBuffer, UINT64 srcOffset, UINT64 numBytes) = 0;
+
+    // PIX markers
+    virtual void BeginEvent(LPCWSTR name) = 0;
+    virtual void EndEvent() = 0;
+
+    virtual ID3D12GraphicsCommandList* GetNative() const = 0;   // nullptr on the null backend
+};
+
+/*
+    Owns the direct queue, a copy queue and a fence for each.
+    Fence values are handed out by Signal()/SignalCopy() and increase monotonically from 1,
+    so 0 can be used to mean "never submitted".
+    The two queues count independently, a copy fence value is never compared to a direct one.
+*/
+class GraphicsDevice
+{
+public:
+    virtual ~GraphicsDevice() = default;
+
+    virtual GraphicsBackend GetBackend() const = 0;
+    virtual ID3D12Device* GetNative() const = 0;     // nullptr on the null backend
+
+    virtual std::unique_ptr<GraphicsCommandAllocator> CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE type) = 0;
+    virtual std::unique_ptr<GraphicsCommandList> CreateCommandList(D3D12_COMMAND_LIST_TYPE type, GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState) = 0;
+    virtual GraphicsResourcePtr CreateBuffer(D3D12_HEAP_TYPE heapType, uint64_t byteSize, D3D12_RESOURCE_STATES initialState, D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE) = 0;
+
+    virtual void ExecuteCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists) = 0;
+
+    virtual UINT64 Signal() = 0;
+    virtual UINT64 GetCompletedFenceValue() = 0;
+    // Value the next Signal() returns, work recorded now has finished once it completes
+    virtual UINT64 GetNextFenceValue() const = 0;
+    virtual void WaitForFenceValue(UINT64 fenceValue) = 0;
+
+    // Copy queue, for uploads that run alongside rendering
+    virtual void ExecuteCopyCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists) = 0;
+    virtual UINT64 SignalCopy() = 0;
+    virtual UINT64 GetCompletedCopyFenceValue() = 0;
+    virtual void WaitForCopyFenceValue(UINT64 fenceValue) = 0;
+
+    // PIX markers on the queue
+    virtual void BeginEvent(LPCWSTR name) = 0;
+    virtual void EndEvent() = 0;
+
+    bool IsFenceComplete(UINT64 fenceValue) { return GetCompletedFenceValue() >= fenceValue; }
+    bool IsCopyFenceComplete(UINT64 fenceValue) { return GetCompletedCopyFenceValue() >= fenceValue; }
+
+    // Block until everything submitted so far has executed
+    void Flush() { WaitForFenceValue(Signal()); }
+
+    const GraphicsStats& GetStats() const { return m_stats; }
+    void ResetStats() { m_stats = GraphicsStats(); }
+
+protected:
+    GraphicsStats m_stats;
+};
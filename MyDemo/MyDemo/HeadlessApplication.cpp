@@ -0,0 +1,27 @@
+#include "pch.h"
+#include "HeadlessApplication.h"
+
+// Drive the frame loop on the null graphics backend without creating a window.
+int HeadlessApplication::Run(DXSample* pSample)
+{
+    pSample->OnInit();
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const UINT frameCount = pSample->GetHeadlessFrameCount();
+    for (UINT i = 0; i < frameCount; ++i)
+    {
+        pSample->OnUpdate();
+        pSample->OnRender();
+    }
+
+    const double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    char report[128];
+    sprintf_s(report, "headless: %u frames in %.3f ms, %.4f ms/frame\n", frameCount, totalMs, frameCount > 0 ? totalMs / frameCount : 0.0);
+    OutputDebugStringA(report);
+    printf("%s", report);
+
+    pSample->OnDestroy();
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "DXSample.h"
+
+// Frame loop of the null graphics backend, portable: no window, no Win32 calls
+class HeadlessApplication
+{
+public:
+    /*
+        Used instead of the window loop when "-null" is passed, and by the portable build, which has no other backend.
+        No window or swap chain is created, OnUpdate()/OnRender() are called "-frames" times
+        back to back and the average CPU frame time is reported on stdout.
+    */
+    static int Run(DXSample* pSample);
+};
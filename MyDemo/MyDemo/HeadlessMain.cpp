@@ -0,0 +1,30 @@
+#include "pch.h"
+#include "MyD3D12.h"
+#include "HeadlessApplication.h"
+#include "TaskBenchmark.h"
+
+// Entry point of the portable build (CMakeLists.txt), the Windows one is WinMain in Main.cpp
+int main(int argc, char* argv[])
+{
+    // The arguments are parsed as the wide strings CommandLineToArgvW gives on Windows
+    std::vector<std::wstring> arguments;
+    std::vector<WCHAR*> argumentPointers;
+    for (int i = 0; i < argc; ++i)
+    {
+        arguments.push_back(std::filesystem::path(argv[i]).wstring());
+    }
+    for (std::wstring& argument : arguments)
+    {
+        argumentPointers.push_back(&argument[0]);
+    }
+
+    MyD3D12 sample(1280, 720, L"To romantic unfailing Elysia");
+    sample.ParseCommandLineArgs(argumentPointers.data(), argc);
+
+    if (sample.IsTaskBenchmark())
+    {
+        return RunTaskBenchmarks();
+    }
+
+    return HeadlessApplication::Run(&sample);
+}
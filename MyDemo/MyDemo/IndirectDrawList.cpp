@@ -0,0 +1,129 @@
+#include "pch.h"
+#include "IndirectDrawList.h"
+#include "RadixSort.h"
+
+static_assert(sizeof(IndirectDrawCommand) == 56, "IndirectDrawCommand must match the command signature");
+
+IndirectDrawList::IndirectDrawList() :
+    m_commandCount(0)
+{
+}
+
+ComPtr<ID3D12CommandSignature> IndirectDrawList::CreateCommandSignature(ID3D12Device* pDevice, ID3D12RootSignature* pRootSignature)
+{
+    D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[4] = {};
+    argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+    argumentDescs[0].VertexBuffer.Slot = 0;
+    argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+    argumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+    argumentDescs[2].Constant.RootParameterIndex = 0;
+    argumentDescs[2].Constant.DestOffsetIn32BitValues = 0;
+    argumentDescs[2].Constant.Num32BitValuesToSet = 1;
+    argumentDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+    D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+    commandSignatureDesc.ByteStride = sizeof(IndirectDrawCommand);
+    commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
+    commandSignatureDesc.pArgumentDescs = argumentDescs;
+
+    // The root signature is needed because the commands change a root constant
+    ComPtr<ID3D12CommandSignature> commandSignature;
+    ThrowIfFailed(pDevice->CreateCommandSignature(&commandSignatureDesc, pRootSignature, IID_PPV_ARGS(&commandSignature)));
+    NAME_D3D12_OBJECT(commandSignature);
+
+    return commandSignature;
+}
+
+void IndirectDrawList::Build(
+    GraphicsDevice* pDevice,
+    GraphicsCommandList* pCommandList,
+    DeferredReleaseQueue* pReleaseQueue,
+    const std::vector<Renderer*>& renderers)
+{
+    pReleaseQueue->Release(std::move(m_commandBuffer));
+    pReleaseQueue->Release(std::move(m_instanceBuffer));
+    m_ranges.clear();
+
+    m_commandCount = static_cast<uint32_t>(renderers.size());
+    if (m_commandCount == 0)
+    {
+        return;
+    }
+
+    // State key order puts renderers of one PSO next to each other, so a range covers many commands
+    std::vector<SortItem> order(m_commandCount);
+    std::vector<SortItem> scratch;
+    for (uint32_t i = 0; i < m_commandCount; ++i)
+    {
+        order[i].key = renderers[i]->stateKey;
+        order[i].index = i;
+    }
+    RadixSort(order, scratch);
+
+    std::vector<IndirectDrawCommand> commands(m_commandCount);
+    std::vector<uint32_t> objectIndices(m_commandCount);
+
+    for (uint32_t i = 0; i < m_commandCount; ++i)
+    {
+        const Renderer* pRenderer = renderers[order[i].index];
+
+        IndirectDrawCommand& command = commands[i];
+        command.vertexBufferView = pRenderer->Geo->VertexBufferView();
+        command.indexBufferView = pRenderer->Geo->IndexBufferView();
+        command.firstInstance = i;
+        command.drawArguments.IndexCountPerInstance = pRenderer->indexCount;
+        command.drawArguments.InstanceCount = 1;
+        command.drawArguments.StartIndexLocation = pRenderer->startIndex;
+        command.drawArguments.BaseVertexLocation = pRenderer->baseVertex;
+        command.drawArguments.StartInstanceLocation = 0;
+
+        objectIndices[i] = pRenderer->objectIndex;
+
+        const bool sameRange = !m_ranges.empty() &&
+            m_ranges.back().pso == pRenderer->PSO &&
+            m_ranges.back().rootSignature == pRenderer->rootSignature &&
+            m_ranges.back().primitiveType == pRenderer->PrimitiveType;
+
+        if (!sameRange)
+        {
+            Range range;
+            range.pso = pRenderer->PSO;
+            range.rootSignature = pRenderer->rootSignature;
+            range.primitiveType = pRenderer->PrimitiveType;
+            range.firstCommand = i;
+            range.commandCount = 0;
+            m_ranges.push_back(range);
+        }
+
+        m_ranges.back().commandCount++;
+    }
+
+    // GENERIC_READ at the end covers INDIRECT_ARGUMENT and NON_PIXEL_SHADER_RESOURCE
+    m_commandBuffer = CreateDefaultBuffer(pDevice, pCommandList, commands.data(), commands.size() * sizeof(IndirectDrawCommand), pReleaseQueue);
+    m_instanceBuffer = CreateDefaultBuffer(pDevice, pCommandList, objectIndices.data(), objectIndices.size() * sizeof(uint32_t), pReleaseQueue);
+}
+
+void IndirectDrawList::Record(
+    GraphicsCommandList* pCommandList,
+    ID3D12CommandSignature* pCommandSignature,
+    D3D12_GPU_VIRTUAL_ADDRESS passCBAddress,
+    D3D12_GPU_VIRTUAL_ADDRESS objectBufferAddress) const
+{
+    for (const Range& range : m_ranges)
+    {
+        pCommandList->SetPipelineState(range.pso);
+        pCommandList->SetGraphicsRootSignature(range.rootSignature);
+        pCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
+        pCommandList->SetGraphicsRootShaderResourceView(2, objectBufferAddress);
+        pCommandList->SetGraphicsRootShaderResourceView(3, m_instanceBuffer->GetGPUVirtualAddress());
+        pCommandList->IASetPrimitiveTopology(range.primitiveType);
+
+        pCommandList->ExecuteIndirect(
+            pCommandSignature,
+            range.commandCount,
+            m_commandBuffer.get(),
+            static_cast<UINT64>(range.firstCommand) * sizeof(IndirectDrawCommand),
+            nullptr,
+            0);
+    }
+}
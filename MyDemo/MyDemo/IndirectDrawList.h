@@ -0,0 +1,68 @@
+#pragma once
+
+#include "GPUBuffer.h"
+#include "Renderer.h"
+
+using Microsoft::WRL::ComPtr;
+
+/*
+    Arguments of one indirect draw, the layout the command signature describes.
+    Ordered so no member needs padding: the views are 16 bytes each, 56 bytes in total.
+*/
+struct IndirectDrawCommand
+{
+    D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
+    D3D12_INDEX_BUFFER_VIEW indexBufferView;
+    UINT firstInstance;                             // root constant 0, the command's entry in the instance buffer
+    D3D12_DRAW_INDEXED_ARGUMENTS drawArguments;
+};
+
+/*
+    The renderer list in default heap buffers: one IndirectDrawCommand per renderer and
+    the object index of each command, read by the shaders as the instance buffer.
+    The buffers are rebuilt only when the renderer list changes, drawing the whole list
+    is one ExecuteIndirect per PSO, so the per frame CPU cost doesn't grow with the renderer count.
+    A compute shader can later cull by compacting the commands and passing a count buffer.
+*/
+class IndirectDrawList
+{
+public:
+    IndirectDrawList();
+
+    static ComPtr<ID3D12CommandSignature> CreateCommandSignature(ID3D12Device* pDevice, ID3D12RootSignature* pRootSignature);
+
+    /*
+        Records the upload of the new buffers into pCommandList, they can be drawn from
+        by lists executed after it. The previous buffers are retired through pReleaseQueue.
+    */
+    void Build(
+        GraphicsDevice* pDevice,
+        GraphicsCommandList* pCommandList,
+        DeferredReleaseQueue* pReleaseQueue,
+        const std::vector<Renderer*>& renderers);
+
+    // Leaves the PSO, root signature and topology of the last range bound
+    void Record(
+        GraphicsCommandList* pCommandList,
+        ID3D12CommandSignature* pCommandSignature,
+        D3D12_GPU_VIRTUAL_ADDRESS passCBAddress,
+        D3D12_GPU_VIRTUAL_ADDRESS objectBufferAddress) const;
+
+    uint32_t GetCommandCount() const { return m_commandCount; }
+
+private:
+    // Consecutive commands that share everything not in the command arguments
+    struct Range
+    {
+        ID3D12PipelineState* pso;
+        ID3D12RootSignature* rootSignature;
+        D3D12_PRIMITIVE_TOPOLOGY primitiveType;
+        uint32_t firstCommand;
+        uint32_t commandCount;
+    };
+
+    GraphicsResourcePtr m_commandBuffer;
+    GraphicsResourcePtr m_instanceBuffer;
+    std::vector<Range> m_ranges;
+    uint32_t m_commandCount;
+};
@@ -0,0 +1,53 @@
+#include "pch.h"
+#include "LodSelector.h"
+
+LodSelector::LodSelector() :
+    m_cameraPosition(0.f, 0.f, 0.f),
+    m_pixelsPerUnit(1.f),
+    m_pixelThreshold(1.f)
+{
+}
+
+void LodSelector::SetView(const XMFLOAT3& cameraPosition, float fieldOfView, float viewportHeight, float pixelThreshold)
+{
+    m_cameraPosition = cameraPosition;
+    m_pixelsPerUnit = 0.5f * viewportHeight / tanf(0.5f * fieldOfView);
+    m_pixelThreshold = pixelThreshold;
+}
+
+uint32_t LodSelector::Select(const Renderer& renderer, const XMFLOAT3& center, float radius) const
+{
+    if (renderer.lods.size() < 2)
+    {
+        return 0;
+    }
+
+    const float dx = center.x - m_cameraPosition.x;
+    const float dy = center.y - m_cameraPosition.y;
+    const float dz = center.z - m_cameraPosition.z;
+    const float distance = sqrtf(dx * dx + dy * dy + dz * dz) - radius;
+
+    // Inside the sphere anything may be right in front of the camera
+    if (distance <= 0.f)
+    {
+        return 0;
+    }
+
+    // The errors are in mesh units, the world matrix scales them by at most its largest axis scale
+    const XMFLOAT4X4& world = renderer.world;
+    const float scaleX = world._11 * world._11 + world._12 * world._12 + world._13 * world._13;
+    const float scaleY = world._21 * world._21 + world._22 * world._22 + world._23 * world._23;
+    const float scaleZ = world._31 * world._31 + world._32 * world._32 + world._33 * world._33;
+    const float scale = sqrtf(MathHelper::Max(scaleX, MathHelper::Max(scaleY, scaleZ)));
+
+    // Largest error in mesh units that still projects to at most the threshold
+    const float maxError = m_pixelThreshold * distance / (m_pixelsPerUnit * scale);
+
+    uint32_t level = static_cast<uint32_t>(renderer.lods.size()) - 1;
+    while (level > 0 && renderer.lods[level].error > maxError)
+    {
+        --level;
+    }
+
+    return level;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Renderer.h"
+
+/*
+    Picks the coarsest level of detail whose error, projected to the screen at the
+    distance of the renderer's bounding sphere, stays within a pixel threshold.
+    The nearest point of the sphere is used, so a level never shows more error than allowed.
+*/
+class LodSelector
+{
+public:
+    LodSelector();
+
+    // fieldOfView is vertical, in radians, viewportHeight in pixels
+    void SetView(const XMFLOAT3& cameraPosition, float fieldOfView, float viewportHeight, float pixelThreshold = 1.f);
+
+    // center and radius are the renderer's world space bounding sphere
+    uint32_t Select(const Renderer& renderer, const XMFLOAT3& center, float radius) const;
+
+private:
+    XMFLOAT3 m_cameraPosition;
+    float m_pixelsPerUnit;      // at a distance of 1
+    float m_pixelThreshold;
+};
@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "MappedFile.h"
+#include "DXSampleHelper.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::wstring& path) :
+    m_file(INVALID_HANDLE_VALUE),
+    m_mapping(nullptr),
+    m_pData(nullptr),
+    m_size(0)
+{
+    m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    HRESULT hr = m_file != INVALID_HANDLE_VALUE ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+
+    LARGE_INTEGER size = {};
+    if (SUCCEEDED(hr) && !GetFileSizeEx(m_file, &size))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // A mapping can't be empty
+    if (SUCCEEDED(hr) && size.QuadPart > 0)
+    {
+        m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping != nullptr)
+        {
+            m_pData = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+
+        if (m_pData != nullptr)
+        {
+            m_size = static_cast<size_t>(size.QuadPart);
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+        ThrowIfFailed(hr);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+void MappedFile::Close()
+{
+    if (m_pData != nullptr)
+    {
+        UnmapViewOfFile(m_pData);
+        m_pData = nullptr;
+    }
+
+    if (m_mapping != nullptr)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+}
+#else
+MappedFile::MappedFile(const std::wstring& path) :
+    m_file(-1),
+    m_pData(nullptr),
+    m_size(0)
+{
+    m_file = open(std::filesystem::path(path).c_str(), O_RDONLY | O_CLOEXEC);
+    HRESULT hr = m_file != -1 ? S_OK : E_FAIL;
+
+    struct stat status = {};
+    if (SUCCEEDED(hr) && fstat(m_file, &status) != 0)
+    {
+        hr = E_FAIL;
+    }
+
+    // A mapping can't be empty
+    if (SUCCEEDED(hr) && status.st_size > 0)
+    {
+        void* pData = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+        if (pData != MAP_FAILED)
+        {
+            m_pData = static_cast<const char*>(pData);
+            m_size = static_cast<size_t>(status.st_size);
+
+            // Read front to back, as FILE_FLAG_SEQUENTIAL_SCAN asks for on Windows
+            madvise(pData, m_size, MADV_SEQUENTIAL);
+        }
+        else
+        {
+            hr = E_FAIL;
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+        ThrowIfFailed(hr);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+void MappedFile::Close()
+{
+    if (m_pData != nullptr)
+    {
+        munmap(const_cast<char*>(m_pData), m_size);
+        m_pData = nullptr;
+    }
+
+    if (m_file != -1)
+    {
+        close(m_file);
+        m_file = -1;
+    }
+}
+#endif
+
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+// Read only view of a whole file, an empty file has no data
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::wstring& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* GetData() const { return m_pData; }
+    size_t GetSize() const { return m_size; }
+
+private:
+    void Close();
+
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_file;
+#endif
+    const char* m_pData;
+    size_t m_size;
+};
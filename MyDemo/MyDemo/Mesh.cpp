@@ -1,139 +1,662 @@
 #include "pch.h"
 #include "Mesh.h"
-#include "FrameResource.h"
+#include "DrawKey.h"
+#include <immintrin.h>
+#include <cfloat>
 
-ProceduralGeometry::MeshData ProceduralGeometry::CreateGrid(float width, float depth, uint32_t m, uint32_t n)
+void Mesh::ComputeBounds(const void* vertexData, uint32_t vertexCount, uint32_t vertexStride)
 {
-	MeshData meshData;
+	if (vertexCount == 0)
+	{
+		bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0.f;
+		return;
+	}
+
+	const BYTE* pVertex = static_cast<const BYTE*>(vertexData);
+
+	// Center of the bounding box, then the farthest vertex from it
+	XMFLOAT3 minimum = *reinterpret_cast<const XMFLOAT3*>(pVertex);
+	XMFLOAT3 maximum = minimum;
+	for (uint32_t i = 1; i < vertexCount; ++i)
+	{
+		const XMFLOAT3& p = *reinterpret_cast<const XMFLOAT3*>(pVertex + static_cast<size_t>(i) * vertexStride);
+
+		minimum.x = MathHelper::Min(minimum.x, p.x);
+		minimum.y = MathHelper::Min(minimum.y, p.y);
+		minimum.z = MathHelper::Min(minimum.z, p.z);
+		maximum.x = MathHelper::Max(maximum.x, p.x);
+		maximum.y = MathHelper::Max(maximum.y, p.y);
+		maximum.z = MathHelper::Max(maximum.z, p.z);
+	}
+
+	bounds[0] = 0.5f * (minimum.x + maximum.x);
+	bounds[1] = 0.5f * (minimum.y + maximum.y);
+	bounds[2] = 0.5f * (minimum.z + maximum.z);
+
+	float radiusSq = 0.f;
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const XMFLOAT3& p = *reinterpret_cast<const XMFLOAT3*>(pVertex + static_cast<size_t>(i) * vertexStride);
+
+		const float dx = p.x - bounds[0];
+		const float dy = p.y - bounds[1];
+		const float dz = p.z - bounds[2];
+		radiusSq = MathHelper::Max(radiusSq, dx * dx + dy * dy + dz * dz);
+	}
+
+	bounds[3] = sqrtf(radiusSq);
+}
+
+void Mesh::CopyDepthVertices(const void* vertexData, uint32_t vertexStride, uint32_t vertexCount, void* depthData)
+{
+	const uint8_t* pVertex = static_cast<const uint8_t*>(vertexData);
+	uint8_t* pDepth = static_cast<uint8_t*>(depthData);
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		memcpy(pDepth, pVertex, DepthVertexStride);
+		pVertex += vertexStride;
+		pDepth += DepthVertexStride;
+	}
+}
+
+uint64_t Mesh::GetVertexRangeSize(uint64_t vbSize, uint32_t vbStride)
+{
+	const uint64_t depthStart = (vbSize + GeometryBufferPool::Alignment - 1) & ~(GeometryBufferPool::Alignment - 1);
+	return depthStart + (vbStride > 0 ? vbSize / vbStride * DepthVertexStride : 0);
+}
+
+void Mesh::UploadGeometry(GeometryBufferPool* pool, UploadBatcher* uploader, const void* vertexData, const void* indexData)
+{
+	void* pVertexStaging = nullptr;
+	void* pDepthStaging = nullptr;
+	void* pIndexStaging = nullptr;
+	ReserveGeometry(pool, uploader, &pVertexStaging, &pDepthStaging, &pIndexStaging);
+
+	// Nothing is reserved for an empty buffer
+	if (pVertexStaging != nullptr)
+	{
+		memcpy(pVertexStaging, vertexData, vbSize);
+		CopyDepthVertices(vertexData, vbStride, vbSize / vbStride, pDepthStaging);
+	}
+	if (pIndexStaging != nullptr)
+	{
+		memcpy(pIndexStaging, indexData, ibSize);
+	}
+}
+
+void Mesh::ReserveGeometry(GeometryBufferPool* pool, UploadBatcher* uploader, void** ppVertexData, void** ppDepthData, void** ppIndexData)
+{
+	// The position only stream starts on the next pool alignment after the vertices, both must stay within 32 bit sizes
+	const uint64_t vertexRangeSize = GetVertexRangeSize(vbSize, vbStride);
+	if (vertexRangeSize > UINT32_MAX)
+	{
+		ThrowIfFailed(E_INVALIDARG);
+	}
+	const uint32_t depthStart = static_cast<uint32_t>((vbSize + GeometryBufferPool::Alignment - 1) & ~(GeometryBufferPool::Alignment - 1));
+	vbDepthSize = static_cast<uint32_t>(vertexRangeSize) - depthStart;
+
+	vertexAllocation = pool->Allocate(vertexRangeSize);
+	indexAllocation = pool->Allocate(ibSize);
+
+	// Offsets within a block always fit, blocks are far below 4GB
+	vertexBufferGPU = vertexAllocation.buffer;
+	vbOffset = static_cast<uint32_t>(vertexAllocation.offset);
+	vbDepthOffset = vbOffset + depthStart;
+
+	indexBufferGPU = indexAllocation.buffer;
+	ibOffset = static_cast<uint32_t>(indexAllocation.offset);
+
+	// Both vertex streams go up with one copy
+	uint8_t* pVertexData = static_cast<uint8_t*>(uploader->Reserve(vertexBufferGPU.get(), vbOffset, depthStart + vbDepthSize));
+	*ppVertexData = pVertexData;
+	*ppDepthData = pVertexData != nullptr ? pVertexData + depthStart : nullptr;
+	*ppIndexData = uploader->Reserve(indexBufferGPU.get(), ibOffset, ibSize);
+}
+
+void Mesh::UploadIndices(GeometryBufferPool* pool, UploadBatcher* uploader, const void* indexData)
+{
+	indexAllocation = pool->Allocate(ibSize);
+
+	indexBufferGPU = indexAllocation.buffer;
+	ibOffset = static_cast<uint32_t>(indexAllocation.offset);
+
+	uploader->Upload(indexBufferGPU.get(), ibOffset, indexData, ibSize);
+}
+
+void Mesh::Release(GeometryBufferPool* pool, DeferredReleaseQueue* releaseQueue)
+{
+	GeometryAllocation vertexRange = vertexAllocation;
+	GeometryAllocation indexRange = indexAllocation;
 
-	uint32_t vertexCount = m * n;
-	uint32_t faceCount = (m - 1) * (n - 1) * 2;
+	// The copy queue may still be writing the ranges of a mesh whose upload hasn't completed
+	releaseQueue->ReleaseAfterCopy([pool, vertexRange, indexRange]()
+	{
+		if (vertexRange.IsValid())
+		{
+			pool->Free(vertexRange);
+		}
+		if (indexRange.IsValid())
+		{
+			pool->Free(indexRange);
+		}
+	}, uploadToken);
 
-	//
-	// Create the vertices.
-	//
+	vertexAllocation = GeometryAllocation();
+	indexAllocation = GeometryAllocation();
+	vertexBufferGPU = nullptr;
+	indexBufferGPU = nullptr;
+}
 
-	float halfWidth = 0.5f * width;
-	float halfDepth = 0.5f * depth;
+namespace
+{
+	// Enough rows per task that the hand-off is cheap next to the work
+	const uint32_t RowsPerTask = 32;
 
-	float dx = width / (n - 1);
-	float dz = depth / (m - 1);
+	// Levels below the full detail per draw, see BuildLodChain
+	const uint32_t MaxLodLevels = 4;
 
-	float du = 1.0f / (n - 1);
-	float dv = 1.0f / (m - 1);
+	// Full precision land vertex, the grid is generated and optimized in it, then packed into PackedColorVertex
+	struct UnpackedLandVertex
+	{
+		XMFLOAT3 pos;
+		XMFLOAT4 color;
+	};
 
-	meshData.vertices.resize(vertexCount);
-	for (uint32_t i = 0; i < m; ++i)
+	// At least one quad, and every index must fit in uint32_t
+	void ValidateGridSize(uint32_t m, uint32_t n)
 	{
-		float z = halfDepth - i * dz;
-		for (uint32_t j = 0; j < n; ++j)
+		if (m < 2 || n < 2 || static_cast<uint64_t>(m - 1) * (n - 1) * 6 > UINT32_MAX)
 		{
-			float x = -halfWidth + j * dx;
+			ThrowIfFailed(E_INVALIDARG);
+		}
+	}
 
-			meshData.vertices[i * n + j].position = XMFLOAT3(x, 0.0f, z);
-			meshData.vertices[i * n + j].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.vertices[i * n + j].tangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+	// A chunk of k quad rows uses k + 1 vertex rows, with 16 bit indices a chunk holds at most 65536 vertices
+	uint32_t GetQuadRowsPerChunk(uint32_t m, uint32_t n, DXGI_FORMAT indexFormat)
+	{
+		if (indexFormat != DXGI_FORMAT_R16_UINT)
+		{
+			return m - 1;
+		}
 
-			// Stretch texture over grid.
-			meshData.vertices[i * n + j].texC.x = j * du;
-			meshData.vertices[i * n + j].texC.y = i * dv;
+		const uint32_t vertexRowsPerChunk = 0x10000 / n;
+		if (vertexRowsPerChunk < 2)
+		{
+			ThrowIfFailed(E_INVALIDARG);
 		}
+
+		return MathHelper::Min(m - 1, vertexRowsPerChunk - 1);
 	}
 
-	//
-	// Create the indices.
-	//
+	/*
+		Reorders the triangles of one chunk of a grid for the vertex cache and overdraw, then cuts it into meshlets
+		and builds its LOD chain. Chunks share their edge rows, so the vertices keep their row major order,
+		which is already the order the optimized triangles fetch them in, give or take a row.
+		The borders of every level match the full chunk, neighbouring chunks can use different levels.
+	*/
+	template<typename Index>
+	void OptimizeGridChunk(
+		Index* pIndices, const UnpackedLandVertex* pVertices, uint32_t n, const Mesh::Draw::Chunk& chunk,
+		VertexCacheStats& before, VertexCacheStats& after, std::vector<Meshlet>& meshlets, std::vector<LodLevel>& lods)
+	{
+		const uint32_t vertexCount = (chunk.indexCount / ((n - 1) * 6) + 1) * n;
+		Index* pChunkIndices = pIndices + chunk.startIndex;
+
+		std::vector<uint32_t> indices(pChunkIndices, pChunkIndices + chunk.indexCount);
+
+		before = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+		std::vector<uint32_t> clusters;
+		OptimizeVertexCache(indices.data(), indices.size(), vertexCount, DefaultVertexCacheSize, &clusters);
+		OptimizeOverdraw(indices.data(), indices.size(), &pVertices[chunk.baseVertex].pos, sizeof(UnpackedLandVertex), vertexCount, clusters);
+
+		after = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+		BuildMeshlets(indices.data(), indices.size(), chunk.startIndex, &pVertices[chunk.baseVertex].pos, sizeof(UnpackedLandVertex), vertexCount, meshlets);
+
+		// A bound that misses a vertex culls triangles that are on screen. Tests/MeshletTests.cpp covers it
+		assert(VerifyMeshlets(indices.data(), indices.size(), chunk.startIndex, &pVertices[chunk.baseVertex].pos, sizeof(UnpackedLandVertex), vertexCount, meshlets.data(), meshlets.size()));
+
+		BuildLodChain(indices.data(), indices.size(), &pVertices[chunk.baseVertex].pos, sizeof(UnpackedLandVertex), vertexCount, MaxLodLevels, lods);
+		for (LodLevel& lod : lods)
+		{
+			OptimizeVertexCache(lod.indices.data(), lod.indices.size(), vertexCount);
+		}
 
-	meshData.indices32.resize(faceCount * 3); // 3 indices per face
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			pChunkIndices[i] = static_cast<Index>(indices[i]);
+		}
+	}
 
-	// Iterate over each quad and compute indices.
-	uint32_t k = 0;
-	for (uint32_t i = 0; i < m - 1; ++i)
+	/*
+		Two triangles per quad of an m x n vertex grid, for quad rows [firstRow, endRow).
+		The grid is drawn in chunks of quadRowsPerChunk rows, indices are relative to the first vertex of their chunk.
+	*/
+	template<typename Index>
+	void FillGridIndices(Index* pIndices, uint32_t n, uint32_t firstRow, uint32_t endRow, uint32_t quadRowsPerChunk)
 	{
-		for (uint32_t j = 0; j < n - 1; ++j)
+		Index* pQuad = pIndices + static_cast<size_t>(firstRow) * (n - 1) * 6;
+		for (uint32_t i = firstRow; i < endRow; ++i)
 		{
-			meshData.indices32[k] = i * n + j;
-			meshData.indices32[k + 1] = i * n + j + 1;
-			meshData.indices32[k + 2] = (i + 1) * n + j;
+			const uint32_t row = i % quadRowsPerChunk;
+			for (uint32_t j = 0; j < n - 1; ++j)
+			{
+				pQuad[0] = static_cast<Index>(row * n + j);
+				pQuad[1] = static_cast<Index>(row * n + j + 1);
+				pQuad[2] = static_cast<Index>((row + 1) * n + j);
 
-			meshData.indices32[k + 3] = (i + 1) * n + j;
-			meshData.indices32[k + 4] = i * n + j + 1;
-			meshData.indices32[k + 5] = (i + 1) * n + j + 1;
+				pQuad[3] = static_cast<Index>((row + 1) * n + j);
+				pQuad[4] = static_cast<Index>(row * n + j + 1);
+				pQuad[5] = static_cast<Index>((row + 1) * n + j + 1);
 
-			k += 6; // next quad
+				pQuad += 6; // next quad
+			}
 		}
 	}
 
-	return meshData;
+	/*
+		Hills over an m x n vertex grid of width x depth, written straight into pVertices (m * n)
+		and pIndices ((m - 1) * (n - 1) * 6 of uint16_t or uint32_t, see indexFormat).
+		Throws E_INVALIDARG when m or n is below 2 or the index count overflows uint32_t.
+		Row blocks run in parallel, heights and colors are computed 4 vertices at a time.
+
+		With DXGI_FORMAT_R16_UINT the grid is cut into bands of rows of at most 65536 vertices,
+		neighbouring bands share their edge row so no vertex is duplicated.
+		chunks receives one entry per band, minHeight/maxHeight the height range.
+	*/
+	void CreateHeightfield(
+		float width, float depth, uint32_t m, uint32_t n,
+		ThreadPool* pThreadPool,
+		UnpackedLandVertex* pVertices,
+		void* pIndices, DXGI_FORMAT indexFormat,
+		std::vector<Mesh::Draw::Chunk>& chunks,
+		float& minHeight, float& maxHeight)
+	{
+		ValidateGridSize(m, n);
+
+		const uint32_t quadRowsPerChunk = GetQuadRowsPerChunk(m, n, indexFormat);
+
+		const float halfWidth = 0.5f * width;
+		const float halfDepth = 0.5f * depth;
+		const float dx = width / (n - 1);
+		const float dz = depth / (m - 1);
+
+		/*
+			height = 0.3 * (z * sin(0.1 * x) + x * cos(0.1 * z))
+			x only depends on the column and z on the row, so sin(0.1 * x) is computed once per column
+			and cos(0.1 * z) once per row, the per vertex work is a few multiply-adds.
+			The column tables are padded to a multiple of 4.
+		*/
+		const uint32_t paddedColumns = (n + 3) & ~3u;
+		std::vector<XMFLOAT4A> columnX(paddedColumns / 4);
+		std::vector<XMFLOAT4A> columnSin(paddedColumns / 4);
+		for (uint32_t j = 0; j < paddedColumns; j += 4)
+		{
+			const XMVECTOR x = XMVectorSet(-halfWidth + j * dx, -halfWidth + (j + 1) * dx, -halfWidth + (j + 2) * dx, -halfWidth + (j + 3) * dx);
+			XMStoreFloat4A(&columnX[j / 4], x);
+			XMStoreFloat4A(&columnSin[j / 4], XMVectorSin(XMVectorScale(x, 0.1f)));
+		}
+
+		// Color bands by height, the band is the number of thresholds at or below the height
+		static const XMFLOAT4 BandColors[5] =
+		{
+			XMFLOAT4(1.f, 0.9f, 0.62f, 1.f),        // sand
+			XMFLOAT4(0.48f, 0.77f, 0.46f, 1.f),     // light grass
+			XMFLOAT4(0.1f, 0.48f, 0.19f, 1.f),      // dark grass
+			XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f),    // rock
+			XMFLOAT4(1.f, 1.f, 1.f, 1.f),           // snow
+		};
+		const __m128 threshold0 = _mm_set1_ps(-10.f);
+		const __m128 threshold1 = _mm_set1_ps(5.f);
+		const __m128 threshold2 = _mm_set1_ps(12.f);
+		const __m128 threshold3 = _mm_set1_ps(20.f);
+
+		// Per row so chunk bounds can be put together whatever rows a task covered
+		std::vector<float> rowMin(m);
+		std::vector<float> rowMax(m);
+
+		ForEachRowBlock(pThreadPool, 0, m, RowsPerTask, [&](uint32_t firstRow, uint32_t endRow)
+		{
+			for (uint32_t i = firstRow; i < endRow; ++i)
+			{
+				__m128 rowBlockMin = _mm_set1_ps(FLT_MAX);
+				__m128 rowBlockMax = _mm_set1_ps(-FLT_MAX);
+
+				const float z = halfDepth - i * dz;
+				const __m128 zScaled = _mm_set1_ps(0.3f * z);
+				const __m128 cosZScaled = _mm_set1_ps(0.3f * cosf(0.1f * z));
+
+				UnpackedLandVertex* pRow = pVertices + static_cast<size_t>(i) * n;
+
+				for (uint32_t j = 0; j < n; j += 4)
+				{
+					const __m128 x = _mm_load_ps(&columnX[j / 4].x);
+					const __m128 height = _mm_add_ps(_mm_mul_ps(zScaled, _mm_load_ps(&columnSin[j / 4].x)), _mm_mul_ps(x, cosZScaled));
+
+					// Each passed threshold is -1 in the mask, subtracting the masks counts them
+					__m128i band = _mm_setzero_si128();
+					band = _mm_sub_epi32(band, _mm_castps_si128(_mm_cmpge_ps(height, threshold0)));
+					band = _mm_sub_epi32(band, _mm_castps_si128(_mm_cmpge_ps(height, threshold1)));
+					band = _mm_sub_epi32(band, _mm_castps_si128(_mm_cmpge_ps(height, threshold2)));
+					band = _mm_sub_epi32(band, _mm_castps_si128(_mm_cmpge_ps(height, threshold3)));
+
+					alignas(16) float heights[4];
+					alignas(16) int32_t bands[4];
+					_mm_store_ps(heights, height);
+					_mm_store_si128(reinterpret_cast<__m128i*>(bands), band);
+
+					const uint32_t laneCount = MathHelper::Min(4u, n - j);
+					if (laneCount == 4)
+					{
+						rowBlockMin = _mm_min_ps(rowBlockMin, height);
+						rowBlockMax = _mm_max_ps(rowBlockMax, height);
+					}
+
+					for (uint32_t k = 0; k < laneCount; ++k)
+					{
+						pRow[j + k].pos = XMFLOAT3((&columnX[j / 4].x)[k], heights[k], z);
+						pRow[j + k].color = BandColors[bands[k]];
+
+						if (laneCount < 4)
+						{
+							rowBlockMin = _mm_min_ss(rowBlockMin, _mm_set_ss(heights[k]));
+							rowBlockMax = _mm_max_ss(rowBlockMax, _mm_set_ss(heights[k]));
+						}
+					}
+				}
+
+				alignas(16) float lanes[4];
+
+				_mm_store_ps(lanes, rowBlockMin);
+				rowMin[i] = MathHelper::Min(MathHelper::Min(lanes[0], lanes[1]), MathHelper::Min(lanes[2], lanes[3]));
+				_mm_store_ps(lanes, rowBlockMax);
+				rowMax[i] = MathHelper::Max(MathHelper::Max(lanes[0], lanes[1]), MathHelper::Max(lanes[2], lanes[3]));
+			}
+
+			// The quads between these rows and the next, their vertices are all written by now or by another task
+			const uint32_t quadRowEnd = MathHelper::Min(endRow, m - 1);
+			if (firstRow < quadRowEnd)
+			{
+				if (indexFormat == DXGI_FORMAT_R16_UINT)
+				{
+					FillGridIndices(static_cast<uint16_t*>(pIndices), n, firstRow, quadRowEnd, quadRowsPerChunk);
+				}
+				else
+				{
+					FillGridIndices(static_cast<uint32_t*>(pIndices), n, firstRow, quadRowEnd, quadRowsPerChunk);
+				}
+			}
+		});
+
+		minHeight = FLT_MAX;
+		maxHeight = -FLT_MAX;
+
+		chunks.clear();
+		for (uint32_t firstRow = 0; firstRow < m - 1; firstRow += quadRowsPerChunk)
+		{
+			const uint32_t lastRow = MathHelper::Min(firstRow + quadRowsPerChunk, m - 1);
+
+			float chunkMin = FLT_MAX;
+			float chunkMax = -FLT_MAX;
+			for (uint32_t i = firstRow; i <= lastRow; ++i)
+			{
+				chunkMin = MathHelper::Min(chunkMin, rowMin[i]);
+				chunkMax = MathHelper::Max(chunkMax, rowMax[i]);
+			}
+
+			minHeight = MathHelper::Min(minHeight, chunkMin);
+			maxHeight = MathHelper::Max(maxHeight, chunkMax);
+
+			Mesh::Draw::Chunk chunk;
+			chunk.indexCount = (lastRow - firstRow) * (n - 1) * 6;
+			chunk.startIndex = firstRow * (n - 1) * 6;
+			chunk.baseVertex = firstRow * n;
+
+			// Sphere around the box of the band
+			const float halfDepthChunk = 0.5f * (lastRow - firstRow) * dz;
+			const float halfHeight = 0.5f * (chunkMax - chunkMin);
+			chunk.bounds[0] = 0.f;
+			chunk.bounds[1] = 0.5f * (chunkMin + chunkMax);
+			chunk.bounds[2] = halfDepth - (firstRow * dz + halfDepthChunk);
+			chunk.bounds[3] = sqrtf(halfWidth * halfWidth + halfDepthChunk * halfDepthChunk + halfHeight * halfHeight);
+
+			chunks.push_back(chunk);
+		}
+	}
 }
 
 void ProceduralGeometry::CreateLand(
-	ComPtr<ID3D12Device> device,
-	ComPtr<ID3D12GraphicsCommandList> cmdList,
-	std::unordered_map<std::string, std::unique_ptr<Mesh>>& geometries,
-	std::unordered_map<std::string, std::unique_ptr<Mesh::Draw>>& draws)
+	GeometryBufferPool* pool,
+	UploadBatcher* uploader,
+	ThreadPool* pThreadPool,
+	MeshRegistry& geometries,
+	DrawRegistry& draws,
+	uint32_t m,
+	uint32_t n,
+	DXGI_FORMAT indexFormat,
+	bool optimize)
 {
-	MeshData grid = CreateGrid(160.f, 160.f, 50, 50);
+	const float width = 160.f;
+	const float depth = 160.f;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	ValidateGridSize(m, n);
 
-	std::vector<InstanceVertex> vertices(grid.vertices.size());
-	std::vector<std::uint16_t> indices = grid.GetIndices16();
+	// Half the index bandwidth, large grids are split into chunks to keep it
+	bool useIndices16 = indexFormat == DXGI_FORMAT_R16_UINT;
+	if (useIndices16)
+	{
+		// Each chunk and each of its levels is a draw range, a grid the draw keys can't number stays one 32 bit chunk
+		const uint64_t chunkCount = (m - 2) / GetQuadRowsPerChunk(m, n, indexFormat) + 1;
+		useIndices16 = chunkCount * (1 + MaxLodLevels) <= DrawKeyBuilder::MaxDrawsPerMesh;
+	}
+	const uint32_t indexSize = useIndices16 ? sizeof(uint16_t) : sizeof(uint32_t);
 
-	for (UINT i = 0; i < grid.vertices.size(); ++i)
+	// Both vertex streams and the index buffer must fit the 32 bit byte sizes, the LOD indices are checked once they are built
+	const uint64_t vertexBytes = static_cast<uint64_t>(m) * n * sizeof(PackedColorVertex);
+	const uint64_t indexBytes = static_cast<uint64_t>(m - 1) * (n - 1) * 6 * indexSize;
+	if (Mesh::GetVertexRangeSize(vertexBytes, sizeof(PackedColorVertex)) > UINT32_MAX || indexBytes > UINT32_MAX)
 	{
-		auto& p = grid.vertices[i].position;
+		ThrowIfFailed(E_INVALIDARG);
+	}
+
+	const uint32_t vertexCount = m * n;
+	const uint32_t indexCount = (m - 1) * (n - 1) * 6;
+
+	auto pGeo = std::make_unique<Mesh>();
+
+	pGeo->name = "Land";
+	pGeo->vbSize = static_cast<uint32_t>(vertexBytes);
+	pGeo->vbStride = sizeof(PackedColorVertex);
+	pGeo->ibFormat = useIndices16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	pGeo->ibSize = static_cast<uint32_t>(indexBytes);
+
+	// Indices are generated straight into the CPU copy, the float vertices are packed into it once the height range is known
+	pGeo->vertexBufferCPU.resize(pGeo->vbSize);
+	pGeo->indexBufferCPU.resize(pGeo->ibSize);
+
+	std::vector<UnpackedLandVertex> vertices(vertexCount);
+	UnpackedLandVertex* pVertices = vertices.data();
+	PackedColorVertex* pPackedVertices = reinterpret_cast<PackedColorVertex*>(pGeo->vertexBufferCPU.data());
+	void* pIndices = pGeo->indexBufferCPU.data();
 
-		auto GetHillsHeight = [&]() -> float
+	auto landDraw = std::make_unique<Mesh::Draw>();
+
+	float minHeight, maxHeight;
+	CreateHeightfield(width, depth, m, n, pThreadPool, pVertices, pIndices, pGeo->ibFormat, landDraw->chunks, minHeight, maxHeight);
+
+	pGeo->positionQuantization = PositionQuantization::FromBox(
+		XMFLOAT3(-0.5f * width, minHeight, -0.5f * depth),
+		XMFLOAT3(0.5f * width, maxHeight, 0.5f * depth));
+
+	/*
+		The float positions are replaced by their decoded values, so the optimizers, meshlets and LOD errors
+		work on what the GPU draws. Shared edge rows pack the same way in both chunks, no cracks appear.
+	*/
+	std::vector<VertexPackingError> rowPackingErrors(m);
+	ForEachRowBlock(pThreadPool, 0, m, RowsPerTask, [&](uint32_t firstRow, uint32_t endRow)
+	{
+		for (uint32_t i = firstRow; i < endRow; ++i)
 		{
-			return 0.3f * (p.z * sinf(0.1f * p.x) + p.x * cosf(0.1f * p.z));
-		};
+			for (size_t v = static_cast<size_t>(i) * n; v < static_cast<size_t>(i + 1) * n; ++v)
+			{
+				UnpackedLandVertex& vertex = pVertices[v];
+				PackedColorVertex& packed = pPackedVertices[v];
+
+				PackPosition(vertex.pos, pGeo->positionQuantization, packed.position);
+				packed.color = PackColor(vertex.color);
+
+				const XMFLOAT3 position = UnpackPosition(packed.position, pGeo->positionQuantization);
+				const XMFLOAT4 color = UnpackColor(packed.color);
+
+				VertexPackingError vertexError;
+				vertexError.position = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&position), XMLoadFloat3(&vertex.pos))));
+				vertexError.color = MathHelper::Max(
+					MathHelper::Max(fabsf(color.x - vertex.color.x), fabsf(color.y - vertex.color.y)),
+					MathHelper::Max(fabsf(color.z - vertex.color.z), fabsf(color.w - vertex.color.w)));
+				rowPackingErrors[i].Combine(vertexError);
+
+				vertex.pos = position;
+			}
+		}
+	});
+
+	const auto generated = std::chrono::steady_clock::now();
 
-		vertices[i].pos = p;
-		vertices[i].pos.y = GetHillsHeight();
+	const uint32_t chunkCount = static_cast<uint32_t>(landDraw->chunks.size());
+	std::vector<VertexCacheStats> chunkStatsBefore(chunkCount);
+	std::vector<VertexCacheStats> chunkStatsAfter(chunkCount);
+	std::vector<std::vector<Meshlet>> chunkMeshlets(chunkCount);
+	std::vector<std::vector<LodLevel>> chunkLods(chunkCount);
 
-		if (vertices[i].pos.y < -10.f)
+	// The grid order is drawable as it is, without the passes there are no meshlets or LODs
+	ForEachTask(pThreadPool, optimize ? chunkCount : 0, [&](uint32_t i)
+	{
+		if (useIndices16)
 		{
-			vertices[i].color = XMFLOAT4(1.f, 0.9f, 0.62f, 1.f);
+			OptimizeGridChunk(static_cast<uint16_t*>(pIndices), pVertices, n, landDraw->chunks[i], chunkStatsBefore[i], chunkStatsAfter[i], chunkMeshlets[i], chunkLods[i]);
 		}
-		else if (vertices[i].pos.y < 5.f)
+		else
 		{
-			vertices[i].color = XMFLOAT4(0.48f, 0.77f, 0.46f, 1.f);
+			OptimizeGridChunk(static_cast<uint32_t*>(pIndices), pVertices, n, landDraw->chunks[i], chunkStatsBefore[i], chunkStatsAfter[i], chunkMeshlets[i], chunkLods[i]);
 		}
-		else if (vertices[i].pos.y < 12.f)
+	});
+
+	VertexPackingError packingError;
+	for (const VertexPackingError& rowError : rowPackingErrors)
+	{
+		packingError.Combine(rowError);
+	}
+
+	VertexCacheStats statsBefore;
+	VertexCacheStats statsAfter;
+	uint64_t lodIndexCount = 0;
+	for (uint32_t i = 0; i < chunkCount; ++i)
+	{
+		statsBefore += chunkStatsBefore[i];
+		statsAfter += chunkStatsAfter[i];
+
+		pGeo->meshlets.insert(pGeo->meshlets.end(), chunkMeshlets[i].begin(), chunkMeshlets[i].end());
+
+		for (const LodLevel& lod : chunkLods[i])
 		{
-			vertices[i].color = XMFLOAT4(0.1f, 0.48f, 0.19f, 1.f);
+			lodIndexCount += lod.indices.size();
 		}
-		else if (vertices[i].pos.y < 20.f)
+	}
+
+	// The levels go after the full mesh in the same index buffer, they index the same vertices
+	if (lodIndexCount > 0)
+	{
+		const uint64_t allIndexBytes = (indexCount + lodIndexCount) * indexSize;
+		if (allIndexBytes > UINT32_MAX)
 		{
-			vertices[i].color = XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f);
+			ThrowIfFailed(E_INVALIDARG);
 		}
-		else
+
+		std::vector<uint8_t> indexBufferCPU(allIndexBytes);
+		memcpy(indexBufferCPU.data(), pIndices, pGeo->ibSize);
+
+		uint8_t* pLodIndices = indexBufferCPU.data();
+		uint32_t nextIndex = indexCount;
+		for (uint32_t i = 0; i < chunkCount; ++i)
 		{
-			vertices[i].color = XMFLOAT4(1.f, 1.f, 1.f, 1.f);
+			for (const LodLevel& lod : chunkLods[i])
+			{
+				for (size_t j = 0; j < lod.indices.size(); ++j)
+				{
+					if (useIndices16)
+					{
+						reinterpret_cast<uint16_t*>(pLodIndices)[nextIndex + j] = static_cast<uint16_t>(lod.indices[j]);
+					}
+					else
+					{
+						reinterpret_cast<uint32_t*>(pLodIndices)[nextIndex + j] = lod.indices[j];
+					}
+				}
+
+				Mesh::Draw::Lod drawLod;
+				drawLod.indexCount = static_cast<uint32_t>(lod.indices.size());
+				drawLod.startIndex = nextIndex;
+				drawLod.error = lod.error;
+				landDraw->chunks[i].lods.push_back(drawLod);
+
+				nextIndex += drawLod.indexCount;
+			}
 		}
+
+		pGeo->indexBufferCPU = std::move(indexBufferCPU);
+		pGeo->ibSize = static_cast<uint32_t>(allIndexBytes);
+		pIndices = pGeo->indexBufferCPU.data();
 	}
 
-	auto pGeo = std::make_unique<Mesh>();
+	const auto end = std::chrono::steady_clock::now();
 
-	pGeo->name = "Land";
-	pGeo->vbSize = (uint32_t)vertices.size() * sizeof(InstanceVertex);
-	pGeo->vbStride = sizeof(InstanceVertex);
-	pGeo->ibSize = (uint32_t)indices.size() * sizeof(uint16_t);
-	pGeo->ibFormat = DXGI_FORMAT_R16_UINT;
+	char report[256];
+	sprintf_s(report, "%s: %u x %u vertices, generated in %.1f ms, optimized in %.1f ms\n",
+		pGeo->name.c_str(), m, n,
+		std::chrono::duration<double, std::milli>(generated - start).count(),
+		std::chrono::duration<double, std::milli>(end - generated).count());
+	OutputDebugStringA(report);
 
-	ThrowIfFailed(D3DCreateBlob(pGeo->vbSize, &pGeo->vertexBufferCPU));
-	CopyMemory(pGeo->vertexBufferCPU->GetBufferPointer(), vertices.data(), pGeo->vbSize);
+	if (optimize)
+	{
+		sprintf_s(report, "%s: %u chunks, %zu meshlets, %u LOD indices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+			pGeo->name.c_str(), chunkCount, pGeo->meshlets.size(), lodIndexCount,
+			statsBefore.Acmr(), statsAfter.Acmr(), statsBefore.Atvr(), statsAfter.Atvr());
+		OutputDebugStringA(report);
+	}
 
-	ThrowIfFailed(D3DCreateBlob(pGeo->ibSize, &pGeo->indexBufferCPU));
-	CopyMemory(pGeo->indexBufferCPU->GetBufferPointer(), indices.data(), pGeo->ibSize);
+	const VertexPackingError packingTolerance = VertexPackingError::GetTolerance(pGeo->positionQuantization);
+	sprintf_s(report, "%s: vertices %zu -> %zu bytes, largest position error %.5f (%.5f allowed), color error %.4f (%.4f allowed)\n",
+		pGeo->name.c_str(), sizeof(UnpackedLandVertex), sizeof(PackedColorVertex),
+		packingError.position, packingTolerance.position, packingError.color, packingTolerance.color);
+	OutputDebugStringA(report);
 
-	pGeo->vertexBufferGPU = CreateDefaultBuffer(device.Get(), cmdList.Get(), vertices.data(), pGeo->vbSize, pGeo->vertexUploadBuffer);
-	pGeo->indexBufferGPU = CreateDefaultBuffer(device.Get(), cmdList.Get(), indices.data(), pGeo->ibSize, pGeo->indexUploadBuffer);
+	// Past half a step the packing itself is broken, not just lossy. Tests/VertexPackingTests.cpp covers it
+	assert(packingError.IsWithin(packingTolerance));
+
+	// Small enough to be drawn in one go
+	if (landDraw->chunks.size() == 1)
+	{
+		landDraw->lods = landDraw->chunks[0].lods;
+		landDraw->chunks.clear();
+	}
+
+	// Sphere around the box, looser than ComputeBounds but free for millions of vertices
+	const float halfHeight = 0.5f * (maxHeight - minHeight);
+	pGeo->bounds[0] = 0.f;
+	pGeo->bounds[1] = 0.5f * (minHeight + maxHeight);
+	pGeo->bounds[2] = 0.f;
+	pGeo->bounds[3] = sqrtf(0.25f * width * width + 0.25f * depth * depth + halfHeight * halfHeight);
+
+	pGeo->UploadGeometry(pool, uploader, pPackedVertices, pIndices);
 
-	auto landDraw = std::make_unique<Mesh::Draw>();
 	landDraw->baseVertex = 0;
-	landDraw->indexCount = (uint32_t)indices.size();
+	landDraw->indexCount = indexCount;
 	landDraw->startIndex = 0;
 
-	geometries["Land"] = std::move(pGeo);
-	draws["Land"] = std::move(landDraw);
+	geometries.Add("Land", std::move(pGeo));
+	draws.Add("Land", std::move(landDraw));
 }
\ No newline at end of file
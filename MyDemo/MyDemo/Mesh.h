@@ -1,5 +1,16 @@
 #pragma once
 
+#include "GraphicsDevice.h"
+#include "UploadBatcher.h"
+#include "GeometryBufferPool.h"
+#include "DeferredReleaseQueue.h"
+#include "ThreadPool.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "VertexPacking.h"
+#include "ResourceRegistry.h"
+
 using Microsoft::WRL::ComPtr;
 
 using namespace DirectX;
@@ -8,16 +19,18 @@ struct Mesh
 {
 	std::string name;
 
-	ComPtr<ID3DBlob> vertexBufferCPU = nullptr;
-	ComPtr<ID3DBlob> indexBufferCPU = nullptr;
+	// What was uploaded, kept for cooking the mesh cache. Empty for meshes loaded from it
+	std::vector<uint8_t> vertexBufferCPU;
+	std::vector<uint8_t> indexBufferCPU;
 
-	ComPtr<ID3D12Resource> vertexBufferGPU = nullptr;
-	ComPtr<ID3D12Resource> indexBufferGPU = nullptr;
+	// Shared pool buffers, the mesh data starts at vbOffset/ibOffset
+	GraphicsResourcePtr vertexBufferGPU = nullptr;
+	GraphicsResourcePtr indexBufferGPU = nullptr;
 
-	ComPtr<ID3D12Resource> vertexUploadBuffer = nullptr;
-	ComPtr<ID3D12Resource> indexUploadBuffer = nullptr;
+	GeometryAllocation vertexAllocation;
+	GeometryAllocation indexAllocation;
 
-	float bounds[4];		// A bounding sphere
+	float bounds[4] = {};		// A bounding sphere, center xyz and radius in mesh space
 	uint32_t vbOffset = 0;		// BufferLocation - Buffer.GpuVirtualAddress
 	uint32_t vbSize = 0;		// SizeInBytes
 	uint32_t vbStride = 0;		// StrideInBytes
@@ -27,102 +40,144 @@ struct Mesh
 	uint32_t ibSize = 0;		// SizeInBytes
 	DXGI_FORMAT ibFormat = DXGI_FORMAT_R16_UINT;	// DXGI_FORMAT
 
+	// Decodes packed positions, folded into the object's world matrix. Identity for float positions
+	PositionQuantization positionQuantization;
+
+	UploadToken uploadToken = 0;	// the GPU buffers can be drawn from once this batch has completed
+
+	// In index buffer order, a draw range holds whole meshlets. Empty when the mesh isn't culled per meshlet
+	std::vector<Meshlet> meshlets;
+
 	struct Draw
 	{
 		uint32_t indexCount = 0;		// Number of indices = 3 * number of triangles
 		uint32_t startIndex = 0;		// Offset to first index in index buffer
 		uint32_t baseVertex = 0;		// Offset to first vertex in vertex buffer
+
+		// A simplified version of a draw, same baseVertex, error is about how far it is off in mesh units
+		struct Lod
+		{
+			uint32_t indexCount = 0;
+			uint32_t startIndex = 0;
+			float error = 0.f;
+		};
+
+		// Coarser levels, finest first
+		std::vector<Lod> lods;
+
+		// A piece of a draw whose indices are relative to its own baseVertex
+		struct Chunk
+		{
+			uint32_t indexCount = 0;
+			uint32_t startIndex = 0;
+			uint32_t baseVertex = 0;
+			float bounds[4] = {};		// A bounding sphere of the chunk, in mesh space
+			std::vector<Lod> lods;
+		};
+
+		/*
+			Set when the draw was split to keep 16 bit indices, each chunk is drawn on its own.
+			The whole range above is then only a summary, its indices don't share one baseVertex.
+		*/
+		std::vector<Chunk> chunks;
 	};
 
+	// Sets bounds from unpacked vertices, a float3 position must be the first element of a vertex
+	void ComputeBounds(const void* vertexData, uint32_t vertexCount, uint32_t vertexStride);
+
+	// Vertex stride of the position only stream drawn by the depth prepass
+	static const uint32_t DepthVertexStride = 4 * sizeof(uint16_t);
+
+	/*
+		Bytes of the pool range holding the vertices and, on the next pool alignment, their position only stream.
+		Callers check it against UINT32_MAX before filling a mesh, every byte size of a mesh is 32 bit.
+	*/
+	static uint64_t GetVertexRangeSize(uint64_t vbSize, uint32_t vbStride);
+
+	// Fills the position only stream, every packed vertex format starts with its R16G16B16A16_UNORM position
+	static void CopyDepthVertices(const void* vertexData, uint32_t vertexStride, uint32_t vertexCount, void* depthData);
+
+	/*
+		Places the vertex and index data in the pool and queues the upload, vbSize, vbStride and ibSize must be set.
+		The position only stream follows the vertices in the same pool range, it is built from vertexData.
+	*/
+	void UploadGeometry(GeometryBufferPool* pool, UploadBatcher* uploader, const void* vertexData, const void* indexData);
+
+	// Same as UploadGeometry but hands out the staging memory, the caller fills all three before the batch is submitted
+	void ReserveGeometry(GeometryBufferPool* pool, UploadBatcher* uploader, void** ppVertexData, void** ppDepthData, void** ppIndexData);
+
+	// For meshes whose vertices are streamed every frame, only the indices go in the pool. ibSize must be set
+	void UploadIndices(GeometryBufferPool* pool, UploadBatcher* uploader, const void* indexData);
+
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView() const;
 
+	D3D12_VERTEX_BUFFER_VIEW DepthVertexBufferView() const;
+
 	D3D12_INDEX_BUFFER_VIEW IndexBufferView() const;
 
-	void Destory()
-	{
-		vertexUploadBuffer = nullptr;
-		indexUploadBuffer = nullptr;
-	}
+	// Gives the pool ranges back once the GPU is done drawing from them and uploadToken has completed
+	void Release(GeometryBufferPool* pool, DeferredReleaseQueue* releaseQueue);
 };
 
 inline D3D12_VERTEX_BUFFER_VIEW Mesh::VertexBufferView() const
 {
 	D3D12_VERTEX_BUFFER_VIEW VBView;
-	VBView.BufferLocation = vertexBufferGPU->GetGPUVirtualAddress();
+	VBView.BufferLocation = vertexBufferGPU->GetGPUVirtualAddress() + vbOffset;
 	VBView.SizeInBytes = vbSize;
 	VBView.StrideInBytes = vbStride;
 
 	return VBView;
 }
 
+inline D3D12_VERTEX_BUFFER_VIEW Mesh::DepthVertexBufferView() const
+{
+	D3D12_VERTEX_BUFFER_VIEW VBView;
+	VBView.BufferLocation = vertexBufferGPU->GetGPUVirtualAddress() + vbDepthOffset;
+	VBView.SizeInBytes = vbDepthSize;
+	VBView.StrideInBytes = DepthVertexStride;
+
+	return VBView;
+}
+
 inline D3D12_INDEX_BUFFER_VIEW Mesh::IndexBufferView() const
 {
 	D3D12_INDEX_BUFFER_VIEW IBView;
-	IBView.BufferLocation = indexBufferGPU->GetGPUVirtualAddress();
+	IBView.BufferLocation = indexBufferGPU->GetGPUVirtualAddress() + ibOffset;
 	IBView.Format = ibFormat;
 	IBView.SizeInBytes = ibSize;
 
 	return IBView;
 }
 
+// The values are owned through pointers, Renderer::Geo and the like stay valid as the registries grow
+typedef ResourceRegistry<std::unique_ptr<Mesh>> MeshRegistry;
+typedef ResourceRegistry<std::unique_ptr<Mesh::Draw>> DrawRegistry;
+
 
 class ProceduralGeometry
 {
-	struct Vertex
-	{
-		Vertex() {}
-		Vertex(
-			const XMFLOAT3& p,
-			const XMFLOAT3& n,
-			const XMFLOAT3& t,
-			const XMFLOAT2& uv) :
-			position(p),
-			normal(n),
-			tangentU(t),
-			texC(uv)
-		{}
-
-		Vertex(
-			float px, float py, float pz,
-			float nx, float ny, float nz,
-			float tx, float ty, float tz,
-			float u, float v) :
-			position(px, py, pz),
-			normal(nx, ny, nz),
-			tangentU(tx, ty, tz),
-			texC(u, v)
-		{}
-
-		XMFLOAT3 position;
-		XMFLOAT3 normal;
-		XMFLOAT3 tangentU;
-		XMFLOAT2 texC;
-	};
-
-	class MeshData
-	{
-	public:
-		std::vector<Vertex> vertices;
-		std::vector<uint32_t> indices32;
-
-		std::vector<uint16_t>& GetIndices16()
-		{
-			if (m_indices16.empty())
-			{
-				m_indices16.resize(indices32.size());
-				for (size_t i = 0; i < indices32.size(); ++i)
-					m_indices16[i] = static_cast<uint16_t>(indices32[i]);
-			}
-
-			return m_indices16;
-		}
-
-	private:
-		std::vector<uint16_t> m_indices16;
-	};
-
 public:
-	MeshData CreateGrid(float width, float depth, uint32_t m, uint32_t n);
-
-	void CreateLand(ComPtr<ID3D12Device> device, ComPtr<ID3D12GraphicsCommandList> cmdList, std::unordered_map<std::string, std::unique_ptr<Mesh>>& geometries, std::unordered_map<std::string, std::unique_ptr<Mesh::Draw>>& draws);
+	// Bump whenever CreateLand builds something different, cooked copies of older versions are stale
+	static const uint32_t LandVersion = 1;
+
+	/*
+		Queues the buffers on uploader, Mesh::uploadToken is set once the caller submits the batch.
+		Grids over 65536 vertices are split into chunks unless DXGI_FORMAT_R32_UINT is asked for,
+		or unless the chunks and their levels would need more draw ranges than DrawKeyBuilder::MaxDrawsPerMesh.
+		The triangles of each chunk are reordered for the vertex cache and overdraw, then cut into meshlets,
+		and a LOD chain per chunk is appended to the index buffer.
+		Without optimize those passes are skipped, the grid is only generated and packed: no meshlets, no LODs,
+		for when the land is regenerated often and its build time matters more than its draw cost.
+		The vertices are uploaded as PackedColorVertex, every CPU side structure is built from the decoded positions.
+	*/
+	void CreateLand(
+		GeometryBufferPool* pool,
+		UploadBatcher* uploader,
+		ThreadPool* pThreadPool,
+		MeshRegistry& geometries,
+		DrawRegistry& draws,
+		uint32_t m = 50,
+		uint32_t n = 50,
+		DXGI_FORMAT indexFormat = DXGI_FORMAT_R16_UINT,
+		bool optimize = true);
 };
\ No newline at end of file
@@ -0,0 +1,645 @@
+#include "pch.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <type_traits>
+
+namespace
+{
+    // "MESH" in a hex dump
+    const uint32_t CacheMagic = 0x4853454D;
+
+    // Bump when the layout below changes
+    const uint32_t CacheVersion = 2;
+
+    // Streams start on a page so the mapped copies read whole pages
+    const uint64_t StreamAlignment = 4096;
+    const uint64_t RecordAlignment = 16;
+
+    // Bytes hashed or copied per task
+    const size_t BytesPerTask = 4 << 20;
+
+    const uint64_t HashPrime = 0x9E3779B97F4A7C15ull;
+
+    struct CacheSection
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+
+        uint64_t settingsHash;
+        uint64_t contentHash;       // Of the source file, 0 without one
+        uint64_t sourceSize;
+        uint64_t sourceWriteTime;   // std::filesystem::file_time_type ticks, a FILETIME with MSVC
+
+        uint32_t vertexStride;
+        uint32_t indexFormat;       // DXGI_FORMAT
+        float bounds[4];
+        float quantizationOffset[3];
+        float quantizationScale[3];
+
+        CacheSection vertices;
+        CacheSection depthVertices; // Position only stream, Mesh::DepthVertexStride
+        CacheSection indices;
+        CacheSection names;         // Draw names back to back, not terminated
+        CacheSection draws;         // CachedDraw
+        CacheSection chunks;        // CachedChunk
+        CacheSection lods;          // CachedLod
+        CacheSection meshlets;      // Meshlet
+    };
+
+    // The chunks and LODs of a draw or chunk are ranges of the chunk and LOD sections
+    struct CachedDraw
+    {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t indexCount;
+        uint32_t startIndex;
+        uint32_t baseVertex;
+        uint32_t firstLod;
+        uint32_t lodCount;
+        uint32_t firstChunk;
+        uint32_t chunkCount;
+    };
+
+    struct CachedChunk
+    {
+        uint32_t indexCount;
+        uint32_t startIndex;
+        uint32_t baseVertex;
+        uint32_t firstLod;
+        uint32_t lodCount;
+        float bounds[4];
+    };
+
+    struct CachedLod
+    {
+        uint32_t indexCount;
+        uint32_t startIndex;
+        float error;
+    };
+
+    static_assert(std::is_trivially_copyable<Meshlet>::value, "meshlets are stored as they are");
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    uint64_t HashBytes(const uint8_t* pData, size_t byteSize, uint64_t hash)
+    {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= byteSize; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, pData + i, sizeof(word));
+            hash = (hash ^ word) * HashPrime;
+            hash ^= hash >> 29;
+        }
+
+        for (; i < byteSize; ++i)
+        {
+            hash = (hash ^ pData[i]) * HashPrime;
+            hash ^= hash >> 29;
+        }
+
+        return hash;
+    }
+
+    // Blocks are hashed in parallel and their hashes combined in order, the result doesn't depend on the thread count
+    uint64_t HashFileContents(const std::wstring& path, ThreadPool* pThreadPool)
+    {
+        MappedFile file(path);
+        const uint8_t* pData = reinterpret_cast<const uint8_t*>(file.GetData());
+        const size_t size = file.GetSize();
+
+        const uint32_t blockCount = static_cast<uint32_t>((size + BytesPerTask - 1) / BytesPerTask);
+        std::vector<uint64_t> blockHashes(blockCount);
+        ForEachTask(pThreadPool, blockCount, [&](uint32_t block)
+        {
+            const size_t first = block * BytesPerTask;
+            blockHashes[block] = HashBytes(pData + first, MathHelper::Min(BytesPerTask, size - first), block + 1);
+        });
+
+        return HashBytes(reinterpret_cast<const uint8_t*>(blockHashes.data()), blockHashes.size() * sizeof(uint64_t), size);
+    }
+
+    // Size and last write time, false when the file isn't there
+    bool GetSourceStamp(const std::wstring& path, uint64_t& size, uint64_t& writeTime)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error)
+        {
+            return false;
+        }
+
+        const std::filesystem::file_time_type lastWriteTime = std::filesystem::last_write_time(path, error);
+        if (error)
+        {
+            return false;
+        }
+
+        writeTime = static_cast<uint64_t>(lastWriteTime.time_since_epoch().count());
+        return true;
+    }
+
+    // Records a new stamp for a source that was touched without changing, best effort
+    void Restamp(const std::wstring& path, uint64_t sourceSize, uint64_t sourceWriteTime)
+    {
+        // In place, without truncating
+        std::fstream file(std::filesystem::path(path), std::ios::binary | std::ios::in | std::ios::out);
+        if (!file)
+        {
+            return;
+        }
+
+        const uint64_t stamp[] = { sourceSize, sourceWriteTime };
+        static_assert(offsetof(CacheHeader, sourceWriteTime) == offsetof(CacheHeader, sourceSize) + sizeof(uint64_t), "the stamp is written in one go");
+
+        file.seekp(offsetof(CacheHeader, sourceSize));
+        file.write(reinterpret_cast<const char*>(stamp), sizeof(stamp));
+    }
+
+    bool WriteAll(std::ofstream& file, const void* pData, uint64_t byteSize)
+    {
+        file.write(static_cast<const char*>(pData), static_cast<std::streamsize>(byteSize));
+        return file.good();
+    }
+
+    // Parallel slices keep several page faults in flight, a single thread would wait for the disk one page run at a time
+    void CopyStream(void* pDst, const char* pSrc, uint64_t byteSize, ThreadPool* pThreadPool)
+    {
+        const uint32_t sliceCount = static_cast<uint32_t>((byteSize + BytesPerTask - 1) / BytesPerTask);
+        ForEachTask(pThreadPool, sliceCount, [&](uint32_t slice)
+        {
+            const uint64_t first = static_cast<uint64_t>(slice) * BytesPerTask;
+            memcpy(static_cast<uint8_t*>(pDst) + first, pSrc + first, static_cast<size_t>(MathHelper::Min<uint64_t>(BytesPerTask, byteSize - first)));
+        });
+    }
+
+    bool IsSectionValid(const CacheSection& section, uint64_t fileSize, uint64_t recordSize)
+    {
+        return section.offset <= fileSize && section.size <= fileSize - section.offset && section.size % recordSize == 0;
+    }
+
+    bool IsRangeValid(uint32_t first, uint32_t count, uint64_t size)
+    {
+        return static_cast<uint64_t>(first) + count <= size;
+    }
+
+    // Indices drawn with a base vertex, the LODs of a draw or chunk use its base vertex
+    struct IndexRange
+    {
+        uint32_t startIndex;
+        uint32_t indexCount;
+        uint32_t baseVertex;
+    };
+
+    // Every index of the range lands on one of vertexCount vertices
+    template<typename Index>
+    bool AreIndicesValid(const Index* pIndices, const IndexRange& range, uint64_t vertexCount)
+    {
+        Index largest = 0;
+        for (uint32_t i = range.startIndex; i < range.startIndex + range.indexCount; ++i)
+        {
+            largest = MathHelper::Max(largest, pIndices[i]);
+        }
+        return range.indexCount == 0 || static_cast<uint64_t>(range.baseVertex) + largest < vertexCount;
+    }
+
+    template<typename T>
+    const T* GetRecords(const MappedFile& file, const CacheSection& section)
+    {
+        return reinterpret_cast<const T*>(file.GetData() + section.offset);
+    }
+
+    void AddLods(const CachedLod* pLods, uint32_t first, uint32_t count, std::vector<Mesh::Draw::Lod>& lods)
+    {
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            Mesh::Draw::Lod lod;
+            lod.indexCount = pLods[i].indexCount;
+            lod.startIndex = pLods[i].startIndex;
+            lod.error = pLods[i].error;
+            lods.push_back(lod);
+        }
+    }
+
+    void CookLods(const std::vector<Mesh::Draw::Lod>& lods, std::vector<CachedLod>& cachedLods, uint32_t& first, uint32_t& count)
+    {
+        first = static_cast<uint32_t>(cachedLods.size());
+        count = static_cast<uint32_t>(lods.size());
+        for (const Mesh::Draw::Lod& lod : lods)
+        {
+            cachedLods.push_back({ lod.indexCount, lod.startIndex, lod.error });
+        }
+    }
+
+    void ReportStale(const std::wstring& path, const char* reason)
+    {
+        char report[512];
+        sprintf_s(report, "Mesh cache %ls: %s, cooking it again\n", path.c_str(), reason);
+        OutputDebugStringA(report);
+    }
+}
+
+uint64_t HashMeshSettings(const void* pData, size_t byteSize, uint64_t seed)
+{
+    return HashBytes(static_cast<const uint8_t*>(pData), byteSize, seed ^ HashPrime);
+}
+
+bool LoadMeshCache(
+    const std::wstring& path,
+    const MeshSource& source,
+    const std::string& name,
+    GeometryBufferPool* pool,
+    UploadBatcher* uploader,
+    ThreadPool* pThreadPool,
+    MeshRegistry& geometries,
+    DrawRegistry& draws,
+    std::vector<DrawRegistry::Handle>& drawHandles)
+{
+    // Not cooked yet
+    std::error_code error;
+    if (!std::filesystem::exists(path, error))
+    {
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    bool restamp = false;
+    uint64_t sourceSize = 0;
+    uint64_t sourceWriteTime = 0;
+    uint64_t fileSize = 0;
+
+    std::unique_ptr<Mesh> pGeo;
+    std::vector<std::pair<std::string, std::unique_ptr<Mesh::Draw>>> cachedDraws;
+
+    {
+        MappedFile file(path);
+        fileSize = file.GetSize();
+
+        CacheHeader header = {};
+        if (fileSize < sizeof(header))
+        {
+            ReportStale(path, "truncated");
+            return false;
+        }
+        memcpy(&header, file.GetData(), sizeof(header));
+
+        if (header.magic != CacheMagic || header.version != CacheVersion)
+        {
+            ReportStale(path, "older format");
+            return false;
+        }
+
+        if (header.settingsHash != source.settingsHash)
+        {
+            ReportStale(path, "cooked with other settings");
+            return false;
+        }
+
+        const uint32_t indexSize = header.indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t);
+        const bool isValid =
+            (header.indexFormat == DXGI_FORMAT_R16_UINT || header.indexFormat == DXGI_FORMAT_R32_UINT) &&
+            header.vertexStride > 0 &&
+            IsSectionValid(header.vertices, fileSize, header.vertexStride) &&
+            Mesh::GetVertexRangeSize(header.vertices.size, header.vertexStride) <= UINT32_MAX &&
+            IsSectionValid(header.depthVertices, fileSize, Mesh::DepthVertexStride) &&
+            header.depthVertices.size / Mesh::DepthVertexStride == header.vertices.size / header.vertexStride &&
+            IsSectionValid(header.indices, fileSize, indexSize) && header.indices.size <= UINT32_MAX &&
+            IsSectionValid(header.names, fileSize, 1) &&
+            IsSectionValid(header.draws, fileSize, sizeof(CachedDraw)) &&
+            IsSectionValid(header.chunks, fileSize, sizeof(CachedChunk)) &&
+            IsSectionValid(header.lods, fileSize, sizeof(CachedLod)) &&
+            IsSectionValid(header.meshlets, fileSize, sizeof(Meshlet));
+        if (!isValid)
+        {
+            ReportStale(path, "damaged");
+            return false;
+        }
+
+        // A source that can't be found can't be cooked again either, the cache is all there is
+        if (!source.path.empty() &&
+            GetSourceStamp(source.path, sourceSize, sourceWriteTime) &&
+            (sourceSize != header.sourceSize || sourceWriteTime != header.sourceWriteTime))
+        {
+            // Touched, copied or rewritten, only the contents tell whether it changed
+            if (HashFileContents(source.path, pThreadPool) != header.contentHash)
+            {
+                ReportStale(path, "source changed");
+                return false;
+            }
+            restamp = true;
+        }
+
+        const char* pNames = GetRecords<char>(file, header.names);
+        const CachedDraw* pDraws = GetRecords<CachedDraw>(file, header.draws);
+        const CachedChunk* pChunks = GetRecords<CachedChunk>(file, header.chunks);
+        const CachedLod* pLods = GetRecords<CachedLod>(file, header.lods);
+        const Meshlet* pMeshlets = GetRecords<Meshlet>(file, header.meshlets);
+
+        const uint64_t drawCount = header.draws.size / sizeof(CachedDraw);
+        const uint64_t chunkCount = header.chunks.size / sizeof(CachedChunk);
+        const uint64_t lodCount = header.lods.size / sizeof(CachedLod);
+        const uint64_t meshletCount = header.meshlets.size / sizeof(Meshlet);
+        const uint64_t vertexCount = header.vertices.size / header.vertexStride;
+        const uint64_t indexCount = header.indices.size / indexSize;
+
+        /*
+            Everything is checked before anything is queued: every record range, every index range
+            against the index stream and every index those ranges draw against the vertex stream.
+        */
+        std::vector<IndexRange> drawnRanges;
+        const auto addDrawnRange = [&](uint32_t startIndex, uint32_t count, uint32_t baseVertex)
+        {
+            if (!IsRangeValid(startIndex, count, indexCount) || (count > 0 && baseVertex >= vertexCount))
+            {
+                return false;
+            }
+            drawnRanges.push_back({ startIndex, count, baseVertex });
+            return true;
+        };
+        const auto addLodRanges = [&](uint32_t firstLod, uint32_t count, uint32_t baseVertex)
+        {
+            for (uint32_t l = firstLod; l < firstLod + count; ++l)
+            {
+                if (!addDrawnRange(pLods[l].startIndex, pLods[l].indexCount, baseVertex))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        for (uint64_t i = 0; i < drawCount; ++i)
+        {
+            const CachedDraw& draw = pDraws[i];
+            if (!IsRangeValid(draw.nameOffset, draw.nameLength, header.names.size) ||
+                !IsRangeValid(draw.firstLod, draw.lodCount, lodCount) ||
+                !IsRangeValid(draw.firstChunk, draw.chunkCount, chunkCount) ||
+                !addDrawnRange(draw.startIndex, draw.indexCount, draw.baseVertex) ||
+                !addLodRanges(draw.firstLod, draw.lodCount, draw.baseVertex))
+            {
+                ReportStale(path, "damaged");
+                return false;
+            }
+        }
+
+        for (uint64_t i = 0; i < chunkCount; ++i)
+        {
+            const CachedChunk& chunk = pChunks[i];
+            if (!IsRangeValid(chunk.firstLod, chunk.lodCount, lodCount) ||
+                !addDrawnRange(chunk.startIndex, chunk.indexCount, chunk.baseVertex) ||
+                !addLodRanges(chunk.firstLod, chunk.lodCount, chunk.baseVertex))
+            {
+                ReportStale(path, "damaged");
+                return false;
+            }
+        }
+
+        for (uint64_t i = 0; i < meshletCount; ++i)
+        {
+            if (!IsRangeValid(pMeshlets[i].startIndex, pMeshlets[i].indexCount, indexCount))
+            {
+                ReportStale(path, "damaged");
+                return false;
+            }
+        }
+
+        // The index stream is the largest thing read here, ranges are scanned in parallel
+        std::vector<uint8_t> rangeValid(drawnRanges.size());
+        const char* pIndexData = file.GetData() + header.indices.offset;
+        ForEachTask(pThreadPool, static_cast<uint32_t>(drawnRanges.size()), [&](uint32_t i)
+        {
+            rangeValid[i] = header.indexFormat == DXGI_FORMAT_R16_UINT ?
+                AreIndicesValid(reinterpret_cast<const uint16_t*>(pIndexData), drawnRanges[i], vertexCount) :
+                AreIndicesValid(reinterpret_cast<const uint32_t*>(pIndexData), drawnRanges[i], vertexCount);
+        });
+        if (std::find(rangeValid.begin(), rangeValid.end(), 0) != rangeValid.end())
+        {
+            ReportStale(path, "damaged");
+            return false;
+        }
+
+        for (uint64_t i = 0; i < drawCount; ++i)
+        {
+            const CachedDraw& cachedDraw = pDraws[i];
+
+            auto draw = std::make_unique<Mesh::Draw>();
+            draw->indexCount = cachedDraw.indexCount;
+            draw->startIndex = cachedDraw.startIndex;
+            draw->baseVertex = cachedDraw.baseVertex;
+            AddLods(pLods, cachedDraw.firstLod, cachedDraw.lodCount, draw->lods);
+
+            for (uint32_t c = cachedDraw.firstChunk; c < cachedDraw.firstChunk + cachedDraw.chunkCount; ++c)
+            {
+                Mesh::Draw::Chunk chunk;
+                chunk.indexCount = pChunks[c].indexCount;
+                chunk.startIndex = pChunks[c].startIndex;
+                chunk.baseVertex = pChunks[c].baseVertex;
+                memcpy(chunk.bounds, pChunks[c].bounds, sizeof(chunk.bounds));
+                AddLods(pLods, pChunks[c].firstLod, pChunks[c].lodCount, chunk.lods);
+                draw->chunks.push_back(chunk);
+            }
+
+            cachedDraws.emplace_back(std::string(pNames + cachedDraw.nameOffset, cachedDraw.nameLength), std::move(draw));
+        }
+
+        pGeo = std::make_unique<Mesh>();
+        pGeo->name = name;
+        pGeo->vbStride = header.vertexStride;
+        pGeo->vbSize = static_cast<uint32_t>(header.vertices.size);
+        pGeo->ibFormat = static_cast<DXGI_FORMAT>(header.indexFormat);
+        pGeo->ibSize = static_cast<uint32_t>(header.indices.size);
+        memcpy(pGeo->bounds, header.bounds, sizeof(pGeo->bounds));
+        pGeo->positionQuantization.offset = XMFLOAT3(header.quantizationOffset[0], header.quantizationOffset[1], header.quantizationOffset[2]);
+        pGeo->positionQuantization.scale = XMFLOAT3(header.quantizationScale[0], header.quantizationScale[1], header.quantizationScale[2]);
+        pGeo->meshlets.assign(pMeshlets, pMeshlets + header.meshlets.size / sizeof(Meshlet));
+
+        // From the mapping straight into staging memory, the only copy the CPU makes
+        void* pVertexStaging = nullptr;
+        void* pDepthStaging = nullptr;
+        void* pIndexStaging = nullptr;
+        pGeo->ReserveGeometry(pool, uploader, &pVertexStaging, &pDepthStaging, &pIndexStaging);
+        CopyStream(pVertexStaging, file.GetData() + header.vertices.offset, header.vertices.size, pThreadPool);
+        CopyStream(pDepthStaging, file.GetData() + header.depthVertices.offset, header.depthVertices.size, pThreadPool);
+        CopyStream(pIndexStaging, file.GetData() + header.indices.offset, header.indices.size, pThreadPool);
+    }
+
+    // The mapping is closed, the header can be written
+    if (restamp)
+    {
+        Restamp(path, sourceSize, sourceWriteTime);
+    }
+
+    drawHandles.clear();
+    for (auto& cachedDraw : cachedDraws)
+    {
+        drawHandles.push_back(draws.Add(cachedDraw.first, std::move(cachedDraw.second)));
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double megabytes = fileSize / (1024.0 * 1024.0);
+
+    char report[256];
+    sprintf_s(report, "%s: cached, %.1f MB, %zu draws, %.1f ms, %.0f MB/s%s\n",
+        name.c_str(), megabytes, drawHandles.size(), 1000.0 * seconds, megabytes / MathHelper::Max(seconds, 1e-6),
+        restamp ? ", source touched but unchanged" : "");
+    OutputDebugStringA(report);
+
+    geometries.Add(name, std::move(pGeo));
+    return true;
+}
+
+bool SaveMeshCache(
+    const std::wstring& path,
+    const MeshSource& source,
+    const Mesh& mesh,
+    const std::vector<DrawRegistry::Handle>& drawHandles,
+    const DrawRegistry& draws,
+    ThreadPool* pThreadPool)
+{
+    if (mesh.vertexBufferCPU.empty() || mesh.indexBufferCPU.empty() || mesh.vbStride == 0)
+    {
+        return false;
+    }
+
+    CacheHeader header = {};
+    header.magic = CacheMagic;
+    header.version = CacheVersion;
+    header.settingsHash = source.settingsHash;
+
+    // Stamped first, a source written to while it is hashed then looks modified and is hashed again next time
+    if (!source.path.empty() && GetSourceStamp(source.path, header.sourceSize, header.sourceWriteTime))
+    {
+        header.contentHash = HashFileContents(source.path, pThreadPool);
+    }
+
+    header.vertexStride = mesh.vbStride;
+    header.indexFormat = mesh.ibFormat;
+    memcpy(header.bounds, mesh.bounds, sizeof(header.bounds));
+    header.quantizationOffset[0] = mesh.positionQuantization.offset.x;
+    header.quantizationOffset[1] = mesh.positionQuantization.offset.y;
+    header.quantizationOffset[2] = mesh.positionQuantization.offset.z;
+    header.quantizationScale[0] = mesh.positionQuantization.scale.x;
+    header.quantizationScale[1] = mesh.positionQuantization.scale.y;
+    header.quantizationScale[2] = mesh.positionQuantization.scale.z;
+
+    std::string names;
+    std::vector<CachedDraw> cachedDraws;
+    std::vector<CachedChunk> cachedChunks;
+    std::vector<CachedLod> cachedLods;
+
+    for (DrawRegistry::Handle drawHandle : drawHandles)
+    {
+        const std::string& drawName = draws.GetName(drawHandle);
+        const Mesh::Draw& draw = *draws.Get(drawHandle);
+
+        CachedDraw cachedDraw = {};
+        cachedDraw.nameOffset = static_cast<uint32_t>(names.size());
+        cachedDraw.nameLength = static_cast<uint32_t>(drawName.size());
+        cachedDraw.indexCount = draw.indexCount;
+        cachedDraw.startIndex = draw.startIndex;
+        cachedDraw.baseVertex = draw.baseVertex;
+        CookLods(draw.lods, cachedLods, cachedDraw.firstLod, cachedDraw.lodCount);
+
+        cachedDraw.firstChunk = static_cast<uint32_t>(cachedChunks.size());
+        cachedDraw.chunkCount = static_cast<uint32_t>(draw.chunks.size());
+        for (const Mesh::Draw::Chunk& chunk : draw.chunks)
+        {
+            CachedChunk cachedChunk = {};
+            cachedChunk.indexCount = chunk.indexCount;
+            cachedChunk.startIndex = chunk.startIndex;
+            cachedChunk.baseVertex = chunk.baseVertex;
+            memcpy(cachedChunk.bounds, chunk.bounds, sizeof(cachedChunk.bounds));
+            CookLods(chunk.lods, cachedLods, cachedChunk.firstLod, cachedChunk.lodCount);
+            cachedChunks.push_back(cachedChunk);
+        }
+
+        names += drawName;
+        cachedDraws.push_back(cachedDraw);
+    }
+
+    uint64_t offset = sizeof(CacheHeader);
+    auto place = [&offset](CacheSection& section, uint64_t size, uint64_t alignment)
+    {
+        offset = AlignUp(offset, alignment);
+        section.offset = offset;
+        section.size = size;
+        offset += size;
+    };
+
+    place(header.names, names.size(), RecordAlignment);
+    place(header.draws, cachedDraws.size() * sizeof(CachedDraw), RecordAlignment);
+    place(header.chunks, cachedChunks.size() * sizeof(CachedChunk), RecordAlignment);
+    place(header.lods, cachedLods.size() * sizeof(CachedLod), RecordAlignment);
+    place(header.meshlets, mesh.meshlets.size() * sizeof(Meshlet), RecordAlignment);
+    place(header.vertices, mesh.vbSize, StreamAlignment);
+    place(header.depthVertices, mesh.vbDepthSize, StreamAlignment);
+    place(header.indices, mesh.ibSize, StreamAlignment);
+
+    // Everything before the vertex stream, padding included, goes out in one write
+    std::vector<uint8_t> records(static_cast<size_t>(header.vertices.offset), 0);
+    memcpy(records.data(), &header, sizeof(header));
+    memcpy(records.data() + header.names.offset, names.data(), names.size());
+    memcpy(records.data() + header.draws.offset, cachedDraws.data(), header.draws.size);
+    memcpy(records.data() + header.chunks.offset, cachedChunks.data(), header.chunks.size);
+    memcpy(records.data() + header.lods.offset, cachedLods.data(), header.lods.size);
+    memcpy(records.data() + header.meshlets.offset, mesh.meshlets.data(), header.meshlets.size);
+
+    // The position only stream lives on the GPU, it is rebuilt from the vertices
+    const uint32_t vertexCount = mesh.vbSize / mesh.vbStride;
+    std::vector<uint8_t> depthVertices(static_cast<size_t>(vertexCount) * Mesh::DepthVertexStride);
+    Mesh::CopyDepthVertices(mesh.vertexBufferCPU.data(), mesh.vbStride, vertexCount, depthVertices.data());
+
+    const std::vector<uint8_t> padding(StreamAlignment, 0);
+    const uint64_t depthPadding = header.depthVertices.offset - (header.vertices.offset + header.vertices.size);
+    const uint64_t indexPadding = header.indices.offset - (header.depthVertices.offset + header.depthVertices.size);
+
+    // Written aside and renamed over the old cache, a reader never maps a half written file
+    const std::filesystem::path tempPath = path + L".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    bool saved = file.is_open();
+    if (saved)
+    {
+        saved =
+            WriteAll(file, records.data(), records.size()) &&
+            WriteAll(file, mesh.vertexBufferCPU.data(), mesh.vbSize) &&
+            WriteAll(file, padding.data(), depthPadding) &&
+            WriteAll(file, depthVertices.data(), depthVertices.size()) &&
+            WriteAll(file, padding.data(), indexPadding) &&
+            WriteAll(file, mesh.indexBufferCPU.data(), mesh.ibSize);
+        file.close();
+        saved = saved && !file.fail();
+
+        std::error_code error;
+        if (saved)
+        {
+            std::filesystem::rename(tempPath, path, error);
+            saved = !error;
+        }
+        if (!saved)
+        {
+            std::filesystem::remove(tempPath, error);
+        }
+    }
+
+    if (!saved)
+    {
+        char report[512];
+        sprintf_s(report, "Mesh cache %ls: couldn't be written\n", path.c_str());
+        OutputDebugStringA(report);
+    }
+
+    return saved;
+}
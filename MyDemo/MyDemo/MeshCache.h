@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Mesh.h"
+
+/*
+    Cooked meshes: one file holds a Mesh with its bounds, meshlets and draws, LODs and chunks included.
+    The vertex, position only and index streams start on page boundaries, loading maps the file and copies them
+    straight into upload heap staging memory, nothing is parsed or rebuilt and no CPU copy is kept.
+
+    A cache remembers what it was cooked from: a hash of the cooker settings and, for a source file,
+    a hash of its contents. The file size and write time are stored too so an untouched source
+    isn't read again, only a source that looks modified is hashed and compared.
+*/
+
+// What a mesh is cooked from, a cache cooked from anything else is stale
+struct MeshSource
+{
+    std::wstring path;              // Source file, empty for generated meshes
+    uint64_t settingsHash = 0;      // Cooker version and settings, or the parameters of a generated mesh
+};
+
+// 64 bit hash of a few settings, chain calls through seed
+uint64_t HashMeshSettings(const void* pData, size_t byteSize, uint64_t seed = 0);
+
+/*
+    Maps path and queues the mesh as name, Mesh::uploadToken is set once the caller submits the batch.
+    The draws are added under the names they were cooked with, drawHandles receives them.
+    Returns false without adding anything when the cache is missing, damaged or stale.
+*/
+bool LoadMeshCache(
+    const std::wstring& path,
+    const MeshSource& source,
+    const std::string& name,
+    GeometryBufferPool* pool,
+    UploadBatcher* uploader,
+    ThreadPool* pThreadPool,
+    MeshRegistry& geometries,
+    DrawRegistry& draws,
+    std::vector<DrawRegistry::Handle>& drawHandles);
+
+/*
+    Cooks mesh and the draws in drawHandles into path, under their names. The CPU copies of the buffers must still be there.
+    The file is written under a temporary name and renamed, a cache is never left half written.
+    Returns false when it couldn't be written, the mesh can still be used.
+*/
+bool SaveMeshCache(
+    const std::wstring& path,
+    const MeshSource& source,
+    const Mesh& mesh,
+    const std::vector<DrawRegistry::Handle>& drawHandles,
+    const DrawRegistry& draws,
+    ThreadPool* pThreadPool);
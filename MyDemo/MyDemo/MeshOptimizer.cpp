@@ -0,0 +1,390 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t InvalidIndex = UINT32_MAX;
+
+    /*
+        FIFO cache emulated with time stamps: a vertex is cached when fewer than cacheSize
+        vertices have been added since it was. Reset() makes every vertex a miss again.
+    */
+    class CacheSimulator
+    {
+    public:
+        CacheSimulator(uint32_t vertexCount, uint32_t cacheSize) :
+            m_timeStamps(vertexCount, 0),
+            m_cacheSize(cacheSize),
+            m_time(cacheSize + 1)
+        {
+        }
+
+        // Returns true on a miss
+        bool Access(uint32_t vertex)
+        {
+            if (m_time - m_timeStamps[vertex] > m_cacheSize)
+            {
+                m_timeStamps[vertex] = m_time++;
+                return true;
+            }
+
+            return false;
+        }
+
+        void Reset()
+        {
+            m_time += m_cacheSize + 1;
+        }
+
+    private:
+        std::vector<uint32_t> m_timeStamps;
+        uint32_t m_cacheSize;
+        uint32_t m_time;
+    };
+
+    const float* GetPosition(const void* pPositions, size_t positionStride, uint32_t vertex)
+    {
+        return reinterpret_cast<const float*>(static_cast<const uint8_t*>(pPositions) + vertex * positionStride);
+    }
+}
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    stats.triangleCount = indexCount / 3;
+
+    CacheSimulator cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        const uint32_t vertex = pIndices[i];
+
+        stats.missCount += cache.Access(vertex) ? 1 : 0;
+
+        if (!referenced[vertex])
+        {
+            referenced[vertex] = true;
+            stats.vertexCount++;
+        }
+    }
+
+    return stats;
+}
+
+void OptimizeVertexCache(uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>* pClusters)
+{
+    const size_t triangleCount = indexCount / 3;
+
+    if (pClusters != nullptr)
+    {
+        pClusters->assign(1, 0);
+    }
+
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Triangles not yet emitted per vertex, and the vertex -> triangle adjacency packed per vertex
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        liveCount[pIndices[i]]++;
+    }
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCount[v];
+    }
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+        {
+            adjacency[fill[pIndices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<uint32_t> timeStamps(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    deadEnds.reserve(triangleCount * 3);
+    result.reserve(triangleCount * 3);
+
+    uint32_t time = cacheSize + 1;
+    uint32_t scanCursor = 0;
+
+    uint32_t fanVertex = pIndices[0];
+    while (fanVertex != InvalidIndex)
+    {
+        // Emit every remaining triangle around the fan vertex
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fanVertex]; a < adjacencyOffsets[fanVertex + 1]; ++a)
+        {
+            const uint32_t triangle = adjacency[a];
+            if (emitted[triangle])
+            {
+                continue;
+            }
+
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                const uint32_t vertex = pIndices[triangle * 3 + corner];
+
+                result.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveCount[vertex]--;
+
+                if (time - timeStamps[vertex] > cacheSize)
+                {
+                    timeStamps[vertex] = time++;
+                }
+            }
+
+            emitted[triangle] = true;
+        }
+
+        // Next fan: the oldest candidate that is still cached once its own triangles have been emitted
+        uint32_t nextVertex = InvalidIndex;
+        uint32_t bestPriority = 0;
+        for (uint32_t vertex : candidates)
+        {
+            if (liveCount[vertex] == 0)
+            {
+                continue;
+            }
+
+            uint32_t priority = 0;
+            if (time - timeStamps[vertex] + 2 * liveCount[vertex] <= cacheSize)
+            {
+                priority = time - timeStamps[vertex];
+            }
+
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                nextVertex = vertex;
+            }
+        }
+
+        // Dead end, continue from a recently used vertex or failing that the next one in index order
+        if (nextVertex == InvalidIndex)
+        {
+            while (!deadEnds.empty() && nextVertex == InvalidIndex)
+            {
+                const uint32_t vertex = deadEnds.back();
+                deadEnds.pop_back();
+
+                if (liveCount[vertex] > 0)
+                {
+                    nextVertex = vertex;
+                }
+            }
+
+            while (scanCursor < vertexCount && nextVertex == InvalidIndex)
+            {
+                if (liveCount[scanCursor] > 0)
+                {
+                    nextVertex = scanCursor;
+                }
+                else
+                {
+                    ++scanCursor;
+                }
+            }
+
+            const uint32_t firstTriangle = static_cast<uint32_t>(result.size() / 3);
+            if (nextVertex != InvalidIndex && pClusters != nullptr && pClusters->back() != firstTriangle)
+            {
+                pClusters->push_back(firstTriangle);
+            }
+        }
+
+        fanVertex = nextVertex;
+    }
+
+    std::copy(result.begin(), result.end(), pIndices);
+}
+
+void OptimizeOverdraw(
+    uint32_t* pIndices, size_t indexCount,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    const std::vector<uint32_t>& clusters,
+    float threshold,
+    uint32_t cacheSize)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+    if (triangleCount == 0 || clusters.empty())
+    {
+        return;
+    }
+
+    CacheSimulator cache(vertexCount, cacheSize);
+
+    // Split the clusters where the part so far is nearly as cache friendly as the whole cluster
+    std::vector<uint32_t> splitClusters;
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        const uint32_t first = clusters[c];
+        const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        cache.Reset();
+        uint32_t clusterMisses = 0;
+        for (uint32_t i = first * 3; i < end * 3; ++i)
+        {
+            clusterMisses += cache.Access(pIndices[i]) ? 1 : 0;
+        }
+
+        const float maxAcmr = threshold * clusterMisses / (end - first);
+
+        cache.Reset();
+        splitClusters.push_back(first);
+
+        uint32_t misses = 0;
+        uint32_t triangles = 0;
+        for (uint32_t t = first; t < end; ++t)
+        {
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                misses += cache.Access(pIndices[t * 3 + corner]) ? 1 : 0;
+            }
+            ++triangles;
+
+            if (t + 1 < end && misses <= maxAcmr * triangles)
+            {
+                splitClusters.push_back(t + 1);
+                cache.Reset();
+                misses = 0;
+                triangles = 0;
+            }
+        }
+    }
+
+    // Area weighted centroid and normal per cluster
+    const size_t clusterCount = splitClusters.size();
+    std::vector<XMFLOAT3> centroids(clusterCount);
+    std::vector<XMFLOAT3> normals(clusterCount);
+    std::vector<float> areas(clusterCount);
+
+    XMFLOAT3 meshCentroid(0.f, 0.f, 0.f);
+    float meshArea = 0.f;
+
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        const uint32_t first = splitClusters[c];
+        const uint32_t end = c + 1 < clusterCount ? splitClusters[c + 1] : triangleCount;
+
+        XMFLOAT3 centroid(0.f, 0.f, 0.f);
+        XMFLOAT3 normal(0.f, 0.f, 0.f);
+        float area = 0.f;
+
+        for (uint32_t t = first; t < end; ++t)
+        {
+            const float* p0 = GetPosition(pPositions, positionStride, pIndices[t * 3 + 0]);
+            const float* p1 = GetPosition(pPositions, positionStride, pIndices[t * 3 + 1]);
+            const float* p2 = GetPosition(pPositions, positionStride, pIndices[t * 3 + 2]);
+
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+            // Twice the area, the scale cancels out
+            const float nx = e1[1] * e2[2] - e1[2] * e2[1];
+            const float ny = e1[2] * e2[0] - e1[0] * e2[2];
+            const float nz = e1[0] * e2[1] - e1[1] * e2[0];
+            const float triangleArea = sqrtf(nx * nx + ny * ny + nz * nz);
+
+            normal.x += nx;
+            normal.y += ny;
+            normal.z += nz;
+
+            centroid.x += triangleArea * (p0[0] + p1[0] + p2[0]) / 3.f;
+            centroid.y += triangleArea * (p0[1] + p1[1] + p2[1]) / 3.f;
+            centroid.z += triangleArea * (p0[2] + p1[2] + p2[2]) / 3.f;
+            area += triangleArea;
+        }
+
+        meshCentroid.x += centroid.x;
+        meshCentroid.y += centroid.y;
+        meshCentroid.z += centroid.z;
+        meshArea += area;
+
+        const float invArea = area > 0.f ? 1.f / area : 0.f;
+        centroids[c] = XMFLOAT3(centroid.x * invArea, centroid.y * invArea, centroid.z * invArea);
+
+        const float normalLength = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+        const float invNormalLength = normalLength > 0.f ? 1.f / normalLength : 0.f;
+        normals[c] = XMFLOAT3(normal.x * invNormalLength, normal.y * invNormalLength, normal.z * invNormalLength);
+        areas[c] = area;
+    }
+
+    const float invMeshArea = meshArea > 0.f ? 1.f / meshArea : 0.f;
+    meshCentroid = XMFLOAT3(meshCentroid.x * invMeshArea, meshCentroid.y * invMeshArea, meshCentroid.z * invMeshArea);
+
+    // Clusters far out along their own normal occlude the rest, draw them first
+    std::vector<float> sortKeys(clusterCount);
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        sortKeys[c] =
+            (centroids[c].x - meshCentroid.x) * normals[c].x +
+            (centroids[c].y - meshCentroid.y) * normals[c].y +
+            (centroids[c].z - meshCentroid.z) * normals[c].z;
+        order[c] = static_cast<uint32_t>(c);
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    for (uint32_t c : order)
+    {
+        const uint32_t first = splitClusters[c];
+        const uint32_t end = c + 1 < clusterCount ? splitClusters[c + 1] : triangleCount;
+
+        result.insert(result.end(), pIndices + first * 3, pIndices + end * 3);
+    }
+
+    std::copy(result.begin(), result.end(), pIndices);
+}
+
+uint32_t OptimizeVertexFetch(void* pVertices, size_t vertexStride, uint32_t vertexCount, uint32_t* pIndices, size_t indexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, InvalidIndex);
+    uint32_t nextVertex = 0;
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t& newIndex = remap[pIndices[i]];
+        if (newIndex == InvalidIndex)
+        {
+            newIndex = nextVertex++;
+        }
+
+        pIndices[i] = newIndex;
+    }
+
+    uint8_t* pData = static_cast<uint8_t*>(pVertices);
+    const std::vector<uint8_t> source(pData, pData + vertexCount * vertexStride);
+
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        if (remap[v] != InvalidIndex)
+        {
+            memcpy(pData + remap[v] * vertexStride, source.data() + v * vertexStride, vertexStride);
+        }
+    }
+
+    return nextVertex;
+}
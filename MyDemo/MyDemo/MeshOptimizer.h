@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Post-transform cache size the optimizer plans for and the stats are measured with
+const uint32_t DefaultVertexCacheSize = 16;
+
+/*
+    Vertex shader invocations of an index list on a FIFO post-transform cache.
+    ACMR is misses per triangle (0.5 is ideal for a regular grid, 3 is no reuse at all),
+    ATVR is misses per referenced vertex (1 is ideal). Stats of separate draws can be added up.
+*/
+struct VertexCacheStats
+{
+    uint64_t triangleCount = 0;
+    uint64_t vertexCount = 0;      // distinct vertices referenced
+    uint64_t missCount = 0;
+
+    float Acmr() const { return triangleCount > 0 ? static_cast<float>(missCount) / triangleCount : 0.f; }
+    float Atvr() const { return vertexCount > 0 ? static_cast<float>(missCount) / vertexCount : 0.f; }
+
+    VertexCacheStats& operator+=(const VertexCacheStats& other)
+    {
+        triangleCount += other.triangleCount;
+        vertexCount += other.vertexCount;
+        missCount += other.missCount;
+        return *this;
+    }
+};
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = DefaultVertexCacheSize);
+
+/*
+    Reorders the triangles of a triangle list for the post-transform cache (Tipsify, Sander et al. 2007).
+    Runs in linear time. pClusters, when given, receives the first triangle of every run
+    that starts with a cold cache, OptimizeOverdraw only moves whole runs.
+*/
+void OptimizeVertexCache(uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = DefaultVertexCacheSize, std::vector<uint32_t>* pClusters = nullptr);
+
+/*
+    Reorders clusters of a cache optimized triangle list so that outward facing clusters are drawn first,
+    which lets early depth reject more of what is behind them from any view point.
+    Clusters are split further where that costs at most threshold times the ACMR of the cluster.
+    pPositions points at the float3 position of vertex 0, vertices are positionStride bytes apart.
+*/
+void OptimizeOverdraw(
+    uint32_t* pIndices, size_t indexCount,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    const std::vector<uint32_t>& clusters,
+    float threshold = 1.05f,
+    uint32_t cacheSize = DefaultVertexCacheSize);
+
+/*
+    Moves the vertices into the order the indices first use them, so vertex fetch reads memory front to back,
+    and rewrites the indices to match. Unreferenced vertices are dropped, returns the new vertex count.
+*/
+uint32_t OptimizeVertexFetch(void* pVertices, size_t vertexStride, uint32_t vertexCount, uint32_t* pIndices, size_t indexCount);
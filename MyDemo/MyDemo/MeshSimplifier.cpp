@@ -0,0 +1,394 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <queue>
+
+using namespace DirectX;
+
+namespace
+{
+    // Sum of squared distances to a set of planes, the symmetric 4x4 matrix of Garland and Heckbert
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0;
+        double b2 = 0, bc = 0, bd = 0;
+        double c2 = 0, cd = 0;
+        double d2 = 0;
+        double weight = 0;      // number of planes
+
+        void AddPlane(double a, double b, double c, double d)
+        {
+            a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+            b2 += b * b; bc += b * c; bd += b * d;
+            c2 += c * c; cd += c * d;
+            d2 += d * d;
+            weight += 1;
+        }
+
+        void Add(const Quadric& other)
+        {
+            a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+            b2 += other.b2; bc += other.bc; bd += other.bd;
+            c2 += other.c2; cd += other.cd;
+            d2 += other.d2;
+            weight += other.weight;
+        }
+
+        // Mean squared distance of p to the planes
+        float Evaluate(const XMFLOAT3& p) const
+        {
+            const double x = p.x, y = p.y, z = p.z;
+            const double sum =
+                a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+                b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+                c2 * z * z + 2 * cd * z +
+                d2;
+
+            return weight > 0 ? static_cast<float>(MathHelper::Max(sum, 0.0) / weight) : 0.f;
+        }
+    };
+
+    struct Collapse
+    {
+        float cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+    {
+        const float e1x = b.x - a.x, e1y = b.y - a.y, e1z = b.z - a.z;
+        const float e2x = c.x - a.x, e2y = c.y - a.y, e2z = c.z - a.z;
+
+        return XMFLOAT3(e1y * e2z - e1z * e2y, e1z * e2x - e1x * e2z, e1x * e2y - e1y * e2x);
+    }
+
+    class Simplifier
+    {
+    public:
+        Simplifier(const uint32_t* pIndices, size_t indexCount, const void* pPositions, size_t positionStride, uint32_t vertexCount) :
+            m_triangles(pIndices, pIndices + indexCount / 3 * 3),
+            m_triangleAlive(indexCount / 3, true),
+            m_liveTriangleCount(indexCount / 3),
+            m_positions(vertexCount),
+            m_quadrics(vertexCount),
+            m_vertexTriangles(vertexCount),
+            m_locked(vertexCount, false),
+            m_removed(vertexCount, false),
+            m_versions(vertexCount, 0)
+        {
+            for (uint32_t v = 0; v < vertexCount; ++v)
+            {
+                const float* p = reinterpret_cast<const float*>(static_cast<const uint8_t*>(pPositions) + v * positionStride);
+                m_positions[v] = XMFLOAT3(p[0], p[1], p[2]);
+            }
+
+            for (uint32_t t = 0; t < m_triangleAlive.size(); ++t)
+            {
+                const uint32_t* pTriangle = &m_triangles[t * 3];
+                const XMFLOAT3 normal = Cross(m_positions[pTriangle[0]], m_positions[pTriangle[1]], m_positions[pTriangle[2]]);
+                const double length = sqrt(double(normal.x) * normal.x + double(normal.y) * normal.y + double(normal.z) * normal.z);
+
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    m_vertexTriangles[pTriangle[corner]].push_back(t);
+                }
+
+                if (length > 0)
+                {
+                    const double a = normal.x / length;
+                    const double b = normal.y / length;
+                    const double c = normal.z / length;
+                    const XMFLOAT3& p = m_positions[pTriangle[0]];
+                    const double d = -(a * p.x + b * p.y + c * p.z);
+
+                    for (uint32_t corner = 0; corner < 3; ++corner)
+                    {
+                        m_quadrics[pTriangle[corner]].AddPlane(a, b, c, d);
+                    }
+                }
+            }
+
+            LockBorders();
+
+            for (uint32_t t = 0; t < m_triangleAlive.size(); ++t)
+            {
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    PushCollapse(m_triangles[t * 3 + corner], m_triangles[t * 3 + (corner + 1) % 3]);
+                    PushCollapse(m_triangles[t * 3 + (corner + 1) % 3], m_triangles[t * 3 + corner]);
+                }
+            }
+        }
+
+        float Run(size_t targetIndexCount, float maxError, std::vector<uint32_t>& result)
+        {
+            const float maxCost = maxError * maxError;
+            float worstCost = 0.f;
+
+            while (m_liveTriangleCount * 3 > targetIndexCount && !m_queue.empty())
+            {
+                const Collapse collapse = m_queue.top();
+                m_queue.pop();
+
+                if (collapse.cost > maxCost)
+                {
+                    break;
+                }
+
+                // Superseded by a collapse pushed after one of the vertices changed
+                if (m_removed[collapse.from] || m_removed[collapse.to] ||
+                    m_versions[collapse.from] != collapse.fromVersion || m_versions[collapse.to] != collapse.toVersion)
+                {
+                    continue;
+                }
+
+                if (!IsAdjacent(collapse.from, collapse.to) || FlipsTriangle(collapse.from, collapse.to))
+                {
+                    continue;
+                }
+
+                Apply(collapse.from, collapse.to);
+                worstCost = MathHelper::Max(worstCost, collapse.cost);
+            }
+
+            result.clear();
+            result.reserve(m_liveTriangleCount * 3);
+            for (uint32_t t = 0; t < m_triangleAlive.size(); ++t)
+            {
+                if (m_triangleAlive[t])
+                {
+                    result.insert(result.end(), &m_triangles[t * 3], &m_triangles[t * 3] + 3);
+                }
+            }
+
+            return sqrtf(worstCost);
+        }
+
+    private:
+        // An edge used by one triangle is on an open border
+        void LockBorders()
+        {
+            std::vector<uint64_t> edges;
+            edges.reserve(m_triangles.size());
+            for (size_t i = 0; i < m_triangles.size(); i += 3)
+            {
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    const uint64_t a = m_triangles[i + corner];
+                    const uint64_t b = m_triangles[i + (corner + 1) % 3];
+                    edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+                }
+            }
+
+            std::sort(edges.begin(), edges.end());
+
+            for (size_t i = 0; i < edges.size();)
+            {
+                size_t end = i + 1;
+                while (end < edges.size() && edges[end] == edges[i])
+                {
+                    ++end;
+                }
+
+                if (end - i == 1)
+                {
+                    m_locked[static_cast<uint32_t>(edges[i] >> 32)] = true;
+                    m_locked[static_cast<uint32_t>(edges[i])] = true;
+                }
+
+                i = end;
+            }
+        }
+
+        void PushCollapse(uint32_t from, uint32_t to)
+        {
+            if (from == to || m_locked[from])
+            {
+                return;
+            }
+
+            // Moving from onto to only adds the distance of to's position to the planes around from
+            m_queue.push({ m_quadrics[from].Evaluate(m_positions[to]), from, to, m_versions[from], m_versions[to] });
+        }
+
+        bool IsAdjacent(uint32_t from, uint32_t to) const
+        {
+            for (uint32_t t : m_vertexTriangles[from])
+            {
+                const uint32_t* pTriangle = &m_triangles[t * 3];
+                if (m_triangleAlive[t] && (pTriangle[0] == to || pTriangle[1] == to || pTriangle[2] == to))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // The triangles that survive the collapse must keep facing the same way
+        bool FlipsTriangle(uint32_t from, uint32_t to) const
+        {
+            for (uint32_t t : m_vertexTriangles[from])
+            {
+                const uint32_t* pTriangle = &m_triangles[t * 3];
+                if (!m_triangleAlive[t] || pTriangle[0] == to || pTriangle[1] == to || pTriangle[2] == to)
+                {
+                    continue;
+                }
+
+                XMFLOAT3 p[3];
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    p[corner] = m_positions[pTriangle[corner]];
+                }
+
+                const XMFLOAT3 before = Cross(p[0], p[1], p[2]);
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    if (pTriangle[corner] == from)
+                    {
+                        p[corner] = m_positions[to];
+                    }
+                }
+                const XMFLOAT3 after = Cross(p[0], p[1], p[2]);
+
+                if (before.x * after.x + before.y * after.y + before.z * after.z <= 0.f)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void Apply(uint32_t from, uint32_t to)
+        {
+            m_quadrics[to].Add(m_quadrics[from]);
+            m_removed[from] = true;
+            m_versions[to]++;
+
+            std::vector<uint32_t>& toTriangles = m_vertexTriangles[to];
+            for (uint32_t t : m_vertexTriangles[from])
+            {
+                if (!m_triangleAlive[t])
+                {
+                    continue;
+                }
+
+                uint32_t* pTriangle = &m_triangles[t * 3];
+                if (pTriangle[0] == to || pTriangle[1] == to || pTriangle[2] == to)
+                {
+                    m_triangleAlive[t] = false;
+                    m_liveTriangleCount--;
+                    continue;
+                }
+
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    if (pTriangle[corner] == from)
+                    {
+                        pTriangle[corner] = to;
+                    }
+                }
+                toTriangles.push_back(t);
+            }
+            m_vertexTriangles[from].clear();
+
+            // Drop the dead triangles so the lists don't grow without bound
+            toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(),
+                [this](uint32_t t) { return !m_triangleAlive[t]; }), toTriangles.end());
+
+            // The collapses out of to have a new quadric, the ones into it a new neighbourhood
+            for (uint32_t t : toTriangles)
+            {
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    const uint32_t neighbour = m_triangles[t * 3 + corner];
+                    PushCollapse(to, neighbour);
+                    PushCollapse(neighbour, to);
+                }
+            }
+        }
+
+        std::vector<uint32_t> m_triangles;
+        std::vector<bool> m_triangleAlive;
+        size_t m_liveTriangleCount;
+
+        std::vector<XMFLOAT3> m_positions;
+        std::vector<Quadric> m_quadrics;
+        std::vector<std::vector<uint32_t>> m_vertexTriangles;
+        std::vector<bool> m_locked;
+        std::vector<bool> m_removed;
+        std::vector<uint32_t> m_versions;
+
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_queue;
+    };
+}
+
+float SimplifyMesh(
+    const uint32_t* pIndices, size_t indexCount,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    size_t targetIndexCount, float maxError,
+    std::vector<uint32_t>& result)
+{
+    Simplifier simplifier(pIndices, indexCount, pPositions, positionStride, vertexCount);
+    return simplifier.Run(targetIndexCount, maxError, result);
+}
+
+void BuildLodChain(
+    const uint32_t* pIndices, size_t indexCount,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    uint32_t maxLevels,
+    std::vector<LodLevel>& levels)
+{
+    // Below this a level saves less than it costs to switch to it
+    const size_t MinIndexCount = 3 * 32;
+
+    // Past this part of the mesh size a level has lost its shape, it would only be picked when the mesh is a few pixels anyway
+    const float MaxRelativeError = 0.05f;
+
+    levels.clear();
+
+    XMFLOAT3 minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+    XMFLOAT3 maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        const float* p = reinterpret_cast<const float*>(static_cast<const uint8_t*>(pPositions) + pIndices[i] * positionStride);
+        minimum = XMFLOAT3(MathHelper::Min(minimum.x, p[0]), MathHelper::Min(minimum.y, p[1]), MathHelper::Min(minimum.z, p[2]));
+        maximum = XMFLOAT3(MathHelper::Max(maximum.x, p[0]), MathHelper::Max(maximum.y, p[1]), MathHelper::Max(maximum.z, p[2]));
+    }
+
+    const float extentX = maximum.x - minimum.x;
+    const float extentY = maximum.y - minimum.y;
+    const float extentZ = maximum.z - minimum.z;
+    const float maxError = MaxRelativeError * sqrtf(extentX * extentX + extentY * extentY + extentZ * extentZ);
+
+    const uint32_t* pSource = pIndices;
+    size_t sourceCount = indexCount;
+    float sourceError = 0.f;
+
+    while (levels.size() < maxLevels && sourceCount > MinIndexCount)
+    {
+        LodLevel level;
+        const size_t targetCount = sourceCount / 6 * 3;
+        const float error = SimplifyMesh(pSource, sourceCount, pPositions, positionStride, vertexCount, targetCount, maxError - sourceError, level.indices);
+
+        if (level.indices.size() * 4 > sourceCount * 3)
+        {
+            break;
+        }
+
+        // Errors of simplifying a simplified mesh add up at most
+        level.error = sourceError + error;
+        levels.push_back(std::move(level));
+
+        pSource = levels.back().indices.data();
+        sourceCount = levels.back().indices.size();
+        sourceError = levels.back().error;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+    Edge collapse simplification with quadric error metrics (Garland and Heckbert 1997).
+    Collapses move a vertex onto a neighbour, so the result only indexes the input vertices
+    and can share the vertex buffer of the full mesh. Vertices on open borders never move,
+    meshes drawn in chunks stay crack free whatever level each chunk uses.
+
+    Collapses go cheapest first until the result has at most targetIndexCount indices
+    or the next collapse would be above maxError. Collapses that would flip a triangle are skipped.
+    Returns the error of the result, about the largest distance it moved from the input surface.
+*/
+float SimplifyMesh(
+    const uint32_t* pIndices, size_t indexCount,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    size_t targetIndexCount, float maxError,
+    std::vector<uint32_t>& result);
+
+struct LodLevel
+{
+    std::vector<uint32_t> indices;
+    float error = 0.f;      // against the full mesh, in mesh units
+};
+
+/*
+    Halves the triangle count level by level, up to maxLevels coarser levels.
+    Stops early once a level can't get rid of at least a quarter of the triangles
+    without its error passing 5% of the mesh size.
+*/
+void BuildLodChain(
+    const uint32_t* pIndices, size_t indexCount,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    uint32_t maxLevels,
+    std::vector<LodLevel>& levels);
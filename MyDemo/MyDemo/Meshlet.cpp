@@ -0,0 +1,246 @@
+#include "pch.h"
+#include "Meshlet.h"
+
+namespace
+{
+    const uint32_t InvalidSlot = UINT32_MAX;
+
+    XMFLOAT3 GetPosition(const void* pPositions, size_t positionStride, uint32_t vertex)
+    {
+        const float* p = reinterpret_cast<const float*>(static_cast<const uint8_t*>(pPositions) + vertex * positionStride);
+        return XMFLOAT3(p[0], p[1], p[2]);
+    }
+
+    // Unit front face normal, false for a degenerate triangle
+    bool GetTriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2, XMFLOAT3& normal)
+    {
+        const float e1x = p1.x - p0.x, e1y = p1.y - p0.y, e1z = p1.z - p0.z;
+        const float e2x = p2.x - p0.x, e2y = p2.y - p0.y, e2z = p2.z - p0.z;
+
+        const float nx = e1y * e2z - e1z * e2y;
+        const float ny = e1z * e2x - e1x * e2z;
+        const float nz = e1x * e2y - e1y * e2x;
+        const float length = sqrtf(nx * nx + ny * ny + nz * nz);
+
+        if (length <= 0.f)
+        {
+            return false;
+        }
+
+        normal = XMFLOAT3(nx / length, ny / length, nz / length);
+        return true;
+    }
+
+    // Sphere and normal cone of the triangles [first, end) of pIndices
+    void ComputeMeshletBounds(
+        const uint32_t* pIndices, size_t first, size_t end,
+        const void* pPositions, size_t positionStride,
+        Meshlet& meshlet)
+    {
+        XMFLOAT3 minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+        XMFLOAT3 maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (size_t i = first * 3; i < end * 3; ++i)
+        {
+            const XMFLOAT3 p = GetPosition(pPositions, positionStride, pIndices[i]);
+            minimum = XMFLOAT3(MathHelper::Min(minimum.x, p.x), MathHelper::Min(minimum.y, p.y), MathHelper::Min(minimum.z, p.z));
+            maximum = XMFLOAT3(MathHelper::Max(maximum.x, p.x), MathHelper::Max(maximum.y, p.y), MathHelper::Max(maximum.z, p.z));
+        }
+
+        meshlet.center = XMFLOAT3(0.5f * (minimum.x + maximum.x), 0.5f * (minimum.y + maximum.y), 0.5f * (minimum.z + maximum.z));
+
+        float radiusSq = 0.f;
+        for (size_t i = first * 3; i < end * 3; ++i)
+        {
+            const XMFLOAT3 p = GetPosition(pPositions, positionStride, pIndices[i]);
+            const float dx = p.x - meshlet.center.x;
+            const float dy = p.y - meshlet.center.y;
+            const float dz = p.z - meshlet.center.z;
+            radiusSq = MathHelper::Max(radiusSq, dx * dx + dy * dy + dz * dz);
+        }
+        meshlet.radius = sqrtf(radiusSq);
+
+        // The axis is the mean normal, the cone has to open up to the normal furthest from it
+        XMFLOAT3 axis(0.f, 0.f, 0.f);
+        for (size_t t = first; t < end; ++t)
+        {
+            XMFLOAT3 normal;
+            if (GetTriangleNormal(
+                GetPosition(pPositions, positionStride, pIndices[t * 3 + 0]),
+                GetPosition(pPositions, positionStride, pIndices[t * 3 + 1]),
+                GetPosition(pPositions, positionStride, pIndices[t * 3 + 2]),
+                normal))
+            {
+                axis.x += normal.x;
+                axis.y += normal.y;
+                axis.z += normal.z;
+            }
+        }
+
+        const float axisLength = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+        if (axisLength <= 0.f)
+        {
+            meshlet.coneAxis = XMFLOAT3(0.f, 1.f, 0.f);
+            meshlet.coneCutoff = 1.f;
+            return;
+        }
+
+        meshlet.coneAxis = XMFLOAT3(axis.x / axisLength, axis.y / axisLength, axis.z / axisLength);
+
+        float minDot = 1.f;
+        for (size_t t = first; t < end; ++t)
+        {
+            XMFLOAT3 normal;
+            if (GetTriangleNormal(
+                GetPosition(pPositions, positionStride, pIndices[t * 3 + 0]),
+                GetPosition(pPositions, positionStride, pIndices[t * 3 + 1]),
+                GetPosition(pPositions, positionStride, pIndices[t * 3 + 2]),
+                normal))
+            {
+                minDot = MathHelper::Min(minDot, normal.x * meshlet.coneAxis.x + normal.y * meshlet.coneAxis.y + normal.z * meshlet.coneAxis.z);
+            }
+        }
+
+        // Wider than a half space, some triangle always faces the camera
+        meshlet.coneCutoff = minDot <= 0.f ? 1.f : sqrtf(1.f - minDot * minDot);
+    }
+}
+
+void BuildMeshlets(
+    const uint32_t* pIndices, size_t indexCount, uint32_t startIndex,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    std::vector<Meshlet>& meshlets,
+    uint32_t maxVertices,
+    uint32_t maxTriangles)
+{
+    const size_t triangleCount = indexCount / 3;
+
+    // Which meshlet last used a vertex, so a vertex is counted once per meshlet
+    std::vector<uint32_t> lastMeshlet(vertexCount, InvalidSlot);
+
+    size_t first = 0;
+    uint32_t meshletVertexCount = 0;
+    uint32_t meshletId = static_cast<uint32_t>(meshlets.size());
+
+    for (size_t t = 0; t <= triangleCount; ++t)
+    {
+        uint32_t newVertices = 0;
+        if (t < triangleCount)
+        {
+            const uint32_t* pTriangle = pIndices + t * 3;
+            newVertices += lastMeshlet[pTriangle[0]] != meshletId ? 1 : 0;
+            newVertices += lastMeshlet[pTriangle[1]] != meshletId && pTriangle[1] != pTriangle[0] ? 1 : 0;
+            newVertices += lastMeshlet[pTriangle[2]] != meshletId && pTriangle[2] != pTriangle[0] && pTriangle[2] != pTriangle[1] ? 1 : 0;
+        }
+
+        // Close the meshlet at the end or when the triangle doesn't fit
+        const bool full = t - first >= maxTriangles || meshletVertexCount + newVertices > maxVertices;
+        if (t > first && (t == triangleCount || full))
+        {
+            Meshlet meshlet;
+            meshlet.startIndex = startIndex + static_cast<uint32_t>(first * 3);
+            meshlet.indexCount = static_cast<uint32_t>((t - first) * 3);
+            meshlet.vertexCount = meshletVertexCount;
+            ComputeMeshletBounds(pIndices, first, t, pPositions, positionStride, meshlet);
+            meshlets.push_back(meshlet);
+
+            first = t;
+            meshletVertexCount = 0;
+            meshletId = static_cast<uint32_t>(meshlets.size());
+
+            // Every vertex of the triangle is new to the next meshlet
+            if (t < triangleCount)
+            {
+                const uint32_t* pTriangle = pIndices + t * 3;
+                newVertices = 1 + (pTriangle[1] != pTriangle[0] ? 1 : 0) + (pTriangle[2] != pTriangle[0] && pTriangle[2] != pTriangle[1] ? 1 : 0);
+            }
+        }
+
+        if (t < triangleCount)
+        {
+            const uint32_t* pTriangle = pIndices + t * 3;
+            lastMeshlet[pTriangle[0]] = meshletId;
+            lastMeshlet[pTriangle[1]] = meshletId;
+            lastMeshlet[pTriangle[2]] = meshletId;
+            meshletVertexCount += newVertices;
+        }
+    }
+}
+
+bool VerifyMeshlets(
+    const uint32_t* pIndices, size_t indexCount, uint32_t startIndex,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    const Meshlet* pMeshlets, size_t meshletCount,
+    uint32_t maxVertices,
+    uint32_t maxTriangles)
+{
+    // Relative slack for the float math of the bounds
+    const float Epsilon = 1e-4f;
+
+    std::vector<uint32_t> lastMeshlet(vertexCount, InvalidSlot);
+    uint32_t nextIndex = startIndex;
+
+    for (size_t m = 0; m < meshletCount; ++m)
+    {
+        const Meshlet& meshlet = pMeshlets[m];
+
+        if (meshlet.startIndex != nextIndex || meshlet.indexCount == 0 || meshlet.indexCount % 3 != 0 ||
+            meshlet.indexCount / 3 > maxTriangles)
+        {
+            return false;
+        }
+        nextIndex += meshlet.indexCount;
+
+        const size_t first = meshlet.startIndex - startIndex;
+        if (first + meshlet.indexCount > indexCount)
+        {
+            return false;
+        }
+
+        uint32_t distinctVertices = 0;
+        for (size_t i = first; i < first + meshlet.indexCount; ++i)
+        {
+            const uint32_t vertex = pIndices[i];
+            if (lastMeshlet[vertex] != m)
+            {
+                lastMeshlet[vertex] = static_cast<uint32_t>(m);
+                distinctVertices++;
+            }
+
+            const XMFLOAT3 p = GetPosition(pPositions, positionStride, vertex);
+            const float dx = p.x - meshlet.center.x;
+            const float dy = p.y - meshlet.center.y;
+            const float dz = p.z - meshlet.center.z;
+            if (sqrtf(dx * dx + dy * dy + dz * dz) > meshlet.radius * (1.f + Epsilon) + Epsilon)
+            {
+                return false;
+            }
+        }
+
+        if (distinctVertices != meshlet.vertexCount || distinctVertices > maxVertices)
+        {
+            return false;
+        }
+
+        if (meshlet.coneCutoff >= 1.f)
+        {
+            continue;
+        }
+
+        const float minDot = sqrtf(1.f - meshlet.coneCutoff * meshlet.coneCutoff);
+        for (size_t i = first; i < first + meshlet.indexCount; i += 3)
+        {
+            XMFLOAT3 normal;
+            if (GetTriangleNormal(
+                GetPosition(pPositions, positionStride, pIndices[i + 0]),
+                GetPosition(pPositions, positionStride, pIndices[i + 1]),
+                GetPosition(pPositions, positionStride, pIndices[i + 2]),
+                normal) &&
+                normal.x * meshlet.coneAxis.x + normal.y * meshlet.coneAxis.y + normal.z * meshlet.coneAxis.z < minDot - Epsilon)
+            {
+                return false;
+            }
+        }
+    }
+
+    return nextIndex == startIndex + (indexCount / 3) * 3;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+using namespace DirectX;
+
+const uint32_t MaxMeshletVertices = 64;
+const uint32_t MaxMeshletTriangles = 124;
+
+/*
+    A run of consecutive triangles of an index buffer that touches at most MaxMeshletVertices vertices,
+    small enough to be culled on its own. The bounds are in mesh space.
+*/
+struct Meshlet
+{
+    uint32_t startIndex = 0;        // into the mesh index buffer
+    uint32_t indexCount = 0;
+    uint32_t vertexCount = 0;       // distinct vertices used
+
+    XMFLOAT3 center = XMFLOAT3(0.f, 0.f, 0.f);
+    float radius = 0.f;
+
+    // Every triangle normal is within the cone, cutoff is the sine of its half angle, 1 when it can't be back facing
+    XMFLOAT3 coneAxis = XMFLOAT3(0.f, 1.f, 0.f);
+    float coneCutoff = 1.f;
+};
+
+/*
+    Splits the triangle list pIndices into meshlets, in order, and appends them to meshlets.
+    The indices are relative to pPositions (the float3 position of the draw's base vertex, vertices
+    positionStride bytes apart), startIndex is where pIndices starts in the mesh index buffer.
+    Triangles keep their order, so a cache optimized list gives compact meshlets.
+*/
+void BuildMeshlets(
+    const uint32_t* pIndices, size_t indexCount, uint32_t startIndex,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    std::vector<Meshlet>& meshlets,
+    uint32_t maxVertices = MaxMeshletVertices,
+    uint32_t maxTriangles = MaxMeshletTriangles);
+
+/*
+    Checks meshlets built from the same input by BuildMeshlets: they cover the list without gaps,
+    respect the limits, the spheres hold every vertex and the cones every triangle normal.
+    Only debug builds and the tests run it, it costs about as much as building them.
+*/
+bool VerifyMeshlets(
+    const uint32_t* pIndices, size_t indexCount, uint32_t startIndex,
+    const void* pPositions, size_t positionStride, uint32_t vertexCount,
+    const Meshlet* pMeshlets, size_t meshletCount,
+    uint32_t maxVertices = MaxMeshletVertices,
+    uint32_t maxTriangles = MaxMeshletTriangles);
+
+/*
+    True when every triangle of the meshlet faces away from a camera at cameraPosition (mesh space).
+    Front faces have the normal cross(p1 - p0, p2 - p0), the winding every mesh here uses.
+*/
+inline bool IsMeshletBackfacing(const Meshlet& meshlet, const XMFLOAT3& cameraPosition)
+{
+    const float dx = meshlet.center.x - cameraPosition.x;
+    const float dy = meshlet.center.y - cameraPosition.y;
+    const float dz = meshlet.center.z - cameraPosition.z;
+
+    const float alongAxis = dx * meshlet.coneAxis.x + dy * meshlet.coneAxis.y + dz * meshlet.coneAxis.z;
+    return alongAxis >= meshlet.coneCutoff * sqrtf(dx * dx + dy * dy + dz * dz) + meshlet.radius;
+}
@@ -0,0 +1,113 @@
+#include "pch.h"
+#include "MeshletCuller.h"
+#include <algorithm>
+
+MeshletCuller::MeshletCuller() :
+    m_viewProjection(MathHelper::Identity4x4()),
+    m_cameraPosition(0.f, 0.f, 0.f)
+{
+}
+
+void MeshletCuller::SetView(const XMFLOAT4X4& viewProjection, const XMFLOAT3& cameraPosition)
+{
+    m_viewProjection = viewProjection;
+    m_cameraPosition = cameraPosition;
+}
+
+bool MeshletCuller::Cull(const Renderer& renderer, std::vector<MeshletRange>& ranges)
+{
+    ranges.clear();
+
+    if (renderer.Geo->meshlets.empty())
+    {
+        return false;
+    }
+
+    const DrawMeshlets& draw = GetDrawMeshlets(renderer);
+    if (draw.meshletCount == 0)
+    {
+        return false;
+    }
+
+    const XMMATRIX world = XMLoadFloat4x4(&renderer.world);
+
+    XMFLOAT4X4 meshViewProjection;
+    XMStoreFloat4x4(&meshViewProjection, XMMatrixMultiply(world, XMLoadFloat4x4(&m_viewProjection)));
+    draw.spheres.Cull(meshViewProjection, m_visible);
+
+    XMFLOAT3 meshCameraPosition;
+    XMStoreFloat3(&meshCameraPosition, XMVector3TransformCoord(XMLoadFloat3(&m_cameraPosition), XMMatrixInverse(nullptr, world)));
+
+    const Meshlet* pMeshlets = renderer.Geo->meshlets.data() + draw.firstMeshlet;
+
+    m_stats.meshletsTested += draw.meshletCount;
+    m_stats.frustumCulled += draw.meshletCount - m_visible.size();
+
+    for (uint32_t index : m_visible)
+    {
+        const Meshlet& meshlet = pMeshlets[index];
+        if (IsMeshletBackfacing(meshlet, meshCameraPosition))
+        {
+            m_stats.backfaceCulled++;
+            continue;
+        }
+
+        if (!ranges.empty() && ranges.back().startIndex + ranges.back().indexCount == meshlet.startIndex)
+        {
+            ranges.back().indexCount += meshlet.indexCount;
+        }
+        else
+        {
+            ranges.push_back({ meshlet.startIndex, meshlet.indexCount });
+        }
+    }
+
+    return true;
+}
+
+MeshletCuller::DrawMeshlets& MeshletCuller::GetDrawMeshlets(const Renderer& renderer)
+{
+    const DrawRange key(renderer.Geo, renderer.startIndex, renderer.indexCount);
+
+    auto found = m_draws.find(key);
+    if (found != m_draws.end())
+    {
+        return found->second;
+    }
+
+    DrawMeshlets& draw = m_draws[key];
+
+    const std::vector<Meshlet>& meshlets = renderer.Geo->meshlets;
+    auto first = std::lower_bound(meshlets.begin(), meshlets.end(), renderer.startIndex,
+        [](const Meshlet& meshlet, uint32_t startIndex) { return meshlet.startIndex < startIndex; });
+
+    // The range has to be exactly a run of meshlets
+    const uint32_t endIndex = renderer.startIndex + renderer.indexCount;
+    auto end = first;
+    while (end != meshlets.end() && end->startIndex + end->indexCount <= endIndex)
+    {
+        ++end;
+    }
+
+    const bool covered = first != end &&
+        first->startIndex == renderer.startIndex &&
+        (end - 1)->startIndex + (end - 1)->indexCount == endIndex;
+
+    if (covered)
+    {
+        draw.firstMeshlet = static_cast<uint32_t>(first - meshlets.begin());
+        draw.meshletCount = static_cast<uint32_t>(end - first);
+
+        const XMFLOAT4X4 identity = MathHelper::Identity4x4();
+
+        draw.spheres.Resize(draw.meshletCount);
+        for (uint32_t i = 0; i < draw.meshletCount; ++i)
+        {
+            const Meshlet& meshlet = meshlets[draw.firstMeshlet + i];
+            const float bounds[4] = { meshlet.center.x, meshlet.center.y, meshlet.center.z, meshlet.radius };
+            draw.spheres.SetSphere(i, bounds, identity);
+        }
+    }
+
+    return draw;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "FrustumCuller.h"
+#include "Renderer.h"
+#include <map>
+#include <tuple>
+
+// Consecutive visible meshlets, drawn with the renderer's baseVertex
+struct MeshletRange
+{
+    uint32_t startIndex;
+    uint32_t indexCount;
+};
+
+struct MeshletCullStats
+{
+    uint64_t meshletsTested = 0;
+    uint64_t frustumCulled = 0;
+    uint64_t backfaceCulled = 0;
+};
+
+/*
+    Culls the meshlets of a renderer's draw range against the frustum and their normal cones.
+    The tests run in mesh space: the planes come from world * viewProjection and the camera is moved
+    by the inverse world matrix, which is exact for any world matrix that doesn't mirror.
+    The spheres of a draw range are put in a FrustumCuller the first time it is culled,
+    renderers drawing the same range share them.
+*/
+class MeshletCuller
+{
+public:
+    MeshletCuller();
+
+    void SetView(const XMFLOAT4X4& viewProjection, const XMFLOAT3& cameraPosition);
+
+    /*
+        Replaces ranges with the visible parts of the renderer's draw range, neighbouring meshlets are merged.
+        Returns false when the range isn't made of meshlets, the renderer is then drawn whole.
+    */
+    bool Cull(const Renderer& renderer, std::vector<MeshletRange>& ranges);
+
+    const MeshletCullStats& GetStats() const { return m_stats; }
+
+private:
+    struct DrawMeshlets
+    {
+        uint32_t firstMeshlet = 0;
+        uint32_t meshletCount = 0;      // 0 when the range isn't made of meshlets
+        FrustumCuller spheres;
+    };
+
+    typedef std::tuple<const Mesh*, uint32_t, uint32_t> DrawRange;
+
+    DrawMeshlets& GetDrawMeshlets(const Renderer& renderer);
+
+    std::map<DrawRange, DrawMeshlets> m_draws;
+
+    XMFLOAT4X4 m_viewProjection;
+    XMFLOAT3 m_cameraPosition;
+
+    std::vector<uint32_t> m_visible;
+    MeshletCullStats m_stats;
+};
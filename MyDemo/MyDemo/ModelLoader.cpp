@@ -1,3 +1,846 @@
 #include "pch.h"
 #include "ModelLoader.h"
+#include "MappedFile.h"
+#include <cfloat>
 
+namespace
+{
+    // Smaller blocks aren't worth a task, more blocks than threads even out lines of different cost
+    const size_t MinBlockSize = 1 << 20;
+    const uint32_t BlocksPerThread = 4;
+
+    // Vertices packed or snapped per task
+    const uint32_t VerticesPerTask = 16384;
+
+    const HRESULT InvalidModel = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+    //
+    // Tokenizing, every function stops at end, the end of the line
+    //
+
+    bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    bool IsDigit(char c)
+    {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    const char* SkipBlanks(const char* p, const char* end)
+    {
+        while (p < end && IsBlank(*p))
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    // True when the line starts with keyword and a blank, p is then moved past the keyword
+    bool ParseKeyword(const char*& p, const char* end, const char* keyword)
+    {
+        const char* q = p;
+        for (; *keyword != '\0'; ++keyword, ++q)
+        {
+            if (q == end || *q != *keyword)
+            {
+                return false;
+            }
+        }
+
+        if (q == end || !IsBlank(*q))
+        {
+            return false;
+        }
+
+        p = q;
+        return true;
+    }
+
+    // strtof is locale dependent and several times slower than this, OBJ writers only use plain decimals
+    bool ParseFloat(const char*& p, const char* end, float& value)
+    {
+        p = SkipBlanks(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        bool hasDigits = false;
+        double mantissa = 0.0;
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            mantissa = mantissa * 10.0 + (*p - '0');
+            hasDigits = true;
+        }
+
+        double divisor = 1.0;
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && IsDigit(*p); ++p)
+            {
+                mantissa = mantissa * 10.0 + (*p - '0');
+                divisor *= 10.0;
+                hasDigits = true;
+            }
+        }
+
+        if (!hasDigits)
+        {
+            return false;
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negativeExponent = *p == '-';
+                ++p;
+            }
+
+            int exponent = 0;
+            for (; p < end && IsDigit(*p); ++p)
+            {
+                exponent = MathHelper::Min(exponent * 10 + (*p - '0'), 400);
+            }
+
+            const double power = pow(10.0, exponent);
+            divisor = negativeExponent ? divisor * power : divisor / power;
+        }
+
+        value = static_cast<float>((negative ? -mantissa : mantissa) / divisor);
+        return true;
+    }
+
+    bool ParseInt(const char*& p, const char* end, int32_t& value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        if (p == end || !IsDigit(*p))
+        {
+            return false;
+        }
+
+        int64_t magnitude = 0;
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            magnitude = MathHelper::Min<int64_t>(magnitude * 10 + (*p - '0'), INT32_MAX);
+        }
+
+        value = static_cast<int32_t>(negative ? -magnitude : magnitude);
+        return true;
+    }
+
+    //
+    // Parsed data
+    //
+
+    enum CornerElement
+    {
+        CornerPosition,
+        CornerTexC,
+        CornerNormal,
+        CornerElementCount
+    };
+
+    // 0 based indices of a face corner, -1 when missing
+    struct Corner
+    {
+        int32_t index[CornerElementCount];
+
+        // Bit i is set when index[i] came from a negative OBJ index and counts from the first element of the block
+        uint32_t localMask;
+
+        bool operator==(const Corner& other) const
+        {
+            return index[0] == other.index[0] && index[1] == other.index[1] && index[2] == other.index[2];
+        }
+    };
+
+    // An o or g line, firstTriangle counts from the start of the block
+    struct GroupStart
+    {
+        std::string name;
+        uint32_t firstTriangle;
+    };
+
+    // What one block of lines holds, the counts of earlier blocks are only known after the parse
+    struct ObjBlock
+    {
+        std::vector<XMFLOAT3> positions;
+        std::vector<XMFLOAT2> texCs;
+        std::vector<XMFLOAT3> normals;
+        std::vector<Corner> corners;            // 3 per triangle
+        std::vector<GroupStart> groups;
+
+        // Of the whole file, set once every block is parsed
+        uint32_t firstElement[CornerElementCount] = {};
+        uint32_t firstTriangle = 0;
+        uint32_t triangleCount = 0;
+
+        uint32_t GetElementCount(uint32_t element) const
+        {
+            const size_t counts[CornerElementCount] = { positions.size(), texCs.size(), normals.size() };
+            return static_cast<uint32_t>(counts[element]);
+        }
+    };
+
+    // v, v/vt, v//vn or v/vt/vn
+    bool ParseCorner(const char*& p, const char* end, const ObjBlock& block, Corner& corner)
+    {
+        p = SkipBlanks(p, end);
+
+        int32_t values[CornerElementCount] = {};
+        bool present[CornerElementCount] = {};
+
+        present[CornerPosition] = ParseInt(p, end, values[CornerPosition]);
+        if (!present[CornerPosition])
+        {
+            return false;
+        }
+
+        if (p < end && *p == '/')
+        {
+            ++p;
+            present[CornerTexC] = ParseInt(p, end, values[CornerTexC]);
+
+            if (p < end && *p == '/')
+            {
+                ++p;
+                present[CornerNormal] = ParseInt(p, end, values[CornerNormal]);
+            }
+        }
+
+        corner.localMask = 0;
+        for (uint32_t element = 0; element < CornerElementCount; ++element)
+        {
+            corner.index[element] = -1;
+            if (!present[element])
+            {
+                continue;
+            }
+
+            if (values[element] > 0)
+            {
+                corner.index[element] = values[element] - 1;
+            }
+            else if (values[element] < 0)
+            {
+                // -1 is the last one so far, which may be in an earlier block
+                corner.index[element] = static_cast<int32_t>(block.GetElementCount(element)) + values[element];
+                corner.localMask |= 1u << element;
+            }
+            else
+            {
+                ThrowIfFailed(InvalidModel);
+            }
+        }
+
+        return true;
+    }
+
+    void ParseBlock(const char* p, const char* end, ObjBlock& block)
+    {
+        std::vector<Corner> polygon;
+
+        while (p < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (lineEnd == nullptr)
+            {
+                lineEnd = end;
+            }
+
+            p = SkipBlanks(p, lineEnd);
+
+            if (ParseKeyword(p, lineEnd, "v"))
+            {
+                XMFLOAT3 position(0.f, 0.f, 0.f);
+                ParseFloat(p, lineEnd, position.x);
+                ParseFloat(p, lineEnd, position.y);
+                ParseFloat(p, lineEnd, position.z);
+                block.positions.push_back(position);
+            }
+            else if (ParseKeyword(p, lineEnd, "vt"))
+            {
+                // OBJ v goes up the image, D3D texture coordinates go down
+                XMFLOAT2 texC(0.f, 0.f);
+                ParseFloat(p, lineEnd, texC.x);
+                ParseFloat(p, lineEnd, texC.y);
+                block.texCs.push_back(XMFLOAT2(texC.x, 1.f - texC.y));
+            }
+            else if (ParseKeyword(p, lineEnd, "vn"))
+            {
+                XMFLOAT3 normal(0.f, 0.f, 0.f);
+                ParseFloat(p, lineEnd, normal.x);
+                ParseFloat(p, lineEnd, normal.y);
+                ParseFloat(p, lineEnd, normal.z);
+                block.normals.push_back(normal);
+            }
+            else if (ParseKeyword(p, lineEnd, "f"))
+            {
+                polygon.clear();
+
+                Corner corner;
+                while (ParseCorner(p, lineEnd, block, corner))
+                {
+                    polygon.push_back(corner);
+                }
+
+                // Fan, the first corner is in every triangle
+                for (size_t i = 2; i < polygon.size(); ++i)
+                {
+                    block.corners.push_back(polygon[0]);
+                    block.corners.push_back(polygon[i - 1]);
+                    block.corners.push_back(polygon[i]);
+                }
+            }
+            else if (ParseKeyword(p, lineEnd, "o") || ParseKeyword(p, lineEnd, "g"))
+            {
+                const char* nameBegin = SkipBlanks(p, lineEnd);
+                const char* nameEnd = lineEnd;
+                while (nameEnd > nameBegin && IsBlank(nameEnd[-1]))
+                {
+                    --nameEnd;
+                }
+
+                // An o line followed by a g line names one group, the last name wins
+                const uint32_t triangleCount = static_cast<uint32_t>(block.corners.size() / 3);
+                if (!block.groups.empty() && block.groups.back().firstTriangle == triangleCount)
+                {
+                    block.groups.back().name.assign(nameBegin, nameEnd);
+                }
+                else
+                {
+                    block.groups.push_back({ std::string(nameBegin, nameEnd), triangleCount });
+                }
+            }
+
+            p = lineEnd < end ? lineEnd + 1 : end;
+        }
+    }
+
+    //
+    // Building the mesh
+    //
+
+    // Triangles [firstTriangle, firstTriangle + triangleCount) of the file all belong to group
+    struct TriangleRun
+    {
+        uint32_t group;
+        uint32_t firstTriangle;
+        uint32_t triangleCount;
+    };
+
+    struct LoadedVertex
+    {
+        XMFLOAT3 position;          // decoded from packedPosition once it is set
+        XMFLOAT3 normal;
+        XMFLOAT2 texC;
+        uint16_t packedPosition[4];
+    };
+
+    // Finds the vertex of a corner by its resolved indices, open addressing with linear probing
+    class VertexTable
+    {
+    public:
+        explicit VertexTable(size_t expectedVertexCount)
+        {
+            size_t capacity = 1024;
+            while (capacity < expectedVertexCount * 2)
+            {
+                capacity *= 2;
+            }
+            m_slots.assign(capacity, 0);
+        }
+
+        // The vertex using the corner's indices, added after the others if there is none
+        uint32_t Insert(const Corner& corner)
+        {
+            if ((m_vertices.size() + 1) * 2 > m_slots.size())
+            {
+                Grow();
+            }
+
+            const size_t mask = m_slots.size() - 1;
+            for (size_t slot = Hash(corner) & mask; ; slot = (slot + 1) & mask)
+            {
+                if (m_slots[slot] == 0)
+                {
+                    m_vertices.push_back(corner);
+                    m_slots[slot] = static_cast<uint32_t>(m_vertices.size());
+                    return m_slots[slot] - 1;
+                }
+
+                if (m_vertices[m_slots[slot] - 1] == corner)
+                {
+                    return m_slots[slot] - 1;
+                }
+            }
+        }
+
+        const std::vector<Corner>& GetVertices() const { return m_vertices; }
+
+    private:
+        static size_t Hash(const Corner& corner)
+        {
+            uint64_t hash = static_cast<uint32_t>(corner.index[0]) * 0x9E3779B97F4A7C15ull;
+            hash ^= static_cast<uint32_t>(corner.index[1]) * 0xC2B2AE3D27D4EB4Full;
+            hash ^= static_cast<uint32_t>(corner.index[2]) * 0x165667B19E3779F9ull;
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+
+        void Grow()
+        {
+            m_slots.assign(m_slots.size() * 2, 0);
+
+            const size_t mask = m_slots.size() - 1;
+            for (uint32_t vertex = 0; vertex < m_vertices.size(); ++vertex)
+            {
+                size_t slot = Hash(m_vertices[vertex]) & mask;
+                while (m_slots[slot] != 0)
+                {
+                    slot = (slot + 1) & mask;
+                }
+                m_slots[slot] = vertex + 1;
+            }
+        }
+
+        std::vector<uint32_t> m_slots;      // vertex + 1, 0 when empty
+        std::vector<Corner> m_vertices;
+    };
+
+    // Any unit vector perpendicular to normal, the shaders don't use normal maps
+    XMFLOAT3 GetTangent(const XMFLOAT3& normal)
+    {
+        const XMVECTOR n = XMLoadFloat3(&normal);
+        const XMVECTOR axis = fabsf(normal.x) < 0.9f ? XMVectorSet(1.f, 0.f, 0.f, 0.f) : XMVectorSet(0.f, 1.f, 0.f, 0.f);
+
+        XMFLOAT3 tangent;
+        XMStoreFloat3(&tangent, XMVector3Normalize(XMVector3Cross(axis, n)));
+        return tangent;
+    }
+
+    XMFLOAT3 NormalizeOrUp(const XMFLOAT3& vector)
+    {
+        const float length = sqrtf(vector.x * vector.x + vector.y * vector.y + vector.z * vector.z);
+        return length > 0.f ? XMFLOAT3(vector.x / length, vector.y / length, vector.z / length) : XMFLOAT3(0.f, 1.f, 0.f);
+    }
+}
+
+std::vector<DrawRegistry::Handle> ModelLoader::LoadObj(
+    const std::wstring& path,
+    const std::string& name,
+    GeometryBufferPool* pool,
+    UploadBatcher* uploader,
+    ThreadPool* pThreadPool,
+    MeshRegistry& geometries,
+    DrawRegistry& draws)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    MappedFile file(path);
+    const char* pData = file.GetData();
+    const size_t size = file.GetSize();
+
+    //
+    // Parse blocks of whole lines in parallel
+    //
+
+    const uint32_t threadCount = pThreadPool != nullptr ? pThreadPool->GetThreadCount() : 1;
+    const uint32_t blockCount = static_cast<uint32_t>(MathHelper::Max<size_t>(1, MathHelper::Min<size_t>(threadCount * BlocksPerThread, size / MinBlockSize)));
+
+    std::vector<const char*> blockStarts(blockCount + 1);
+    blockStarts[0] = pData;
+    blockStarts[blockCount] = pData + size;
+    for (uint32_t i = 1; i < blockCount; ++i)
+    {
+        const char* p = MathHelper::Max(pData + size / blockCount * i, blockStarts[i - 1]);
+        const char* newline = static_cast<const char*>(memchr(p, '\n', pData + size - p));
+        blockStarts[i] = newline != nullptr ? newline + 1 : pData + size;
+    }
+
+    std::vector<ObjBlock> blocks(blockCount);
+    ForEachTask(pThreadPool, blockCount, [&](uint32_t i)
+    {
+        ParseBlock(blockStarts[i], blockStarts[i + 1], blocks[i]);
+    });
+
+    uint32_t elementCounts[CornerElementCount] = {};
+    uint32_t triangleCount = 0;
+    for (ObjBlock& block : blocks)
+    {
+        for (uint32_t element = 0; element < CornerElementCount; ++element)
+        {
+            block.firstElement[element] = elementCounts[element];
+            elementCounts[element] += block.GetElementCount(element);
+        }
+
+        block.firstTriangle = triangleCount;
+        block.triangleCount = static_cast<uint32_t>(block.corners.size() / 3);
+        triangleCount += block.triangleCount;
+    }
+
+    if (triangleCount == 0)
+    {
+        ThrowIfFailed(InvalidModel);
+    }
+
+    //
+    // Gather the blocks: file wide indices, one array per element, one run per group change
+    //
+
+    std::vector<XMFLOAT3> positions(elementCounts[CornerPosition]);
+    std::vector<XMFLOAT2> texCs(elementCounts[CornerTexC]);
+    std::vector<XMFLOAT3> normals(elementCounts[CornerNormal]);
+    std::vector<Corner> corners(static_cast<size_t>(triangleCount) * 3);
+
+    ForEachTask(pThreadPool, blockCount, [&](uint32_t i)
+    {
+        ObjBlock& block = blocks[i];
+
+        std::copy(block.positions.begin(), block.positions.end(), positions.begin() + block.firstElement[CornerPosition]);
+        std::copy(block.texCs.begin(), block.texCs.end(), texCs.begin() + block.firstElement[CornerTexC]);
+        std::copy(block.normals.begin(), block.normals.end(), normals.begin() + block.firstElement[CornerNormal]);
+
+        Corner* pCorners = corners.data() + static_cast<size_t>(block.firstTriangle) * 3;
+        for (size_t c = 0; c < block.corners.size(); ++c)
+        {
+            Corner corner = block.corners[c];
+            for (uint32_t element = 0; element < CornerElementCount; ++element)
+            {
+                if (corner.localMask & (1u << element))
+                {
+                    corner.index[element] += static_cast<int32_t>(block.firstElement[element]);
+                    if (corner.index[element] < 0)
+                    {
+                        ThrowIfFailed(InvalidModel);
+                    }
+                }
+
+                if (corner.index[element] >= static_cast<int32_t>(elementCounts[element]))
+                {
+                    ThrowIfFailed(InvalidModel);
+                }
+            }
+
+            corner.localMask = 0;
+            pCorners[c] = corner;
+        }
+
+        // Free as we go, a big file holds a lot in the blocks
+        block.positions = std::vector<XMFLOAT3>();
+        block.texCs = std::vector<XMFLOAT2>();
+        block.normals = std::vector<XMFLOAT3>();
+        block.corners = std::vector<Corner>();
+    });
+
+    // Group 0 holds the triangles before the first o or g line
+    std::vector<std::string> groupNames(1);
+    std::unordered_map<std::string, uint32_t> groupIds;
+    groupIds[""] = 0;
+
+    std::vector<TriangleRun> runs;
+    uint32_t currentGroup = 0;
+    for (const ObjBlock& block : blocks)
+    {
+        uint32_t cursor = 0;
+        for (const GroupStart& group : block.groups)
+        {
+            if (group.firstTriangle > cursor)
+            {
+                runs.push_back({ currentGroup, block.firstTriangle + cursor, group.firstTriangle - cursor });
+                cursor = group.firstTriangle;
+            }
+
+            auto found = groupIds.find(group.name);
+            if (found == groupIds.end())
+            {
+                found = groupIds.emplace(group.name, static_cast<uint32_t>(groupNames.size())).first;
+                groupNames.push_back(group.name);
+            }
+            currentGroup = found->second;
+        }
+
+        if (block.triangleCount > cursor)
+        {
+            runs.push_back({ currentGroup, block.firstTriangle + cursor, block.triangleCount - cursor });
+        }
+    }
+
+    const uint32_t groupCount = static_cast<uint32_t>(groupNames.size());
+    std::vector<std::vector<TriangleRun>> groupRuns(groupCount);
+    for (const TriangleRun& run : runs)
+    {
+        groupRuns[run.group].push_back(run);
+    }
+
+    // Faces without normals are smoothed with the area weighted normals of the faces around each position
+    std::vector<XMFLOAT3> generatedNormals;
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        const Corner* pTriangle = &corners[static_cast<size_t>(t) * 3];
+        if (pTriangle[0].index[CornerNormal] >= 0 && pTriangle[1].index[CornerNormal] >= 0 && pTriangle[2].index[CornerNormal] >= 0)
+        {
+            continue;
+        }
+
+        if (generatedNormals.empty())
+        {
+            generatedNormals.assign(positions.size(), XMFLOAT3(0.f, 0.f, 0.f));
+        }
+
+        const XMVECTOR p0 = XMLoadFloat3(&positions[pTriangle[0].index[CornerPosition]]);
+        const XMVECTOR p1 = XMLoadFloat3(&positions[pTriangle[1].index[CornerPosition]]);
+        const XMVECTOR p2 = XMLoadFloat3(&positions[pTriangle[2].index[CornerPosition]]);
+
+        // Twice the area long
+        XMFLOAT3 faceNormal;
+        XMStoreFloat3(&faceNormal, XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0)));
+
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            XMFLOAT3& normal = generatedNormals[pTriangle[c].index[CornerPosition]];
+            normal.x += faceNormal.x;
+            normal.y += faceNormal.y;
+            normal.z += faceNormal.z;
+        }
+    }
+
+    //
+    // One vertex per distinct corner, numbered in group order so a group's vertices are close together
+    //
+
+    VertexTable vertexTable(positions.size());
+    std::vector<uint32_t> indices;
+    indices.reserve(corners.size());
+
+    std::vector<Mesh::Draw> groupDraws(groupCount);
+    for (uint32_t group = 0; group < groupCount; ++group)
+    {
+        groupDraws[group].startIndex = static_cast<uint32_t>(indices.size());
+        for (const TriangleRun& run : groupRuns[group])
+        {
+            const size_t firstCorner = static_cast<size_t>(run.firstTriangle) * 3;
+            for (size_t c = firstCorner; c < firstCorner + static_cast<size_t>(run.triangleCount) * 3; ++c)
+            {
+                indices.push_back(vertexTable.Insert(corners[c]));
+            }
+        }
+        groupDraws[group].indexCount = static_cast<uint32_t>(indices.size()) - groupDraws[group].startIndex;
+    }
+
+    corners = std::vector<Corner>();
+
+    const std::vector<Corner>& vertexCorners = vertexTable.GetVertices();
+    const uint32_t vertexCount = static_cast<uint32_t>(vertexCorners.size());
+    const uint32_t vertexTaskCount = (vertexCount + VerticesPerTask - 1) / VerticesPerTask;
+
+    std::vector<LoadedVertex> vertices(vertexCount);
+    ForEachTask(pThreadPool, vertexTaskCount, [&](uint32_t task)
+    {
+        for (uint32_t v = task * VerticesPerTask; v < MathHelper::Min(vertexCount, (task + 1) * VerticesPerTask); ++v)
+        {
+            const Corner& corner = vertexCorners[v];
+            LoadedVertex& vertex = vertices[v];
+
+            vertex.position = positions[corner.index[CornerPosition]];
+            vertex.texC = corner.index[CornerTexC] >= 0 ? texCs[corner.index[CornerTexC]] : XMFLOAT2(0.f, 0.f);
+            vertex.normal = NormalizeOrUp(corner.index[CornerNormal] >= 0 ? normals[corner.index[CornerNormal]] : generatedNormals[corner.index[CornerPosition]]);
+        }
+    });
+
+    //
+    // Quantize, then build everything else from the positions the GPU will see
+    //
+
+    XMFLOAT3 minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+    XMFLOAT3 maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (const LoadedVertex& vertex : vertices)
+    {
+        minimum = XMFLOAT3(MathHelper::Min(minimum.x, vertex.position.x), MathHelper::Min(minimum.y, vertex.position.y), MathHelper::Min(minimum.z, vertex.position.z));
+        maximum = XMFLOAT3(MathHelper::Max(maximum.x, vertex.position.x), MathHelper::Max(maximum.y, vertex.position.y), MathHelper::Max(maximum.z, vertex.position.z));
+    }
+
+    auto pGeo = std::make_unique<Mesh>();
+    pGeo->name = name;
+    pGeo->positionQuantization = PositionQuantization::FromBox(minimum, maximum);
+
+    std::vector<VertexPackingError> taskPackingErrors(vertexTaskCount);
+    ForEachTask(pThreadPool, vertexTaskCount, [&](uint32_t task)
+    {
+        for (uint32_t v = task * VerticesPerTask; v < MathHelper::Min(vertexCount, (task + 1) * VerticesPerTask); ++v)
+        {
+            PackPosition(vertices[v].position, pGeo->positionQuantization, vertices[v].packedPosition);
+            const XMFLOAT3 position = UnpackPosition(vertices[v].packedPosition, pGeo->positionQuantization);
+
+            VertexPackingError vertexError;
+            vertexError.position = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&position), XMLoadFloat3(&vertices[v].position))));
+            taskPackingErrors[task].Combine(vertexError);
+
+            vertices[v].position = position;
+        }
+    });
+
+    pGeo->ComputeBounds(vertices.data(), vertexCount, sizeof(LoadedVertex));
+
+    // Per draw over the vertex range it uses, which the numbering above keeps short
+    std::vector<std::vector<Meshlet>> groupMeshlets(groupCount);
+    ForEachTask(pThreadPool, groupCount, [&](uint32_t group)
+    {
+        const Mesh::Draw& draw = groupDraws[group];
+        if (draw.indexCount == 0)
+        {
+            return;
+        }
+
+        uint32_t* pIndices = indices.data() + draw.startIndex;
+
+        uint32_t firstVertex = UINT32_MAX;
+        uint32_t lastVertex = 0;
+        for (uint32_t i = 0; i < draw.indexCount; ++i)
+        {
+            firstVertex = MathHelper::Min(firstVertex, pIndices[i]);
+            lastVertex = MathHelper::Max(lastVertex, pIndices[i]);
+        }
+
+        for (uint32_t i = 0; i < draw.indexCount; ++i)
+        {
+            pIndices[i] -= firstVertex;
+        }
+
+        const uint32_t rangeVertexCount = lastVertex - firstVertex + 1;
+        OptimizeVertexCache(pIndices, draw.indexCount, rangeVertexCount);
+        BuildMeshlets(pIndices, draw.indexCount, draw.startIndex, &vertices[firstVertex].position, sizeof(LoadedVertex), rangeVertexCount, groupMeshlets[group]);
+
+        // A bound that misses a vertex culls triangles that are on screen. Tests/MeshletTests.cpp covers it
+        assert(VerifyMeshlets(pIndices, draw.indexCount, draw.startIndex, &vertices[firstVertex].position, sizeof(LoadedVertex), rangeVertexCount,
+            groupMeshlets[group].data(), groupMeshlets[group].size()));
+
+        for (uint32_t i = 0; i < draw.indexCount; ++i)
+        {
+            pIndices[i] += firstVertex;
+        }
+    });
+
+    for (const std::vector<Meshlet>& meshlets : groupMeshlets)
+    {
+        pGeo->meshlets.insert(pGeo->meshlets.end(), meshlets.begin(), meshlets.end());
+    }
+
+    // Every vertex is used, the count stays the same
+    OptimizeVertexFetch(vertices.data(), sizeof(LoadedVertex), vertexCount, indices.data(), indices.size());
+
+    //
+    // Pack into the CPU copies and queue the upload
+    //
+
+    // No chunking as for the land, one vertex too many and the whole buffer is 32 bit
+    const bool useIndices16 = vertexCount <= 0x10000;
+
+    // Every byte size of a mesh is 32 bit, including the position only stream that follows the vertices
+    const uint64_t vertexBytes = static_cast<uint64_t>(vertexCount) * sizeof(PackedSurfaceVertex);
+    const uint64_t indexBytes = static_cast<uint64_t>(indices.size()) * (useIndices16 ? sizeof(uint16_t) : sizeof(uint32_t));
+    if (Mesh::GetVertexRangeSize(vertexBytes, sizeof(PackedSurfaceVertex)) > UINT32_MAX || indexBytes > UINT32_MAX)
+    {
+        ThrowIfFailed(InvalidModel);
+    }
+
+    pGeo->vbStride = sizeof(PackedSurfaceVertex);
+    pGeo->vbSize = static_cast<uint32_t>(vertexBytes);
+    pGeo->ibFormat = useIndices16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+    pGeo->ibSize = static_cast<uint32_t>(indexBytes);
+
+    pGeo->vertexBufferCPU.resize(pGeo->vbSize);
+    pGeo->indexBufferCPU.resize(pGeo->ibSize);
+
+    PackedSurfaceVertex* pPackedVertices = reinterpret_cast<PackedSurfaceVertex*>(pGeo->vertexBufferCPU.data());
+    ForEachTask(pThreadPool, vertexTaskCount, [&](uint32_t task)
+    {
+        for (uint32_t v = task * VerticesPerTask; v < MathHelper::Min(vertexCount, (task + 1) * VerticesPerTask); ++v)
+        {
+            PackedSurfaceVertex& packed = pPackedVertices[v];
+
+            const XMFLOAT3 tangent = GetTangent(vertices[v].normal);
+
+            memcpy(packed.position, vertices[v].packedPosition, sizeof(packed.position));
+            PackOctahedral(vertices[v].normal, packed.normal);
+            PackOctahedral(tangent, packed.tangentU);
+            PackTexCoord(vertices[v].texC, packed.texC);
+
+            const XMFLOAT3 unpackedNormal = UnpackOctahedral(packed.normal);
+            const XMFLOAT3 unpackedTangent = UnpackOctahedral(packed.tangentU);
+
+            VertexPackingError vertexError;
+            vertexError.normal = MathHelper::Max(
+                XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&unpackedNormal), XMLoadFloat3(&vertices[v].normal)))),
+                XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&unpackedTangent), XMLoadFloat3(&tangent)))));
+            taskPackingErrors[task].Combine(vertexError);
+        }
+    });
+
+    VertexPackingError packingError;
+    for (const VertexPackingError& taskError : taskPackingErrors)
+    {
+        packingError.Combine(taskError);
+    }
+
+    if (useIndices16)
+    {
+        uint16_t* pIndices = reinterpret_cast<uint16_t*>(pGeo->indexBufferCPU.data());
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            pIndices[i] = static_cast<uint16_t>(indices[i]);
+        }
+    }
+    else
+    {
+        memcpy(pGeo->indexBufferCPU.data(), indices.data(), pGeo->ibSize);
+    }
+
+    pGeo->UploadGeometry(pool, uploader, pGeo->vertexBufferCPU.data(), pGeo->indexBufferCPU.data());
+
+    std::vector<DrawRegistry::Handle> drawHandles;
+    for (uint32_t group = 0; group < groupCount; ++group)
+    {
+        if (groupDraws[group].indexCount == 0)
+        {
+            continue;
+        }
+
+        const std::string drawName = group == 0 ? name : name + "/" + groupNames[group];
+        drawHandles.push_back(draws.Add(drawName, std::make_unique<Mesh::Draw>(groupDraws[group])));
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+
+    char report[256];
+    sprintf_s(report, "%s: %.1f MB in %u blocks, %u vertices, %u triangles, %zu draws, %zu meshlets, %.1f ms\n",
+        name.c_str(), size / (1024.0 * 1024.0), blockCount, vertexCount, triangleCount, drawHandles.size(), pGeo->meshlets.size(),
+        std::chrono::duration<double, std::milli>(end - start).count());
+    OutputDebugStringA(report);
+
+    const VertexPackingError packingTolerance = VertexPackingError::GetTolerance(pGeo->positionQuantization);
+    sprintf_s(report, "%s: largest position error %.5f (%.5f allowed), normal error %.6f (%.6f allowed)\n",
+        name.c_str(), packingError.position, packingTolerance.position, packingError.normal, packingTolerance.normal);
+    OutputDebugStringA(report);
+
+    // Past half a step the packing itself is broken, not just lossy. Tests/VertexPackingTests.cpp covers it
+    assert(packingError.IsWithin(packingTolerance));
+
+    geometries.Add(name, std::move(pGeo));
+
+    return drawHandles;
+}
@@ -1,4 +1,36 @@
 #pragma once
 
+#include "Mesh.h"
+
 using namespace DirectX;
 
+/*
+    Loads Wavefront OBJ files: v, vt, vn, f, o and g lines, everything else is skipped.
+    The file is memory mapped and cut into blocks on line boundaries that are parsed in parallel.
+    Polygons are split into fans, corners with the same position, texture coordinate and normal
+    share one vertex, faces without normals get smooth area weighted ones.
+*/
+class ModelLoader
+{
+public:
+    // Bump whenever LoadObj builds something different, meshes cooked by older versions are stale
+    static const uint32_t Version = 1;
+
+    /*
+        Queues the buffers on uploader as the mesh name, Mesh::uploadToken is set once the caller submits the batch.
+        Triangles before the first o or g line go into the draw name, each group into the draw name + "/" + group.
+        A group showing up several times is gathered into one draw. Returns the draws added.
+        Vertices are PackedSurfaceVertex, indices 16 bit up to 65536 vertices. Each draw is reordered
+        for the vertex cache and cut into meshlets.
+        Unlike the land, draws are neither split into 16 bit chunks nor given a LOD chain: a model over
+        65536 vertices gets one 32 bit index buffer and is always drawn at full detail.
+    */
+    std::vector<DrawRegistry::Handle> LoadObj(
+        const std::wstring& path,
+        const std::string& name,
+        GeometryBufferPool* pool,
+        UploadBatcher* uploader,
+        ThreadPool* pThreadPool,
+        MeshRegistry& geometries,
+        DrawRegistry& draws);
+};
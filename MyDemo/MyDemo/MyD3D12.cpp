@@ -2,22 +2,38 @@
 #include "pch.h"
 #include "MyD3D12.h"
 #include "Mesh.h"
+#include "ModelLoader.h"
+#include "MeshCache.h"
+#include "NullGraphicsDevice.h"
 
 using namespace DirectX;
 
+// Bound to a reference by make_unique()
+const UINT64 MyD3D12::UploadRingSize;
+
 MyD3D12::MyD3D12(UINT width, UINT height, std::wstring name) :
     DXSample(width, height, name),
     m_frameIndex(0),
-    m_fenceValue(0),
     m_viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
     m_scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
     m_rtvDescriptorSize(0),
     m_cbvDescriptorSize(0),
     m_passCBVOffset(0),
+    m_rtvHeapStart(),
+    m_dsvHeapStart(),
     m_isWireFrame(false),
+    m_waveDisturbTime(0.f),
+    m_waveSimulationSeconds(0.0),
+    m_waveStreamingSeconds(0.0),
     m_frameCounter(0),
     m_currentFrameResourceIndex(0),
-    m_pCurrentFrameResource(nullptr)
+    m_pCurrentFrameResource(nullptr),
+    m_indirectDrawListDirty(false),
+    m_transforms(FrameCount + 1),
+    m_pRenderFrameResource(nullptr),
+    m_pSubmittedFrameResource(nullptr),
+    m_pRenderedFrameResource(nullptr),
+    m_stopRenderThread(false)
 {
                             
 
@@ -27,112 +43,92 @@ void MyD3D12::OnInit()
 {                    
     m_camera.Init({ 0, 0, 0 });
 
-    LoadPipeline();
-    LoadAssets();
-}
-
-// Load the rendering pipeline dependencies.
-void MyD3D12::LoadPipeline()
-{
-    UINT dxgiFactoryFlags = 0;
+    // One thread per core, the calling thread records too
+    m_threadPool = std::make_unique<ThreadPool>();
 
-///*
-#if defined(_DEBUG)
-    // Enable the debug layer (requires the Graphics Tools "optional feature").
-    // NOTE: Enabling the debug layer after device creation will invalidate the active device.
+    if (m_useNullDevice)
     {
-        ComPtr<ID3D12Debug> debugController;
-        if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
-        {
-            debugController->EnableDebugLayer();
-
-            // Enable additional debug layers.
-            dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
-        }
+        LoadNullPipeline();
     }
-#endif
-//*/
-
-    ComPtr<IDXGIFactory4> factory;  ////DXGI factory is used to create device
-    ThrowIfFailed(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
-
-    if (m_useWarpDevice)    //create software adapter
+#ifndef NULL_BACKEND_ONLY
+    else
     {
-        ComPtr<IDXGIAdapter> warpAdapter;
-        ThrowIfFailed(factory->EnumWarpAdapter(IID_PPV_ARGS(&warpAdapter)));    //enum adapter
-
-        ThrowIfFailed(D3D12CreateDevice(
-            warpAdapter.Get(),
-            D3D_FEATURE_LEVEL_11_0,     //Specifies the highest version is D3D12
-            IID_PPV_ARGS(&m_device)
-            ));
+        LoadPipeline();
     }
-    else   //create hardware adapter
+#endif
+    LoadAssets();
+
+    if (m_usePipelinedFrames)
     {
-        ComPtr<IDXGIAdapter1> hardwareAdapter;
-        GetHardwareAdapter(factory.Get(), &hardwareAdapter);    //acquir first available hardware adapter that supports Direct3D 12
+        // The indirect list is rebuilt from the live renderers while recording, that keeps it on one thread
+        if (m_indirectDrawList == nullptr)
+        {
+            m_renderThread = std::thread(&MyD3D12::RenderThreadLoop, this);
 
-        ThrowIfFailed(D3D12CreateDevice(
-            hardwareAdapter.Get(),
-            D3D_FEATURE_LEVEL_11_0,
-            IID_PPV_ARGS(&m_device)
-            ));
+            // A full ring waits for the render thread instead of failing
+            m_uploadRing->SetPendingFenceWait([this] { WaitForSubmittedFrame(); });
+            m_releaseQueue->UsePendingFrames();
+        }
+        else
+        {
+            OutputDebugStringA("-pipelined is ignored with -indirect\n");
+        }
     }
+}
 
-    // Describe and create the command queue.
-    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
-    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
-
-    ThrowIfFailed(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)));
-    NAME_D3D12_OBJECT(m_commandQueue);  //Associates a name with the device object. This name is for use in debug diagnostics and tools
-
-    // Describe and create the swap chain.
-    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-    swapChainDesc.BufferCount = FrameCount;  //number of swap chain buffers
-    swapChainDesc.Width = m_width;  //buffer width
-    swapChainDesc.Height = m_height;    //buffer hidth
-    swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;      //Buffer format
-    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;    //Buffer usage
-    //specify bit-block transfer(bitblt) model and specify that DXGI discard the contents of the back buffer after call
-    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    swapChainDesc.SampleDesc.Count = 1; //number of multisamples per pixel
-
-    ComPtr<IDXGISwapChain1> swapChain;
-    ThrowIfFailed(factory->CreateSwapChainForHwnd(
-        m_commandQueue.Get(),        // Swap chain needs the queue so that it can force a flush on it
-        Win32Application::GetHwnd(), //HWND handle that is associated with the swap chain that CreateSwapChainForHwnd creates
-        &swapChainDesc,     
-        nullptr,
-        nullptr,
-        &swapChain
-        ));
-
-    // This sample does not support fullscreen transitions.
-    ThrowIfFailed(factory->MakeWindowAssociation(Win32Application::GetHwnd(), DXGI_MWA_NO_ALT_ENTER));
-
-    ThrowIfFailed(swapChain.As(&m_swapChain));
-    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
-
-    BuildDescriptorHeaps();
+// Headless pipeline: no adapter, window or swap chain.
+// Root signature, PSOs and views are not created, their handles stay null.
+void MyD3D12::LoadNullPipeline()
+{
+    m_graphicsDevice = std::make_unique<NullGraphicsDevice>();
 
-    ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)));
+    m_commandAllocator = m_graphicsDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT);
 }
 
 // Load the sample assets.
 void MyD3D12::LoadAssets()
 {
-    BuildRootSignature();
+    // Pipeline objects need the runtime, the null backend runs without them
+#ifndef NULL_BACKEND_ONLY
+    if (m_device != nullptr)
+    {
+        BuildRootSignature();
+
+        BuildShaderAndInputLayout();
+
+        BuildPSO();
 
-    BuildShaderAndInputLayout();
+        m_commandSignature = IndirectDrawList::CreateCommandSignature(m_device.Get(), m_rootSignature.Get());
+    }
+    else
+#endif
+    {
+        // Renderers are built the same way on both backends, they get null pipeline states here
+        m_opaquePSO = m_PSOs.Add("opaque", nullptr);
+        m_surfacePSO = m_PSOs.Add("surface", nullptr);
+        m_depthPSO = m_PSOs.Add("depth", nullptr);
+        m_transparentPSO = m_PSOs.Add("transparent", nullptr);
+    }
 
-    BuildPSO();
+    if (m_useIndirectDraw)
+    {
+        m_indirectDrawList = std::make_unique<IndirectDrawList>();
+    }
 
     // Create the command list.
-    ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(), nullptr, IID_PPV_ARGS(&m_commandList)));
-    NAME_D3D12_OBJECT(m_commandList);
+    m_commandList = m_graphicsDevice->CreateCommandList(D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.get(), nullptr);
 
-    BuildRTVDSV();
+#ifndef NULL_BACKEND_ONLY
+    if (m_device != nullptr)
+    {
+        BuildRTVDSV();
+    }
+#endif
+
+    // Geometry goes through the copy queue, the frame loop starts without waiting for it
+    m_uploadBatcher = std::make_unique<UploadBatcher>(m_graphicsDevice.get());
+    m_geometryPool = std::make_unique<GeometryBufferPool>(m_graphicsDevice.get());
+    m_releaseQueue = std::make_unique<DeferredReleaseQueue>(m_graphicsDevice.get());
 
     BuildModel();
 
@@ -140,36 +136,24 @@ void MyD3D12::LoadAssets()
 
     // Close the command list and execute it to begin the initial GPU setup.
     ThrowIfFailed(m_commandList->Close());
-    ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+    GraphicsCommandList* ppCommandLists[] = { m_commandList.get() };
+    m_graphicsDevice->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
-    // Create synchronization objects and wait until assets have been uploaded to the GPU.
-    {
-        ThrowIfFailed(m_device->CreateFence(m_fenceValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-        m_fenceValue++;
+    // Wait for the command list to execute; we are reusing the same command 
+    // list in our main loop but for now, we just want to wait for setup to 
+    // complete before continuing.
+    m_graphicsDevice->Flush();
 
-        // Create an event handle to use for frame synchronization.
-        m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-        if(m_fenceEvent == nullptr)
-        {
-            ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
-        }
+    BuildFrameResources();
 
-        // Wait for the command list to execute; we are reusing the same command 
-        // list in our main loop but for now, we just want to wait for setup to 
-        // complete before continuing.
-        
-        // Signal and increment the fence value.
-        const UINT64 fenceToWaitFor = m_fenceValue;
-        ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fenceToWaitFor));
-        m_fenceValue++;
+    BuildWorkerCommandLists();
 
-        // Wait until the fence is completed.
-        ThrowIfFailed(m_fence->SetEventOnCompletion(fenceToWaitFor, m_fenceEvent));
-        WaitForSingleObject(m_fenceEvent, INFINITE);
+    // Done before the first frame, so its fan outs don't share the workers with file writes
+    for (auto& cacheWriteTask : m_cacheWriteTasks)
+    {
+        m_threadPool->Wait(cacheWriteTask.get());
     }
-
-    BuildFrameResources();
+    m_cacheWriteTasks.clear();
 }
 
 // Update frame-based values.
@@ -183,6 +167,18 @@ void MyD3D12::OnUpdate()
         wchar_t fps[64];
         swprintf_s(fps, L"%ufps", m_timer.GetFramesPerSecond());
         SetCustomWindowText(fps);
+
+        // Averages over the frames since the last report
+        const double waveBytes = static_cast<double>(m_waves->GetVertexCount()) * sizeof(PackedColorVertex) * m_frameCounter;
+        char waveReport[192];
+        sprintf_s(waveReport, "waves: %ux%u, simulation %.3f ms/frame, vertex streaming %.3f ms/frame, %.0f MB/s\n",
+            m_waves->GetRowCount(), m_waves->GetColumnCount(),
+            1000.0 * m_waveSimulationSeconds / m_frameCounter, 1000.0 * m_waveStreamingSeconds / m_frameCounter,
+            waveBytes / (1024.0 * 1024.0) / MathHelper::Max(m_waveStreamingSeconds, 1e-6));
+        OutputDebugStringA(waveReport);
+
+        m_waveSimulationSeconds = 0.0;
+        m_waveStreamingSeconds = 0.0;
         m_frameCounter = 0;
     }
 
@@ -190,7 +186,7 @@ void MyD3D12::OnUpdate()
 
     // Get current GPU progress against submitted workload. Resources still scheduled 
     // for GPU execution cannot be modified or else undefined behavior will result
-    const UINT64 lastCompletedFence = m_fence->GetCompletedValue();
+    const UINT64 lastCompletedFence = m_graphicsDevice->GetCompletedFenceValue();
 
     // Move to the next frame resource
     m_currentFrameResourceIndex = (m_currentFrameResourceIndex + 1) % FrameCount;
@@ -200,39 +196,195 @@ void MyD3D12::OnUpdate()
     // If it is, wait for it to complete.
     if (m_pCurrentFrameResource->fenceValue != 0 && m_pCurrentFrameResource->fenceValue > lastCompletedFence)
     {
-        ThrowIfFailed(m_fence->SetEventOnCompletion(m_pCurrentFrameResource->fenceValue, m_fenceEvent));
-        WaitForSingleObject(m_fenceEvent, INFINITE);
+        m_graphicsDevice->WaitForFenceValue(m_pCurrentFrameResource->fenceValue);
     }
 
     m_camera.Update(static_cast<float>(m_timer.GetElapsedSeconds()));
 
-    m_pCurrentFrameResource->UpdateObjectConstantBuffers(std::move(m_allRenderers));
+    // The frame resource is free again, its water vertices can be rewritten.
+    // Nothing below reads them before the instance batches, the workers run the water meanwhile
+    const float elapsedSeconds = static_cast<float>(m_timer.GetElapsedSeconds());
+    ThreadPool::Task wavesTask([this, elapsedSeconds] { UpdateWaves(elapsedSeconds); });
+    m_threadPool->Submit(&wavesTask);
+
+    // Moved renderers first, the ones becoming drawable take their sphere from the world
+    UpdateSceneGraph();
+
+    UpdatePendingRenderers();
+
+    // Free whatever the GPU has finished with
+    m_releaseQueue->Collect();
 
-    m_pCurrentFrameResource->UpdatePassConstantBuffers(m_camera.GetViewMatrix(), m_camera.GetProjectionMatrix(0.8f, m_aspectRatio));
+    const float fieldOfView = 0.8f;
+    const float nearPlane = 1.f;
+    const float farPlane = 1000.f;
+
+    XMMATRIX view = m_camera.GetViewMatrix();
+    XMMATRIX projection = m_camera.GetProjectionMatrix(fieldOfView, m_aspectRatio, nearPlane, farPlane);
+
+    m_lodSelector.SetView(m_camera.GetPosition(), fieldOfView, static_cast<float>(m_height));
+
+    CullAndSortRenderers(view, projection, farPlane);
+
+    m_pCurrentFrameResource->ReserveObjects(m_graphicsDevice.get(), m_releaseQueue.get(), static_cast<uint32_t>(m_allRenderers.size()));
+
+    m_pCurrentFrameResource->UpdateObjectConstantBuffers(&m_transforms, m_currentFrameResourceIndex, m_threadPool.get());
+
+    m_pCurrentFrameResource->UpdatePassConstantBuffers(m_uploadRing.get(), view, projection);
+
+    XMFLOAT4X4 viewProjection;
+    XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(view, projection));
+    m_meshletCuller.SetView(viewProjection, m_camera.GetPosition());
+
+    m_threadPool->Wait(&wavesTask);
+
+    m_pCurrentFrameResource->BuildInstanceBatches(m_uploadRing.get(), m_sortedRenderers, &m_meshletCuller, m_depthRenderers, m_PSOs.Get(m_depthPSO).Get());
 }
 
 // Render the scene.
 void MyD3D12::OnRender()
 {
-    PIXBeginEvent(m_commandQueue.Get(), 0, L"Render");
+    if (!m_renderThread.joinable())
+    {
+        RenderFrame(m_pCurrentFrameResource);
+
+        // Everything allocated from the ring this frame is released with the same fence
+        m_uploadRing->FinishFrame(m_pCurrentFrameResource->fenceValue);
+        return;
+    }
+
+    // Only the update thread touches the ring and the release queue, the fence of this frame is filled in once it has been signaled
+    m_uploadRing->FinishFrame(UploadRingBuffer::PendingFenceValue);
+    m_releaseQueue->FinishPendingFrame();
+
+    std::unique_lock<std::mutex> lock(m_renderMutex);
+    m_pRenderFrameResource = m_pCurrentFrameResource;
+    m_renderCondition.notify_all();
+
+    /*
+        One frame of overlap: the next update starts once the render thread has taken this frame,
+        by then it has submitted the previous one. Together with the frame being built and
+        the one on the GPU that needs all FrameCount frame resources.
+    */
+    m_renderCondition.wait(lock, [this] { return m_pRenderFrameResource == nullptr || m_renderException != nullptr; });
+    if (m_renderException != nullptr)
+    {
+        std::rethrow_exception(m_renderException);
+    }
+    lock.unlock();
+
+    // Taking this frame means the previous one has been signaled, this doesn't block
+    WaitForSubmittedFrame();
+    m_pSubmittedFrameResource = m_pCurrentFrameResource;
+}
+
+// Blocks until the render thread has signaled the frame last handed over and passes its fence on
+void MyD3D12::WaitForSubmittedFrame()
+{
+    if (m_pSubmittedFrameResource == nullptr)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_renderMutex);
+        m_renderCondition.wait(lock, [this] { return m_pRenderedFrameResource == m_pSubmittedFrameResource || m_renderException != nullptr; });
+        if (m_renderException != nullptr)
+        {
+            std::rethrow_exception(m_renderException);
+        }
+    }
+
+    m_uploadRing->SetPendingFence(m_pSubmittedFrameResource->fenceValue);
+    m_releaseQueue->SetPendingFence(m_pSubmittedFrameResource->fenceValue);
+    m_pSubmittedFrameResource = nullptr;
+}
+
+// Records, submits and presents the frame built in pFrameResource, then signals its fence
+void MyD3D12::RenderFrame(FrameResource* pFrameResource)
+{
+    m_graphicsDevice->BeginEvent(L"Render");
 
     // Record all the commands we need to render the scene into the command list
-    PopulateCommandList();
+    PopulateCommandList(pFrameResource);
 
-    // Execute the command list.
-    ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+    // Execute the command lists, in recording order and in a single submission.
+    m_graphicsDevice->ExecuteCommandLists(static_cast<UINT>(m_submitCommandLists.size()), m_submitCommandLists.data());
 
-    PIXEndEvent(m_commandQueue.Get());
+    m_graphicsDevice->EndEvent();
 
     // Present the frame
-    ThrowIfFailed(m_swapChain->Present(0, 0));
-    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+#ifndef NULL_BACKEND_ONLY
+    if (m_swapChain != nullptr)
+    {
+        ThrowIfFailed(m_swapChain->Present(0, 0));
+        m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+    }
+    else
+#endif
+    {
+        m_frameIndex = (m_frameIndex + 1) % FrameCount;
+    }
 
     // Signal and increment the fence value.
-    m_pCurrentFrameResource->fenceValue = m_fenceValue;
-    ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_fenceValue));
-    m_fenceValue++;
+    pFrameResource->fenceValue = m_graphicsDevice->Signal();
+}
+
+void MyD3D12::RenderThreadLoop()
+{
+    for (;;)
+    {
+        FrameResource* pFrameResource = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_renderMutex);
+            m_renderCondition.wait(lock, [this] { return m_pRenderFrameResource != nullptr || m_stopRenderThread; });
+            if (m_pRenderFrameResource == nullptr)
+            {
+                return;
+            }
+
+            pFrameResource = m_pRenderFrameResource;
+            m_pRenderFrameResource = nullptr;
+        }
+        m_renderCondition.notify_all();
+
+        try
+        {
+            RenderFrame(pFrameResource);
+        }
+        catch (...)
+        {
+            // Rethrown by the next OnRender()
+            std::lock_guard<std::mutex> lock(m_renderMutex);
+            m_renderException = std::current_exception();
+            m_renderCondition.notify_all();
+            return;
+        }
+
+        // Its fence is known now, see WaitForSubmittedFrame()
+        {
+            std::lock_guard<std::mutex> lock(m_renderMutex);
+            m_pRenderedFrameResource = pFrameResource;
+        }
+        m_renderCondition.notify_all();
+    }
+}
+
+// Returns once the last frame handed over has been submitted
+void MyD3D12::StopRenderThread()
+{
+    if (!m_renderThread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        m_stopRenderThread = true;
+    }
+    m_renderCondition.notify_all();
+
+    m_renderThread.join();
 }
 
 void MyD3D12::OnDestroy()
@@ -241,202 +393,466 @@ void MyD3D12::OnDestroy()
         Ensure that the GPU is no longer referencing resources that are about to be
         cleaned up by the destructor
     */
+    StopRenderThread();
+    m_uploadBatcher->Flush();
+    m_graphicsDevice->Flush();
+    m_releaseQueue->Flush();
+
+    if (m_graphicsDevice->GetBackend() == GraphicsBackend::Null)
     {
-        const UINT64 fence = m_fenceValue;
-        const UINT64 lastCompletedFence = m_fence->GetCompletedValue();
+        const GraphicsStats& stats = m_graphicsDevice->GetStats();
+
+        char report[768];
+        sprintf_s(report,
+            "null device: %llu lists executed, %llu draws, %llu indices, %llu instances, %llu indirect calls (%llu commands), "
+            "%llu PSO / %llu root signature / %llu root argument changes, %llu VB / %llu IB binds, "
+            "%llu barriers, %llu copies (%llu bytes), %llu buffers (%llu bytes), %llu signals, %llu fence waits\n",
+            stats.commandListsExecuted, stats.drawCalls, stats.indicesDrawn, stats.instancesDrawn, stats.indirectCalls, stats.indirectCommands,
+            stats.pipelineStateChanges, stats.rootSignatureChanges, stats.rootArgumentChanges, stats.vertexBufferBinds, stats.indexBufferBinds,
+            stats.resourceBarriers, stats.copyCommands, stats.bytesCopied, stats.buffersCreated, stats.bytesAllocated, stats.fenceSignals, stats.fenceWaits);
+        OutputDebugStringA(report);
+        printf("%s", report);
+    }
 
-        // Signal and increment the fence value.
-        ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_fenceValue));
-        m_fenceValue++;
+    const GeometryBufferStats geometryStats = m_geometryPool->GetStats();
 
-        // Wait until the previous frame is finished.
-        if (lastCompletedFence < fence)
-        {
-            ThrowIfFailed(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
-            WaitForSingleObject(m_fenceEvent, INFINITE);
-        }
+    char geometryReport[256];
+    sprintf_s(geometryReport,
+        "geometry pool: %u blocks, %llu of %llu bytes used, %u allocations, %u free ranges, largest free %llu bytes, fragmentation %.1f%%\n",
+        geometryStats.blockCount, geometryStats.usedBytes, geometryStats.reservedBytes, geometryStats.allocationCount,
+        geometryStats.freeRangeCount, geometryStats.largestFreeRange, 100.f * geometryStats.Fragmentation());
+    OutputDebugStringA(geometryReport);
+    if (m_graphicsDevice->GetBackend() == GraphicsBackend::Null)
+    {
+        printf("%s", geometryReport);
+    }
+
+    const MeshletCullStats& meshletStats = m_meshletCuller.GetStats();
+
+    char meshletReport[256];
+    sprintf_s(meshletReport, "meshlets: %llu tested, %llu outside the frustum, %llu back facing\n",
+        meshletStats.meshletsTested, meshletStats.frustumCulled, meshletStats.backfaceCulled);
+    OutputDebugStringA(meshletReport);
+    if (m_graphicsDevice->GetBackend() == GraphicsBackend::Null)
+    {
+        printf("%s", meshletReport);
+    }
+
+    // Every range goes back to the pool, anything left over was never released
+    for (auto& geometry : m_geometries)
+    {
+        geometry->Release(m_geometryPool.get(), m_releaseQueue.get());
+    }
+    m_releaseQueue->Flush();
+
+    if (m_geometryPool->GetStats().allocationCount != 0)
+    {
+        OutputDebugStringA("geometry pool: ranges leaked on shutdown\n");
     }
 }
 
-void MyD3D12::BuildDescriptorHeaps()
+void MyD3D12::BuildModel()
 {
-    // create a render target view (RTV) descriptor heap
-    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
-    rtvHeapDesc.NumDescriptors = FrameCount;
-    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-    rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-    ThrowIfFailed(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)));
-
-    // Describe and create a depth stencil view (DSV) descriptor heap.
-    D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc = {};
-    dsvHeapDesc.NumDescriptors = 1;
-    dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
-    dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-    ThrowIfFailed(m_device->CreateDescriptorHeap(&dsvHeapDesc, IID_PPV_ARGS(&m_dsvHeap)));
-
-    // create a const buffer view(CBV) descriptor heap
-
-    D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc = {};
-    cbvHeapDesc.NumDescriptors = (uint32_t)(m_allRenderers.size() + 1) * FrameCount;
-    cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    ThrowIfFailed(m_device->CreateDescriptorHeap(&cbvHeapDesc, IID_PPV_ARGS(&m_cbvHeap)));
-    NAME_D3D12_OBJECT(m_cbvHeap);
-
-    // Once we create the RTV descriptor heap, we need to get the size of the RTV descriptor type size on the GPU
-    // There is no guarentee that a descriptor type on one GPU is the same size as a descriptor on another GPU
-    m_rtvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-    m_cbvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    // Cooked meshes are loaded as they are, only missing or stale ones are built and cooked again
+    const uint32_t landSettings[] = { ProceduralGeometry::LandVersion, m_landSize, m_landSize, DXGI_FORMAT_R16_UINT, m_optimizeLand ? 1u : 0u };
+    MeshSource landSource;
+    landSource.settingsHash = HashMeshSettings(landSettings, sizeof(landSettings));
+
+    const std::wstring landCachePath = GetAssetFullPath(L"Land.meshcache");
+    std::vector<DrawRegistry::Handle> landDraws;
+    if (!LoadMeshCache(landCachePath, landSource, "Land", m_geometryPool.get(), m_uploadBatcher.get(), m_threadPool.get(), m_geometries, m_draws, landDraws))
+    {
+        ProceduralGeometry Land;
+        Land.CreateLand(m_geometryPool.get(), m_uploadBatcher.get(), m_threadPool.get(), m_geometries, m_draws,
+            landSettings[1], landSettings[2], static_cast<DXGI_FORMAT>(landSettings[3]), landSettings[4] != 0);
+        const Mesh* pLand = m_geometries.Get(m_geometries.Find("Land")).get();
+        landDraws.assign(1, m_draws.Find("Land"));
+        m_cacheWriteTasks.push_back(std::make_unique<ThreadPool::Task>([this, landCachePath, landSource, pLand, landDraws]
+        {
+            SaveMeshCache(landCachePath, landSource, *pLand, landDraws, m_draws, m_threadPool.get());
+        }));
+    }
+
+    // Names are only looked up while loading, everything past BuildModel() goes through the handles
+    m_landMesh = m_geometries.Find("Land");
+    m_landDraw = m_draws.Find("Land");
+
+    if (!m_modelPath.empty())
+    {
+        const uint32_t modelSettings[] = { ModelLoader::Version };
+        MeshSource modelSource;
+        modelSource.path = m_modelPath;
+        modelSource.settingsHash = HashMeshSettings(modelSettings, sizeof(modelSettings));
+
+        // Cooked next to the source
+        const std::wstring modelCachePath = m_modelPath + L".meshcache";
+        if (!LoadMeshCache(modelCachePath, modelSource, "Model", m_geometryPool.get(), m_uploadBatcher.get(), m_threadPool.get(), m_geometries, m_draws, m_modelDraws))
+        {
+            ModelLoader loader;
+            m_modelDraws = loader.LoadObj(m_modelPath, "Model", m_geometryPool.get(), m_uploadBatcher.get(), m_threadPool.get(), m_geometries, m_draws);
+            const Mesh* pModel = m_geometries.Get(m_geometries.Find("Model")).get();
+            m_cacheWriteTasks.push_back(std::make_unique<ThreadPool::Task>([this, modelCachePath, modelSource, pModel]
+            {
+                SaveMeshCache(modelCachePath, modelSource, *pModel, m_modelDraws, m_draws, m_threadPool.get());
+            }));
+        }
+
+        m_modelMesh = m_geometries.Find("Model");
+    }
+
+    // Only the indices of the water live in the pool, its vertices come from the frame resources
+    m_waves = std::make_unique<Waves>(128, 128, 1.f, 0.03f, 4.f, 0.2f, 2.f);
+    m_waves->CreateGeometry("Waves", m_geometryPool.get(), m_uploadBatcher.get(), m_geometries, m_draws);
+    m_wavesMesh = m_geometries.Find("Waves");
+    m_wavesDraw = m_draws.Find("Waves");
+
+    // All meshes built above share one batch
+    const UploadToken uploadToken = m_uploadBatcher->Submit();
+    for (auto& geometry : m_geometries)
+    {
+        geometry->uploadToken = uploadToken;
+    }
+
+    // No mesh or draw is added from here on, the caches are written while the rest of the setup runs
+    for (auto& cacheWriteTask : m_cacheWriteTasks)
+    {
+        m_threadPool->Submit(cacheWriteTask.get());
+    }
 }
 
-void MyD3D12::BuildRootSignature()
+void MyD3D12::BuildRenderer()
 {
-    D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
+    const Mesh::Draw* pLandDraw = m_draws.Get(m_landDraw).get();
 
-    /* 
-        This is the highest version the sample supports.
-        If CheckFeatureSupport succeeds, the HighestVersion returned will not be greater than this.
-    */
-    featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+    // A split draw gets a renderer per chunk, each is culled on its own
+    const size_t landRendererCount = MathHelper::Max<size_t>(pLandDraw->chunks.size(), 1);
+    for (size_t i = 0; i < landRendererCount; ++i)
+    {
+        auto landRenderer = std::make_unique<Renderer>();
+
+        landRenderer->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+        landRenderer->Geo = m_geometries.Get(m_landMesh).get();
+        landRenderer->pass = RenderPass::Opaque;
+        landRenderer->PSO = m_PSOs.Get(m_opaquePSO).Get();
+        landRenderer->rootSignature = m_rootSignature.Get();
+        landRenderer->objectIndex = static_cast<uint32_t>(m_allRenderers.size());
+        m_sceneGraph.AddNode(SceneGraph::NoNode, SceneGraph::Transform(), landRenderer->objectIndex);
+
+        const std::vector<Mesh::Draw::Lod>* pLods = &pLandDraw->lods;
+        if (pLandDraw->chunks.empty())
+        {
+            landRenderer->baseVertex = pLandDraw->baseVertex;
+            landRenderer->startIndex = pLandDraw->startIndex;
+            landRenderer->indexCount = pLandDraw->indexCount;
+        }
+        else
+        {
+            const Mesh::Draw::Chunk& chunk = pLandDraw->chunks[i];
+            landRenderer->baseVertex = chunk.baseVertex;
+            landRenderer->startIndex = chunk.startIndex;
+            landRenderer->indexCount = chunk.indexCount;
+            landRenderer->drawBounds = chunk.bounds;
+            pLods = &chunk.lods;
+        }
+
+        // Level 0 is the full range, the coarser levels follow
+        if (!pLods->empty())
+        {
+            landRenderer->lods.resize(pLods->size() + 1);
+            landRenderer->lods[0].startIndex = landRenderer->startIndex;
+            landRenderer->lods[0].indexCount = landRenderer->indexCount;
+            for (size_t level = 0; level < pLods->size(); ++level)
+            {
+                landRenderer->lods[level + 1].startIndex = (*pLods)[level].startIndex;
+                landRenderer->lods[level + 1].indexCount = (*pLods)[level].indexCount;
+                landRenderer->lods[level + 1].error = (*pLods)[level].error;
+            }
+        }
 
-    if (FAILED(m_device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+        m_pendingRenderers.push_back(landRenderer.get());
+        m_allRenderers.push_back(std::move(landRenderer));
+    }
+
+    // Blended over the land, the vertex buffer is set by UpdateWaves every frame
+    auto wavesRenderer = std::make_unique<Renderer>();
+    wavesRenderer->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    wavesRenderer->Geo = m_geometries.Get(m_wavesMesh).get();
+    wavesRenderer->pass = RenderPass::Transparent;
+    wavesRenderer->PSO = m_PSOs.Get(m_transparentPSO).Get();
+    wavesRenderer->rootSignature = m_rootSignature.Get();
+    wavesRenderer->objectIndex = static_cast<uint32_t>(m_allRenderers.size());
+    m_sceneGraph.AddNode(SceneGraph::NoNode, SceneGraph::Transform(), wavesRenderer->objectIndex);
+    wavesRenderer->indexCount = m_draws.Get(m_wavesDraw)->indexCount;
+
+    m_pendingRenderers.push_back(wavesRenderer.get());
+    m_allRenderers.push_back(std::move(wavesRenderer));
+
+    if (m_modelDraws.empty())
     {
-        featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+        return;
     }
 
-    CD3DX12_ROOT_PARAMETER1 rootParameters[2];
-    rootParameters[0].InitAsConstantBufferView(0);
-    rootParameters[1].InitAsConstantBufferView(1);
+    // Whatever its units, the model is scaled to a sphere hovering over the land in front of the camera
+    const XMFLOAT3 modelCenter(0.f, 20.f, -60.f);
+    const float modelRadius = 15.f;
 
-    CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
-    rootSignatureDesc.Init_1_1(_countof(rootParameters), rootParameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+    Mesh* pModel = m_geometries.Get(m_modelMesh).get();
+    const float modelScale = pModel->bounds[3] > 0.f ? modelRadius / pModel->bounds[3] : 1.f;
 
-    ComPtr<ID3DBlob> signature;
-    ComPtr<ID3DBlob> error;
-    ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, featureData.HighestVersion, &signature, &error));
-    ThrowIfFailed(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_rootSignature)));
-    NAME_D3D12_OBJECT(m_rootSignature);
+    // One node places the model, its draws hang off it and move with it
+    SceneGraph::Transform modelTransform;
+    modelTransform.scale = XMFLOAT3(modelScale, modelScale, modelScale);
+    modelTransform.translation = XMFLOAT3(
+        modelCenter.x - modelScale * pModel->bounds[0],
+        modelCenter.y - modelScale * pModel->bounds[1],
+        modelCenter.z - modelScale * pModel->bounds[2]);
+    const SceneGraph::NodeId modelNode = m_sceneGraph.AddNode(SceneGraph::NoNode, modelTransform);
+
+    for (DrawRegistry::Handle modelDraw : m_modelDraws)
+    {
+        const Mesh::Draw* pDraw = m_draws.Get(modelDraw).get();
+
+        auto modelRenderer = std::make_unique<Renderer>();
+
+        modelRenderer->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+        modelRenderer->Geo = pModel;
+        modelRenderer->pass = RenderPass::Opaque;
+        modelRenderer->PSO = m_PSOs.Get(m_surfacePSO).Get();
+        modelRenderer->rootSignature = m_rootSignature.Get();
+        modelRenderer->objectIndex = static_cast<uint32_t>(m_allRenderers.size());
+        m_sceneGraph.AddNode(modelNode, SceneGraph::Transform(), modelRenderer->objectIndex);
+        modelRenderer->baseVertex = pDraw->baseVertex;
+        modelRenderer->startIndex = pDraw->startIndex;
+        modelRenderer->indexCount = pDraw->indexCount;
+
+        m_pendingRenderers.push_back(modelRenderer.get());
+        m_allRenderers.push_back(std::move(modelRenderer));
+    }
 }
 
-void MyD3D12::BuildShaderAndInputLayout()
+// Hands the worlds the scene graph recomputed to their renderers
+void MyD3D12::UpdateSceneGraph()
 {
-    m_shaders["LandVS"] = CompileShader(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, "VSMain", "vs_5_0");
-    m_shaders["LandPS"] = CompileShader(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, "PSMain", "ps_5_0");
+    m_sceneGraph.Update(m_threadPool.get(), m_changedObjects);
 
-    m_inputLayout =
+    for (const SceneGraph::ChangedObject& changed : m_changedObjects)
     {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-    };
+        SetRendererWorld(m_allRenderers[changed.objectIndex].get(), m_sceneGraph.GetWorld(changed.node));
+    }
 }
 
-void MyD3D12::BuildPSO()
+// Keeps the renderer's world and its copy in the transform store, the one the shaders get, in step
+void MyD3D12::SetRendererWorld(Renderer* pRenderer, const XMFLOAT4X4& world)
 {
-    // Describe and create the graphics pipeline state object (PSO).
-    D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePSODesc = {};
-    ZeroMemory(&opaquePSODesc, sizeof(opaquePSODesc));
-
-    opaquePSODesc.InputLayout = { m_inputLayout.data(), (uint32_t)m_inputLayout.size()};
-    opaquePSODesc.pRootSignature = m_rootSignature.Get();
-    opaquePSODesc.VS =
-    {
-        reinterpret_cast<BYTE*>(m_shaders["LandVS"]->GetBufferPointer()),
-        m_shaders["LandVS"]->GetBufferSize()
-    };
-    opaquePSODesc.PS = 
-    {
-        reinterpret_cast<BYTE*>(m_shaders["LandPS"]->GetBufferPointer()),
-        m_shaders["LandPS"]->GetBufferSize()
-    };
-    opaquePSODesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
-    opaquePSODesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
-    opaquePSODesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
-    opaquePSODesc.SampleMask = UINT_MAX;  //set the sampling for each pixel(Multiple sampling takes up to 32 samples)
-    opaquePSODesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-    opaquePSODesc.NumRenderTargets = 1;   //The number of render target formats in the RTVFormats member
-    opaquePSODesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-    opaquePSODesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
-    opaquePSODesc.SampleDesc.Count = 1;
-
-    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&opaquePSODesc, IID_PPV_ARGS(&m_PSOs["opaque"])));
-    NAME_D3D12_OBJECT(m_PSOs["opaque"]);
+    pRenderer->world = world;
+
+    if (pRenderer->objectIndex >= m_transforms.GetCount())
+    {
+        m_transforms.Resize(pRenderer->objectIndex + 1);
+    }
+
+    // Packed positions are decoded by the same matrix
+    m_transforms.SetWorld(pRenderer->objectIndex, XMMatrixMultiply(pRenderer->Geo->positionQuantization.GetDecodeMatrix(), XMLoadFloat4x4(&world)));
 }
 
-void MyD3D12::BuildRTVDSV()
+// Steps the water and writes its vertices into the current frame resource, the two are timed apart
+void MyD3D12::UpdateWaves(float dt)
 {
-    // Create rtv 
+    const auto start = std::chrono::steady_clock::now();
+
+    m_waveDisturbTime += dt;
+    if (m_waveDisturbTime >= 0.25f)
     {
-        // get a handle to the first descriptor in the descriptor heap
-        CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
+        m_waveDisturbTime = 0.f;
 
-        // Create a RTV for each frame
-        for (UINT n = 0; n < FrameCount; n++)
-        {
-            // get a pointer to the buffer in the swap chain
-            ThrowIfFailed(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])));
-            // create a descriptor that points to the resource and store it in a descriptor handle
-            m_device->CreateRenderTargetView(m_renderTargets[n].Get(), nullptr, rtvHandle);
-            // increment the rtv handle by the rtv descriptor size we got above
-            rtvHandle.Offset(1, m_rtvDescriptorSize);
-
-            NAME_D3D12_OBJECT_INDEXED(m_renderTargets, n);
-        }
+        const uint32_t i = MathHelper::Rand(4, m_waves->GetRowCount() - 5);
+        const uint32_t j = MathHelper::Rand(4, m_waves->GetColumnCount() - 5);
+        m_waves->Disturb(i, j, MathHelper::RandF(0.2f, 0.5f));
     }
 
-    //Create dsv
+    m_waves->Update(dt, m_threadPool.get());
+
+    const auto simulated = std::chrono::steady_clock::now();
+
+    UploadBuffer<PackedColorVertex>* pVertexBuffer = m_pCurrentFrameResource->waveVertexBuffer.get();
+    m_waves->WriteVertices(pVertexBuffer->MappedData(), m_threadPool.get());
+
+    // Drawn from upload memory, the buffer is only rewritten once this frame has completed on the GPU
+    Mesh* pWavesGeo = m_geometries.Get(m_wavesMesh).get();
+    pWavesGeo->vertexBufferGPU = pVertexBuffer->ResourcePtr();
+    pWavesGeo->vbOffset = 0;
+    pWavesGeo->vbSize = m_waves->GetVertexCount() * sizeof(PackedColorVertex);
+
+    const auto streamed = std::chrono::steady_clock::now();
+
+    m_waveSimulationSeconds += std::chrono::duration<double>(simulated - start).count();
+    m_waveStreamingSeconds += std::chrono::duration<double>(streamed - simulated).count();
+}
+
+// Starts drawing renderers whose mesh has finished uploading on the copy queue
+void MyD3D12::UpdatePendingRenderers()
+{
+    if (m_pendingRenderers.empty())
     {
+        return;
+    }
+
+    // Read the fence once so a renderer can't change state halfway through
+    const UINT64 completedUpload = m_graphicsDevice->GetCompletedCopyFenceValue();
+
+    size_t stillPending = 0;
+    for (Renderer* pRenderer : m_pendingRenderers)
+    {
+        if (pRenderer->Geo->uploadToken <= completedUpload)
+        {
+            const bool isTransparent = pRenderer->pass == RenderPass::Transparent;
+            std::vector<Renderer*>& renderers = isTransparent ? m_transparentRenderers : m_opaqueRenderers;
+            FrustumCuller& culler = isTransparent ? m_transparentCuller : m_opaqueCuller;
 
-        ThrowIfFailed(m_device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R24G8_TYPELESS, m_width, m_height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL, D3D12_TEXTURE_LAYOUT_UNKNOWN),
-            D3D12_RESOURCE_STATE_COMMON,
-            &CD3DX12_CLEAR_VALUE(DXGI_FORMAT_D24_UNORM_S8_UINT, 1.0f, 0), // Performance tip: Tell the runtime at resource creation the desired clear value.
-            IID_PPV_ARGS(&m_depthStencil)
-        ));
+            const uint32_t cullIndex = static_cast<uint32_t>(renderers.size());
+            renderers.push_back(pRenderer);
+            pRenderer->cullIndex = cullIndex;
 
-        NAME_D3D12_OBJECT(m_depthStencil);
+            culler.Resize(cullIndex + 1);
+            culler.SetSphere(cullIndex, pRenderer->GetBounds(), pRenderer->world);
 
-        D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
-        depthStencilDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-        depthStencilDesc.Flags = D3D12_DSV_FLAG_NONE;
-        depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+            pRenderer->stateKey = m_drawKeyBuilder.BuildStateKey(*pRenderer);
+            for (RendererLod& lod : pRenderer->lods)
+            {
+                lod.stateKey = m_drawKeyBuilder.BuildStateKey(*pRenderer, lod.startIndex, lod.indexCount);
+            }
 
-        m_device->CreateDepthStencilView(m_depthStencil.Get(), &depthStencilDesc, m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
+            m_indirectDrawListDirty |= !isTransparent;
+        }
+        else
+        {
+            m_pendingRenderers[stillPending++] = pRenderer;
+        }
     }
+
+    m_pendingRenderers.resize(stillPending);
 }
 
-void MyD3D12::BuildModel()
+void MyD3D12::CullAndSortRenderers(const XMMATRIX& view, const XMMATRIX& projection, float farPlane)
 {
-    ProceduralGeometry Land;
-    Land.CreateLand(m_device, m_commandList, m_geometries, m_draws);
+    XMFLOAT4X4 cullView;
+    XMFLOAT4X4 cullViewProjection;
+    XMStoreFloat4x4(&cullView, view);
+    XMStoreFloat4x4(&cullViewProjection, XMMatrixMultiply(view, projection));
+
+    // Moved renderers need a new world space sphere, the ones not drawable yet get theirs when they become drawable
+    m_transforms.ConsumeDirtyRuns(CullDirtySet, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const Renderer* pRenderer = m_allRenderers[i].get();
+            if (pRenderer->cullIndex != Renderer::NotCulled)
+            {
+                FrustumCuller& culler = pRenderer->pass == RenderPass::Transparent ? m_transparentCuller : m_opaqueCuller;
+                culler.SetSphere(pRenderer->cullIndex, pRenderer->GetBounds(), pRenderer->world);
+            }
+        }
+    });
+
+    m_visibleRenderers.clear();
+    m_drawSortItems.clear();
+    m_depthSortItems.clear();
+
+    // The indirect draw list covers all opaque renderers
+    if (m_indirectDrawList == nullptr)
+    {
+        AddVisibleRenderers(m_opaqueRenderers, m_opaqueCuller, cullView, cullViewProjection, farPlane);
+    }
+    AddVisibleRenderers(m_transparentRenderers, m_transparentCuller, cullView, cullViewProjection, farPlane);
+
+    // One sort for all passes, the pass is the top of the key
+    RadixSort(m_drawSortItems, m_drawSortScratch);
+
+    m_sortedRenderers.resize(m_drawSortItems.size());
+    for (size_t i = 0; i < m_drawSortItems.size(); ++i)
+    {
+        m_sortedRenderers[i] = m_visibleRenderers[m_drawSortItems[i].index];
+    }
+
+    RadixSort(m_depthSortItems, m_drawSortScratch);
+
+    m_depthRenderers.resize(m_depthSortItems.size());
+    for (size_t i = 0; i < m_depthSortItems.size(); ++i)
+    {
+        m_depthRenderers[i] = m_visibleRenderers[m_depthSortItems[i].index];
+    }
 }
 
-void MyD3D12::BuildRenderer()
+void MyD3D12::AddVisibleRenderers(
+    const std::vector<Renderer*>& renderers,
+    FrustumCuller& culler,
+    const XMFLOAT4X4& view,
+    const XMFLOAT4X4& viewProjection,
+    float farPlane)
 {
-    auto landRenderer = std::make_unique<Renderer>();
-
-    landRenderer->world = MathHelper::Identity4x4();
-    landRenderer->numFramesDirty = FrameCount;
-    landRenderer->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    landRenderer->Geo = m_geometries["Land"].get();
-    landRenderer->objectIndex = 0;
-    landRenderer->baseVertex = m_draws["Land"]->baseVertex;
-    landRenderer->startIndex = m_draws["Land"]->startIndex;
-    landRenderer->indexCount = m_draws["Land"]->indexCount;
-
-    m_opaqueRenderers.push_back(landRenderer.get());
-    m_allRenderers.push_back(std::move(landRenderer));
+    culler.Cull(viewProjection, m_visibleIndices);
+
+    const float depthScale = 1.f / farPlane;
+
+    for (uint32_t index : m_visibleIndices)
+    {
+        Renderer* pRenderer = renderers[index];
+
+        // The view is right handed, it looks down -z
+        const XMFLOAT3 center = culler.GetCenter(index);
+        const float viewDepth = -(center.x * view._13 + center.y * view._23 + center.z * view._33 + view._43);
+
+        if (!pRenderer->lods.empty())
+        {
+            pRenderer->SetLod(m_lodSelector.Select(*pRenderer, center, culler.GetRadius(index)));
+        }
+
+        SortItem item;
+        item.key = DrawKeyBuilder::BuildKey(pRenderer->pass, pRenderer->stateKey, viewDepth * depthScale);
+        item.index = static_cast<uint32_t>(m_visibleRenderers.size());
+
+        m_drawSortItems.push_back(item);
+
+        // Meshes without a position only stream just aren't in the prepass, the color pass still draws them
+        if (m_useDepthPrepass && pRenderer->pass == RenderPass::Opaque && pRenderer->Geo->vbDepthSize > 0)
+        {
+            item.key = DrawKeyBuilder::BuildDepthKey(pRenderer->stateKey, viewDepth * depthScale);
+            m_depthSortItems.push_back(item);
+        }
+
+        m_visibleRenderers.push_back(pRenderer);
+    }
 }
 
 void MyD3D12::BuildFrameResources()
 {
+    m_uploadRing = std::make_unique<UploadRingBuffer>(m_graphicsDevice.get(), UploadRingSize);
+
     for (UINT i = 0; i < FrameCount; ++i)
     {
-        m_frameResources.push_back(std::make_unique<FrameResource>(m_device.Get(), 1, (uint32_t)m_allRenderers.size()));
+        m_frameResources.push_back(std::make_unique<FrameResource>(m_graphicsDevice.get(), (uint32_t)m_allRenderers.size(), m_threadPool->GetThreadCount(), m_waves->GetVertexCount()));
     }
 }
 
+void MyD3D12::BuildWorkerCommandLists()
+{
+    /*
+        Lists are created in the recording state, close each one before creating the next
+        so the setup allocator never backs two open lists.
+        They are reset onto the frame resource allocators every frame.
+    */
+    m_postCommandList = m_graphicsDevice->CreateCommandList(D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.get(), nullptr);
+    ThrowIfFailed(m_postCommandList->Close());
+
+    for (UINT i = 0; i < m_threadPool->GetThreadCount(); ++i)
+    {
+        m_workerCommandLists.push_back(m_graphicsDevice->CreateCommandList(D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.get(), nullptr));
+        ThrowIfFailed(m_workerCommandLists.back()->Close());
+    }
+
+    m_submitCommandLists.reserve(m_workerCommandLists.size() + 2);
+}
+
 void MyD3D12::OnKeyUp(UINT8 key)
 {
     m_camera.OnKeyUp(key);
@@ -445,54 +861,129 @@ void MyD3D12::OnKeyUp(UINT8 key)
 void MyD3D12::OnKeyDown(UINT8 key)
 {
     m_camera.OnKeyDown(key);
+
+    if (key == 'Z')
+    {
+        m_useDepthPrepass = !m_useDepthPrepass;
+    }
 }
 
-void MyD3D12::PopulateCommandList()
+void MyD3D12::PopulateCommandList(FrameResource* pFrameResource)
 {
+    /*
+        Split the sorted instance batches into contiguous chunks, one command list each.
+        Chunks are recorded in parallel and submitted in chunk order, so the GPU
+        sees the same draw order as a single list would give.
+        They don't depend on the frame start and end lists, those are recorded here meanwhile.
+    */
+    const size_t batchCount = pFrameResource->instanceBatches.size();
+    const size_t maxChunkCount = m_workerCommandLists.size();
+    const size_t chunkCount = MathHelper::Max<size_t>(1, MathHelper::Min<size_t>(maxChunkCount, (batchCount + MinBatchesPerCommandList - 1) / MinBatchesPerCommandList));
+
+    ThreadPool::Task recordChunksTask([&]
+    {
+        m_threadPool->Dispatch(static_cast<uint32_t>(chunkCount), [&](uint32_t chunk)
+        {
+            GraphicsCommandAllocator* pAllocator = pFrameResource->workerCommandAllocators[chunk].get();
+            GraphicsCommandList* pCommandList = m_workerCommandLists[chunk].get();
+
+            ThrowIfFailed(pAllocator->Reset());
+            // The batches carry their PSO and root signature
+            ThrowIfFailed(pCommandList->Reset(pAllocator, nullptr));
+
+            // Command lists don't inherit state, every list sets up its own
+            SetRenderTargetState(pCommandList);
+
+            pCommandList->BeginEvent(L"Draw Scene");
+
+            const size_t begin = batchCount * chunk / chunkCount;
+            const size_t end = batchCount * (chunk + 1) / chunkCount;
+            pFrameResource->PopulateCommandList(pCommandList, begin, end);
+
+            pCommandList->EndEvent();
+
+            ThrowIfFailed(pCommandList->Close());
+        });
+    });
+    m_threadPool->Submit(&recordChunksTask);
+
     /*
         Command list allocators can only be reset when the associated
         command lists have finished execution on the GPU
         apps should use fences to determine GPU execution progress
     */
-    ThrowIfFailed(m_pCurrentFrameResource->commandAllocator->Reset());
+    ThrowIfFailed(pFrameResource->commandAllocator->Reset());
 
     /* 
         when ExecuteCommandList() is called on a particular command list 
         command list can then be reset at any time and must be before re-recording
     */
-    ThrowIfFailed(m_commandList->Reset(m_pCurrentFrameResource->commandAllocator.Get(), m_PSOs["opaque"].Get()));
-
-    // Set necessary state
-    m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
-
-    /*
-    ID3D12DescriptorHeap* ppHeaps[] = { m_cbvHeap.Get() };
-    m_commandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
-    */
-
-    m_commandList->RSSetViewports(1, &m_viewport);
-    m_commandList->RSSetScissorRects(1, &m_scissorRect);
+    ThrowIfFailed(m_commandList->Reset(pFrameResource->commandAllocator.get(), nullptr));
 
     // Indicate that the back buffer will be used as a render target.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+    const CD3DX12_RESOURCE_BARRIER renderTargetBarrier = CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    m_commandList->ResourceBarrier(1, &renderTargetBarrier);
 
-    CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart(), m_frameIndex, m_rtvDescriptorSize);
-    CD3DX12_CPU_DESCRIPTOR_HANDLE dsvHandle(m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
-    m_commandList->OMSetRenderTargets(1, &rtvHandle, TRUE, &dsvHandle);
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeapStart, m_frameIndex, m_rtvDescriptorSize);
+    CD3DX12_CPU_DESCRIPTOR_HANDLE dsvHandle(m_dsvHeapStart);
 
     // Record commands.
     const float clearColor[] = { 1.f, 1.f, 1.f, 1.f };
     m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
-    m_commandList->ClearDepthStencilView(m_dsvHeap->GetCPUDescriptorHandleForHeapStart(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.f, 0, 0, nullptr);
+    m_commandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.f, 0, 0, nullptr);
 
-    PIXBeginEvent(m_commandList.Get(), 0, L"Draw Land");
+    if (m_indirectDrawList != nullptr)
+    {
+        if (m_indirectDrawListDirty)
+        {
+            m_indirectDrawList->Build(m_graphicsDevice.get(), m_commandList.get(), m_releaseQueue.get(), m_opaqueRenderers);
+            m_indirectDrawListDirty = false;
+        }
 
-    m_pCurrentFrameResource->PopulateCommandList(m_commandList.Get(), m_opaqueRenderers);
+        SetRenderTargetState(m_commandList.get());
 
-    PIXEndEvent(m_commandList.Get());
+        m_commandList->BeginEvent(L"Draw Indirect");
+        m_indirectDrawList->Record(
+            m_commandList.get(),
+            m_commandSignature.Get(),
+            pFrameResource->passCBAddress,
+            pFrameResource->objectUploadBuffer->Resource()->GetGPUVirtualAddress());
+        m_commandList->EndEvent();
+    }
+
+    ThrowIfFailed(m_commandList->Close());
+
+    // The main allocator is free again now that m_commandList is closed
+    ThrowIfFailed(m_postCommandList->Reset(pFrameResource->commandAllocator.get(), nullptr));
 
     // Indicate that the back buffer will now be used to present.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+    const CD3DX12_RESOURCE_BARRIER presentBarrier = CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
+    m_postCommandList->ResourceBarrier(1, &presentBarrier);
 
-    ThrowIfFailed(m_commandList->Close());
+    ThrowIfFailed(m_postCommandList->Close());
+
+    m_threadPool->Wait(&recordChunksTask);
+
+    m_submitCommandLists.clear();
+    m_submitCommandLists.push_back(m_commandList.get());
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        m_submitCommandLists.push_back(m_workerCommandLists[i].get());
+    }
+    m_submitCommandLists.push_back(m_postCommandList.get());
+}
+
+void MyD3D12::SetRenderTargetState(GraphicsCommandList* pCommandList)
+{
+    /*
+    ID3D12DescriptorHeap* ppHeaps[] = { m_cbvHeap.Get() };
+    pCommandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+    */
+
+    pCommandList->RSSetViewports(1, &m_viewport);
+    pCommandList->RSSetScissorRects(1, &m_scissorRect);
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeapStart, m_frameIndex, m_rtvDescriptorSize);
+    CD3DX12_CPU_DESCRIPTOR_HANDLE dsvHandle(m_dsvHeapStart);
+    pCommandList->OMSetRenderTargets(1, &rtvHandle, TRUE, &dsvHandle);
 }
@@ -5,6 +5,19 @@
 #include "StepTimer.h"
 #include "FrameResource.h"
 #include "Renderer.h"
+#include "GraphicsDevice.h"
+#include "ThreadPool.h"
+#include "UploadBatcher.h"
+#include "GeometryBufferPool.h"
+#include "FrustumCuller.h"
+#include "DrawKey.h"
+#include "RadixSort.h"
+#include "IndirectDrawList.h"
+#include "LodSelector.h"
+#include "Waves.h"
+#include "TransformStore.h"
+#include "SceneGraph.h"
+#include "ResourceRegistry.h"
 
 using namespace DirectX;
 
@@ -30,55 +43,163 @@ public:
 private:
     static const UINT FrameCount = 3;
 
+    // Below this many draws per list the Reset/Close and thread hand-off cost more than they save
+    static const UINT MinBatchesPerCommandList = 256;
+
+    // Per frame constants, dynamic vertices and staging data, shared by all frames in flight
+    static const UINT64 UploadRingSize = 16 * 1024 * 1024;
+
+    typedef ResourceRegistry<ComPtr<ID3D12PipelineState>> PipelineRegistry;
+    typedef ResourceRegistry<ComPtr<ID3DBlob>> ShaderRegistry;
+
     // Pipeline objects.
     CD3DX12_VIEWPORT m_viewport;
     CD3DX12_RECT m_scissorRect;
+#ifndef NULL_BACKEND_ONLY
     ComPtr<IDXGISwapChain3> m_swapChain;
-    ComPtr<ID3D12Device> m_device;
+#endif
+    ComPtr<ID3D12Device> m_device;      // nullptr on the null backend, only used while building init time objects
+    std::unique_ptr<GraphicsDevice> m_graphicsDevice;
+    std::unique_ptr<UploadBatcher> m_uploadBatcher;
+    std::unique_ptr<GeometryBufferPool> m_geometryPool;
+    std::unique_ptr<DeferredReleaseQueue> m_releaseQueue;
     ComPtr<ID3D12Resource> m_renderTargets[FrameCount];
     ComPtr<ID3D12Resource> m_depthStencil;
-    ComPtr<ID3D12CommandAllocator> m_commandAllocator;
-    ComPtr<ID3D12CommandQueue> m_commandQueue;
+    std::unique_ptr<GraphicsCommandAllocator> m_commandAllocator;
     ComPtr<ID3D12RootSignature> m_rootSignature;
     ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
     ComPtr<ID3D12DescriptorHeap> m_cbvHeap;
     ComPtr<ID3D12DescriptorHeap> m_dsvHeap;
-    std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> m_PSOs;
+    PipelineRegistry m_PSOs;            // null pipeline states on the null backend
+    PipelineRegistry::Handle m_opaquePSO;
+    PipelineRegistry::Handle m_surfacePSO;
+    PipelineRegistry::Handle m_depthPSO;
+    PipelineRegistry::Handle m_transparentPSO;
     std::vector<D3D12_INPUT_ELEMENT_DESC> m_inputLayout;
-    std::unordered_map<std::string, ComPtr<ID3DBlob>> m_shaders;
-    ComPtr<ID3D12GraphicsCommandList> m_commandList;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> m_surfaceInputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> m_depthInputLayout;
+    ShaderRegistry m_shaders;
+    ShaderRegistry::Handle m_landVS;
+    ShaderRegistry::Handle m_landPS;
+    ShaderRegistry::Handle m_surfaceVS;
+    ShaderRegistry::Handle m_surfacePS;
+    ShaderRegistry::Handle m_depthVS;
+    std::unique_ptr<GraphicsCommandList> m_commandList;         // frame start: barrier and clears
+    std::unique_ptr<GraphicsCommandList> m_postCommandList;     // frame end: barrier back to present
+    std::vector<std::unique_ptr<GraphicsCommandList>> m_workerCommandLists;
+    std::vector<GraphicsCommandList*> m_submitCommandLists;
+    D3D12_CPU_DESCRIPTOR_HANDLE m_rtvHeapStart;
+    D3D12_CPU_DESCRIPTOR_HANDLE m_dsvHeapStart;
 
     // App resources
     UINT m_rtvDescriptorSize;
     UINT m_cbvDescriptorSize;
     UINT m_passCBVOffset;
-    std::unordered_map<std::string, std::unique_ptr<Mesh>> m_geometries;
-    std::unordered_map<std::string, std::unique_ptr<Mesh::Draw>> m_draws;
+    MeshRegistry m_geometries;
+    DrawRegistry m_draws;
+    MeshRegistry::Handle m_landMesh;
+    DrawRegistry::Handle m_landDraw;
+    MeshRegistry::Handle m_wavesMesh;
+    DrawRegistry::Handle m_wavesDraw;
+    MeshRegistry::Handle m_modelMesh;                   // invalid without -model
+    std::vector<DrawRegistry::Handle> m_modelDraws;     // draws of the -model file, in m_modelMesh
+    std::vector<std::unique_ptr<ThreadPool::Task>> m_cacheWriteTasks;     // mesh caches written during OnInit
+
+    // Water simulated on the CPU, its vertices are written into the frame resource every frame
+    std::unique_ptr<Waves> m_waves;
+    float m_waveDisturbTime;            // since the last random disturbance
+    double m_waveSimulationSeconds;     // simulation and vertex writing time since the last report
+    double m_waveStreamingSeconds;
     StepTimer m_timer;
     FpsCamera m_camera;
     bool m_isWireFrame;
 
     //Frame resources
+    std::unique_ptr<UploadRingBuffer> m_uploadRing;
     std::vector<std::unique_ptr<FrameResource>> m_frameResources;
     FrameResource* m_pCurrentFrameResource;
     UINT m_currentFrameResourceIndex;
 
     // renderer resources
-    std::vector<std::unique_ptr<Renderer>> m_allRenderers;
+    std::vector<std::unique_ptr<Renderer>> m_allRenderers;     // indexed by Renderer::objectIndex
     std::vector<Renderer*> m_opaqueRenderers;
     std::vector<Renderer*> m_transparentRenderers;
+    std::vector<Renderer*> m_pendingRenderers;     // drawn once their mesh upload has completed
+
+    // Renderers are attached to nodes by object index, their worlds follow the nodes
+    SceneGraph m_sceneGraph;
+    std::vector<SceneGraph::ChangedObject> m_changedObjects;
+
+    // World matrices as uploaded, dirty sets 0 to FrameCount - 1 belong to the frame resources
+    static const uint32_t CullDirtySet = FrameCount;
+    TransformStore m_transforms;
+
+    // Frustum culling, sphere i of a culler bounds renderer i of its list
+    FrustumCuller m_opaqueCuller;
+    FrustumCuller m_transparentCuller;
+    std::vector<uint32_t> m_visibleIndices;
+
+    // Visible renderers with meshlets only draw their visible meshlets
+    MeshletCuller m_meshletCuller;
+
+    // Visible renderers with LOD levels draw the coarsest one that is accurate enough at their distance
+    LodSelector m_lodSelector;
+
+    // Visible renderers of all passes in draw key order
+    DrawKeyBuilder m_drawKeyBuilder;
+    std::vector<Renderer*> m_visibleRenderers;
+    std::vector<SortItem> m_drawSortItems;
+    std::vector<SortItem> m_drawSortScratch;
+    std::vector<Renderer*> m_sortedRenderers;
+
+    // Visible opaque renderers again, nearest first, for the depth prepass. Empty while it is off
+    std::vector<SortItem> m_depthSortItems;
+    std::vector<Renderer*> m_depthRenderers;
+
+    // GPU driven opaque pass (-indirect), rebuilt when m_opaqueRenderers changes
+    ComPtr<ID3D12CommandSignature> m_commandSignature;
+    std::unique_ptr<IndirectDrawList> m_indirectDrawList;
+    bool m_indirectDrawListDirty;
      
+    // Work stealing scheduler, everything that fans out goes through it
+    std::unique_ptr<ThreadPool> m_threadPool;
+
+    /*
+        Pipelined frames (-pipelined): OnUpdate() builds the next frame while the render thread
+        records and submits the previous one. The frame resource is the snapshot handed over,
+        its batches, constants and views are all the render thread reads of the scene.
+        m_frameIndex and the command lists belong to the render thread while it runs.
+    */
+    std::thread m_renderThread;
+    std::mutex m_renderMutex;
+    std::condition_variable m_renderCondition;
+    FrameResource* m_pRenderFrameResource;          // waiting for the render thread, nullptr once taken
+    FrameResource* m_pSubmittedFrameResource;       // previous one handed over, its fence not passed on yet
+    FrameResource* m_pRenderedFrameResource;        // last one the render thread has signaled
+    bool m_stopRenderThread;
+    std::exception_ptr m_renderException;
+
     // Synchronization objects.
     UINT m_frameIndex;
-    HANDLE m_fenceEvent;
     UINT m_frameCounter;
-    ComPtr<ID3D12Fence> m_fence;
-    UINT64 m_fenceValue;
 
     void LoadPipeline();
+    void LoadNullPipeline();
     void LoadAssets();
-    void PopulateCommandList();
+    void RenderFrame(FrameResource* pFrameResource);
+    void RenderThreadLoop();
+    void StopRenderThread();
+    void WaitForSubmittedFrame();
+    void PopulateCommandList(FrameResource* pFrameResource);
+    void SetRenderTargetState(GraphicsCommandList* pCommandList);
+    void UpdateSceneGraph();
+    void SetRendererWorld(Renderer* pRenderer, const XMFLOAT4X4& world);
+    void UpdatePendingRenderers();
+    void UpdateWaves(float dt);
+    void CullAndSortRenderers(const XMMATRIX& view, const XMMATRIX& projection, float farPlane);
+    void AddVisibleRenderers(const std::vector<Renderer*>& renderers, FrustumCuller& culler, const XMFLOAT4X4& view, const XMFLOAT4X4& viewProjection, float farPlane);
 
+    // In MyD3D12Pipeline.cpp with LoadPipeline(), only the D3D12 backend calls them
     void BuildDescriptorHeaps();
     void BuildRootSignature();
     void BuildShaderAndInputLayout();
@@ -87,4 +208,5 @@ private:
     void BuildModel();
     void BuildRenderer();
     void BuildFrameResources();
+    void BuildWorkerCommandLists();
 };
@@ -0,0 +1,334 @@
+#include "pch.h"
+#include "MyD3D12.h"
+#include "D3D12GraphicsDevice.h"
+
+// The parts of MyD3D12 that need the D3D12 runtime, DXGI, D3DCompiler or a window, left out of the portable build
+
+// Load the rendering pipeline dependencies.
+void MyD3D12::LoadPipeline()
+{
+    UINT dxgiFactoryFlags = 0;
+
+///*
+#if defined(_DEBUG)
+    // Enable the debug layer (requires the Graphics Tools "optional feature").
+    // NOTE: Enabling the debug layer after device creation will invalidate the active device.
+    {
+        ComPtr<ID3D12Debug> debugController;
+        if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
+        {
+            debugController->EnableDebugLayer();
+
+            // Enable additional debug layers.
+            dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
+        }
+    }
+#endif
+//*/
+
+    ComPtr<IDXGIFactory4> factory;  ////DXGI factory is used to create device
+    ThrowIfFailed(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+
+    if (m_useWarpDevice)    //create software adapter
+    {
+        ComPtr<IDXGIAdapter> warpAdapter;
+        ThrowIfFailed(factory->EnumWarpAdapter(IID_PPV_ARGS(&warpAdapter)));    //enum adapter
+
+        ThrowIfFailed(D3D12CreateDevice(
+            warpAdapter.Get(),
+            D3D_FEATURE_LEVEL_11_0,     //Specifies the highest version is D3D12
+            IID_PPV_ARGS(&m_device)
+            ));
+    }
+    else   //create hardware adapter
+    {
+        ComPtr<IDXGIAdapter1> hardwareAdapter;
+        GetHardwareAdapter(factory.Get(), &hardwareAdapter);    //acquir first available hardware adapter that supports Direct3D 12
+
+        ThrowIfFailed(D3D12CreateDevice(
+            hardwareAdapter.Get(),
+            D3D_FEATURE_LEVEL_11_0,
+            IID_PPV_ARGS(&m_device)
+            ));
+    }
+
+    // Describe and create the command queue.
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+
+    ComPtr<ID3D12CommandQueue> commandQueue;
+    ThrowIfFailed(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue)));
+    NAME_D3D12_OBJECT(commandQueue);  //Associates a name with the device object. This name is for use in debug diagnostics and tools
+
+    // Describe and create the swap chain.
+    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+    swapChainDesc.BufferCount = FrameCount;  //number of swap chain buffers
+    swapChainDesc.Width = m_width;  //buffer width
+    swapChainDesc.Height = m_height;    //buffer hidth
+    swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;      //Buffer format
+    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;    //Buffer usage
+    //specify bit-block transfer(bitblt) model and specify that DXGI discard the contents of the back buffer after call
+    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+    swapChainDesc.SampleDesc.Count = 1; //number of multisamples per pixel
+
+    ComPtr<IDXGISwapChain1> swapChain;
+    ThrowIfFailed(factory->CreateSwapChainForHwnd(
+        commandQueue.Get(),        // Swap chain needs the queue so that it can force a flush on it
+        Win32Application::GetHwnd(), //HWND handle that is associated with the swap chain that CreateSwapChainForHwnd creates
+        &swapChainDesc,     
+        nullptr,
+        nullptr,
+        &swapChain
+        ));
+
+    // This sample does not support fullscreen transitions.
+    ThrowIfFailed(factory->MakeWindowAssociation(Win32Application::GetHwnd(), DXGI_MWA_NO_ALT_ENTER));
+
+    ThrowIfFailed(swapChain.As(&m_swapChain));
+    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+
+    BuildDescriptorHeaps();
+
+    // The frame loop records and submits through the graphics device from here on
+    m_graphicsDevice = std::make_unique<D3D12GraphicsDevice>(m_device, commandQueue);
+
+    m_commandAllocator = m_graphicsDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT);
+}
+
+void MyD3D12::BuildDescriptorHeaps()
+{
+    // create a render target view (RTV) descriptor heap
+    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
+    rtvHeapDesc.NumDescriptors = FrameCount;
+    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+    rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    ThrowIfFailed(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)));
+
+    // Describe and create a depth stencil view (DSV) descriptor heap.
+    D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc = {};
+    dsvHeapDesc.NumDescriptors = 1;
+    dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+    dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    ThrowIfFailed(m_device->CreateDescriptorHeap(&dsvHeapDesc, IID_PPV_ARGS(&m_dsvHeap)));
+
+    // create a const buffer view(CBV) descriptor heap
+
+    D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc = {};
+    cbvHeapDesc.NumDescriptors = (uint32_t)(m_allRenderers.size() + 1) * FrameCount;
+    cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    ThrowIfFailed(m_device->CreateDescriptorHeap(&cbvHeapDesc, IID_PPV_ARGS(&m_cbvHeap)));
+    NAME_D3D12_OBJECT(m_cbvHeap);
+
+    // Once we create the RTV descriptor heap, we need to get the size of the RTV descriptor type size on the GPU
+    // There is no guarentee that a descriptor type on one GPU is the same size as a descriptor on another GPU
+    m_rtvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+    m_cbvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    m_rtvHeapStart = m_rtvHeap->GetCPUDescriptorHandleForHeapStart();
+    m_dsvHeapStart = m_dsvHeap->GetCPUDescriptorHandleForHeapStart();
+}
+
+void MyD3D12::BuildRootSignature()
+{
+    D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
+
+    /* 
+        This is the highest version the sample supports.
+        If CheckFeatureSupport succeeds, the HighestVersion returned will not be greater than this.
+    */
+    featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+
+    if (FAILED(m_device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+    {
+        featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+    }
+
+    /*
+        0 : first instance of the draw (b0), 1 : pass constants (b1),
+        2 : object constants of all objects as a structured buffer (t0),
+        3 : object index of each instance (t1)
+    */
+    CD3DX12_ROOT_PARAMETER1 rootParameters[4];
+    rootParameters[0].InitAsConstants(1, 0);
+    rootParameters[1].InitAsConstantBufferView(1);
+    rootParameters[2].InitAsShaderResourceView(0);
+    rootParameters[3].InitAsShaderResourceView(1);
+
+    CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
+    rootSignatureDesc.Init_1_1(_countof(rootParameters), rootParameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+    ComPtr<ID3DBlob> signature;
+    ComPtr<ID3DBlob> error;
+    ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, featureData.HighestVersion, &signature, &error));
+    ThrowIfFailed(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_rootSignature)));
+    NAME_D3D12_OBJECT(m_rootSignature);
+}
+
+void MyD3D12::BuildShaderAndInputLayout()
+{
+    m_landVS = m_shaders.Add("LandVS", CompileShader(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, "VSMain", "vs_5_0"));
+    m_landPS = m_shaders.Add("LandPS", CompileShader(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, "PSMain", "ps_5_0"));
+    m_surfaceVS = m_shaders.Add("SurfaceVS", CompileShader(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, "VSSurfaceMain", "vs_5_0"));
+    m_surfacePS = m_shaders.Add("SurfacePS", CompileShader(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, "PSSurfaceMain", "ps_5_0"));
+    m_depthVS = m_shaders.Add("DepthVS", CompileShader(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, "VSDepthMain", "vs_5_0"));
+
+    // PackedColorVertex
+    m_inputLayout =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+
+    // PackedSurfaceVertex, normal and tangent are octahedral and decoded in VSSurfaceMain
+    m_surfaceInputLayout =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+
+    // Mesh::DepthVertexBufferView, the packed position on its own
+    m_depthInputLayout =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+}
+
+void MyD3D12::BuildPSO()
+{
+    // Describe and create the graphics pipeline state object (PSO).
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePSODesc = {};
+    ZeroMemory(&opaquePSODesc, sizeof(opaquePSODesc));
+
+    opaquePSODesc.InputLayout = { m_inputLayout.data(), (uint32_t)m_inputLayout.size()};
+    opaquePSODesc.pRootSignature = m_rootSignature.Get();
+    opaquePSODesc.VS =
+    {
+        reinterpret_cast<BYTE*>(m_shaders.Get(m_landVS)->GetBufferPointer()),
+        m_shaders.Get(m_landVS)->GetBufferSize()
+    };
+    opaquePSODesc.PS = 
+    {
+        reinterpret_cast<BYTE*>(m_shaders.Get(m_landPS)->GetBufferPointer()),
+        m_shaders.Get(m_landPS)->GetBufferSize()
+    };
+    opaquePSODesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+    opaquePSODesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+    opaquePSODesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    // Passes where the prepass already wrote the same depth, and works just as well without it
+    opaquePSODesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+    opaquePSODesc.SampleMask = UINT_MAX;  //set the sampling for each pixel(Multiple sampling takes up to 32 samples)
+    opaquePSODesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    opaquePSODesc.NumRenderTargets = 1;   //The number of render target formats in the RTVFormats member
+    opaquePSODesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+    opaquePSODesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+    opaquePSODesc.SampleDesc.Count = 1;
+
+    ComPtr<ID3D12PipelineState> opaquePSO;
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&opaquePSODesc, IID_PPV_ARGS(&opaquePSO)));
+    NAME_D3D12_OBJECT(opaquePSO);
+    m_opaquePSO = m_PSOs.Add("opaque", opaquePSO);
+
+    // Loaded models, lit from their normals
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC surfacePSODesc = opaquePSODesc;
+    surfacePSODesc.InputLayout = { m_surfaceInputLayout.data(), (uint32_t)m_surfaceInputLayout.size() };
+    surfacePSODesc.VS =
+    {
+        reinterpret_cast<BYTE*>(m_shaders.Get(m_surfaceVS)->GetBufferPointer()),
+        m_shaders.Get(m_surfaceVS)->GetBufferSize()
+    };
+    surfacePSODesc.PS =
+    {
+        reinterpret_cast<BYTE*>(m_shaders.Get(m_surfacePS)->GetBufferPointer()),
+        m_shaders.Get(m_surfacePS)->GetBufferSize()
+    };
+
+    ComPtr<ID3D12PipelineState> surfacePSO;
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&surfacePSODesc, IID_PPV_ARGS(&surfacePSO)));
+    NAME_D3D12_OBJECT(surfacePSO);
+    m_surfacePSO = m_PSOs.Add("surface", surfacePSO);
+
+    // Depth prepass of every opaque mesh, positions only and no pixel shader.
+    // Color writes are off instead of dropping the render target, so the bound targets match every pass
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC depthPSODesc = opaquePSODesc;
+    depthPSODesc.InputLayout = { m_depthInputLayout.data(), (uint32_t)m_depthInputLayout.size() };
+    depthPSODesc.VS =
+    {
+        reinterpret_cast<BYTE*>(m_shaders.Get(m_depthVS)->GetBufferPointer()),
+        m_shaders.Get(m_depthVS)->GetBufferSize()
+    };
+    depthPSODesc.PS = {};
+    depthPSODesc.BlendState.RenderTarget[0].RenderTargetWriteMask = 0;
+    depthPSODesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+
+    ComPtr<ID3D12PipelineState> depthPSO;
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&depthPSODesc, IID_PPV_ARGS(&depthPSO)));
+    NAME_D3D12_OBJECT(depthPSO);
+    m_depthPSO = m_PSOs.Add("depth", depthPSO);
+
+    // Alpha blended, tested against the opaque depth but not written
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC transparentPSODesc = opaquePSODesc;
+
+    D3D12_RENDER_TARGET_BLEND_DESC& blendDesc = transparentPSODesc.BlendState.RenderTarget[0];
+    blendDesc.BlendEnable = TRUE;
+    blendDesc.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+    blendDesc.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+    blendDesc.BlendOp = D3D12_BLEND_OP_ADD;
+    blendDesc.SrcBlendAlpha = D3D12_BLEND_ONE;
+    blendDesc.DestBlendAlpha = D3D12_BLEND_ZERO;
+    blendDesc.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+
+    transparentPSODesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+
+    ComPtr<ID3D12PipelineState> transparentPSO;
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&transparentPSODesc, IID_PPV_ARGS(&transparentPSO)));
+    NAME_D3D12_OBJECT(transparentPSO);
+    m_transparentPSO = m_PSOs.Add("transparent", transparentPSO);
+}
+
+void MyD3D12::BuildRTVDSV()
+{
+    // Create rtv 
+    {
+        // get a handle to the first descriptor in the descriptor heap
+        CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
+
+        // Create a RTV for each frame
+        for (UINT n = 0; n < FrameCount; n++)
+        {
+            // get a pointer to the buffer in the swap chain
+            ThrowIfFailed(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])));
+            // create a descriptor that points to the resource and store it in a descriptor handle
+            m_device->CreateRenderTargetView(m_renderTargets[n].Get(), nullptr, rtvHandle);
+            // increment the rtv handle by the rtv descriptor size we got above
+            rtvHandle.Offset(1, m_rtvDescriptorSize);
+
+            NAME_D3D12_OBJECT_INDEXED(m_renderTargets, n);
+        }
+    }
+
+    //Create dsv
+    {
+
+        ThrowIfFailed(m_device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R24G8_TYPELESS, m_width, m_height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL, D3D12_TEXTURE_LAYOUT_UNKNOWN),
+            D3D12_RESOURCE_STATE_COMMON,
+            &CD3DX12_CLEAR_VALUE(DXGI_FORMAT_D24_UNORM_S8_UINT, 1.0f, 0), // Performance tip: Tell the runtime at resource creation the desired clear value.
+            IID_PPV_ARGS(&m_depthStencil)
+        ));
+
+        NAME_D3D12_OBJECT(m_depthStencil);
+
+        D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
+        depthStencilDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+        depthStencilDesc.Flags = D3D12_DSV_FLAG_NONE;
+        depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+
+        m_device->CreateDepthStencilView(m_depthStencil.Get(), &depthStencilDesc, m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
+    }
+}
@@ -0,0 +1,335 @@
+#include "pch.h"
+#include "NullGraphicsDevice.h"
+
+NullCommandList::NullCommandList(ID3D12PipelineState* pInitialState) :
+    m_isOpen(true)      // like D3D12, a new command list starts in the recording state
+{
+    m_stats.commandListsRecorded++;
+    if (pInitialState != nullptr)
+    {
+        m_stats.pipelineStateChanges++;
+    }
+}
+
+HRESULT NullCommandList::Reset(GraphicsCommandAllocator*, ID3D12PipelineState* pInitialState)
+{
+    if (m_isOpen)
+    {
+        return E_FAIL;
+    }
+
+    m_isOpen = true;
+    m_stats.commandListsRecorded++;
+    if (pInitialState != nullptr)
+    {
+        m_stats.pipelineStateChanges++;
+    }
+
+    return S_OK;
+}
+
+HRESULT NullCommandList::Close()
+{
+    if (!m_isOpen)
+    {
+        return E_FAIL;
+    }
+
+    m_isOpen = false;
+    return S_OK;
+}
+
+void NullCommandList::SetPipelineState(ID3D12PipelineState*)
+{
+    CheckOpen();
+    m_stats.pipelineStateChanges++;
+}
+
+void NullCommandList::SetGraphicsRootSignature(ID3D12RootSignature*)
+{
+    CheckOpen();
+    m_stats.rootSignatureChanges++;
+}
+
+void NullCommandList::SetGraphicsRootConstantBufferView(UINT, D3D12_GPU_VIRTUAL_ADDRESS)
+{
+    CheckOpen();
+    m_stats.rootArgumentChanges++;
+}
+
+void NullCommandList::SetGraphicsRootShaderResourceView(UINT, D3D12_GPU_VIRTUAL_ADDRESS)
+{
+    CheckOpen();
+    m_stats.rootArgumentChanges++;
+}
+
+void NullCommandList::SetGraphicsRoot32BitConstant(UINT, UINT, UINT)
+{
+    CheckOpen();
+    m_stats.rootArgumentChanges++;
+}
+
+void NullCommandList::RSSetViewports(UINT, const D3D12_VIEWPORT*)
+{
+    CheckOpen();
+}
+
+void NullCommandList::RSSetScissorRects(UINT, const D3D12_RECT*)
+{
+    CheckOpen();
+}
+
+void NullCommandList::OMSetRenderTargets(UINT, const D3D12_CPU_DESCRIPTOR_HANDLE*, BOOL, const D3D12_CPU_DESCRIPTOR_HANDLE*)
+{
+    CheckOpen();
+}
+
+void NullCommandList::ResourceBarrier(UINT numBarriers, const D3D12_RESOURCE_BARRIER*)
+{
+    CheckOpen();
+    m_stats.resourceBarriers += numBarriers;
+}
+
+void NullCommandList::ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE, const FLOAT[4], UINT, const D3D12_RECT*)
+{
+    CheckOpen();
+    m_stats.clears++;
+}
+
+void NullCommandList::ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_CLEAR_FLAGS, FLOAT, UINT8, UINT, const D3D12_RECT*)
+{
+    CheckOpen();
+    m_stats.clears++;
+}
+
+void NullCommandList::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY)
+{
+    CheckOpen();
+    m_stats.topologyChanges++;
+}
+
+void NullCommandList::IASetVertexBuffers(UINT, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW*)
+{
+    CheckOpen();
+    m_stats.vertexBufferBinds += numViews;
+}
+
+void NullCommandList::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW*)
+{
+    CheckOpen();
+    m_stats.indexBufferBinds++;
+}
+
+void NullCommandList::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT, INT, UINT)
+{
+    CheckOpen();
+    m_stats.drawCalls++;
+    m_stats.indicesDrawn += static_cast<uint64_t>(indexCountPerInstance) * instanceCount;
+    m_stats.instancesDrawn += instanceCount;
+}
+
+void NullCommandList::ExecuteIndirect(
+    ID3D12CommandSignature*,
+    UINT maxCommandCount,
+    GraphicsResource* pArgumentBuffer,
+    UINT64 argumentBufferOffset,
+    GraphicsResource* pCountBuffer,
+    UINT64 countBufferOffset)
+{
+    CheckOpen();
+
+    if (argumentBufferOffset > pArgumentBuffer->GetSize() ||
+        (pCountBuffer != nullptr && countBufferOffset + sizeof(UINT) > pCountBuffer->GetSize()))
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    m_stats.indirectCalls++;
+    m_stats.indirectCommands += maxCommandCount;
+}
+
+void NullCommandList::CopyBufferRegion(GraphicsResource* pDstBuffer, UINT64 dstOffset, GraphicsResource* pSrcBuffer, UINT64 srcOffset, UINT64 numBytes)
+{
+    CheckOpen();
+
+    // Catch out of range copies here, the debug layer would report them on D3D12
+    if (dstOffset + numBytes > pDstBuffer->GetSize() || srcOffset + numBytes > pSrcBuffer->GetSize())
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    m_stats.copyCommands++;
+    m_stats.bytesCopied += numBytes;
+}
+
+void NullCommandList::FlushStats(GraphicsStats& stats)
+{
+    stats.commandListsRecorded += m_stats.commandListsRecorded;
+    stats.drawCalls += m_stats.drawCalls;
+    stats.indicesDrawn += m_stats.indicesDrawn;
+    stats.instancesDrawn += m_stats.instancesDrawn;
+    stats.indirectCalls += m_stats.indirectCalls;
+    stats.indirectCommands += m_stats.indirectCommands;
+    stats.pipelineStateChanges += m_stats.pipelineStateChanges;
+    stats.rootSignatureChanges += m_stats.rootSignatureChanges;
+    stats.rootArgumentChanges += m_stats.rootArgumentChanges;
+    stats.vertexBufferBinds += m_stats.vertexBufferBinds;
+    stats.indexBufferBinds += m_stats.indexBufferBinds;
+    stats.topologyChanges += m_stats.topologyChanges;
+    stats.resourceBarriers += m_stats.resourceBarriers;
+    stats.clears += m_stats.clears;
+    stats.copyCommands += m_stats.copyCommands;
+    stats.bytesCopied += m_stats.bytesCopied;
+
+    m_stats = GraphicsStats();
+}
+
+NullGraphicsDevice::NullGraphicsDevice(UINT64 fenceLatency) :
+    m_fenceLatency(fenceLatency),
+    m_lastSignaledValue(0),
+    m_completedValue(0),
+    m_nextGpuVirtualAddress(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT),   // keep 0 free, it means "no buffer"
+    m_lastSignaledCopyValue(0),
+    m_completedCopyValue(0)
+{
+}
+
+std::unique_ptr<GraphicsCommandAllocator> NullGraphicsDevice::CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE)
+{
+    return std::make_unique<NullCommandAllocator>();
+}
+
+std::unique_ptr<GraphicsCommandList> NullGraphicsDevice::CreateCommandList(D3D12_COMMAND_LIST_TYPE, GraphicsCommandAllocator*, ID3D12PipelineState* pInitialState)
+{
+    return std::make_unique<NullCommandList>(pInitialState);
+}
+
+GraphicsResourcePtr NullGraphicsDevice::CreateBuffer(D3D12_HEAP_TYPE heapType, uint64_t byteSize, D3D12_RESOURCE_STATES, D3D12_RESOURCE_FLAGS)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stats.buffersCreated++;
+    m_stats.bytesAllocated += byteSize;
+
+    return std::make_shared<GraphicsResource>(AllocateAddressRange(byteSize), heapType, byteSize);
+}
+
+void NullGraphicsDevice::ExecuteCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists)
+{
+    ExecuteLists(numCommandLists, ppCommandLists);
+}
+
+void NullGraphicsDevice::ExecuteCopyCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists)
+{
+    ExecuteLists(numCommandLists, ppCommandLists);
+}
+
+void NullGraphicsDevice::ExecuteLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stats.executeCalls++;
+
+    for (UINT i = 0; i < numCommandLists; ++i)
+    {
+        auto pCommandList = static_cast<NullCommandList*>(ppCommandLists[i]);
+
+        // Executing a list that is still recording is invalid
+        if (pCommandList->IsOpen())
+        {
+            ThrowIfFailed(E_FAIL);
+        }
+
+        pCommandList->FlushStats(m_stats);
+        m_stats.commandListsExecuted++;
+    }
+}
+
+UINT64 NullGraphicsDevice::Signal()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stats.fenceSignals++;
+    ++m_lastSignaledValue;
+
+    // The "GPU" retires work m_fenceLatency signals behind the CPU
+    if (m_lastSignaledValue > m_fenceLatency)
+    {
+        m_completedValue = MathHelper::Max(m_completedValue, m_lastSignaledValue - m_fenceLatency);
+    }
+
+    // Copies submitted before this frame are done
+    m_completedCopyValue = m_lastSignaledCopyValue;
+
+    return m_lastSignaledValue;
+}
+
+UINT64 NullGraphicsDevice::SignalCopy()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stats.fenceSignals++;
+    return ++m_lastSignaledCopyValue;
+}
+
+UINT64 NullGraphicsDevice::GetCompletedCopyFenceValue()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completedCopyValue;
+}
+
+void NullGraphicsDevice::WaitForCopyFenceValue(UINT64 fenceValue)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_completedCopyValue < fenceValue)
+    {
+        if (fenceValue > m_lastSignaledCopyValue)
+        {
+            ThrowIfFailed(E_INVALIDARG);
+        }
+
+        m_stats.fenceWaits++;
+        m_completedCopyValue = fenceValue;
+    }
+}
+
+UINT64 NullGraphicsDevice::GetNextFenceValue() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastSignaledValue + 1;
+}
+
+UINT64 NullGraphicsDevice::GetCompletedFenceValue()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completedValue;
+}
+
+void NullGraphicsDevice::WaitForFenceValue(UINT64 fenceValue)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_completedValue < fenceValue)
+    {
+        // Waiting on a value that was never signaled would hang on D3D12
+        if (fenceValue > m_lastSignaledValue)
+        {
+            ThrowIfFailed(E_INVALIDARG);
+        }
+
+        m_stats.fenceWaits++;
+        m_completedValue = fenceValue;
+    }
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS NullGraphicsDevice::AllocateAddressRange(uint64_t byteSize)
+{
+    // Committed resources are 64KB aligned
+    const uint64_t alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    D3D12_GPU_VIRTUAL_ADDRESS address = m_nextGpuVirtualAddress;
+    m_nextGpuVirtualAddress += (byteSize + alignment - 1) & ~(alignment - 1);
+
+    return address;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "GraphicsDevice.h"
+#include <mutex>
+
+class NullCommandAllocator : public GraphicsCommandAllocator
+{
+public:
+    virtual HRESULT Reset() { return S_OK; }
+    virtual ID3D12CommandAllocator* GetNative() const { return nullptr; }
+};
+
+/*
+    Accepts every call and only counts it.
+    Counters are kept per list so lists can be recorded on different threads,
+    they are folded into the device stats when the list is executed.
+*/
+class NullCommandList : public GraphicsCommandList
+{
+public:
+    NullCommandList(ID3D12PipelineState* pInitialState);
+
+    virtual HRESULT Reset(GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState);
+    virtual HRESULT Close();
+
+    virtual void SetPipelineState(ID3D12PipelineState* pPipelineState);
+    virtual void SetGraphicsRootSignature(ID3D12RootSignature* pRootSignature);
+    virtual void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation);
+    virtual void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation);
+    virtual void SetGraphicsRoot32BitConstant(UINT rootParameterIndex, UINT srcData, UINT destOffsetIn32BitValues);
+
+    virtual void RSSetViewports(UINT numViewports, const D3D12_VIEWPORT* pViewports);
+    virtual void RSSetScissorRects(UINT numRects, const D3D12_RECT* pRects);
+    virtual void OMSetRenderTargets(
+        UINT numRenderTargetDescriptors,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* pRenderTargetDescriptors,
+        BOOL RTsSingleHandleToDescriptorRange,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* pDepthStencilDescriptor);
+
+    virtual void ResourceBarrier(UINT numBarriers, const D3D12_RESOURCE_BARRIER* pBarriers);
+
+    virtual void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, const FLOAT colorRGBA[4], UINT numRects, const D3D12_RECT* pRects);
+    virtual void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView, D3D12_CLEAR_FLAGS clearFlags, FLOAT depth, UINT8 stencil, UINT numRects, const D3D12_RECT* pRects);
+
+    virtual void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology);
+    virtual void IASetVertexBuffers(UINT startSlot, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW* pViews);
+    virtual void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* pView);
+
+    virtual void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation);
+    virtual void ExecuteIndirect(
+        ID3D12CommandSignature* pCommandSignature,
+        UINT maxCommandCount,
+        GraphicsResource* pArgumentBuffer,
+        UINT64 argumentBufferOffset,
+        GraphicsResource* pCountBuffer,
+        UINT64 countBufferOffset);
+
+    virtual void CopyBufferRegion(GraphicsResource* pDstBuffer, UINT64 dstOffset, GraphicsResource* pSrcBuffer, UINT64 srcOffset, UINT64 numBytes);
+
+    virtual void BeginEvent(LPCWSTR) {}
+    virtual void EndEvent() {}
+
+    virtual ID3D12GraphicsCommandList* GetNative() const { return nullptr; }
+
+    bool IsOpen() const { return m_isOpen; }
+
+    // Hands the counters recorded since the last call to the caller
+    void FlushStats(GraphicsStats& stats);
+
+private:
+    // Recording into a closed list is an error on D3D12 as well
+    void CheckOpen() const
+    {
+        if (!m_isOpen)
+        {
+            ThrowIfFailed(E_FAIL);
+        }
+    }
+
+    GraphicsStats m_stats;
+    bool m_isOpen;
+};
+
+/*
+    Headless device.
+    Buffers on the upload/readback heaps are backed by host memory so everything the CPU
+    writes (constants, staging data) really is written, default heap buffers only get an address.
+    A signaled fence value completes after "fenceLatency" further signals,
+    which mimics the GPU running a few frames behind the CPU.
+    Copy queue work completes together with the next direct queue signal,
+    so uploads land a frame after they were submitted.
+    Calls may come from several threads, a mutex guards the fences and the stats.
+*/
+class NullGraphicsDevice : public GraphicsDevice
+{
+public:
+    NullGraphicsDevice(UINT64 fenceLatency = 1);
+
+    virtual GraphicsBackend GetBackend() const { return GraphicsBackend::Null; }
+    virtual ID3D12Device* GetNative() const { return nullptr; }
+
+    virtual std::unique_ptr<GraphicsCommandAllocator> CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE type);
+    virtual std::unique_ptr<GraphicsCommandList> CreateCommandList(D3D12_COMMAND_LIST_TYPE type, GraphicsCommandAllocator* pAllocator, ID3D12PipelineState* pInitialState);
+    virtual GraphicsResourcePtr CreateBuffer(D3D12_HEAP_TYPE heapType, uint64_t byteSize, D3D12_RESOURCE_STATES initialState, D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
+
+    virtual void ExecuteCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists);
+
+    virtual UINT64 Signal();
+    virtual UINT64 GetCompletedFenceValue();
+    virtual UINT64 GetNextFenceValue() const;
+    virtual void WaitForFenceValue(UINT64 fenceValue);
+
+    virtual void ExecuteCopyCommandLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists);
+    virtual UINT64 SignalCopy();
+    virtual UINT64 GetCompletedCopyFenceValue();
+    virtual void WaitForCopyFenceValue(UINT64 fenceValue);
+
+    virtual void BeginEvent(LPCWSTR) {}
+    virtual void EndEvent() {}
+
+private:
+    D3D12_GPU_VIRTUAL_ADDRESS AllocateAddressRange(uint64_t byteSize);
+    void ExecuteLists(UINT numCommandLists, GraphicsCommandList* const* ppCommandLists);
+
+    mutable std::mutex m_mutex;
+
+    UINT64 m_fenceLatency;
+    UINT64 m_lastSignaledValue;
+    UINT64 m_completedValue;
+    D3D12_GPU_VIRTUAL_ADDRESS m_nextGpuVirtualAddress;
+
+    UINT64 m_lastSignaledCopyValue;
+    UINT64 m_completedCopyValue;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+// The few MSVC and Win32 calls the portable sources use, for the CMake build
+// of the null backend on other compilers. winadapter.h has the Win32 types.
+
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <strings.h>
+
+#ifndef _countof
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#ifndef _Use_decl_annotations_
+#define _Use_decl_annotations_
+#endif
+#ifndef _In_reads_
+#define _In_reads_(size)
+#endif
+#ifndef _Out_writes_
+#define _Out_writes_(size)
+#endif
+
+#ifndef ERROR_INVALID_DATA
+#define ERROR_INVALID_DATA 13L
+#endif
+#ifndef HRESULT_FROM_WIN32
+#define HRESULT_FROM_WIN32(x) ((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000))
+#endif
+
+// The keys FpsCamera handles, Win32 virtual key codes
+#ifndef VK_ESCAPE
+#define VK_ESCAPE 0x1B
+#define VK_LEFT 0x25
+#define VK_UP 0x26
+#define VK_RIGHT 0x27
+#define VK_DOWN 0x28
+#endif
+
+// No debugger output outside Windows, stderr is the closest
+inline void OutputDebugStringA(const char* text)
+{
+    fputs(text, stderr);
+}
+
+template <size_t Size>
+inline int sprintf_s(char (&buffer)[Size], const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(buffer, Size, format, args);
+    va_end(args);
+    return length;
+}
+
+template <size_t Size>
+inline int swprintf_s(wchar_t (&buffer)[Size], const wchar_t* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const int length = vswprintf(buffer, Size, format, args);
+    va_end(args);
+    return length;
+}
+
+inline int _wcsnicmp(const wchar_t* a, const wchar_t* b, size_t count)
+{
+    return wcsncasecmp(a, b, count);
+}
+
+inline int _wtoi(const wchar_t* text)
+{
+    return static_cast<int>(wcstol(text, nullptr, 10));
+}
+
+// Callers only scan nonzero masks, as with the intrinsics
+inline unsigned char _BitScanForward(unsigned long* pIndex, unsigned long mask)
+{
+    if (mask == 0)
+    {
+        return 0;
+    }
+    *pIndex = static_cast<unsigned long>(__builtin_ctzl(mask));
+    return 1;
+}
+
+inline unsigned char _BitScanReverse(unsigned long* pIndex, unsigned long mask)
+{
+    if (mask == 0)
+    {
+        return 0;
+    }
+    *pIndex = static_cast<unsigned long>(sizeof(unsigned long) * 8 - 1 - __builtin_clzl(mask));
+    return 1;
+}
+#endif
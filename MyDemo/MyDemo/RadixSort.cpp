@@ -0,0 +1,63 @@
+#include "pch.h"
+#include "RadixSort.h"
+
+void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch)
+{
+    const size_t count = items.size();
+    if (count < 2)
+    {
+        return;
+    }
+
+    static const uint32_t PassCount = 8;
+    static const uint32_t BucketCount = 256;
+
+    uint32_t histograms[PassCount][BucketCount] = {};
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint64_t key = items[i].key;
+        for (uint32_t pass = 0; pass < PassCount; ++pass)
+        {
+            histograms[pass][(key >> (pass * 8)) & 0xff]++;
+        }
+    }
+
+    scratch.resize(count);
+
+    SortItem* pSource = items.data();
+    SortItem* pDestination = scratch.data();
+
+    for (uint32_t pass = 0; pass < PassCount; ++pass)
+    {
+        uint32_t* histogram = histograms[pass];
+        const uint32_t shift = pass * 8;
+
+        // All keys in one bucket, this byte doesn't change the order
+        if (histogram[(pSource[0].key >> shift) & 0xff] == count)
+        {
+            continue;
+        }
+
+        // Turn the counts into the first output position of each bucket
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < BucketCount; ++bucket)
+        {
+            const uint32_t bucketSize = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketSize;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            pDestination[histogram[(pSource[i].key >> shift) & 0xff]++] = pSource[i];
+        }
+
+        std::swap(pSource, pDestination);
+    }
+
+    // An odd number of passes ran, the result is in scratch
+    if (pSource != items.data())
+    {
+        items.swap(scratch);
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct SortItem
+{
+    uint64_t key;
+    uint32_t index;     // what the key belongs to, carried along
+};
+
+/*
+    LSD radix sort on the 64 bit keys, 8 passes of 8 bits.
+    All histograms are built in one read of the input, and a pass is skipped
+    when every key has the same byte there, so keys that only use a few bits cost a few passes.
+    Stable, items with equal keys keep their order. scratch is resized as needed and can be reused.
+*/
+void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
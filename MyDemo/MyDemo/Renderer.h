@@ -3,23 +3,65 @@
 #include "pch.h"
 #include "Mesh.h"
 
+// Passes are drawn in this order
+enum class RenderPass : uint32_t
+{
+	Opaque = 0,
+	Transparent = 1,
+};
+
+// A level of detail of a renderer's draw range, see LodSelector
+struct RendererLod
+{
+	uint32_t indexCount = 0;
+	uint32_t startIndex = 0;
+	float error = 0.f;		// in mesh units, 0 for the full detail range
+	uint64_t stateKey = 0;
+};
+
 struct Renderer
 {
-	XMFLOAT4X4 world = MathHelper::Identity4x4();
-	/*	
-		dirty flags.
-		Represents a change in the data associated with an object.
-		Because each frame resource has an object constant buffer, so we should set like this "numFramesDirty = FrameCount"
+	/*
+		Read by culling and LOD selection. Follows the renderer's SceneGraph node, through
+		MyD3D12::SetRendererWorld, which also updates the uploaded copy in the TransformStore.
 	*/
-	uint32_t numFramesDirty;
+	XMFLOAT4X4 world = MathHelper::Identity4x4();
 
 	uint32_t objectIndex = 0;
+
+	// Sphere index in the frustum culler of its pass, NotCulled until it becomes drawable
+	static const uint32_t NotCulled = UINT32_MAX;
+	uint32_t cullIndex = NotCulled;
 	
 	Mesh* Geo = nullptr;
 
+	RenderPass pass = RenderPass::Opaque;
+	ID3D12PipelineState* PSO = nullptr;
+	ID3D12RootSignature* rootSignature = nullptr;
+
+	// Set by DrawKeyBuilder once the renderer becomes drawable, renderers with equal keys are instanced
+	uint64_t stateKey = 0;
+
 	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
 	uint32_t indexCount = 0;
 	uint32_t startIndex = 0;
 	uint32_t baseVertex = 0;
+
+	// Bounding sphere of the drawn range when it is only part of the mesh, e.g. a Mesh::Draw::Chunk
+	const float* drawBounds = nullptr;
+
+	const float* GetBounds() const { return drawBounds != nullptr ? drawBounds : Geo->bounds; }
+
+	// Empty, or the full range followed by coarser ones. The selected level is copied into the draw range and state key
+	std::vector<RendererLod> lods;
+	uint32_t lod = 0;
+
+	void SetLod(uint32_t level)
+	{
+		lod = level;
+		indexCount = lods[level].indexCount;
+		startIndex = lods[level].startIndex;
+		stateKey = lods[level].stateKey;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "DXSampleHelper.h"
+
+/*
+    Named resources addressed by handle. The values are kept dense and in one array, so walking all
+    of them touches nothing else, a handle leads to its value through a slot table without hashing.
+    Every slot has a generation that is bumped when its value is removed, a handle kept past that
+    is stale and Get() throws instead of returning whatever took the slot.
+
+    Names are only for setup and tooling: Find() is the one place a string is hashed, hot code keeps
+    the handles it found. Adding or removing values must not overlap with any other use, reading
+    from several threads at once is fine.
+*/
+template<typename T>
+class ResourceRegistry
+{
+public:
+    // Typed by the registry, a shader handle can't be given to the registry of pipeline states
+    struct Handle
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;    // slots start at 1, a default handle is never valid
+    };
+
+    // Throws E_INVALIDARG when name is already taken
+    Handle Add(const std::string& name, T value)
+    {
+        if (m_names.find(name) != m_names.end())
+        {
+            ThrowIfFailed(E_INVALIDARG);
+        }
+
+        uint32_t index;
+        if (m_freeSlots.empty())
+        {
+            index = static_cast<uint32_t>(m_slots.size());
+            m_slots.push_back(Slot());
+            m_slotNames.emplace_back();
+        }
+        else
+        {
+            index = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+
+        Slot& slot = m_slots[index];
+        slot.dense = static_cast<uint32_t>(m_values.size());
+        m_values.push_back(std::move(value));
+        m_denseSlots.push_back(index);
+
+        m_slotNames[index] = name;
+        m_names.emplace(name, index);
+
+        Handle handle;
+        handle.index = index;
+        handle.generation = slot.generation;
+        return handle;
+    }
+
+    // The last value takes the removed one's place, the handle and every copy of it turn stale
+    void Remove(Handle handle)
+    {
+        const uint32_t dense = GetDenseIndex(handle);
+        const uint32_t lastDense = static_cast<uint32_t>(m_values.size()) - 1;
+        if (dense != lastDense)
+        {
+            m_values[dense] = std::move(m_values[lastDense]);
+            m_denseSlots[dense] = m_denseSlots[lastDense];
+            m_slots[m_denseSlots[dense]].dense = dense;
+        }
+        m_values.pop_back();
+        m_denseSlots.pop_back();
+
+        m_names.erase(m_slotNames[handle.index]);
+        m_slotNames[handle.index].clear();
+
+        m_slots[handle.index].generation++;
+        m_freeSlots.push_back(handle.index);
+    }
+
+    bool IsValid(Handle handle) const
+    {
+        return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation;
+    }
+
+    // Throws E_INVALIDARG for a stale or default handle
+    T& Get(Handle handle) { return m_values[GetDenseIndex(handle)]; }
+    const T& Get(Handle handle) const { return m_values[GetDenseIndex(handle)]; }
+
+    // A default handle when nothing has that name
+    Handle Find(const std::string& name) const
+    {
+        Handle handle;
+        const auto found = m_names.find(name);
+        if (found != m_names.end())
+        {
+            handle.index = found->second;
+            handle.generation = m_slots[found->second].generation;
+        }
+        return handle;
+    }
+
+    const std::string& GetName(Handle handle) const
+    {
+        GetDenseIndex(handle);
+        return m_slotNames[handle.index];
+    }
+
+    // The values in no particular order, removing one reorders them
+    size_t size() const { return m_values.size(); }
+    typename std::vector<T>::iterator begin() { return m_values.begin(); }
+    typename std::vector<T>::iterator end() { return m_values.end(); }
+    typename std::vector<T>::const_iterator begin() const { return m_values.begin(); }
+    typename std::vector<T>::const_iterator end() const { return m_values.end(); }
+
+private:
+    struct Slot
+    {
+        uint32_t dense = 0;         // position in m_values while the slot is used
+        uint32_t generation = 1;
+    };
+
+    uint32_t GetDenseIndex(Handle handle) const
+    {
+        if (!IsValid(handle))
+        {
+            ThrowIfFailed(E_INVALIDARG);
+        }
+        return m_slots[handle.index].dense;
+    }
+
+    // Dense
+    std::vector<T> m_values;
+    std::vector<uint32_t> m_denseSlots;
+
+    // By handle index
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+
+    // Off the hot path
+    std::vector<std::string> m_slotNames;
+    std::unordered_map<std::string, uint32_t> m_names;
+};
@@ -0,0 +1,228 @@
+#include "pch.h"
+#include "SceneGraph.h"
+#include "DXSampleHelper.h"
+
+namespace
+{
+    // Nodes of a level per task, smaller levels are updated on the calling thread
+    const uint32_t NodesPerTask = 256;
+
+    XMMATRIX LocalMatrix(const SceneGraph::Transform& local)
+    {
+        return XMMatrixScaling(local.scale.x, local.scale.y, local.scale.z) *
+            XMMatrixRotationQuaternion(XMLoadFloat4(&local.rotation)) *
+            XMMatrixTranslation(local.translation.x, local.translation.y, local.translation.z);
+    }
+}
+
+SceneGraph::SceneGraph() :
+    m_firstChangedLevel(NoLevel),
+    m_lastChangedLevel(0),
+    m_levelOrderDirty(false)
+{
+}
+
+SceneGraph::NodeId SceneGraph::AddNode(NodeId parent, const Transform& local, uint32_t objectIndex)
+{
+    if (parent != NoNode && parent >= GetNodeCount())
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    const NodeId node = GetNodeCount();
+    const uint32_t depth = parent == NoNode ? 0 : m_depths[parent] + 1;
+
+    m_slots.push_back(static_cast<uint32_t>(m_nodes.size()));
+    m_parents.push_back(parent);
+    m_depths.push_back(depth);
+
+    // Parent slots are filled in by BuildLevelOrder()
+    m_nodes.push_back(node);
+    m_parentSlots.push_back(0);
+    m_locals.push_back(local);
+    m_worlds.push_back(MathHelper::Identity4x4());
+    m_objects.push_back(objectIndex);
+    m_localChanged.push_back(1);
+    m_worldChanged.push_back(0);
+
+    m_firstChangedLevel = MathHelper::Min(m_firstChangedLevel, depth);
+    m_lastChangedLevel = MathHelper::Max(m_lastChangedLevel, depth);
+    m_levelOrderDirty = true;
+
+    return node;
+}
+
+void SceneGraph::SetLocal(NodeId node, const Transform& local)
+{
+    const uint32_t slot = m_slots[node];
+    m_locals[slot] = local;
+    m_localChanged[slot] = 1;
+
+    const uint32_t depth = m_depths[node];
+    m_firstChangedLevel = MathHelper::Min(m_firstChangedLevel, depth);
+    m_lastChangedLevel = MathHelper::Max(m_lastChangedLevel, depth);
+}
+
+void SceneGraph::BuildLevelOrder()
+{
+    const uint32_t nodeCount = GetNodeCount();
+
+    // Counting sort by depth, nodes of a level stay in NodeId order
+    uint32_t levelCount = 0;
+    for (uint32_t depth : m_depths)
+    {
+        levelCount = MathHelper::Max(levelCount, depth + 1);
+    }
+
+    m_levelStarts.assign(levelCount + 1, 0);
+    for (uint32_t depth : m_depths)
+    {
+        m_levelStarts[depth + 1]++;
+    }
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        m_levelStarts[level + 1] += m_levelStarts[level];
+    }
+
+    std::vector<uint32_t> newSlots(nodeCount);
+    std::vector<uint32_t> nextSlots(m_levelStarts.begin(), m_levelStarts.end() - 1);
+    for (NodeId node = 0; node < nodeCount; ++node)
+    {
+        newSlots[node] = nextSlots[m_depths[node]]++;
+    }
+
+    std::vector<Transform> locals(nodeCount);
+    std::vector<XMFLOAT4X4> worlds(nodeCount);
+    std::vector<uint32_t> objects(nodeCount);
+    std::vector<uint8_t> localChanged(nodeCount);
+    std::vector<uint8_t> worldChanged(nodeCount);
+
+    for (NodeId node = 0; node < nodeCount; ++node)
+    {
+        const uint32_t oldSlot = m_slots[node];
+        const uint32_t newSlot = newSlots[node];
+
+        m_nodes[newSlot] = node;
+        m_parentSlots[newSlot] = m_parents[node] == NoNode ? NoNode : newSlots[m_parents[node]];
+        locals[newSlot] = m_locals[oldSlot];
+        worlds[newSlot] = m_worlds[oldSlot];
+        objects[newSlot] = m_objects[oldSlot];
+        localChanged[newSlot] = m_localChanged[oldSlot];
+        worldChanged[newSlot] = m_worldChanged[oldSlot];
+    }
+
+    m_slots.swap(newSlots);
+    m_locals.swap(locals);
+    m_worlds.swap(worlds);
+    m_objects.swap(objects);
+    m_localChanged.swap(localChanged);
+    m_worldChanged.swap(worldChanged);
+
+    m_levelOrderDirty = false;
+}
+
+void SceneGraph::Update(ThreadPool* pThreadPool, std::vector<ChangedObject>& changedObjects)
+{
+    changedObjects.clear();
+
+    if (m_levelOrderDirty)
+    {
+        BuildLevelOrder();
+    }
+
+    if (m_firstChangedLevel == NoLevel)
+    {
+        return;
+    }
+
+    const uint32_t levelCount = static_cast<uint32_t>(m_levelStarts.size()) - 1;
+    for (uint32_t level = m_firstChangedLevel; level < levelCount; ++level)
+    {
+        const uint32_t beginSlot = m_levelStarts[level];
+        const uint32_t nodeCount = m_levelStarts[level + 1] - beginSlot;
+        const uint32_t taskCount = (nodeCount + NodesPerTask - 1) / NodesPerTask;
+        const bool parentsUpdated = level > m_firstChangedLevel;
+
+        if (m_taskChanges.size() < taskCount)
+        {
+            m_taskChanges.resize(taskCount);
+        }
+
+        std::atomic<bool> levelChanged(false);
+        const auto updateTask = [&](uint32_t task)
+        {
+            m_taskChanges[task].clear();
+            const bool changed = UpdateNodes(
+                beginSlot + task * NodesPerTask,
+                beginSlot + MathHelper::Min(nodeCount, (task + 1) * NodesPerTask),
+                parentsUpdated,
+                m_taskChanges[task]);
+
+            if (changed)
+            {
+                levelChanged.store(true, std::memory_order_relaxed);
+            }
+        };
+
+        // Every node of a level only depends on the level above, which is complete
+        if (pThreadPool != nullptr && taskCount > 1)
+        {
+            pThreadPool->Dispatch(taskCount, updateTask);
+        }
+        else
+        {
+            for (uint32_t task = 0; task < taskCount; ++task)
+            {
+                updateTask(task);
+            }
+        }
+
+        for (uint32_t task = 0; task < taskCount; ++task)
+        {
+            changedObjects.insert(changedObjects.end(), m_taskChanges[task].begin(), m_taskChanges[task].end());
+        }
+
+        // Past the last changed local transform only changed parents carry on, stop once none did
+        if (level >= m_lastChangedLevel && !levelChanged.load(std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    m_firstChangedLevel = NoLevel;
+    m_lastChangedLevel = 0;
+}
+
+bool SceneGraph::UpdateNodes(uint32_t beginSlot, uint32_t endSlot, bool parentsUpdated, std::vector<ChangedObject>& changedObjects)
+{
+    bool anyChanged = false;
+    for (uint32_t slot = beginSlot; slot < endSlot; ++slot)
+    {
+        const uint32_t parentSlot = m_parentSlots[slot];
+        const bool parentChanged = parentsUpdated && parentSlot != NoNode && m_worldChanged[parentSlot] != 0;
+
+        const bool changed = m_localChanged[slot] != 0 || parentChanged;
+        m_worldChanged[slot] = changed ? 1 : 0;
+        if (!changed)
+        {
+            continue;
+        }
+
+        m_localChanged[slot] = 0;
+        anyChanged = true;
+
+        XMMATRIX world = LocalMatrix(m_locals[slot]);
+        if (parentSlot != NoNode)
+        {
+            world = XMMatrixMultiply(world, XMLoadFloat4x4(&m_worlds[parentSlot]));
+        }
+        XMStoreFloat4x4(&m_worlds[slot], world);
+
+        if (m_objects[slot] != NoObject)
+        {
+            changedObjects.push_back({ m_objects[slot], m_nodes[slot] });
+        }
+    }
+
+    return anyChanged;
+}
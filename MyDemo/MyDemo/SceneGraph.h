@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+/*
+    Transform hierarchy. Every node has a local scale, rotation and translation and a cached world matrix
+    (row vector convention: scale, rotate, translate, then the parent's world).
+    Nodes are stored in breadth first level order, so Update() walks the levels top down and
+    each level in parallel. A node is recomputed when its local transform or its parent's world changed,
+    untouched branches are skipped and levels outside the changed range are never visited.
+    A hierarchy where nothing changed costs nothing per frame.
+
+    NodeIds stay valid as nodes are added, the next Update() rebuilds the level order.
+    A node can carry an object index, Update() reports the objects whose world changed.
+*/
+class SceneGraph
+{
+public:
+    typedef uint32_t NodeId;
+    static const NodeId NoNode = UINT32_MAX;
+    static const uint32_t NoObject = UINT32_MAX;
+
+    struct Transform
+    {
+        XMFLOAT3 scale = XMFLOAT3(1.f, 1.f, 1.f);
+        XMFLOAT4 rotation = XMFLOAT4(0.f, 0.f, 0.f, 1.f);     // quaternion
+        XMFLOAT3 translation = XMFLOAT3(0.f, 0.f, 0.f);
+    };
+
+    struct ChangedObject
+    {
+        uint32_t objectIndex;
+        NodeId node;
+    };
+
+    SceneGraph();
+
+    // parent is NoNode for a root, otherwise it must have been added before
+    NodeId AddNode(NodeId parent, const Transform& local, uint32_t objectIndex = NoObject);
+
+    uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_slots.size()); }
+    NodeId GetParent(NodeId node) const { return m_parents[node]; }
+
+    const Transform& GetLocal(NodeId node) const { return m_locals[m_slots[node]]; }
+    void SetLocal(NodeId node, const Transform& local);
+
+    // As of the last Update()
+    const XMFLOAT4X4& GetWorld(NodeId node) const { return m_worlds[m_slots[node]]; }
+
+    // Brings the world matrices up to date, changedObjects is replaced by the objects whose world changed, in level order
+    void Update(ThreadPool* pThreadPool, std::vector<ChangedObject>& changedObjects);
+
+private:
+    static const uint32_t NoLevel = UINT32_MAX;
+
+    void BuildLevelOrder();
+
+    // parentsUpdated is false for the first level visited, its parents' change flags are from an earlier Update().
+    // Returns whether any world in the range changed
+    bool UpdateNodes(uint32_t beginSlot, uint32_t endSlot, bool parentsUpdated, std::vector<ChangedObject>& changedObjects);
+
+    // By NodeId
+    std::vector<uint32_t> m_slots;          // position in the level order
+    std::vector<NodeId> m_parents;
+    std::vector<uint32_t> m_depths;
+
+    // By slot. Nodes added since the last Update() are appended out of order
+    std::vector<NodeId> m_nodes;
+    std::vector<uint32_t> m_parentSlots;    // NoNode for roots
+    std::vector<Transform> m_locals;
+    std::vector<XMFLOAT4X4> m_worlds;
+    std::vector<uint32_t> m_objects;
+    std::vector<uint8_t> m_localChanged;
+    std::vector<uint8_t> m_worldChanged;
+
+    std::vector<uint32_t> m_levelStarts;    // first slot of every level, then the node count
+    uint32_t m_firstChangedLevel;           // range of levels with changed local transforms
+    uint32_t m_lastChangedLevel;
+    bool m_levelOrderDirty;
+
+    // A list per task of a level, appended in task order so the result stays in level order
+    std::vector<std::vector<ChangedObject>> m_taskChanges;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+
 // Helper class for animation and simulation timing.
 class StepTimer
 {
@@ -11,15 +13,14 @@ public:
         m_frameCount(0),
         m_framesPerSecond(0),
         m_framesThisSecond(0),
-        m_qpcSecondCounter(0),
+        m_clockSecondCounter(0),
         m_isFixedTimeStep(false),
         m_targetElapsedTicks(TicksPerSecond / 60)
     {
-        QueryPerformanceFrequency(&m_qpcFrequency);
-        QueryPerformanceCounter(&m_qpcLastTime);
+        m_clockLastTime = Clock::now();
 
         // Initialize max delta to 1/10 of a second.
-        m_qpcMaxDelta = m_qpcFrequency.QuadPart / 10;
+        m_clockMaxDelta = std::chrono::milliseconds(100);
     }
 
     // Get elapsed time since the previous Update call.
@@ -55,12 +56,12 @@ public:
 
     void ResetElapsedTime()
     {
-        QueryPerformanceCounter(&m_qpcLastTime);
+        m_clockLastTime = Clock::now();
 
         m_leftOverTicks = 0;
         m_framesPerSecond = 0;
         m_framesThisSecond = 0;
-        m_qpcSecondCounter = 0;
+        m_clockSecondCounter = Clock::duration::zero();
     }
 
     typedef void(*LPUPDATEFUNC) (void);
@@ -69,24 +70,21 @@ public:
     void Tick(LPUPDATEFUNC update = nullptr)
     {
         // Query the current time.
-        LARGE_INTEGER currentTime;
-
-        QueryPerformanceCounter(&currentTime);
+        const Clock::time_point currentTime = Clock::now();
 
-        UINT64 timeDelta = currentTime.QuadPart - m_qpcLastTime.QuadPart;
+        Clock::duration clockDelta = currentTime - m_clockLastTime;
 
-        m_qpcLastTime = currentTime;
-        m_qpcSecondCounter += timeDelta;
+        m_clockLastTime = currentTime;
+        m_clockSecondCounter += clockDelta;
 
         // Clamp excessively large time deltas (e.g. after paused in the debugger).
-        if (timeDelta > m_qpcMaxDelta)
+        if (clockDelta > m_clockMaxDelta)
         {
-            timeDelta = m_qpcMaxDelta;
+            clockDelta = m_clockMaxDelta;
         }
 
-        // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
-        timeDelta *= TicksPerSecond;
-        timeDelta /= m_qpcFrequency.QuadPart;
+        // Convert clock units into a canonical tick format. This cannot overflow due to the previous clamp.
+        UINT64 timeDelta = std::chrono::duration_cast<TickDuration>(clockDelta).count();
 
         UINT32 lastFrameCount = m_frameCount;
 
@@ -141,19 +139,21 @@ public:
             m_framesThisSecond++;
         }
 
-        if (m_qpcSecondCounter >= static_cast<UINT64>(m_qpcFrequency.QuadPart))
+        if (m_clockSecondCounter >= std::chrono::seconds(1))
         {
             m_framesPerSecond = m_framesThisSecond;
             m_framesThisSecond = 0;
-            m_qpcSecondCounter %= m_qpcFrequency.QuadPart;
+            m_clockSecondCounter %= std::chrono::seconds(1);
         }
     }
 
 private:
-    // Source timing data uses QPC units.
-    LARGE_INTEGER m_qpcFrequency;
-    LARGE_INTEGER m_qpcLastTime;
-    UINT64 m_qpcMaxDelta;
+    // Source timing data uses the units of a monotonic clock, QPC on Windows.
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::duration<UINT64, std::ratio<1, TicksPerSecond>> TickDuration;
+
+    Clock::time_point m_clockLastTime;
+    Clock::duration m_clockMaxDelta;
 
     // Derived timing data uses a canonical tick format.
     UINT64 m_elapsedTicks;
@@ -164,7 +164,7 @@ private:
     UINT32 m_frameCount;
     UINT32 m_framesPerSecond;
     UINT32 m_framesThisSecond;
-    UINT64 m_qpcSecondCounter;
+    Clock::duration m_clockSecondCounter;
 
     // Members for configuring fixed timestep mode.
     bool m_isFixedTimeStep;
@@ -0,0 +1,214 @@
+#include "pch.h"
+#include "TaskBenchmark.h"
+#include "DXSampleHelper.h"
+#include <algorithm>
+
+namespace
+{
+    const uint32_t DispatchIndexCount = 1 << 22;
+    const uint32_t SpawnerCount = 64;
+    const uint32_t TasksPerSpawner = 1024;     // stays below the deque capacity
+    const uint32_t SplitTreeDepth = 17;
+    const uint32_t AwakeLatencyRounds = 10000;
+    const uint32_t AsleepLatencyRounds = 100;
+    const uint32_t RoundTripCount = 10000;
+
+    struct LatencyStats
+    {
+        double average = 0.0;
+        double median = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point Now()
+    {
+        return Clock::now();
+    }
+
+    double ToMilliseconds(Clock::duration time)
+    {
+        return std::chrono::duration<double, std::milli>(time).count();
+    }
+
+    // Sorts samples, in microseconds
+    LatencyStats GetLatencyStats(std::vector<double>& samples)
+    {
+        LatencyStats stats;
+        if (samples.empty())
+        {
+            return stats;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        stats.average = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+        stats.median = samples[samples.size() / 2];
+        stats.p99 = samples[MathHelper::Min(samples.size() - 1, samples.size() * 99 / 100)];
+        stats.max = samples.back();
+        return stats;
+    }
+
+    void Report(const char* text)
+    {
+        OutputDebugStringA(text);
+        printf("%s", text);
+    }
+
+    void ReportLatency(const char* name, std::vector<double>& samples)
+    {
+        const LatencyStats stats = GetLatencyStats(samples);
+
+        char report[256];
+        sprintf_s(report, "  %s: avg %.2f us, median %.2f us, p99 %.2f us, max %.2f us\n",
+            name, stats.average, stats.median, stats.p99, stats.max);
+        Report(report);
+    }
+
+    // Submits one half and runs the other, only stealing spreads the tree over the workers
+    uint64_t SplitTree(ThreadPool* pThreadPool, uint32_t depth)
+    {
+        if (depth == 0)
+        {
+            return 1;
+        }
+
+        uint64_t left = 0;
+        ThreadPool::Task task([&] { left = SplitTree(pThreadPool, depth - 1); });
+        pThreadPool->Submit(&task);
+
+        const uint64_t right = SplitTree(pThreadPool, depth - 1);
+        pThreadPool->Wait(&task);
+
+        return left + right + 1;
+    }
+
+    double RunDispatch(ThreadPool* pThreadPool, std::vector<uint32_t>& values)
+    {
+        const Clock::time_point start = Now();
+        pThreadPool->Dispatch(DispatchIndexCount, [&](uint32_t index)
+        {
+            values[index] = index;
+        });
+        return ToMilliseconds(Now() - start);
+    }
+
+    double RunIndependentTasks(ThreadPool* pThreadPool)
+    {
+        const uint32_t taskCount = SpawnerCount * TasksPerSpawner;
+        std::vector<uint8_t> ran(taskCount, 0);
+
+        std::unique_ptr<ThreadPool::Task[]> tasks(new ThreadPool::Task[taskCount]);
+        ThreadPool::Task join;
+        for (uint32_t i = 0; i < taskCount; ++i)
+        {
+            tasks[i].SetFunction([&ran, i] { ran[i] = 1; });
+            tasks[i].Then(&join);
+        }
+
+        const Clock::time_point start = Now();
+
+        // Submitted from every thread at once, the creating thread alone would fill its deque
+        pThreadPool->Dispatch(SpawnerCount, [&](uint32_t spawner)
+        {
+            for (uint32_t i = spawner * TasksPerSpawner; i < (spawner + 1) * TasksPerSpawner; ++i)
+            {
+                pThreadPool->Submit(&tasks[i]);
+            }
+        });
+        pThreadPool->Submit(&join);
+        pThreadPool->Wait(&join);
+
+        const double milliseconds = ToMilliseconds(Now() - start);
+
+        if (std::count(ran.begin(), ran.end(), 1) != static_cast<ptrdiff_t>(taskCount))
+        {
+            ThrowIfFailed(E_FAIL);
+        }
+        return milliseconds;
+    }
+
+    // Time from Submit() until a worker starts the task, the submitting thread only watches
+    void MeasureStartLatency(ThreadPool* pThreadPool, uint32_t roundCount, bool letWorkersSleep, std::vector<double>& samples)
+    {
+        samples.clear();
+        for (uint32_t round = 0; round < roundCount; ++round)
+        {
+            if (letWorkersSleep)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+
+            Clock::time_point startTime;
+            ThreadPool::Task task([&] { startTime = Now(); });
+
+            const Clock::time_point submitTime = Now();
+            pThreadPool->Submit(&task);
+            while (!task.IsFinished())
+            {
+                std::this_thread::yield();
+            }
+
+            samples.push_back(1000.0 * ToMilliseconds(startTime - submitTime));
+        }
+    }
+}
+
+int RunTaskBenchmarks(uint32_t threadCount)
+{
+    ThreadPool threadPool(threadCount);
+
+    char report[256];
+    sprintf_s(report, "task benchmark: %u threads\n", threadPool.GetThreadCount());
+    Report(report);
+
+    // Each is run once before it is timed, to start the workers and touch the memory
+    std::vector<uint32_t> values(DispatchIndexCount);
+    RunDispatch(&threadPool, values);
+    const double dispatchMs = RunDispatch(&threadPool, values);
+    sprintf_s(report, "  dispatch: %u indices in %.2f ms, %.1f M indices/s\n",
+        DispatchIndexCount, dispatchMs, DispatchIndexCount / (1000.0 * dispatchMs));
+    Report(report);
+
+    const uint32_t independentTaskCount = SpawnerCount * TasksPerSpawner;
+    RunIndependentTasks(&threadPool);
+    const double independentMs = RunIndependentTasks(&threadPool);
+    sprintf_s(report, "  independent tasks: %u tasks and a join in %.2f ms, %.2f M tasks/s\n",
+        independentTaskCount, independentMs, independentTaskCount / (1000.0 * independentMs));
+    Report(report);
+
+    SplitTree(&threadPool, SplitTreeDepth);
+    const Clock::time_point splitStart = Now();
+    const uint64_t splitNodeCount = SplitTree(&threadPool, SplitTreeDepth);
+    const double splitMs = ToMilliseconds(Now() - splitStart);
+    sprintf_s(report, "  split tree: %llu nodes in %.2f ms, %.2f M nodes/s\n",
+        splitNodeCount, splitMs, splitNodeCount / (1000.0 * splitMs));
+    Report(report);
+
+    // A pool without workers would never start a task the submitting thread doesn't run itself
+    std::vector<double> samples;
+    if (threadPool.GetThreadCount() > 1)
+    {
+        MeasureStartLatency(&threadPool, AwakeLatencyRounds, false, samples);
+        ReportLatency("submit to start, workers awake", samples);
+
+        MeasureStartLatency(&threadPool, AsleepLatencyRounds, true, samples);
+        ReportLatency("submit to start, workers asleep", samples);
+    }
+
+    // As wide as the pool, like the per frame fan outs
+    const uint32_t roundTripIndexCount = threadPool.GetThreadCount();
+    samples.clear();
+    for (uint32_t i = 0; i < RoundTripCount; ++i)
+    {
+        const Clock::time_point start = Now();
+        threadPool.Dispatch(roundTripIndexCount, [](uint32_t) {});
+        samples.push_back(1000.0 * ToMilliseconds(Now() - start));
+    }
+
+    sprintf_s(report, "dispatch round trip of %u indices", roundTripIndexCount);
+    ReportLatency(report, samples);
+
+    return 0;
+}
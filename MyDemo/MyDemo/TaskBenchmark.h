@@ -0,0 +1,13 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+/*
+    Microbenchmarks of the ThreadPool scheduler, run instead of the sample with "-taskbench".
+    Throughput: empty indices through Dispatch(), independent tasks joined by one continuation,
+    and a recursively split task tree that only load balances through stealing.
+    Latency: from Submit() until a worker starts the task, with the workers awake and asleep,
+    and the round trip of a Dispatch() as small as the per frame ones.
+    Results go to the debug output and stdout.
+*/
+int RunTaskBenchmarks(uint32_t threadCount = std::thread::hardware_concurrency());
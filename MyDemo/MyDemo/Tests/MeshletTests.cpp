@@ -0,0 +1,208 @@
+#include "pch.h"
+#include "Meshlet.h"
+#include "TestHelper.h"
+
+// BuildMeshlets() output checked by hand and by VerifyMeshlets()
+namespace
+{
+    std::vector<Meshlet> Build(const std::vector<uint32_t>& indices, const std::vector<XMFLOAT3>& positions)
+    {
+        std::vector<Meshlet> meshlets;
+        BuildMeshlets(indices.data(), indices.size(), 0, positions.data(), sizeof(XMFLOAT3), static_cast<uint32_t>(positions.size()), meshlets);
+        return meshlets;
+    }
+
+    bool Verify(const std::vector<uint32_t>& indices, const std::vector<XMFLOAT3>& positions, const std::vector<Meshlet>& meshlets)
+    {
+        return VerifyMeshlets(indices.data(), indices.size(), 0, positions.data(), sizeof(XMFLOAT3), static_cast<uint32_t>(positions.size()),
+            meshlets.data(), meshlets.size());
+    }
+
+    // (n + 1) x (n + 1) vertices in the xz plane, front faces up
+    void BuildFlatPatch(uint32_t n, std::vector<uint32_t>& indices, std::vector<XMFLOAT3>& positions)
+    {
+        for (uint32_t i = 0; i <= n; ++i)
+        {
+            for (uint32_t j = 0; j <= n; ++j)
+            {
+                positions.push_back(XMFLOAT3(static_cast<float>(i), 0.f, static_cast<float>(j)));
+            }
+        }
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            for (uint32_t j = 0; j < n; ++j)
+            {
+                const uint32_t v = i * (n + 1) + j;
+                const uint32_t triangles[] = { v, v + 1, v + n + 1, v + 1, v + n + 2, v + n + 1 };
+                indices.insert(indices.end(), std::begin(triangles), std::end(triangles));
+            }
+        }
+    }
+
+    void TestTriangleLimit()
+    {
+        // One triangle over and over: 3 vertices, so only the triangle limit splits it
+        const std::vector<XMFLOAT3> positions = { XMFLOAT3(0.f, 0.f, 0.f), XMFLOAT3(0.f, 0.f, 1.f), XMFLOAT3(1.f, 0.f, 0.f) };
+        std::vector<uint32_t> indices;
+        for (uint32_t t = 0; t < 2 * MaxMeshletTriangles + 52; ++t)
+        {
+            indices.insert(indices.end(), { 0, 1, 2 });
+        }
+
+        const std::vector<Meshlet> meshlets = Build(indices, positions);
+        CHECK(meshlets.size() == 3);
+        if (meshlets.size() == 3)
+        {
+            CHECK(meshlets[0].indexCount == 3 * MaxMeshletTriangles && meshlets[1].indexCount == 3 * MaxMeshletTriangles);
+            CHECK(meshlets[2].indexCount == 3 * 52);
+            CHECK(meshlets[1].startIndex == 3 * MaxMeshletTriangles);
+            CHECK(meshlets[0].vertexCount == 3);
+        }
+        CHECK(Verify(indices, positions, meshlets));
+    }
+
+    void TestVertexLimit()
+    {
+        // Triangles that share nothing: 21 of them make 63 vertices, the 22nd doesn't fit
+        std::vector<XMFLOAT3> positions;
+        std::vector<uint32_t> indices;
+        for (uint32_t t = 0; t < 100; ++t)
+        {
+            const float x = static_cast<float>(t);
+            positions.insert(positions.end(), { XMFLOAT3(x, 0.f, 0.f), XMFLOAT3(x, 0.f, 1.f), XMFLOAT3(x + 1.f, 0.f, 0.f) });
+            indices.insert(indices.end(), { 3 * t, 3 * t + 1, 3 * t + 2 });
+        }
+
+        const std::vector<Meshlet> meshlets = Build(indices, positions);
+        CHECK(meshlets.size() == 5);
+        for (const Meshlet& meshlet : meshlets)
+        {
+            CHECK(meshlet.vertexCount <= MaxMeshletVertices);
+            CHECK(meshlet.vertexCount == meshlet.indexCount);
+        }
+        CHECK(!meshlets.empty() && meshlets[0].vertexCount == 63);
+        CHECK(Verify(indices, positions, meshlets));
+
+        // A larger grid splits on both limits, all within them
+        std::vector<XMFLOAT3> gridPositions;
+        std::vector<uint32_t> gridIndices;
+        BuildFlatPatch(40, gridIndices, gridPositions);
+        const std::vector<Meshlet> gridMeshlets = Build(gridIndices, gridPositions);
+        for (const Meshlet& meshlet : gridMeshlets)
+        {
+            CHECK(meshlet.vertexCount <= MaxMeshletVertices && meshlet.indexCount <= 3 * MaxMeshletTriangles);
+        }
+        CHECK(Verify(gridIndices, gridPositions, gridMeshlets));
+
+        // And Verify holds them to the limits it is given
+        CHECK(!VerifyMeshlets(gridIndices.data(), gridIndices.size(), 0, gridPositions.data(), sizeof(XMFLOAT3),
+            static_cast<uint32_t>(gridPositions.size()), gridMeshlets.data(), gridMeshlets.size(), 32, MaxMeshletTriangles));
+    }
+
+    void TestDegenerateTriangles()
+    {
+        // Repeated indices and a zero area triangle count their distinct vertices and give no normal
+        const std::vector<XMFLOAT3> positions = {
+            XMFLOAT3(0.f, 0.f, 0.f), XMFLOAT3(1.f, 0.f, 0.f), XMFLOAT3(2.f, 0.f, 0.f), XMFLOAT3(0.f, 0.f, 1.f) };
+        const std::vector<uint32_t> degenerate = { 0, 0, 1, 1, 1, 1, 0, 1, 2 };
+
+        const std::vector<Meshlet> meshlets = Build(degenerate, positions);
+        CHECK(meshlets.size() == 1);
+        if (meshlets.size() == 1)
+        {
+            CHECK(meshlets[0].vertexCount == 3);
+            CHECK(meshlets[0].coneCutoff == 1.f);
+            CHECK(!IsMeshletBackfacing(meshlets[0], XMFLOAT3(0.f, -10.f, 0.f)));
+        }
+        CHECK(Verify(degenerate, positions, meshlets));
+
+        // Next to a real triangle they don't widen its cone
+        std::vector<uint32_t> mixed = degenerate;
+        mixed.insert(mixed.end(), { 0, 3, 1 });
+        const std::vector<Meshlet> mixedMeshlets = Build(mixed, positions);
+        CHECK(mixedMeshlets.size() == 1);
+        if (mixedMeshlets.size() == 1)
+        {
+            CHECK(mixedMeshlets[0].coneCutoff < 1e-3f);
+            CHECK(mixedMeshlets[0].coneAxis.y > 0.999f);
+        }
+        CHECK(Verify(mixed, positions, mixedMeshlets));
+    }
+
+    void TestClosedCube()
+    {
+        const std::vector<XMFLOAT3> positions = {
+            XMFLOAT3(-1.f, -1.f, -1.f), XMFLOAT3(1.f, -1.f, -1.f), XMFLOAT3(1.f, 1.f, -1.f), XMFLOAT3(-1.f, 1.f, -1.f),
+            XMFLOAT3(-1.f, -1.f, 1.f), XMFLOAT3(1.f, -1.f, 1.f), XMFLOAT3(1.f, 1.f, 1.f), XMFLOAT3(-1.f, 1.f, 1.f) };
+        const std::vector<uint32_t> indices = {
+            0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+            3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5 };
+
+        // Faces point every way, no camera sees only back faces
+        const std::vector<Meshlet> meshlets = Build(indices, positions);
+        CHECK(meshlets.size() == 1);
+        if (meshlets.size() == 1)
+        {
+            CHECK(meshlets[0].vertexCount == 8);
+            CHECK(meshlets[0].coneCutoff == 1.f);
+            CHECK(meshlets[0].radius >= sqrtf(3.f) - 1e-5f);
+
+            const XMFLOAT3 cameras[] = { XMFLOAT3(0.f, 10.f, 0.f), XMFLOAT3(0.f, -10.f, 0.f), XMFLOAT3(10.f, 10.f, 10.f), XMFLOAT3(-5.f, 0.f, 3.f) };
+            for (const XMFLOAT3& camera : cameras)
+            {
+                CHECK(!IsMeshletBackfacing(meshlets[0], camera));
+            }
+        }
+        CHECK(Verify(indices, positions, meshlets));
+    }
+
+    void TestFlatPatch()
+    {
+        std::vector<XMFLOAT3> positions;
+        std::vector<uint32_t> indices;
+        BuildFlatPatch(4, indices, positions);
+
+        const std::vector<Meshlet> meshlets = Build(indices, positions);
+        CHECK(meshlets.size() == 1);
+        if (meshlets.size() == 1)
+        {
+            const Meshlet& meshlet = meshlets[0];
+            CHECK(meshlet.vertexCount == 25);
+            CHECK(meshlet.coneAxis.y > 0.999f);
+            CHECK(meshlet.coneCutoff < 1e-3f);
+
+            // Behind the patch every triangle faces away, in front or edge on some face the camera
+            CHECK(IsMeshletBackfacing(meshlet, XMFLOAT3(2.f, -10.f, 2.f)));
+            CHECK(IsMeshletBackfacing(meshlet, XMFLOAT3(-20.f, -50.f, 30.f)));
+            CHECK(!IsMeshletBackfacing(meshlet, XMFLOAT3(2.f, 10.f, 2.f)));
+            CHECK(!IsMeshletBackfacing(meshlet, XMFLOAT3(20.f, 0.f, 2.f)));
+
+            // Right behind it, the bounding sphere keeps it from being culled
+            CHECK(!IsMeshletBackfacing(meshlet, XMFLOAT3(2.f, -0.5f, 2.f)));
+        }
+        CHECK(Verify(indices, positions, meshlets));
+
+        // A sphere that misses a vertex or a cone that misses a normal is rejected
+        std::vector<Meshlet> broken = meshlets;
+        if (!broken.empty())
+        {
+            broken[0].radius *= 0.5f;
+            CHECK(!Verify(indices, positions, broken));
+
+            broken = meshlets;
+            broken[0].coneAxis = XMFLOAT3(1.f, 0.f, 0.f);
+            CHECK(!Verify(indices, positions, broken));
+        }
+    }
+}
+
+int main()
+{
+    TestTriangleLimit();
+    TestVertexLimit();
+    TestDegenerateTriangles();
+    TestClosedCube();
+    TestFlatPatch();
+    return TestHelper::ReportChecks("MeshletTests");
+}
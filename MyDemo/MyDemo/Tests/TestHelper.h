@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+
+/*
+    Just enough for the CTest executables: a failed CHECK prints where it failed and the run goes on,
+    main() returns ReportChecks() so CTest sees any failure.
+*/
+namespace TestHelper
+{
+    inline int s_checkCount = 0;
+    inline int s_failedCount = 0;
+
+    inline void Check(bool passed, const char* condition, const char* file, int line)
+    {
+        ++s_checkCount;
+        if (!passed)
+        {
+            ++s_failedCount;
+            printf("%s(%d): CHECK(%s) failed\n", file, line, condition);
+        }
+    }
+
+    inline int ReportChecks(const char* testName)
+    {
+        printf("%s: %d of %d checks failed\n", testName, s_failedCount, s_checkCount);
+        return s_failedCount == 0 ? 0 : 1;
+    }
+}
+
+#define CHECK(condition) TestHelper::Check(!!(condition), #condition, __FILE__, __LINE__)
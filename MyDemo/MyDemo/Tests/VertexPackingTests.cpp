@@ -0,0 +1,199 @@
+#include "pch.h"
+#include "VertexPacking.h"
+#include "TestHelper.h"
+
+// Round trips of the compact vertex formats at the values where packing tends to break
+namespace
+{
+    float Distance(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&a), XMLoadFloat3(&b))));
+    }
+
+    XMFLOAT3 Normalize(const XMFLOAT3& vector)
+    {
+        XMFLOAT3 normalized;
+        XMStoreFloat3(&normalized, XMVector3Normalize(XMLoadFloat3(&vector)));
+        return normalized;
+    }
+
+    void TestPositionCorners()
+    {
+        const XMFLOAT3 minimum(-2.f, -1.f, -3.f);
+        const XMFLOAT3 maximum(4.f, 5.f, 6.f);
+        const PositionQuantization quantization = PositionQuantization::FromBox(minimum, maximum);
+        const VertexPackingError tolerance = VertexPackingError::GetTolerance(quantization);
+
+        // The corners land on the ends of the UNORM range
+        for (uint32_t corner = 0; corner < 8; ++corner)
+        {
+            const XMFLOAT3 position(
+                (corner & 1) ? maximum.x : minimum.x,
+                (corner & 2) ? maximum.y : minimum.y,
+                (corner & 4) ? maximum.z : minimum.z);
+
+            uint16_t packed[4];
+            PackPosition(position, quantization, packed);
+            CHECK(packed[0] == ((corner & 1) ? 65535 : 0));
+            CHECK(packed[1] == ((corner & 2) ? 65535 : 0));
+            CHECK(packed[2] == ((corner & 4) ? 65535 : 0));
+            CHECK(packed[3] == 0);
+            CHECK(Distance(UnpackPosition(packed, quantization), position) <= tolerance.position);
+        }
+
+        // Inside the box every position is within half a step
+        for (uint32_t i = 0; i <= 1000; ++i)
+        {
+            const float t = i / 1000.f;
+            const XMFLOAT3 position(
+                minimum.x + (maximum.x - minimum.x) * t,
+                minimum.y + (maximum.y - minimum.y) * (1.f - t),
+                minimum.z + (maximum.z - minimum.z) * fmodf(t * 7.f, 1.f));
+
+            uint16_t packed[4];
+            PackPosition(position, quantization, packed);
+            CHECK(Distance(UnpackPosition(packed, quantization), position) <= tolerance.position);
+        }
+    }
+
+    void TestPositionFlatAxes()
+    {
+        // Flat land: no relief, y packs to 0 and comes back exactly
+        const PositionQuantization flat = PositionQuantization::FromBox(XMFLOAT3(-8.f, 2.f, -4.f), XMFLOAT3(8.f, 2.f, 4.f));
+        CHECK(flat.scale.y > 0.f);
+
+        const XMFLOAT3 position(0.25f, 2.f, -0.5f);
+        uint16_t packed[4];
+        PackPosition(position, flat, packed);
+        CHECK(packed[1] == 0);
+
+        const XMFLOAT3 unpacked = UnpackPosition(packed, flat);
+        CHECK(unpacked.y == 2.f);
+        CHECK(Distance(unpacked, position) <= VertexPackingError::GetTolerance(flat).position);
+
+        // A box flat on every axis, a single point
+        const XMFLOAT3 point(3.f, -3.f, 3.f);
+        const PositionQuantization pointQuantization = PositionQuantization::FromBox(point, point);
+        PackPosition(point, pointQuantization, packed);
+        CHECK(packed[0] == 0 && packed[1] == 0 && packed[2] == 0);
+
+        const XMFLOAT3 unpackedPoint = UnpackPosition(packed, pointQuantization);
+        CHECK(unpackedPoint.x == point.x && unpackedPoint.y == point.y && unpackedPoint.z == point.z);
+    }
+
+    void CheckOctahedral(const XMFLOAT3& vector, float tolerance)
+    {
+        int16_t packed[2];
+        PackOctahedral(vector, packed);
+
+        const XMFLOAT3 unpacked = UnpackOctahedral(packed);
+        CHECK(fabsf(XMVectorGetX(XMVector3Length(XMLoadFloat3(&unpacked))) - 1.f) <= 1e-5f);
+        CHECK(Distance(unpacked, Normalize(vector)) <= tolerance);
+    }
+
+    void TestOctahedral()
+    {
+        const float tolerance = VertexPackingError::GetTolerance(PositionQuantization()).normal;
+
+        // Every octant, the lower four are the folded ones
+        for (uint32_t octant = 0; octant < 8; ++octant)
+        {
+            const float sx = (octant & 1) ? -1.f : 1.f;
+            const float sy = (octant & 2) ? -1.f : 1.f;
+            const float sz = (octant & 4) ? -1.f : 1.f;
+            const XMFLOAT3 diagonal(sx, sy, sz);
+            const XMFLOAT3 skewed(sx * 0.2f, sy * 0.7f, sz * 0.3f);
+
+            CheckOctahedral(diagonal, tolerance);
+            CheckOctahedral(skewed, tolerance);
+
+            int16_t packed[2];
+            PackOctahedral(skewed, packed);
+            const XMFLOAT3 unpacked = UnpackOctahedral(packed);
+            CHECK(unpacked.x * sx > 0.f && unpacked.y * sy > 0.f && unpacked.z * sz > 0.f);
+        }
+
+        // The axes, with the poles where the fold meets itself
+        CheckOctahedral(XMFLOAT3(1.f, 0.f, 0.f), tolerance);
+        CheckOctahedral(XMFLOAT3(-1.f, 0.f, 0.f), tolerance);
+        CheckOctahedral(XMFLOAT3(0.f, 1.f, 0.f), tolerance);
+        CheckOctahedral(XMFLOAT3(0.f, -1.f, 0.f), tolerance);
+        CheckOctahedral(XMFLOAT3(0.f, 0.f, 1.f), tolerance);
+        CheckOctahedral(XMFLOAT3(0.f, 0.f, -1.f), tolerance);
+
+        // The fold seam: the equator, just below it and the lower half of the axis planes
+        const float below = -1e-4f;
+        CheckOctahedral(XMFLOAT3(0.6f, 0.8f, 0.f), tolerance);
+        CheckOctahedral(XMFLOAT3(-0.6f, 0.8f, 0.f), tolerance);
+        CheckOctahedral(XMFLOAT3(0.6f, -0.8f, 0.f), tolerance);
+        CheckOctahedral(XMFLOAT3(-0.6f, -0.8f, 0.f), tolerance);
+        CheckOctahedral(XMFLOAT3(0.6f, 0.8f, below), tolerance);
+        CheckOctahedral(XMFLOAT3(-0.6f, -0.8f, below), tolerance);
+        CheckOctahedral(XMFLOAT3(0.f, 1.f, -1.f), tolerance);
+        CheckOctahedral(XMFLOAT3(0.f, -1.f, -1.f), tolerance);
+        CheckOctahedral(XMFLOAT3(1.f, 0.f, -1.f), tolerance);
+        CheckOctahedral(XMFLOAT3(-1.f, 0.f, -1.f), tolerance);
+    }
+
+    void TestColor()
+    {
+        const VertexPackingError tolerance = VertexPackingError::GetTolerance(PositionQuantization());
+
+        CHECK(PackColor(XMFLOAT4(0.f, 0.f, 0.f, 0.f)) == 0u);
+        CHECK(PackColor(XMFLOAT4(1.f, 1.f, 1.f, 1.f)) == 0xffffffffu);
+        CHECK(PackColor(XMFLOAT4(1.f, 0.f, 0.f, 0.f)) == 0x000000ffu);
+        CHECK(PackColor(XMFLOAT4(0.f, 0.f, 0.f, 1.f)) == 0xff000000u);
+        CHECK(PackColor(XMFLOAT4(-0.5f, 1.5f, -1.f, 2.f)) == 0xff00ff00u);
+
+        const XMFLOAT4 black = UnpackColor(0u);
+        const XMFLOAT4 white = UnpackColor(0xffffffffu);
+        CHECK(black.x == 0.f && black.y == 0.f && black.z == 0.f && black.w == 0.f);
+        CHECK(white.x == 1.f && white.y == 1.f && white.z == 1.f && white.w == 1.f);
+
+        // Every level survives unpacking and packing again
+        for (uint32_t level = 0; level < 256; ++level)
+        {
+            const uint32_t packed = level * 0x01010101u;
+            CHECK(PackColor(UnpackColor(packed)) == packed);
+        }
+
+        const XMFLOAT4 color(0.1f, 0.25f, 0.5f, 0.9f);
+        const XMFLOAT4 unpacked = UnpackColor(PackColor(color));
+        CHECK(fabsf(unpacked.x - color.x) <= tolerance.color && fabsf(unpacked.y - color.y) <= tolerance.color);
+        CHECK(fabsf(unpacked.z - color.z) <= tolerance.color && fabsf(unpacked.w - color.w) <= tolerance.color);
+    }
+
+    void TestTexCoord()
+    {
+        // Exact in half precision
+        const float exactValues[] = { 0.f, 0.5f, 1.f, -1.f, 2.5f, -0.25f, 1024.f, 1.f / 1024.f };
+        for (float value : exactValues)
+        {
+            uint16_t packed[2];
+            PackTexCoord(XMFLOAT2(value, -value), packed);
+            const XMFLOAT2 unpacked = UnpackTexCoord(packed);
+            CHECK(unpacked.x == value && unpacked.y == -value);
+        }
+
+        // Otherwise within half a unit in the last place, 11 bits of mantissa
+        const float values[] = { 0.1f, 0.3333f, 0.9999f, 3.7f, 100.1f };
+        for (float value : values)
+        {
+            uint16_t packed[2];
+            PackTexCoord(XMFLOAT2(value, value), packed);
+            const XMFLOAT2 unpacked = UnpackTexCoord(packed);
+            CHECK(fabsf(unpacked.x - value) <= value * (1.f / 2048.f));
+            CHECK(unpacked.x == unpacked.y);
+        }
+    }
+}
+
+int main()
+{
+    TestPositionCorners();
+    TestPositionFlatAxes();
+    TestOctahedral();
+    TestColor();
+    TestTexCoord();
+    return TestHelper::ReportChecks("VertexPackingTests");
+}
@@ -0,0 +1,464 @@
+#include "pch.h"
+#include "ThreadPool.h"
+#include "DXSampleHelper.h"
+#include <immintrin.h>
+
+namespace
+{
+    // An idle thread spins this many times, then yields, then sleeps
+    const uint32_t SpinCount = 64;
+    const uint32_t YieldCount = 256;
+
+    // Deque of the current thread, only valid while t_pPool is the pool asking
+    thread_local ThreadPool* t_pPool = nullptr;
+    thread_local uint32_t t_queueIndex = 0;
+
+    // Picks the first victim to steal from, so thieves don't all start at the same deque
+    thread_local uint32_t t_randomState = 1;
+
+    uint32_t NextRandom()
+    {
+        // xorshift32
+        uint32_t x = t_randomState;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        t_randomState = x;
+        return x;
+    }
+
+    void SetCurrentQueue(ThreadPool* pPool, uint32_t queueIndex)
+    {
+        t_pPool = pPool;
+        t_queueIndex = queueIndex;
+        t_randomState = queueIndex * 2654435761u + 1;
+    }
+}
+
+/*
+    Fixed size Chase-Lev deque. The owner pushes and pops at the bottom, thieves take from the top,
+    the owner and a thief only race for the last task, which a compare exchange on top settles.
+*/
+class ThreadPool::WorkQueue
+{
+public:
+    static const int64_t Capacity = 4096;
+
+    WorkQueue() :
+        m_top(0),
+        m_bottom(0)
+    {
+    }
+
+    // Owner only, false when the deque is full
+    bool Push(Task* pTask)
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_acquire);
+        if (bottom - top >= Capacity)
+        {
+            return false;
+        }
+
+        m_tasks[bottom & (Capacity - 1)].store(pTask, std::memory_order_relaxed);
+        m_bottom.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Owner only, newest first
+    Task* Pop()
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            // Empty
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Task* pTask = m_tasks[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // The last one, a thief may be taking it too
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                pTask = nullptr;
+            }
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return pTask;
+    }
+
+    // Any thread, oldest first. May give up on a task another thread took first
+    Task* Steal()
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+        if (top >= bottom)
+        {
+            return nullptr;
+        }
+
+        Task* pTask = m_tasks[top & (Capacity - 1)].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return pTask;
+    }
+
+    bool IsEmpty() const
+    {
+        return m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire);
+    }
+
+private:
+    // Owner and thieves each on their own cache line
+    alignas(64) std::atomic<int64_t> m_top;
+    alignas(64) std::atomic<int64_t> m_bottom;
+    alignas(64) std::atomic<Task*> m_tasks[Capacity];
+};
+
+ThreadPool::Task::Task() :
+    m_pendingCount(1),
+    m_unfinishedRuns(1),
+    m_finished(false),
+    m_failed(false),
+    m_continuationCount(0)
+{
+}
+
+ThreadPool::Task::Task(std::function<void()> function) :
+    Task()
+{
+    m_function = std::move(function);
+}
+
+void ThreadPool::Task::Then(Task* pContinuation)
+{
+    if (m_continuationCount == MaxContinuations)
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    pContinuation->m_pendingCount.fetch_add(1, std::memory_order_relaxed);
+    m_continuations[m_continuationCount++] = pContinuation;
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount) :
+    m_queueCount(0),
+    m_sleepingCount(0),
+    m_exit(false)
+{
+    // hardware_concurrency() may return 0 when it cannot tell
+    threadCount = MathHelper::Max(threadCount, 1u);
+
+    // Deque 0 is the creating thread's, the workers follow
+    for (uint32_t i = 0; i < threadCount + MaxExternalThreads; ++i)
+    {
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+    m_queueCount.store(threadCount, std::memory_order_release);
+
+    SetCurrentQueue(this, 0);
+
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exit.store(true, std::memory_order_release);
+    }
+    m_workAvailable.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+
+    if (t_pPool == this)
+    {
+        t_pPool = nullptr;
+    }
+}
+
+void ThreadPool::Dispatch(uint32_t taskCount, const std::function<void(uint32_t)>& task)
+{
+    if (taskCount == 0)
+    {
+        return;
+    }
+
+    // Not worth waking anybody up for a single task
+    if (taskCount == 1 || m_workers.empty())
+    {
+        for (uint32_t i = 0; i < taskCount; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    /*
+        One helper task is queued once per worker that could join, each run takes indices
+        from the shared counter until there are none left. Helpers nobody stole in time
+        are popped again by Wait() below and find nothing to do.
+    */
+    std::atomic<uint32_t> nextIndex(0);
+    Task helper;
+    helper.SetFunction([&]
+    {
+        for (;;)
+        {
+            const uint32_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+            if (index >= taskCount)
+            {
+                return;
+            }
+
+            try
+            {
+                task(index);
+            }
+            catch (...)
+            {
+                if (!helper.m_failed.exchange(true))
+                {
+                    helper.m_exception = std::current_exception();
+                }
+            }
+        }
+    });
+
+    const uint32_t helperCount = MathHelper::Min(taskCount - 1, static_cast<uint32_t>(m_workers.size()));
+    helper.m_unfinishedRuns.store(helperCount, std::memory_order_relaxed);
+
+    const uint32_t queueIndex = GetQueueIndex();
+    Push(queueIndex, &helper, helperCount);
+
+    // The calling thread takes indices too
+    helper.m_function();
+
+    Wait(&helper);
+}
+
+void ThreadPool::Submit(Task* pTask)
+{
+    // The last of the dependencies to finish queues it otherwise
+    if (pTask->m_pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        Push(GetQueueIndex(), pTask);
+    }
+}
+
+void ThreadPool::Wait(Task* pTask)
+{
+    const uint32_t queueIndex = GetQueueIndex();
+
+    uint32_t idleCount = 0;
+    while (!pTask->IsFinished())
+    {
+        if (RunOneTask(queueIndex))
+        {
+            idleCount = 0;
+        }
+        else if (++idleCount < SpinCount)
+        {
+            _mm_pause();
+        }
+        else
+        {
+            // Whatever pTask waits for is running on another thread
+            std::this_thread::yield();
+        }
+    }
+
+    if (pTask->m_exception)
+    {
+        std::rethrow_exception(pTask->m_exception);
+    }
+}
+
+void ThreadPool::WorkerLoop(uint32_t queueIndex)
+{
+    SetCurrentQueue(this, queueIndex);
+
+    uint32_t idleCount = 0;
+    while (!m_exit.load(std::memory_order_acquire))
+    {
+        if (RunOneTask(queueIndex))
+        {
+            idleCount = 0;
+            continue;
+        }
+
+        ++idleCount;
+        if (idleCount < SpinCount)
+        {
+            _mm_pause();
+            continue;
+        }
+        if (idleCount < SpinCount + YieldCount)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        /*
+            Announce the sleep before looking at the deques one last time. Push() looks at
+            m_sleepingCount after queueing, so either it sees this worker asleep and wakes it,
+            or this worker sees the task. The mutex covers the gap before wait().
+        */
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sleepingCount.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!m_exit.load(std::memory_order_relaxed) && !HasQueuedTasks())
+        {
+            m_workAvailable.wait(lock);
+        }
+
+        m_sleepingCount.fetch_sub(1, std::memory_order_relaxed);
+        idleCount = 0;
+    }
+}
+
+uint32_t ThreadPool::GetQueueIndex()
+{
+    if (t_pPool == this)
+    {
+        return t_queueIndex;
+    }
+
+    // A thread the pool hasn't seen, it keeps the deque for good
+    const uint32_t queueIndex = m_queueCount.fetch_add(1, std::memory_order_acq_rel);
+    if (queueIndex >= m_queues.size())
+    {
+        m_queueCount.fetch_sub(1, std::memory_order_relaxed);
+        ThrowIfFailed(E_FAIL);
+    }
+
+    SetCurrentQueue(this, queueIndex);
+    return queueIndex;
+}
+
+void ThreadPool::Push(uint32_t queueIndex, Task* pTask, uint32_t runCount)
+{
+    for (uint32_t i = 0; i < runCount; ++i)
+    {
+        if (!m_queues[queueIndex]->Push(pTask))
+        {
+            // Full, the task is ready so it can just as well run here
+            Execute(queueIndex, pTask);
+        }
+    }
+
+    // Pairs with the fence in WorkerLoop, see there
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleepingCount.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (runCount > 1)
+        {
+            m_workAvailable.notify_all();
+        }
+        else
+        {
+            m_workAvailable.notify_one();
+        }
+    }
+}
+
+bool ThreadPool::RunOneTask(uint32_t queueIndex)
+{
+    Task* pTask = m_queues[queueIndex]->Pop();
+
+    if (pTask == nullptr)
+    {
+        const uint32_t queueCount = MathHelper::Min(m_queueCount.load(std::memory_order_acquire), static_cast<uint32_t>(m_queues.size()));
+        const uint32_t firstVictim = NextRandom() % queueCount;
+        for (uint32_t i = 0; i < queueCount && pTask == nullptr; ++i)
+        {
+            const uint32_t victim = (firstVictim + i) % queueCount;
+            if (victim != queueIndex)
+            {
+                pTask = m_queues[victim]->Steal();
+            }
+        }
+    }
+
+    if (pTask == nullptr)
+    {
+        return false;
+    }
+
+    Execute(queueIndex, pTask);
+    return true;
+}
+
+void ThreadPool::Execute(uint32_t queueIndex, Task* pTask)
+{
+    try
+    {
+        // A task without a function only joins the tasks it continues
+        if (pTask->m_function)
+        {
+            pTask->m_function();
+        }
+    }
+    catch (...)
+    {
+        if (!pTask->m_failed.exchange(true))
+        {
+            pTask->m_exception = std::current_exception();
+        }
+    }
+
+    if (pTask->m_unfinishedRuns.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    /*
+        The owner may destroy the task as soon as it is finished, or as soon as a continuation
+        has finished, so the continuations are copied out before either can happen
+    */
+    Task* continuations[Task::MaxContinuations];
+    const uint32_t continuationCount = pTask->m_continuationCount;
+    std::copy(pTask->m_continuations, pTask->m_continuations + continuationCount, continuations);
+
+    pTask->m_finished.store(true, std::memory_order_release);
+
+    // Continuations go to this thread's deque, they likely use what pTask just wrote
+    for (uint32_t i = 0; i < continuationCount; ++i)
+    {
+        if (continuations[i]->m_pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            Push(queueIndex, continuations[i]);
+        }
+    }
+}
+
+bool ThreadPool::HasQueuedTasks() const
+{
+    const uint32_t queueCount = MathHelper::Min(m_queueCount.load(std::memory_order_acquire), static_cast<uint32_t>(m_queues.size()));
+    for (uint32_t i = 0; i < queueCount; ++i)
+    {
+        if (!m_queues[i]->IsEmpty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+/*
+    Work stealing scheduler. Every thread using the pool has its own deque of ready tasks:
+    it pushes and pops at one end, idle threads steal from the other end of somebody else's.
+    Pushing, popping and stealing are lock free, the mutex is only taken to put an idle worker
+    to sleep or to wake one up.
+
+    Dispatch() is the parallel for, it hands out task indices [0, taskCount) to the workers and
+    the calling thread and returns once every index has been processed.
+    Task adds single functions with dependencies: a task is run once it has been submitted and
+    every task it continues has finished.
+    Waiting threads, Dispatch() included, run other tasks meanwhile, so both can be nested in tasks.
+    The first exception thrown by a task is rethrown on the waiting thread.
+
+    The thread that creates the pool and the workers have their deque from the start,
+    any other thread gets one the first time it submits, up to MaxExternalThreads of them.
+*/
+class ThreadPool
+{
+public:
+    class Task
+    {
+    public:
+        Task();
+        explicit Task(std::function<void()> function);
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        void SetFunction(std::function<void()> function) { m_function = std::move(function); }
+
+        // pContinuation waits for this task. Only before either of them is submitted
+        void Then(Task* pContinuation);
+
+        bool IsFinished() const { return m_finished.load(std::memory_order_acquire); }
+
+    private:
+        friend class ThreadPool;
+
+        static const uint32_t MaxContinuations = 8;
+
+        std::function<void()> m_function;
+
+        std::atomic<uint32_t> m_pendingCount;       // unfinished tasks it continues, plus one until it is submitted
+        std::atomic<uint32_t> m_unfinishedRuns;     // Dispatch() queues its helper task once per worker
+        std::atomic<bool> m_finished;
+
+        std::atomic<bool> m_failed;
+        std::exception_ptr m_exception;
+
+        Task* m_continuations[MaxContinuations];
+        uint32_t m_continuationCount;
+    };
+
+    static const uint32_t MaxExternalThreads = 8;
+
+    // threadCount includes the calling thread, so threadCount - 1 workers are started
+    explicit ThreadPool(uint32_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1; }
+
+    void Dispatch(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+
+    // The task must stay alive until it has finished, Wait() for it or for a task continuing it
+    void Submit(Task* pTask);
+
+    // Runs other tasks until pTask has finished, then rethrows its exception if it threw
+    void Wait(Task* pTask);
+
+private:
+    class WorkQueue;
+
+    void WorkerLoop(uint32_t queueIndex);
+
+    // Deque of the calling thread, one is taken the first time a thread not owned by the pool asks
+    uint32_t GetQueueIndex();
+
+    void Push(uint32_t queueIndex, Task* pTask, uint32_t runCount = 1);
+
+    // Pops or steals one task and runs it, false when every deque was empty
+    bool RunOneTask(uint32_t queueIndex);
+    void Execute(uint32_t queueIndex, Task* pTask);
+    bool HasQueuedTasks() const;
+
+    std::vector<std::thread> m_workers;
+
+    // Workers and the creating thread first, external threads are appended as they show up
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::atomic<uint32_t> m_queueCount;
+
+    // Idle workers sleep here once they found nothing to steal for a while
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::atomic<uint32_t> m_sleepingCount;
+    std::atomic<bool> m_exit;
+};
+
+// Calls task(i) for i in [0, taskCount), in parallel when pThreadPool is given
+template<typename Task>
+void ForEachTask(ThreadPool* pThreadPool, uint32_t taskCount, const Task& task)
+{
+    if (pThreadPool != nullptr)
+    {
+        pThreadPool->Dispatch(taskCount, task);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < taskCount; ++i)
+        {
+            task(i);
+        }
+    }
+}
+
+// Calls rowTask(firstRow, endRow) for blocks of up to rowsPerTask rows of [beginRow, endRow), in parallel when pThreadPool is given
+template<typename RowTask>
+void ForEachRowBlock(ThreadPool* pThreadPool, uint32_t beginRow, uint32_t endRow, uint32_t rowsPerTask, const RowTask& rowTask)
+{
+    const uint32_t rowCount = endRow - beginRow;
+    const uint32_t taskCount = (rowCount + rowsPerTask - 1) / rowsPerTask;
+    ForEachTask(pThreadPool, taskCount, [&](uint32_t block)
+    {
+        rowTask(beginRow + block * rowsPerTask, beginRow + MathHelper::Min(rowCount, (block + 1) * rowsPerTask));
+    });
+}
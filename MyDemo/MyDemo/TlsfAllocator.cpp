@@ -0,0 +1,318 @@
+#include "pch.h"
+#include "TlsfAllocator.h"
+#include "DXSampleHelper.h"
+
+namespace
+{
+    uint32_t LowestBit(uint32_t mask)
+    {
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+    }
+
+    uint32_t HighestBit(uint32_t mask)
+    {
+        unsigned long index;
+        _BitScanReverse(&index, mask);
+        return index;
+    }
+
+    // 32 bit scans only, the Win32 configurations have no _BitScanReverse64
+    uint32_t HighestBit64(uint64_t value)
+    {
+        const uint32_t high = static_cast<uint32_t>(value >> 32);
+        return high != 0 ? 32 + HighestBit(high) : HighestBit(static_cast<uint32_t>(value));
+    }
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size, uint64_t granularity) :
+    m_granularity(granularity),
+    m_granularityLog2(HighestBit64(granularity)),
+    m_totalSize(size & ~(granularity - 1)),
+    m_usedSize(0),
+    m_allocationCount(0),
+    m_firstLevelBitmap(0)
+{
+    if (granularity == 0 || (granularity & (granularity - 1)) != 0 || m_totalSize == 0)
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    for (uint32_t i = 0; i < FirstLevelCount; ++i)
+    {
+        m_secondLevelBitmap[i] = 0;
+        for (uint32_t j = 0; j < SecondLevelCount; ++j)
+        {
+            m_freeHeads[i][j] = InvalidNode;
+        }
+    }
+
+    // The whole range starts out as one free block
+    const uint32_t node = NewNode();
+    m_nodes[node].offset = 0;
+    m_nodes[node].size = m_totalSize;
+    InsertFree(node);
+}
+
+TlsfAllocator::Allocation TlsfAllocator::Allocate(uint64_t size)
+{
+    Allocation allocation;
+    if (size == 0)
+    {
+        return allocation;
+    }
+
+    const uint64_t units = (size + m_granularity - 1) >> m_granularityLog2;
+    const uint64_t alignedSize = units << m_granularityLog2;
+
+    const uint32_t node = FindFreeNode(units);
+    if (node == InvalidNode)
+    {
+        return allocation;
+    }
+
+    RemoveFree(node);
+
+    // Give the tail back if it is at least one granule
+    if (m_nodes[node].size > alignedSize)
+    {
+        const uint32_t remainder = NewNode();      // may reallocate m_nodes, index it again below
+
+        m_nodes[remainder].offset = m_nodes[node].offset + alignedSize;
+        m_nodes[remainder].size = m_nodes[node].size - alignedSize;
+        m_nodes[remainder].prevPhysical = node;
+        m_nodes[remainder].nextPhysical = m_nodes[node].nextPhysical;
+
+        if (m_nodes[node].nextPhysical != InvalidNode)
+        {
+            m_nodes[m_nodes[node].nextPhysical].prevPhysical = remainder;
+        }
+
+        m_nodes[node].nextPhysical = remainder;
+        m_nodes[node].size = alignedSize;
+
+        InsertFree(remainder);
+    }
+
+    m_usedSize += alignedSize;
+    m_allocationCount++;
+
+    allocation.offset = m_nodes[node].offset;
+    allocation.size = alignedSize;
+    allocation.node = node;
+
+    return allocation;
+}
+
+void TlsfAllocator::Free(uint32_t node)
+{
+    // Unused nodes have size 0, that catches double frees of merged nodes too
+    if (node >= m_nodes.size() || m_nodes[node].isFree || m_nodes[node].size == 0)
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    m_usedSize -= m_nodes[node].size;
+    m_allocationCount--;
+
+    // Merge with the free range in front
+    const uint32_t prev = m_nodes[node].prevPhysical;
+    if (prev != InvalidNode && m_nodes[prev].isFree)
+    {
+        RemoveFree(prev);
+
+        m_nodes[prev].size += m_nodes[node].size;
+        m_nodes[prev].nextPhysical = m_nodes[node].nextPhysical;
+        if (m_nodes[node].nextPhysical != InvalidNode)
+        {
+            m_nodes[m_nodes[node].nextPhysical].prevPhysical = prev;
+        }
+
+        m_nodes[node].size = 0;
+        m_unusedNodes.push_back(node);
+        node = prev;
+    }
+
+    // and with the one behind
+    const uint32_t next = m_nodes[node].nextPhysical;
+    if (next != InvalidNode && m_nodes[next].isFree)
+    {
+        RemoveFree(next);
+
+        m_nodes[node].size += m_nodes[next].size;
+        m_nodes[node].nextPhysical = m_nodes[next].nextPhysical;
+        if (m_nodes[next].nextPhysical != InvalidNode)
+        {
+            m_nodes[m_nodes[next].nextPhysical].prevPhysical = node;
+        }
+
+        m_nodes[next].size = 0;
+        m_unusedNodes.push_back(next);
+    }
+
+    InsertFree(node);
+}
+
+TlsfAllocator::Stats TlsfAllocator::GetStats() const
+{
+    Stats stats;
+    stats.totalSize = m_totalSize;
+    stats.usedSize = m_usedSize;
+    stats.allocationCount = m_allocationCount;
+
+    for (const Node& node : m_nodes)
+    {
+        if (node.isFree)
+        {
+            stats.freeRangeCount++;
+        }
+    }
+
+    // The largest range is in the highest non-empty bin, but a bin is not sorted
+    if (m_firstLevelBitmap != 0)
+    {
+        const uint32_t firstLevel = HighestBit(m_firstLevelBitmap);
+        const uint32_t secondLevel = HighestBit(m_secondLevelBitmap[firstLevel]);
+
+        for (uint32_t node = m_freeHeads[firstLevel][secondLevel]; node != InvalidNode; node = m_nodes[node].nextFree)
+        {
+            stats.largestFreeRange = MathHelper::Max(stats.largestFreeRange, m_nodes[node].size);
+        }
+    }
+
+    return stats;
+}
+
+void TlsfAllocator::MapInsert(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+    if (units < SecondLevelCount)
+    {
+        // Small ranges get one bin per size
+        firstLevel = 0;
+        secondLevel = static_cast<uint32_t>(units);
+    }
+    else
+    {
+        const uint32_t msb = HighestBit64(units);
+        firstLevel = msb - SecondLevelLog2 + 1;
+        secondLevel = static_cast<uint32_t>(units >> (msb - SecondLevelLog2)) - SecondLevelCount;
+    }
+}
+
+void TlsfAllocator::MapSearch(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+    // Round up to the next bin boundary so any range in the bin found is big enough
+    if (units >= SecondLevelCount)
+    {
+        units += (1ull << (HighestBit64(units) - SecondLevelLog2)) - 1;
+    }
+
+    MapInsert(units, firstLevel, secondLevel);
+}
+
+uint32_t TlsfAllocator::FindFreeNode(uint64_t units)
+{
+    uint32_t firstLevel, secondLevel;
+    MapSearch(units, firstLevel, secondLevel);
+
+    if (firstLevel >= FirstLevelCount)
+    {
+        return InvalidNode;
+    }
+
+    // A big enough bin on the same first level
+    uint32_t secondLevelMap = m_secondLevelBitmap[firstLevel] & (~0u << secondLevel);
+    if (secondLevelMap == 0)
+    {
+        // otherwise the smallest non-empty bin on a higher one
+        const uint32_t firstLevelMap = firstLevel + 1 < FirstLevelCount ? m_firstLevelBitmap & (~0u << (firstLevel + 1)) : 0;
+        if (firstLevelMap == 0)
+        {
+            return InvalidNode;
+        }
+
+        firstLevel = LowestBit(firstLevelMap);
+        secondLevelMap = m_secondLevelBitmap[firstLevel];
+    }
+
+    return m_freeHeads[firstLevel][LowestBit(secondLevelMap)];
+}
+
+void TlsfAllocator::InsertFree(uint32_t node)
+{
+    uint32_t firstLevel, secondLevel;
+    MapInsert(m_nodes[node].size >> m_granularityLog2, firstLevel, secondLevel);
+
+    if (firstLevel >= FirstLevelCount)
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    const uint32_t head = m_freeHeads[firstLevel][secondLevel];
+
+    m_nodes[node].isFree = true;
+    m_nodes[node].prevFree = InvalidNode;
+    m_nodes[node].nextFree = head;
+    if (head != InvalidNode)
+    {
+        m_nodes[head].prevFree = node;
+    }
+
+    m_freeHeads[firstLevel][secondLevel] = node;
+    m_secondLevelBitmap[firstLevel] |= 1u << secondLevel;
+    m_firstLevelBitmap |= 1u << firstLevel;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t node)
+{
+    uint32_t firstLevel, secondLevel;
+    MapInsert(m_nodes[node].size >> m_granularityLog2, firstLevel, secondLevel);
+
+    const uint32_t prev = m_nodes[node].prevFree;
+    const uint32_t next = m_nodes[node].nextFree;
+
+    if (prev != InvalidNode)
+    {
+        m_nodes[prev].nextFree = next;
+    }
+    else
+    {
+        m_freeHeads[firstLevel][secondLevel] = next;
+    }
+
+    if (next != InvalidNode)
+    {
+        m_nodes[next].prevFree = prev;
+    }
+
+    // Keep the bitmaps in sync with empty bins
+    if (m_freeHeads[firstLevel][secondLevel] == InvalidNode)
+    {
+        m_secondLevelBitmap[firstLevel] &= ~(1u << secondLevel);
+        if (m_secondLevelBitmap[firstLevel] == 0)
+        {
+            m_firstLevelBitmap &= ~(1u << firstLevel);
+        }
+    }
+
+    m_nodes[node].isFree = false;
+}
+
+uint32_t TlsfAllocator::NewNode()
+{
+    uint32_t node;
+    if (!m_unusedNodes.empty())
+    {
+        node = m_unusedNodes.back();
+        m_unusedNodes.pop_back();
+    }
+    else
+    {
+        node = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.push_back(Node());
+    }
+
+    m_nodes[node] = { 0, 0, InvalidNode, InvalidNode, InvalidNode, InvalidNode, false };
+    return node;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+    Two-Level Segregated Fit allocator over an abstract range [0, size).
+    It only hands out offsets, the memory itself lives elsewhere (here: a GPU buffer),
+    so the block headers are kept in a node array on the CPU instead of inside the range.
+
+    Free ranges are binned by size: the first level is the power of two,
+    the second level splits every power of two into SecondLevelCount linear steps.
+    Allocate() and Free() are O(1), adjacent free ranges are merged on Free().
+    All sizes and offsets are multiples of the granularity passed to the constructor.
+*/
+class TlsfAllocator
+{
+public:
+    static const uint32_t InvalidNode = 0xffffffff;
+
+    struct Allocation
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t node = InvalidNode;    // pass to Free()
+
+        bool IsValid() const { return node != InvalidNode; }
+    };
+
+    struct Stats
+    {
+        uint64_t totalSize = 0;
+        uint64_t usedSize = 0;
+        uint64_t largestFreeRange = 0;
+        uint32_t allocationCount = 0;
+        uint32_t freeRangeCount = 0;
+    };
+
+    // granularity must be a power of two
+    TlsfAllocator(uint64_t size, uint64_t granularity);
+
+    // Returns an invalid allocation when no free range is large enough
+    Allocation Allocate(uint64_t size);
+    void Free(uint32_t node);
+
+    Stats GetStats() const;
+
+private:
+    static const uint32_t SecondLevelLog2 = 4;
+    static const uint32_t SecondLevelCount = 1 << SecondLevelLog2;
+    static const uint32_t FirstLevelCount = 32;
+
+    struct Node
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t prevPhysical;      // neighbours in address order
+        uint32_t nextPhysical;
+        uint32_t prevFree;          // neighbours in the free list of its bin
+        uint32_t nextFree;
+        bool isFree;
+    };
+
+    // Bin that a free range of "units" granules is filed under
+    static void MapInsert(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel);
+    // Smallest bin whose ranges are all at least "units" granules
+    static void MapSearch(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel);
+
+    uint32_t FindFreeNode(uint64_t units);
+    void InsertFree(uint32_t node);
+    void RemoveFree(uint32_t node);
+    uint32_t NewNode();
+
+    uint64_t m_granularity;
+    uint32_t m_granularityLog2;
+    uint64_t m_totalSize;
+    uint64_t m_usedSize;
+    uint32_t m_allocationCount;
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_unusedNodes;
+
+    uint32_t m_firstLevelBitmap;
+    uint32_t m_secondLevelBitmap[FirstLevelCount];
+    uint32_t m_freeHeads[FirstLevelCount][SecondLevelCount];
+};
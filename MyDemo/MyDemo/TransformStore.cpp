@@ -0,0 +1,164 @@
+#include "pch.h"
+#include "TransformStore.h"
+#include <immintrin.h>
+
+namespace
+{
+    // Dirty words scanned and uploaded per task, 2048 objects
+    const uint32_t WordsPerTask = 64;
+
+    // Below this many dirty objects the hand-off costs more than the upload
+    const uint32_t MinParallelDirtyCount = 8192;
+
+    const uint32_t ElementsPerMatrix = 16;
+    const uint32_t ElementsPerBlock = ElementsPerMatrix * TransformStore::LaneCount;
+}
+
+TransformStore::TransformStore(uint32_t dirtySetCount) :
+    m_count(0),
+    m_dirtyBits(dirtySetCount),
+    m_dirtyCounts(dirtySetCount, 0)
+{
+}
+
+void TransformStore::Resize(uint32_t count)
+{
+    const uint32_t oldCount = m_count;
+    const size_t blockCount = (static_cast<size_t>(count) + LaneCount - 1) / LaneCount;
+    m_elements.resize(blockCount * ElementsPerBlock, 0.f);
+
+    const size_t wordCount = (static_cast<size_t>(count) + BitsPerWord - 1) / BitsPerWord;
+    for (std::vector<uint32_t>& bits : m_dirtyBits)
+    {
+        bits.resize(wordCount, 0);
+    }
+
+    // Shrinking leaves the dirty bits of removed objects behind, recount every set
+    m_count = count;
+    if (count < oldCount)
+    {
+        for (size_t set = 0; set < m_dirtyBits.size(); ++set)
+        {
+            std::vector<uint32_t>& bits = m_dirtyBits[set];
+            if (count % BitsPerWord != 0)
+            {
+                bits.back() &= (1u << (count % BitsPerWord)) - 1;
+            }
+
+            m_dirtyCounts[set] = 0;
+            for (uint32_t word : bits)
+            {
+                for (; word != 0; word &= word - 1)
+                {
+                    m_dirtyCounts[set]++;
+                }
+            }
+        }
+        return;
+    }
+
+    for (uint32_t i = oldCount; i < count; ++i)
+    {
+        SetWorld(i, XMMatrixIdentity());
+    }
+}
+
+void XM_CALLCONV TransformStore::SetWorld(uint32_t index, FXMMATRIX world)
+{
+    XMFLOAT4X4 elements;
+    XMStoreFloat4x4(&elements, world);
+
+    float* pBlock = &m_elements[index / LaneCount * ElementsPerBlock];
+    const uint32_t lane = index % LaneCount;
+    for (uint32_t k = 0; k < ElementsPerMatrix; ++k)
+    {
+        pBlock[k * LaneCount + lane] = elements.m[k / 4][k % 4];
+    }
+
+    const uint32_t word = index / BitsPerWord;
+    const uint32_t bit = 1u << (index % BitsPerWord);
+    for (size_t set = 0; set < m_dirtyBits.size(); ++set)
+    {
+        uint32_t& bits = m_dirtyBits[set][word];
+        if ((bits & bit) == 0)
+        {
+            bits |= bit;
+            m_dirtyCounts[set]++;
+        }
+    }
+}
+
+void TransformStore::MarkAllDirty(uint32_t dirtySet)
+{
+    std::vector<uint32_t>& bits = m_dirtyBits[dirtySet];
+    std::fill(bits.begin(), bits.end(), ~0u);
+
+    // The last word only covers the objects that exist
+    if (m_count % BitsPerWord != 0)
+    {
+        bits.back() = (1u << (m_count % BitsPerWord)) - 1;
+    }
+
+    m_dirtyCounts[dirtySet] = m_count;
+}
+
+void TransformStore::UploadDirty(uint32_t dirtySet, XMFLOAT4X4* pDestination, ThreadPool* pThreadPool)
+{
+    const uint32_t dirtyCount = m_dirtyCounts[dirtySet];
+    if (dirtyCount == 0)
+    {
+        return;
+    }
+
+    const uint32_t wordCount = static_cast<uint32_t>(m_dirtyBits[dirtySet].size());
+    const auto uploadRun = [&](uint32_t begin, uint32_t end) { UploadRun(begin, end, pDestination); };
+
+    if (pThreadPool != nullptr && dirtyCount >= MinParallelDirtyCount)
+    {
+        // Tasks own whole words, a run crossing a task boundary is uploaded in two parts
+        const uint32_t taskCount = (wordCount + WordsPerTask - 1) / WordsPerTask;
+        pThreadPool->Dispatch(taskCount, [&](uint32_t task)
+        {
+            const uint32_t beginWord = task * WordsPerTask;
+            ConsumeDirtyRuns(dirtySet, beginWord, MathHelper::Min(wordCount, beginWord + WordsPerTask), uploadRun);
+        });
+    }
+    else
+    {
+        ConsumeDirtyRuns(dirtySet, 0, wordCount, uploadRun);
+    }
+
+    m_dirtyCounts[dirtySet] = 0;
+}
+
+void TransformStore::UploadRun(uint32_t begin, uint32_t end, XMFLOAT4X4* pDestination) const
+{
+    for (uint32_t blockBegin = begin / LaneCount * LaneCount; blockBegin < end; blockBegin += LaneCount)
+    {
+        const float* pBlock = &m_elements[blockBegin / LaneCount * ElementsPerBlock];
+
+        /*
+            Row r of a transposed matrix is column r of the stored one: elements r, 4 + r, 8 + r and 12 + r.
+            Transposing those 4 vectors turns them into row r of each lane's matrix.
+            The block's matrices are assembled in registers and the run's part of them is copied out in one go.
+        */
+        __m128 rows[ElementsPerMatrix];
+        for (uint32_t r = 0; r < 4; ++r)
+        {
+            __m128 v0 = _mm_loadu_ps(pBlock + r * LaneCount);
+            __m128 v1 = _mm_loadu_ps(pBlock + (4 + r) * LaneCount);
+            __m128 v2 = _mm_loadu_ps(pBlock + (8 + r) * LaneCount);
+            __m128 v3 = _mm_loadu_ps(pBlock + (12 + r) * LaneCount);
+            _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+
+            rows[r] = v0;
+            rows[4 + r] = v1;
+            rows[8 + r] = v2;
+            rows[12 + r] = v3;
+        }
+
+        const uint32_t first = MathHelper::Max(begin, blockBegin);
+        const uint32_t last = MathHelper::Min(end, blockBegin + LaneCount);
+        memcpy(&pDestination[first], &rows[(first - blockBegin) * 4], (last - first) * sizeof(XMFLOAT4X4));
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+/*
+    World matrices of all renderers, indexed by Renderer::objectIndex, in the form the shaders read
+    them: multiplied by the mesh's position decode matrix. Stored as a structure of arrays in blocks
+    of LaneCount objects, element k of the block's matrices is contiguous, so a block is 16 vector loads
+    and 4 transposes away from 4 consecutive transposed 64 byte shader matrices.
+
+    Changes are tracked in dirty sets, one bitset per consumer (every frame resource has its own
+    object buffer, culling has another). SetWorld() marks the object in every set, each consumer
+    walks the runs of set bits in its own and clears them. A set without dirty objects is skipped
+    without looking at it, a static scene costs nothing per frame.
+*/
+class TransformStore
+{
+public:
+    static const uint32_t LaneCount = 4;
+
+    explicit TransformStore(uint32_t dirtySetCount);
+
+    // Objects added by growing are identity and dirty in every set
+    void Resize(uint32_t count);
+    uint32_t GetCount() const { return m_count; }
+
+    void XM_CALLCONV SetWorld(uint32_t index, FXMMATRIX world);
+
+    // e.g. once the destination of a set has been reallocated
+    void MarkAllDirty(uint32_t dirtySet);
+    uint32_t GetDirtyCount(uint32_t dirtySet) const { return m_dirtyCounts[dirtySet]; }
+
+    // Calls runTask(begin, end) for every run of dirty objects in increasing order, then clears the set
+    template<typename RunTask>
+    void ConsumeDirtyRuns(uint32_t dirtySet, const RunTask& runTask)
+    {
+        if (m_dirtyCounts[dirtySet] > 0)
+        {
+            ConsumeDirtyRuns(dirtySet, 0, static_cast<uint32_t>(m_dirtyBits[dirtySet].size()), runTask);
+            m_dirtyCounts[dirtySet] = 0;
+        }
+    }
+
+    /*
+        Writes the dirty objects of a set transposed to pDestination[objectIndex] and clears the set.
+        A run is written front to back in whole blocks, which suits write combined upload memory.
+        Large sets are split over pThreadPool when it is given.
+    */
+    void UploadDirty(uint32_t dirtySet, XMFLOAT4X4* pDestination, ThreadPool* pThreadPool = nullptr);
+
+private:
+    // 32 bit words, the Win32 configurations have no 64 bit bit scans
+    static const uint32_t BitsPerWord = 32;
+
+    template<typename RunTask>
+    void ConsumeDirtyRuns(uint32_t dirtySet, uint32_t beginWord, uint32_t endWord, const RunTask& runTask);
+
+    void UploadRun(uint32_t begin, uint32_t end, XMFLOAT4X4* pDestination) const;
+
+    uint32_t m_count;
+
+    // LaneCount objects per block, 16 groups of LaneCount floats: element k of the block's matrices, one per lane
+    std::vector<float> m_elements;
+
+    std::vector<std::vector<uint32_t>> m_dirtyBits;
+    std::vector<uint32_t> m_dirtyCounts;
+};
+
+template<typename RunTask>
+void TransformStore::ConsumeDirtyRuns(uint32_t dirtySet, uint32_t beginWord, uint32_t endWord, const RunTask& runTask)
+{
+    uint32_t* pWords = m_dirtyBits[dirtySet].data();
+
+    // Runs are merged across word boundaries before they are handed out
+    uint32_t runBegin = 0;
+    uint32_t runEnd = 0;
+
+    for (uint32_t word = beginWord; word < endWord; ++word)
+    {
+        uint32_t bits = pWords[word];
+        if (bits == 0)
+        {
+            continue;
+        }
+        pWords[word] = 0;
+
+        while (bits != 0)
+        {
+            unsigned long first;
+            _BitScanForward(&first, bits);
+
+            // Length of the run of ones starting at first
+            unsigned long length = BitsPerWord - first;
+            const uint32_t clearAbove = ~(bits >> first);
+            if (clearAbove != 0)
+            {
+                _BitScanForward(&length, clearAbove);
+            }
+
+            const uint32_t begin = word * BitsPerWord + first;
+            if (begin != runEnd || runBegin == runEnd)
+            {
+                if (runBegin != runEnd)
+                {
+                    runTask(runBegin, runEnd);
+                }
+                runBegin = begin;
+            }
+            runEnd = begin + length;
+
+            bits = first + length < BitsPerWord ? bits & (~0u << (first + length)) : 0;
+        }
+    }
+
+    if (runBegin != runEnd)
+    {
+        runTask(runBegin, runEnd);
+    }
+}
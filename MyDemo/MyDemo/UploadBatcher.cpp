@@ -0,0 +1,179 @@
+#include "pch.h"
+#include "UploadBatcher.h"
+
+UploadBatcher::UploadBatcher(GraphicsDevice* device, uint64_t stagingBlockSize) :
+    m_device(device),
+    m_stagingBlockSize(stagingBlockSize),
+    m_isRecording(false),
+    m_queuedBytes(0),
+    m_lastToken(0)
+{
+}
+
+UploadBatcher::~UploadBatcher()
+{
+    // The copy queue may still be reading the staging blocks
+    Flush();
+}
+
+GraphicsResourcePtr UploadBatcher::CreateBuffer(const void* pData, uint64_t byteSize)
+{
+    GraphicsResourcePtr buffer = m_device->CreateBuffer(D3D12_HEAP_TYPE_DEFAULT, byteSize, D3D12_RESOURCE_STATE_COMMON);
+
+    Upload(buffer.get(), 0, pData, byteSize);
+
+    return buffer;
+}
+
+void UploadBatcher::Upload(GraphicsResource* pDstBuffer, uint64_t dstOffset, const void* pData, uint64_t byteSize)
+{
+    void* pStaging = Reserve(pDstBuffer, dstOffset, byteSize);
+    if (pStaging != nullptr)
+    {
+        memcpy(pStaging, pData, static_cast<size_t>(byteSize));
+    }
+}
+
+void* UploadBatcher::Reserve(GraphicsResource* pDstBuffer, uint64_t dstOffset, uint64_t byteSize)
+{
+    if (byteSize == 0)
+    {
+        return nullptr;
+    }
+
+    if (!m_isRecording)
+    {
+        BeginBatch();
+    }
+
+    StagingBlock& block = AllocateStaging(byteSize);
+    const uint64_t srcOffset = block.used;
+    block.used += byteSize;
+
+    m_commandList->CopyBufferRegion(pDstBuffer, dstOffset, block.buffer.get(), srcOffset, byteSize);
+
+    m_queuedBytes += byteSize;
+
+    return block.mappedData + srcOffset;
+}
+
+UploadToken UploadBatcher::Submit()
+{
+    if (!m_isRecording)
+    {
+        return 0;
+    }
+
+    ThrowIfFailed(m_commandList->Close());
+
+    GraphicsCommandList* ppCommandLists[] = { m_commandList.get() };
+    m_device->ExecuteCopyCommandLists(_countof(ppCommandLists), ppCommandLists);
+
+    m_current.token = m_device->SignalCopy();
+    m_lastToken = m_current.token;
+
+    m_inFlight.push_back(std::move(m_current));
+    m_current = Batch();
+    m_isRecording = false;
+    m_queuedBytes = 0;
+
+    return m_lastToken;
+}
+
+bool UploadBatcher::IsComplete(UploadToken token)
+{
+    return m_device->IsCopyFenceComplete(token);
+}
+
+void UploadBatcher::Wait(UploadToken token)
+{
+    m_device->WaitForCopyFenceValue(token);
+    Recycle();
+}
+
+void UploadBatcher::Flush()
+{
+    Submit();
+    Wait(m_lastToken);
+}
+
+void UploadBatcher::BeginBatch()
+{
+    // Reuse whatever the copy queue is done with before allocating more
+    Recycle();
+
+    if (!m_freeAllocators.empty())
+    {
+        m_current.allocator = std::move(m_freeAllocators.back());
+        m_freeAllocators.pop_back();
+        ThrowIfFailed(m_current.allocator->Reset());
+    }
+    else
+    {
+        m_current.allocator = m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY);
+    }
+
+    if (m_commandList == nullptr)
+    {
+        // Created in the recording state
+        m_commandList = m_device->CreateCommandList(D3D12_COMMAND_LIST_TYPE_COPY, m_current.allocator.get(), nullptr);
+    }
+    else
+    {
+        ThrowIfFailed(m_commandList->Reset(m_current.allocator.get(), nullptr));
+    }
+
+    m_isRecording = true;
+}
+
+UploadBatcher::StagingBlock& UploadBatcher::AllocateStaging(uint64_t byteSize)
+{
+    if (!m_current.blocks.empty())
+    {
+        StagingBlock& block = m_current.blocks.back();
+        if (block.used + byteSize <= block.buffer->GetSize())
+        {
+            return block;
+        }
+    }
+
+    StagingBlock block;
+    if (byteSize <= m_stagingBlockSize && !m_freeBlocks.empty())
+    {
+        block = std::move(m_freeBlocks.back());
+        m_freeBlocks.pop_back();
+        block.used = 0;
+    }
+    else
+    {
+        // Uploads bigger than a block get a block of their own
+        block.buffer = m_device->CreateBuffer(D3D12_HEAP_TYPE_UPLOAD, MathHelper::Max(byteSize, m_stagingBlockSize), D3D12_RESOURCE_STATE_GENERIC_READ);
+        block.mappedData = block.buffer->Map();
+    }
+
+    m_current.blocks.push_back(std::move(block));
+    return m_current.blocks.back();
+}
+
+void UploadBatcher::Recycle()
+{
+    const UINT64 completedValue = m_device->GetCompletedCopyFenceValue();
+
+    while (!m_inFlight.empty() && m_inFlight.front().token <= completedValue)
+    {
+        Batch& batch = m_inFlight.front();
+
+        m_freeAllocators.push_back(std::move(batch.allocator));
+
+        // Only standard sized blocks are kept, oversized ones are released here
+        for (auto& block : batch.blocks)
+        {
+            if (block.buffer->GetSize() == m_stagingBlockSize)
+            {
+                m_freeBlocks.push_back(std::move(block));
+            }
+        }
+
+        m_inFlight.pop_front();
+    }
+}
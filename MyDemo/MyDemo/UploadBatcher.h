@@ -0,0 +1,87 @@
+#pragma once
+
+#include "GraphicsDevice.h"
+#include <deque>
+
+// Copy queue fence value of a submitted batch, 0 means "nothing to wait for"
+using UploadToken = UINT64;
+
+/*
+    Collects buffer uploads into batches executed on the copy queue.
+    Source data is written straight into large staging blocks on the upload heap and
+    one CopyBufferRegion per upload is recorded, Submit() executes the batch with a
+    single ExecuteCommandLists and returns a token for it.
+    Staging blocks and allocators of a batch are recycled once its token has completed.
+
+    Destination buffers stay in the COMMON state the whole time: buffers are promoted to
+    COPY_DEST by the copy queue, decay back to COMMON when the batch completes and are
+    promoted to a read state by the direct queue on first use, so no barriers are needed.
+    The direct queue must not read a buffer before IsComplete() returns true for its token.
+
+    Not thread safe.
+*/
+class UploadBatcher
+{
+public:
+    static const uint64_t DefaultStagingBlockSize = 8 * 1024 * 1024;
+
+    UploadBatcher(GraphicsDevice* device, uint64_t stagingBlockSize = DefaultStagingBlockSize);
+    ~UploadBatcher();
+
+    // Creates a buffer on the default heap and queues its initial contents
+    GraphicsResourcePtr CreateBuffer(const void* pData, uint64_t byteSize);
+
+    // Queues a copy into an existing default heap buffer that is in the COMMON state
+    void Upload(GraphicsResource* pDstBuffer, uint64_t dstOffset, const void* pData, uint64_t byteSize);
+
+    /*
+        Queues the same copy but leaves filling the staging memory to the caller, so data can be
+        written or read straight into the upload heap. The returned memory is write combined,
+        write it in order and don't read it back. It has to be filled before the next Submit().
+    */
+    void* Reserve(GraphicsResource* pDstBuffer, uint64_t dstOffset, uint64_t byteSize);
+
+    // Executes everything queued since the last call, returns 0 if nothing was queued
+    UploadToken Submit();
+
+    bool IsComplete(UploadToken token);
+    void Wait(UploadToken token);
+
+    // Waits for every submitted batch
+    void Flush();
+
+    // Bytes queued in the batch that is still being recorded
+    uint64_t GetQueuedBytes() const { return m_queuedBytes; }
+
+private:
+    struct StagingBlock
+    {
+        GraphicsResourcePtr buffer;
+        BYTE* mappedData = nullptr;
+        uint64_t used = 0;
+    };
+
+    struct Batch
+    {
+        UploadToken token = 0;
+        std::unique_ptr<GraphicsCommandAllocator> allocator;
+        std::vector<StagingBlock> blocks;
+    };
+
+    void BeginBatch();
+    StagingBlock& AllocateStaging(uint64_t byteSize);
+    void Recycle();
+
+    GraphicsDevice* m_device;
+    uint64_t m_stagingBlockSize;
+
+    std::unique_ptr<GraphicsCommandList> m_commandList;
+    bool m_isRecording;
+    Batch m_current;
+    uint64_t m_queuedBytes;
+
+    std::deque<Batch> m_inFlight;
+    std::vector<std::unique_ptr<GraphicsCommandAllocator>> m_freeAllocators;
+    std::vector<StagingBlock> m_freeBlocks;
+    UploadToken m_lastToken;
+};
@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "VertexPacking.h"
+#include <cfloat>
+
+using namespace DirectX::PackedVector;
+
+namespace
+{
+    const float UnormMax = 65535.f;
+    const float SnormMax = 32767.f;
+
+    uint16_t PackUnorm16(float value)
+    {
+        return static_cast<uint16_t>(MathHelper::Clamp(value, 0.f, 1.f) * UnormMax + 0.5f);
+    }
+
+    int16_t PackSnorm16(float value)
+    {
+        const float scaled = MathHelper::Clamp(value, -1.f, 1.f) * SnormMax;
+        return static_cast<int16_t>(scaled >= 0.f ? scaled + 0.5f : scaled - 0.5f);
+    }
+
+    float SignNotZero(float value)
+    {
+        return value >= 0.f ? 1.f : -1.f;
+    }
+}
+
+PositionQuantization PositionQuantization::FromBox(const XMFLOAT3& minimum, const XMFLOAT3& maximum)
+{
+    // A flat axis keeps a scale, every position on it packs to 0
+    PositionQuantization quantization;
+    quantization.offset = minimum;
+    quantization.scale = XMFLOAT3(
+        maximum.x > minimum.x ? maximum.x - minimum.x : 1.f,
+        maximum.y > minimum.y ? maximum.y - minimum.y : 1.f,
+        maximum.z > minimum.z ? maximum.z - minimum.z : 1.f);
+
+    return quantization;
+}
+
+XMMATRIX PositionQuantization::GetDecodeMatrix() const
+{
+    return XMMatrixMultiply(XMMatrixScaling(scale.x, scale.y, scale.z), XMMatrixTranslation(offset.x, offset.y, offset.z));
+}
+
+void PackPosition(const XMFLOAT3& position, const PositionQuantization& quantization, uint16_t packed[4])
+{
+    packed[0] = PackUnorm16((position.x - quantization.offset.x) / quantization.scale.x);
+    packed[1] = PackUnorm16((position.y - quantization.offset.y) / quantization.scale.y);
+    packed[2] = PackUnorm16((position.z - quantization.offset.z) / quantization.scale.z);
+    packed[3] = 0;
+}
+
+XMFLOAT3 UnpackPosition(const uint16_t packed[4], const PositionQuantization& quantization)
+{
+    // The same multiply-add as the decode matrix on the GPU
+    return XMFLOAT3(
+        quantization.offset.x + quantization.scale.x * (packed[0] / UnormMax),
+        quantization.offset.y + quantization.scale.y * (packed[1] / UnormMax),
+        quantization.offset.z + quantization.scale.z * (packed[2] / UnormMax));
+}
+
+uint32_t PackColor(const XMFLOAT4& color)
+{
+    const auto channel = [](float value)
+    {
+        return static_cast<uint32_t>(MathHelper::Clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+    };
+
+    return channel(color.x) | (channel(color.y) << 8) | (channel(color.z) << 16) | (channel(color.w) << 24);
+}
+
+XMFLOAT4 UnpackColor(uint32_t packed)
+{
+    return XMFLOAT4(
+        (packed & 0xff) / 255.f,
+        ((packed >> 8) & 0xff) / 255.f,
+        ((packed >> 16) & 0xff) / 255.f,
+        (packed >> 24) / 255.f);
+}
+
+void PackOctahedral(const XMFLOAT3& vector, int16_t packed[2])
+{
+    // Onto the octahedron |x| + |y| + |z| = 1, the lower half is folded over the diagonals
+    const float length = fabsf(vector.x) + fabsf(vector.y) + fabsf(vector.z);
+    float x = vector.x / length;
+    float y = vector.y / length;
+
+    if (vector.z < 0.f)
+    {
+        const float foldedX = (1.f - fabsf(y)) * SignNotZero(x);
+        const float foldedY = (1.f - fabsf(x)) * SignNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    packed[0] = PackSnorm16(x);
+    packed[1] = PackSnorm16(y);
+}
+
+XMFLOAT3 UnpackOctahedral(const int16_t packed[2])
+{
+    float x = MathHelper::Max(packed[0] / SnormMax, -1.f);
+    float y = MathHelper::Max(packed[1] / SnormMax, -1.f);
+    const float z = 1.f - fabsf(x) - fabsf(y);
+
+    if (z < 0.f)
+    {
+        const float unfoldedX = (1.f - fabsf(y)) * SignNotZero(x);
+        const float unfoldedY = (1.f - fabsf(x)) * SignNotZero(y);
+        x = unfoldedX;
+        y = unfoldedY;
+    }
+
+    const float length = sqrtf(x * x + y * y + z * z);
+    return XMFLOAT3(x / length, y / length, z / length);
+}
+
+void PackTexCoord(const XMFLOAT2& texC, uint16_t packed[2])
+{
+    packed[0] = XMConvertFloatToHalf(texC.x);
+    packed[1] = XMConvertFloatToHalf(texC.y);
+}
+
+XMFLOAT2 UnpackTexCoord(const uint16_t packed[2])
+{
+    return XMFLOAT2(XMConvertHalfToFloat(packed[0]), XMConvertHalfToFloat(packed[1]));
+}
+
+void VertexPackingError::Combine(const VertexPackingError& other)
+{
+    position = MathHelper::Max(position, other.position);
+    normal = MathHelper::Max(normal, other.normal);
+    texC = MathHelper::Max(texC, other.texC);
+    color = MathHelper::Max(color, other.color);
+}
+
+VertexPackingError VertexPackingError::GetTolerance(const PositionQuantization& quantization)
+{
+    // Half a step per axis, plus the rounding of the multiply-add that decodes it
+    const auto axis = [](float offset, float scale)
+    {
+        return 0.5f * scale / UnormMax + 4.f * FLT_EPSILON * (fabsf(offset) + scale);
+    };
+    const float x = axis(quantization.offset.x, quantization.scale.x);
+    const float y = axis(quantization.offset.y, quantization.scale.y);
+    const float z = axis(quantization.offset.z, quantization.scale.z);
+
+    VertexPackingError tolerance;
+    tolerance.position = sqrtf(x * x + y * y + z * z);
+
+    // The octahedron stretches half a step to at most about 2.1 steps on the sphere
+    tolerance.normal = 2.5f / SnormMax;
+
+    // Half floats keep their precision relative to the value, no single bound fits every mesh
+    tolerance.texC = FLT_MAX;
+
+    tolerance.color = 0.5f / 255.f + 4.f * FLT_EPSILON;
+    return tolerance;
+}
+
+bool VertexPackingError::IsWithin(const VertexPackingError& tolerance) const
+{
+    return position <= tolerance.position && normal <= tolerance.normal && texC <= tolerance.texC && color <= tolerance.color;
+}
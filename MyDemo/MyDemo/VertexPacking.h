@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+using namespace DirectX;
+
+/*
+    Compact vertex formats, about half the bandwidth and memory of the float ones.
+    Positions are 16 bit UNORM within the mesh box, unit vectors are folded onto an octahedron
+    and stored as 2 x 16 bit SNORM, texture coordinates are half floats and colors 8 bit UNORM.
+*/
+
+// mesh position = offset + scale * UNORM position
+struct PositionQuantization
+{
+    XMFLOAT3 offset = XMFLOAT3(0.f, 0.f, 0.f);
+    XMFLOAT3 scale = XMFLOAT3(1.f, 1.f, 1.f);
+
+    static PositionQuantization FromBox(const XMFLOAT3& minimum, const XMFLOAT3& maximum);
+
+    // Scale then translation, applied before the world matrix it turns a UNORM position into a world position
+    XMMATRIX GetDecodeMatrix() const;
+};
+
+// DXGI_FORMAT_R16G16B16A16_UNORM, w is left at 0
+void PackPosition(const XMFLOAT3& position, const PositionQuantization& quantization, uint16_t packed[4]);
+XMFLOAT3 UnpackPosition(const uint16_t packed[4], const PositionQuantization& quantization);
+
+// DXGI_FORMAT_R8G8B8A8_UNORM, red in the lowest byte
+uint32_t PackColor(const XMFLOAT4& color);
+XMFLOAT4 UnpackColor(uint32_t packed);
+
+// DXGI_FORMAT_R16G16_SNORM, the vector doesn't have to be unit length but must not be zero
+void PackOctahedral(const XMFLOAT3& vector, int16_t packed[2]);
+XMFLOAT3 UnpackOctahedral(const int16_t packed[2]);
+
+// DXGI_FORMAT_R16G16_FLOAT
+void PackTexCoord(const XMFLOAT2& texC, uint16_t packed[2]);
+XMFLOAT2 UnpackTexCoord(const uint16_t packed[2]);
+
+// Position and color, 12 bytes
+struct PackedColorVertex
+{
+    uint16_t position[4];
+    uint32_t color;
+};
+
+// Position, normal, tangent and texture coordinates, 20 bytes
+struct PackedSurfaceVertex
+{
+    uint16_t position[4];
+    int16_t normal[2];
+    int16_t tangentU[2];
+    uint16_t texC[2];
+};
+
+// Largest differences between vertices and their packed then unpacked copies
+struct VertexPackingError
+{
+    float position = 0.f;       // distance in mesh units
+    float normal = 0.f;         // distance between unit vectors, the angle in radians at these sizes
+    float texC = 0.f;
+    float color = 0.f;          // per channel
+
+    void Combine(const VertexPackingError& other);
+
+    // What correct packing stays within for a mesh quantized with quantization, texC is not bounded
+    static VertexPackingError GetTolerance(const PositionQuantization& quantization);
+    bool IsWithin(const VertexPackingError& tolerance) const;
+};
@@ -0,0 +1,222 @@
+#include "pch.h"
+#include "Waves.h"
+#include <immintrin.h>
+
+namespace
+{
+    // Rows solved or written per task
+    const uint32_t RowsPerTask = 16;
+
+    const uint32_t MaxStepsPerUpdate = 4;
+
+    template<typename Index>
+    void BuildGridIndices(uint32_t m, uint32_t n, Index* pIndices)
+    {
+        for (uint32_t i = 0; i < m - 1; ++i)
+        {
+            for (uint32_t j = 0; j < n - 1; ++j)
+            {
+                *pIndices++ = static_cast<Index>(i * n + j);
+                *pIndices++ = static_cast<Index>(i * n + j + 1);
+                *pIndices++ = static_cast<Index>((i + 1) * n + j);
+
+                *pIndices++ = static_cast<Index>((i + 1) * n + j);
+                *pIndices++ = static_cast<Index>(i * n + j + 1);
+                *pIndices++ = static_cast<Index>((i + 1) * n + j + 1);
+            }
+        }
+    }
+}
+
+Waves::Waves(uint32_t m, uint32_t n, float dx, float dt, float speed, float damping, float maxHeight) :
+    m_m(m),
+    m_n(n),
+    m_dx(dx),
+    m_timeStep(dt),
+    m_maxHeight(maxHeight),
+    m_time(0.f),
+    m_previous(static_cast<size_t>(m) * n, 0.f),
+    m_current(static_cast<size_t>(m) * n, 0.f)
+{
+    // Central differences in time and space, the new height only depends on the two before it
+    const float d = damping * dt + 2.f;
+    const float e = (speed * speed) * (dt * dt) / (dx * dx);
+    m_k1 = (damping * dt - 2.f) / d;
+    m_k2 = (4.f - 8.f * e) / d;
+    m_k3 = (2.f * e) / d;
+
+    const float halfWidth = 0.5f * (n - 1) * dx;
+    const float halfDepth = 0.5f * (m - 1) * dx;
+    m_quantization = PositionQuantization::FromBox(
+        XMFLOAT3(-halfWidth, -maxHeight, -halfDepth),
+        XMFLOAT3(halfWidth, maxHeight, halfDepth));
+}
+
+void Waves::Update(float dt, ThreadPool* pThreadPool)
+{
+    m_time += dt;
+
+    uint32_t steps = 0;
+    while (m_time >= m_timeStep && steps < MaxStepsPerUpdate)
+    {
+        // Each new height reads its own old one and the current neighbours, rows can go in any order
+        ForEachRowBlock(pThreadPool, 1, m_m - 1, RowsPerTask, [this](uint32_t firstRow, uint32_t endRow)
+        {
+            StepRows(firstRow, endRow);
+        });
+
+        std::swap(m_previous, m_current);
+
+        m_time -= m_timeStep;
+        steps++;
+    }
+
+    // Whatever a long frame couldn't catch up on is dropped, the water slows down instead of stalling the frame
+    m_time = MathHelper::Min(m_time, m_timeStep);
+}
+
+void Waves::StepRows(uint32_t firstRow, uint32_t endRow)
+{
+    const __m128 k1 = _mm_set1_ps(m_k1);
+    const __m128 k2 = _mm_set1_ps(m_k2);
+    const __m128 k3 = _mm_set1_ps(m_k3);
+
+    for (uint32_t i = firstRow; i < endRow; ++i)
+    {
+        float* pPrevious = m_previous.data() + static_cast<size_t>(i) * m_n;
+        const float* pCurrent = m_current.data() + static_cast<size_t>(i) * m_n;
+        const float* pAbove = pCurrent - m_n;
+        const float* pBelow = pCurrent + m_n;
+
+        // The first and last column are border
+        uint32_t j = 1;
+        for (; j + 4 <= m_n - 1; j += 4)
+        {
+            const __m128 neighbours = _mm_add_ps(
+                _mm_add_ps(_mm_loadu_ps(pAbove + j), _mm_loadu_ps(pBelow + j)),
+                _mm_add_ps(_mm_loadu_ps(pCurrent + j - 1), _mm_loadu_ps(pCurrent + j + 1)));
+
+            __m128 next = _mm_mul_ps(k1, _mm_loadu_ps(pPrevious + j));
+            next = _mm_add_ps(next, _mm_mul_ps(k2, _mm_loadu_ps(pCurrent + j)));
+            next = _mm_add_ps(next, _mm_mul_ps(k3, neighbours));
+            _mm_storeu_ps(pPrevious + j, next);
+        }
+
+        for (; j < m_n - 1; ++j)
+        {
+            pPrevious[j] = m_k1 * pPrevious[j] + m_k2 * pCurrent[j] +
+                m_k3 * (pAbove[j] + pBelow[j] + pCurrent[j - 1] + pCurrent[j + 1]);
+        }
+    }
+}
+
+void Waves::Disturb(uint32_t i, uint32_t j, float magnitude)
+{
+    // The neighbours must not be border either
+    if (i < 2 || j < 2 || i + 2 >= m_m || j + 2 >= m_n)
+    {
+        ThrowIfFailed(E_INVALIDARG);
+    }
+
+    const float halfMagnitude = 0.5f * magnitude;
+
+    float* pCenter = m_current.data() + static_cast<size_t>(i) * m_n + j;
+    pCenter[0] += magnitude;
+    pCenter[1] += halfMagnitude;
+    pCenter[-1] += halfMagnitude;
+    pCenter[m_n] += halfMagnitude;
+    pCenter[-static_cast<ptrdiff_t>(m_n)] += halfMagnitude;
+}
+
+void Waves::WriteVertices(PackedColorVertex* pVertices, ThreadPool* pThreadPool) const
+{
+    const float halfWidth = 0.5f * (m_n - 1) * m_dx;
+    const float halfDepth = 0.5f * (m_m - 1) * m_dx;
+
+    // Lit once per vertex here, the land shaders only pass the color through
+    const XMFLOAT3 lightDirection(0.4f / 1.1180f, 1.f / 1.1180f, 0.3f / 1.1180f);
+    const XMFLOAT4 shallowColor(0.20f, 0.45f, 0.60f, 0.65f);
+    const XMFLOAT4 deepColor(0.05f, 0.20f, 0.40f, 0.75f);
+
+    ForEachRowBlock(pThreadPool, 0, m_m, RowsPerTask, [&](uint32_t firstRow, uint32_t endRow)
+    {
+        for (uint32_t i = firstRow; i < endRow; ++i)
+        {
+            const float* pRow = m_current.data() + static_cast<size_t>(i) * m_n;
+            const float* pAbove = i > 0 ? pRow - m_n : pRow;
+            const float* pBelow = i + 1 < m_m ? pRow + m_n : pRow;
+            const float z = halfDepth - i * m_dx;
+
+            PackedColorVertex* pRowVertices = pVertices + static_cast<size_t>(i) * m_n;
+
+            for (uint32_t j = 0; j < m_n; ++j)
+            {
+                const float height = MathHelper::Clamp(pRow[j], -m_maxHeight, m_maxHeight);
+
+                // Rows go towards -z, (left - right, 2 dx, below - above) is the upward normal
+                const float left = pRow[j > 0 ? j - 1 : j];
+                const float right = pRow[j + 1 < m_n ? j + 1 : j];
+                const float nx = left - right;
+                const float ny = 2.f * m_dx;
+                const float nz = pBelow[j] - pAbove[j];
+                const float diffuse = MathHelper::Max(0.f, nx * lightDirection.x + ny * lightDirection.y + nz * lightDirection.z) /
+                    sqrtf(nx * nx + ny * ny + nz * nz);
+
+                // Crests lean towards the shallow color
+                const float t = MathHelper::Clamp(0.5f + 0.5f * height / m_maxHeight, 0.f, 1.f);
+                const float light = 0.35f + 0.65f * diffuse;
+                const XMFLOAT4 color(
+                    light * (deepColor.x + t * (shallowColor.x - deepColor.x)),
+                    light * (deepColor.y + t * (shallowColor.y - deepColor.y)),
+                    light * (deepColor.z + t * (shallowColor.z - deepColor.z)),
+                    deepColor.w + t * (shallowColor.w - deepColor.w));
+
+                // Built on the stack and written whole, the destination is write combined
+                PackedColorVertex vertex;
+                PackPosition(XMFLOAT3(-halfWidth + j * m_dx, height, z), m_quantization, vertex.position);
+                vertex.color = PackColor(color);
+                pRowVertices[j] = vertex;
+            }
+        }
+    });
+}
+
+void Waves::CreateGeometry(
+    const std::string& name,
+    GeometryBufferPool* pool,
+    UploadBatcher* uploader,
+    MeshRegistry& geometries,
+    DrawRegistry& draws) const
+{
+    const bool useIndices16 = GetVertexCount() <= 0x10000;
+
+    auto pGeo = std::make_unique<Mesh>();
+    pGeo->name = name;
+    pGeo->vbStride = sizeof(PackedColorVertex);
+    pGeo->ibFormat = useIndices16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+    pGeo->ibSize = GetIndexCount() * (useIndices16 ? sizeof(uint16_t) : sizeof(uint32_t));
+    pGeo->positionQuantization = m_quantization;
+
+    // The water never leaves its box
+    const float halfWidth = 0.5f * (m_n - 1) * m_dx;
+    const float halfDepth = 0.5f * (m_m - 1) * m_dx;
+    pGeo->bounds[3] = sqrtf(halfWidth * halfWidth + halfDepth * halfDepth + m_maxHeight * m_maxHeight);
+
+    std::vector<uint8_t> indices(pGeo->ibSize);
+    if (useIndices16)
+    {
+        BuildGridIndices(m_m, m_n, reinterpret_cast<uint16_t*>(indices.data()));
+    }
+    else
+    {
+        BuildGridIndices(m_m, m_n, reinterpret_cast<uint32_t*>(indices.data()));
+    }
+
+    pGeo->UploadIndices(pool, uploader, indices.data());
+
+    auto draw = std::make_unique<Mesh::Draw>();
+    draw->indexCount = GetIndexCount();
+
+    geometries.Add(name, std::move(pGeo));
+    draws.Add(name, std::move(draw));
+}
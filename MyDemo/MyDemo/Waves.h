@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Mesh.h"
+
+/*
+    Water surface over an m x n grid, solved with finite differences of the damped 2D wave equation.
+    Heights are stepped at a fixed rate, rows in parallel and 4 columns at a time, the border stays flat.
+    The vertices are rebuilt every frame straight into upload memory, see WriteVertices,
+    the mesh only keeps its indices in the pool.
+*/
+class Waves
+{
+public:
+    // dx is the grid spacing, dt the fixed time step. speed * dt must stay well below dx for the solution to be stable
+    Waves(uint32_t m, uint32_t n, float dx, float dt, float speed, float damping, float maxHeight);
+
+    uint32_t GetRowCount() const { return m_m; }
+    uint32_t GetColumnCount() const { return m_n; }
+    uint32_t GetVertexCount() const { return m_m * m_n; }
+    uint32_t GetIndexCount() const { return (m_m - 1) * (m_n - 1) * 6; }
+
+    // Takes as many fixed steps as dt covers, a slow frame catches up a few steps at most
+    void Update(float dt, ThreadPool* pThreadPool);
+
+    // Raises vertex (i, j) by magnitude and its neighbours by half of it, i and j must be inside the border
+    void Disturb(uint32_t i, uint32_t j, float magnitude);
+
+    // Packed positions and vertex lit colors of the current heights, rows in parallel. pVertices may be write combined
+    void WriteVertices(PackedColorVertex* pVertices, ThreadPool* pThreadPool) const;
+
+    /*
+        Queues the indices of the grid on uploader, the mesh and its draw are added under name.
+        Mesh::uploadToken is set once the caller submits the batch. Vertices have to be given to
+        the mesh every frame, vertexBufferGPU, vbOffset and vbSize, before it is drawn.
+    */
+    void CreateGeometry(
+        const std::string& name,
+        GeometryBufferPool* pool,
+        UploadBatcher* uploader,
+        MeshRegistry& geometries,
+        DrawRegistry& draws) const;
+
+private:
+    // One step of rows [firstRow, endRow), the new heights go over m_previous
+    void StepRows(uint32_t firstRow, uint32_t endRow);
+
+    uint32_t m_m;
+    uint32_t m_n;
+    float m_dx;
+    float m_timeStep;
+    float m_maxHeight;      // heights are clamped to +-maxHeight when packed
+    float m_time;
+
+    // Simulation constants from the time step, speed and damping
+    float m_k1;
+    float m_k2;
+    float m_k3;
+
+    std::vector<float> m_previous;
+    std::vector<float> m_current;
+
+    PositionQuantization m_quantization;
+};
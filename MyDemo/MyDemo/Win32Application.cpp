@@ -1,8 +1,23 @@
 #include "pch.h"
 #include "Win32Application.h"
+#include "TaskBenchmark.h"
+#include "HeadlessApplication.h"
 
 HWND Win32Application::m_hwnd = nullptr;
 
+// The reports are printed, but a /SUBSYSTEM:WINDOWS process starts without a console
+static void AttachReportConsole()
+{
+    // The one it was launched from, else a new one
+    if (!AttachConsole(ATTACH_PARENT_PROCESS) && !AllocConsole())
+    {
+        return;
+    }
+
+    FILE* pStream;
+    freopen_s(&pStream, "CONOUT$", "w", stdout);
+}
+
 int Win32Application::Run(DXSample* pSample, HINSTANCE hInstance, int nCmdShow)
 {
     // Parse the command line parameters
@@ -11,6 +26,18 @@ int Win32Application::Run(DXSample* pSample, HINSTANCE hInstance, int nCmdShow)
     pSample->ParseCommandLineArgs(argv, argc);
     LocalFree(argv);
 
+    if (pSample->IsTaskBenchmark())
+    {
+        AttachReportConsole();
+        return RunTaskBenchmarks();
+    }
+
+    if (pSample->IsHeadless())
+    {
+        AttachReportConsole();
+        return HeadlessApplication::Run(pSample);
+    }
+
     // Initialize the window class.
     WNDCLASSEX windowClass = { 0 };
     windowClass.cbSize = sizeof(WNDCLASSEX);
@@ -7,18 +7,36 @@
 
 #pragma once
 
+#ifdef _WIN32
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers.
 #endif
 
 #include <windows.h>
+#include <wrl.h>
+#include <shellapi.h>
+#include <shlobj.h>
+#else
+// Win32 types and ComPtr from DirectX-Headers, for the CMake build
+#include <wsl/winadapter.h>
+#include <wsl/wrladapter.h>
+#endif
 
 #include <d3d12.h>
+#ifndef NULL_BACKEND_ONLY
 #include <dxgi1_6.h>
 #include <D3Dcompiler.h>
+#endif
 #include <DirectXMath.h>
 #include <DirectXColors.h>
+#include <DirectXPackedVector.h>
+#ifdef _WIN32
 #include "d3dx12.h"
+#else
+#include <directx/d3dx12.h>
+#include <dxguids/dxguids.h>
+#endif
+#include "PlatformHelper.h"
 #include "MathHelper.h"
 
 #include <string>
@@ -28,11 +46,15 @@
 #include <array>
 #include <numeric>
 #include <memory>
-#include <wrl.h>
-#include <shellapi.h>
 #include <cstdint>
+#include <cassert>
+#include <cfloat>
+#include <climits>
+#include <chrono>
+#include <cwctype>
 
 //shader debug
+#ifndef NULL_BACKEND_ONLY
 #include "pix3.h"
+#endif
 #include <filesystem>
-#include <shlobj.h>
@@ -1,3 +1,4 @@
+// 16 bit UNORM positions in the mesh box and 8 bit colors, the world matrix decodes the positions
 struct VSInput
 {
     float3 position : POSITION;
@@ -10,11 +11,22 @@ struct PSInput
     float4 color : COLOR;
 };
 
-cbuffer ObjectCB : register(b0)
+struct ObjectData
 {
-    float4x4 world;
+    float4x4 world;     // position decode of the mesh, then world
+};
+
+// Where the draw's instances start in the instance buffer, set as a root constant per draw
+cbuffer InstanceCB : register(b0)
+{
+    uint firstInstance;
 }
 
+StructuredBuffer<ObjectData> objects : register(t0);
+
+// Object index of every instance drawn this frame
+StructuredBuffer<uint> instances : register(t1);
+
 cbuffer PassCB : register(b1)
 {
     float4x4 view;
@@ -25,12 +37,25 @@ cbuffer PassCB : register(b1)
     float4x4 inverseViewProjection;
 }
 
-PSInput VSMain(VSInput input)
+/*
+    Every vertex shader of an opaque mesh goes through here, the depth prepass included.
+    precise keeps the compiler from reordering the math differently per shader,
+    the color pass depth has to match the prepass exactly for its LESS_EQUAL test.
+*/
+float4 TransformPosition(float3 position, float4x4 world)
+{
+    precise float4 posWorld = mul(float4(position, 1.0f), world);
+    precise float4 posClip = mul(posWorld, viewProjection);
+    return posClip;
+}
+
+PSInput VSMain(VSInput input, uint instanceID : SV_InstanceID)
 {
     PSInput result;
 
-    float4 posWorld = mul(float4(input.position, 1.0f), world);
-    result.position = mul(posWorld, viewProjection);
+    float4x4 world = objects[instances[firstInstance + instanceID]].world;
+
+    result.position = TransformPosition(input.position, world);
     result.color = input.color;
 
     return result;
@@ -40,3 +65,68 @@ float4 PSMain(PSInput input) : SV_TARGET
 {
     return input.color;
 }
+
+// PackedSurfaceVertex, normal and tangent are folded onto an octahedron
+struct SurfaceVSInput
+{
+    float3 position : POSITION;
+    float2 normal : NORMAL;
+    float2 tangent : TANGENT;
+    float2 texC : TEXCOORD;
+};
+
+struct SurfacePSInput
+{
+    float4 position : SV_POSITION;
+    float3 normal : NORMAL;
+    float2 texC : TEXCOORD;
+};
+
+float3 DecodeOctahedral(float2 e)
+{
+    float3 v = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (v.z < 0.0f)
+    {
+        v.xy = (1.0f - abs(v.yx)) * (v.xy >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(v);
+}
+
+// world has the position decode scale in it, normals need its inverse transpose, which is the cofactor matrix up to a scale
+float3 TransformNormal(float3 normal, float4x4 world)
+{
+    float3 r0 = world[0].xyz;
+    float3 r1 = world[1].xyz;
+    float3 r2 = world[2].xyz;
+    return normalize(normal.x * cross(r1, r2) + normal.y * cross(r2, r0) + normal.z * cross(r0, r1));
+}
+
+SurfacePSInput VSSurfaceMain(SurfaceVSInput input, uint instanceID : SV_InstanceID)
+{
+    SurfacePSInput result;
+
+    float4x4 world = objects[instances[firstInstance + instanceID]].world;
+
+    result.position = TransformPosition(input.position, world);
+    result.normal = TransformNormal(DecodeOctahedral(input.normal), world);
+    result.texC = input.texC;
+
+    return result;
+}
+
+float4 PSSurfaceMain(SurfacePSInput input) : SV_TARGET
+{
+    const float3 lightDirection = normalize(float3(0.4f, 1.0f, 0.3f));
+    const float3 albedo = float3(0.75f, 0.72f, 0.68f);
+
+    float diffuse = saturate(dot(normalize(input.normal), lightDirection));
+    return float4(albedo * (0.25f + 0.75f * diffuse), 1.0f);
+}
+
+// Depth prepass, Mesh::DepthVertexBufferView holds nothing but the packed positions
+float4 VSDepthMain(float3 position : POSITION, uint instanceID : SV_InstanceID) : SV_POSITION
+{
+    float4x4 world = objects[instances[firstInstance + instanceID]].world;
+
+    return TransformPosition(position, world);
+}